@@ -0,0 +1,841 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <hive_file.h>
+#include <hive_index.h>
+#include <hive_writer.h>
+#include <key_entry.h>
+#include <key_entry_iterator.h>
+#include <memory_backend.h>
+#include <scan_arena.h>
+#include <snapshot.h>
+#include <sub_key_range.h>
+#include <value_batch.h>
+#include <value_entry.h>
+#include <value_entry_iterator.h>
+#include <value_range.h>
+#include <value_stream.h>
+#include <write_batch.h>
+
+using namespace win32::registry;
+
+using value_requests = std::vector<std::pair<std::wstring, std::wstring>>;
+
+enum class output_format
+{
+	text,
+	json,
+	csv,
+};
+
+struct settings
+{
+	output_format format = output_format::text;
+	/** Only benchmarks whose full name (backend/shape/name) contains this run. */
+	std::string filter;
+	/** Multiplies the size of the generated trees. */
+	uint32_t scale = 1;
+	/** How long each benchmark runs at least, when its iteration count is calibrated. */
+	std::chrono::milliseconds min_time{ 200 };
+	/** A hive file to run the tree benchmarks against, besides the generated trees. */
+	std::optional<std::filesystem::path> hive;
+};
+
+struct benchmark_result
+{
+	std::string backend;
+	std::string shape;
+	std::string name;
+	uint32_t iterations;
+	/** Operations per iteration: keys opened, values decoded, and so on. */
+	uint64_t operations;
+	double ns_per_iteration;
+	/** Allocations from the default memory resource per iteration, which is where keys and values allocate outside an arena_scope. */
+	double allocations_per_iteration;
+};
+
+/**
+ * Counts the allocations made through it, then passes them on to the heap.
+ */
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+	uint64_t allocations = 0;
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		allocations++;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+	{
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+static settings options;
+static std::vector<benchmark_result> results;
+static counting_resource counting_allocations;
+
+/**
+ * Keeps results alive so the optimizer cannot drop the work that produced them.
+ */
+static void consume(size_t value)
+{
+	static volatile size_t sink;
+	sink = sink + value;
+}
+
+/**
+ * Runs a benchmark and records the mean time per iteration. With 0 iterations, runs for at least options.min_time.
+ */
+static void run(const std::string& backend, const std::string& shape, const std::string& name, uint32_t iterations, uint64_t operations, const std::function<void()>& body)
+{
+	if ((backend + "/" + shape + "/" + name).find(options.filter) == std::string::npos)
+	{
+		return;
+	}
+	// One untimed iteration so lazily opened state does not count against the first run.
+	auto start = std::chrono::steady_clock::now();
+	body();
+	if (iterations == 0)
+	{
+		auto once = (std::max)(std::chrono::steady_clock::now() - start, std::chrono::steady_clock::duration{ 1 });
+		iterations = static_cast<uint32_t>(std::clamp<int64_t>(std::chrono::duration_cast<std::chrono::steady_clock::duration>(options.min_time) / once, 1, 1000000));
+	}
+	uint64_t allocations = counting_allocations.allocations;
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		body();
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	benchmark_result result{ backend, shape, name, iterations, operations, static_cast<double>(elapsed.count()) / iterations,
+		static_cast<double>(counting_allocations.allocations - allocations) / iterations };
+	if (options.format == output_format::text)
+	{
+		std::string full_name = backend + " " + shape + " " + name;
+		std::printf("%-48s %10u iterations %14.1f ns/iteration %12.1f ns/operation %12.1f allocations/iteration\n", full_name.c_str(), result.iterations,
+			result.ns_per_iteration, result.ns_per_iteration / static_cast<double>((std::max)(operations, uint64_t{ 1 })), result.allocations_per_iteration);
+		std::fflush(stdout);
+	}
+	results.push_back(std::move(result));
+}
+
+/**
+ * Reads every requested value on its own, the way startup code typically does.
+ */
+static size_t read_one_by_one(const key_entry& root, const value_requests& requests)
+{
+	size_t found = 0;
+	for (const auto& [path, name] : requests)
+	{
+		auto key = path.empty() ? std::optional<key_entry>{ root } : root.try_open_subkey(path);
+		if (key && key->get_value(name))
+		{
+			found++;
+		}
+	}
+	return found;
+}
+
+static size_t read_batched(const key_entry& root, const value_requests& requests)
+{
+	auto batch = root.get_values_by_path(requests);
+	size_t found = 0;
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		found += batch.found(i) ? 1 : 0;
+	}
+	return found;
+}
+
+static void batch_query(const char* backend, const key_entry& root, const value_requests& requests, uint32_t iterations)
+{
+	run(backend, "batch", "per-value loop", iterations, requests.size(), [&] { consume(read_one_by_one(root, requests)); });
+	run(backend, "batch", "batched", iterations, requests.size(), [&] { consume(read_batched(root, requests)); });
+}
+
+/**
+ * 80 values spread over 5 keys of an in-memory tree.
+ */
+static void memory_batch_query()
+{
+	auto root = memory_key::create(L"ROOT");
+	value_requests requests;
+	for (int k = 0; k < 5; k++)
+	{
+		std::wstring path = L"Software\\Vendor\\Component" + std::to_wstring(k);
+		auto& key = root->add_subkey(L"Software").add_subkey(L"Vendor").add_subkey(L"Component" + std::to_wstring(k));
+		for (int v = 0; v < 16; v++)
+		{
+			std::wstring name = L"Setting" + std::to_wstring(v);
+			key.set_dword(name, static_cast<uint32_t>(v));
+			requests.emplace_back(path, name);
+		}
+	}
+	batch_query("memory", root->open(), requests, 10000);
+}
+
+#ifdef _WIN32
+static void win32_batch_query()
+{
+	value_requests requests{
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"ProductName" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"CurrentBuild" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"CurrentBuildNumber" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"CurrentVersion" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"EditionID" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"InstallationType" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"BuildLab" },
+		{ L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", L"SystemRoot" },
+		{ L"SYSTEM\\CurrentControlSet\\Control\\ComputerName\\ComputerName", L"ComputerName" },
+		{ L"SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Environment", L"PROCESSOR_ARCHITECTURE" },
+		{ L"SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Environment", L"NUMBER_OF_PROCESSORS" },
+		{ L"SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Environment", L"OS" },
+	};
+	batch_query("win32", key_entry::open_local_machine(), requests, 1000);
+}
+#endif // _WIN32
+
+/**
+ * Writes every value on its own, opening its key each time.
+ */
+static void write_one_by_one(const key_entry& root, const value_requests& requests, uint32_t data)
+{
+	for (const auto& [path, name] : requests)
+	{
+		root.create_subkey(path).set_dword(name, data);
+	}
+}
+
+static void write_batched(const key_entry& root, const value_requests& requests, uint32_t data)
+{
+	write_batch batch;
+	for (const auto& [path, name] : requests)
+	{
+		batch.set_dword(path, name, data);
+	}
+	batch.commit(root);
+}
+
+static void batch_write(const char* backend, const key_entry& root, const value_requests& requests, uint32_t iterations)
+{
+	uint32_t data = 0;
+	run(backend, "batch", "per-value writes", iterations, requests.size(), [&] { write_one_by_one(root, requests, data++); });
+	run(backend, "batch", "batched writes", iterations, requests.size(), [&] { write_batched(root, requests, data++); });
+}
+
+/**
+ * 80 values spread over 5 keys, as in memory_batch_query.
+ */
+static value_requests write_requests()
+{
+	value_requests requests;
+	for (int k = 0; k < 5; k++)
+	{
+		for (int v = 0; v < 16; v++)
+		{
+			requests.emplace_back(L"Component" + std::to_wstring(k), L"Setting" + std::to_wstring(v));
+		}
+	}
+	return requests;
+}
+
+static void memory_batch_write()
+{
+	auto root = memory_key::create(L"ROOT");
+	batch_write("memory", root->open(), write_requests(), 10000);
+}
+
+#ifdef _WIN32
+/**
+ * Writes below a scratch key of HKEY_CURRENT_USER, deleted again afterwards.
+ */
+static void win32_batch_write()
+{
+	auto user = key_entry::open_current_user();
+	auto root = user.create_subkey(L"Software\\RegistryPP.Benchmarks");
+	batch_write("win32", root, write_requests(), 100);
+	user.delete_subtree(L"Software\\RegistryPP.Benchmarks");
+}
+#endif // _WIN32
+
+/**
+ * Fills a key with one value of every common type.
+ */
+static void add_mixed_values(memory_key& key, uint32_t count)
+{
+	for (uint32_t v = 0; v < count; v++)
+	{
+		std::wstring name = L"Value" + std::to_wstring(v);
+		switch (v % 6)
+		{
+		case 0:
+			key.set_string(name, L"C:\\Program Files\\Vendor\\Component\\bin\\tool" + std::to_wstring(v) + L".exe");
+			break;
+		case 1:
+			key.set_string(name, L"%SystemRoot%\\System32\\component" + std::to_wstring(v) + L".dll", registry_value_type::expandable_string);
+			break;
+		case 2:
+			key.set_strings(name, { L"first", L"second entry", L"third entry of " + std::to_wstring(v) });
+			break;
+		case 3:
+			key.set_dword(name, v);
+			break;
+		case 4:
+			key.set_qword(name, uint64_t{ v } << 32 | v);
+			break;
+		default:
+		{
+			std::vector<uint8_t> data(64, static_cast<uint8_t>(v));
+			key.set_value(name, registry_value_type::binary, data.data(), static_cast<uint32_t>(data.size()));
+			break;
+		}
+		}
+	}
+}
+
+/**
+ * One key with many sub keys.
+ */
+static std::shared_ptr<memory_key> wide_tree(uint32_t scale)
+{
+	auto root = memory_key::create(L"ROOT");
+	for (uint32_t k = 0; k < 10000 * scale; k++)
+	{
+		root->add_subkey(L"Key" + std::to_wstring(k)).set_dword(L"Index", k);
+	}
+	return root;
+}
+
+/**
+ * A long chain of keys, each with a few leaf siblings.
+ */
+static std::shared_ptr<memory_key> deep_tree(uint32_t scale)
+{
+	auto root = memory_key::create(L"ROOT");
+	memory_key* key = root.get();
+	for (uint32_t depth = 0; depth < (std::min)(64 * scale, 500U); depth++)
+	{
+		for (uint32_t leaf = 0; leaf < 4; leaf++)
+		{
+			key->add_subkey(L"Leaf" + std::to_wstring(leaf)).set_dword(L"Depth", depth);
+		}
+		key = &key->add_subkey(L"Level" + std::to_wstring(depth));
+	}
+	return root;
+}
+
+/**
+ * Keys with many small values of every type.
+ */
+static std::shared_ptr<memory_key> values_tree(uint32_t scale)
+{
+	auto root = memory_key::create(L"ROOT");
+	for (uint32_t k = 0; k < 100; k++)
+	{
+		add_mixed_values(root->add_subkey(L"Key" + std::to_wstring(k)), 100 * scale);
+	}
+	return root;
+}
+
+/**
+ * A few keys with large binary and string values.
+ */
+static std::shared_ptr<memory_key> big_values_tree(uint32_t scale)
+{
+	auto root = memory_key::create(L"ROOT");
+	std::vector<uint8_t> binary(256 * 1024 * scale);
+	for (size_t i = 0; i < binary.size(); i++)
+	{
+		binary[i] = static_cast<uint8_t>(i * 31);
+	}
+	std::wstring string(32 * 1024 * scale, L'x');
+	for (uint32_t k = 0; k < 16; k++)
+	{
+		auto& key = root->add_subkey(L"Key" + std::to_wstring(k));
+		for (uint32_t v = 0; v < 4; v++)
+		{
+			key.set_value(L"Binary" + std::to_wstring(v), registry_value_type::binary, binary.data(), static_cast<uint32_t>(binary.size()));
+			key.set_string(L"String" + std::to_wstring(v), string);
+		}
+	}
+	return root;
+}
+
+/**
+ * The relative paths of the keys below a key, parents first.
+ */
+static void collect_paths(const key_entry& key, const std::wstring& path, std::vector<std::wstring>& paths)
+{
+	for (const auto& sub_key : key.subkeys())
+	{
+		std::wstring sub_path = path.empty() ? std::wstring{ sub_key.name() } : path + L"\\" + sub_key.name();
+		paths.push_back(sub_path);
+		collect_paths(sub_key, sub_path, paths);
+	}
+}
+
+static size_t scan_with_iterators(const key_entry& key)
+{
+	size_t keys = 1;
+	uint32_t count = key.sub_key_count();
+	key_entry_iterator sub_keys{ key };
+	for (uint32_t i = 0; i < count; i++, ++sub_keys)
+	{
+		keys += scan_with_iterators(*sub_keys);
+	}
+	return keys;
+}
+
+static size_t scan_with_ranges(const key_entry& key)
+{
+	size_t keys = 1;
+	for (const auto& sub_key : key.subkeys())
+	{
+		keys += scan_with_ranges(sub_key);
+	}
+	return keys;
+}
+
+static size_t decode(const value_entry& value)
+{
+	switch (value.type())
+	{
+	case registry_value_type::string:
+	case registry_value_type::expandable_string:
+		return value.get_string().size();
+	case registry_value_type::multi_string:
+		return value.get_strings().size();
+	case registry_value_type::dword:
+		return value.get_dword();
+	case registry_value_type::qword:
+		return static_cast<size_t>(value.get_qword());
+	default:
+		return value.get_bytes().size();
+	}
+}
+
+static const char* type_name(registry_value_type type)
+{
+	switch (type)
+	{
+	case registry_value_type::string:
+		return "sz";
+	case registry_value_type::expandable_string:
+		return "expand_sz";
+	case registry_value_type::multi_string:
+		return "multi_sz";
+	case registry_value_type::dword:
+		return "dword";
+	case registry_value_type::qword:
+		return "qword";
+	case registry_value_type::binary:
+		return "binary";
+	default:
+		return "other";
+	}
+}
+
+/**
+ * Times opening, enumerating, path building and value decoding over one tree.
+ */
+static void tree_benchmarks(const std::string& backend, const std::string& shape, const key_entry& root)
+{
+	std::vector<std::wstring> paths;
+	collect_paths(root, L"", paths);
+	// Opening every key of the wide shape already takes a while; a sample keeps each iteration short.
+	std::vector<std::wstring> sample;
+	for (size_t i = 0; i < paths.size(); i += (std::max)(size_t{ 1 }, paths.size() / 4096))
+	{
+		sample.push_back(paths[i]);
+	}
+	run(backend, shape, "open_subkey", 0, sample.size(), [&]
+	{
+		for (const auto& path : sample)
+		{
+			consume(root.open_subkey(path).sub_key_count());
+		}
+	});
+
+	run(backend, shape, "key_entry_iterator scan", 0, paths.size() + 1, [&] { consume(scan_with_iterators(root)); });
+	run(backend, shape, "subkeys scan", 0, paths.size() + 1, [&] { consume(scan_with_ranges(root)); });
+
+	std::vector<key_entry> keys{ root };
+	for (const auto& path : sample)
+	{
+		keys.push_back(root.open_subkey(path));
+	}
+	uint64_t value_count = 0;
+	for (const auto& key : keys)
+	{
+		value_count += key.value_count();
+	}
+	run(backend, shape, "path", 0, keys.size(), [&]
+	{
+		for (const auto& key : keys)
+		{
+			consume(key.path().size());
+		}
+	});
+	run(backend, shape, "value_entry_iterator scan", 0, value_count, [&]
+	{
+		for (const auto& key : keys)
+		{
+			uint32_t count = key.value_count();
+			value_entry_iterator values{ key };
+			for (uint32_t i = 0; i < count; i++, ++values)
+			{
+				consume((*values).get_bytes_view().size());
+			}
+		}
+	});
+	run(backend, shape, "values scan", 0, value_count, [&]
+	{
+		for (const auto& key : keys)
+		{
+			for (const auto& value : key.values())
+			{
+				consume(value.get_bytes_view().size());
+			}
+		}
+	});
+
+	std::map<registry_value_type, std::vector<value_entry>> by_type;
+	for (const auto& key : keys)
+	{
+		for (const auto& value : key.values())
+		{
+			by_type[value.type()].push_back(value);
+		}
+	}
+	for (const auto& [type, values] : by_type)
+	{
+		run(backend, shape, std::string{ "decode " } + type_name(type), 0, values.size(), [&]
+		{
+			for (const auto& value : values)
+			{
+				consume(decode(value));
+			}
+		});
+	}
+
+	// Large values read in 64 KiB chunks, against getting them whole.
+	std::vector<std::pair<key_entry, std::wstring>> large;
+	for (const auto& key : keys)
+	{
+		for (const auto& value : key.values(value_enumeration::names_and_types))
+		{
+			if (value_stream{ key, value.name() }.size() > 64 * 1024)
+			{
+				large.emplace_back(key, value.name());
+			}
+		}
+	}
+	if (!large.empty())
+	{
+		run(backend, shape, "large values get_bytes", 0, large.size(), [&]
+		{
+			for (const auto& [key, name] : large)
+			{
+				consume(key.get_value(name)->get_bytes().size());
+			}
+		});
+		std::vector<uint8_t> chunk(64 * 1024);
+		run(backend, shape, "large values value_stream", 0, large.size(), [&]
+		{
+			for (const auto& [key, name] : large)
+			{
+				value_stream stream{ key, name };
+				while (size_t length = stream.read(chunk))
+				{
+					consume(length);
+				}
+			}
+		});
+	}
+}
+
+/**
+ * Opens every key below a key and reads the name and data of every value, keeping nothing.
+ */
+static size_t scan_keys_and_values(const key_entry& key, std::pmr::memory_resource* strings)
+{
+	size_t read = 1;
+	for (const auto& value : key.values())
+	{
+		read += value.name().size();
+		switch (value.type())
+		{
+		case registry_value_type::string:
+		case registry_value_type::expandable_string:
+			read += strings != nullptr ? value.get_string(strings).size() : value.get_string().size();
+			break;
+		case registry_value_type::multi_string:
+			read += strings != nullptr ? value.get_strings(strings).size() : value.get_strings().size();
+			break;
+		default:
+			read += value.get_bytes_view().size();
+			break;
+		}
+	}
+	for (const auto& sub_key : key.subkeys())
+	{
+		read += scan_keys_and_values(sub_key, strings);
+	}
+	return read;
+}
+
+/**
+ * Times a full scan allocating from the heap, against the same scan in an arena dropped in one reset.
+ */
+static void arena_benchmarks(const std::string& backend, const std::string& shape, const key_entry& root)
+{
+	uint64_t keys = scan_with_ranges(root);
+	run(backend, shape, "full scan", 0, keys, [&] { consume(scan_keys_and_values(root, nullptr)); });
+	scan_arena arena;
+	run(backend, shape, "full scan in arena", 0, keys, [&]
+	{
+		{
+			arena_scope scope{ arena };
+			consume(scan_keys_and_values(root, arena.resource()));
+		}
+		arena.reset();
+	});
+}
+
+/**
+ * Times loading a saved snapshot in place, against capturing it again.
+ */
+static void saved_snapshot_benchmarks(const std::string& shape, const snapshot& captured)
+{
+	std::stringstream stream;
+	captured.save(stream);
+	auto bytes = stream.str();
+	auto blob = std::make_shared<std::vector<uint64_t>>((bytes.size() + 7) / 8);
+	std::memcpy(blob->data(), bytes.data(), bytes.size());
+	std::span<const uint8_t> view{ reinterpret_cast<const uint8_t*>(blob->data()), bytes.size() };
+	run("saved", shape, "load", 0, captured.key_count(), [&] { consume(snapshot::load(view, blob, false)->key_count()); });
+	run("saved", shape, "load with checksum", 0, captured.key_count(), [&] { consume(snapshot::load(view, blob)->key_count()); });
+	run("saved", shape, "capture", 0, captured.key_count(), [&] { consume(snapshot::capture(captured.open())->key_count()); });
+}
+
+/**
+ * Times indexing a hive on one thread and on one per hardware thread, then a full scan that enumerates through the index.
+ */
+static void index_benchmarks(const std::string& shape, const hive_file& hive)
+{
+	uint32_t threads = (std::max)(1U, std::thread::hardware_concurrency());
+	size_t cells = 0;
+	for (auto kind : { hive_cell_kind::key, hive_cell_kind::value, hive_cell_kind::security, hive_cell_kind::sub_key_list, hive_cell_kind::big_data, hive_cell_kind::other })
+	{
+		cells += hive_index::build(hive)->cells(kind).size();
+	}
+	run("hive", shape, "index 1 thread", 0, cells, [&] { consume(hive_index::build(hive, hive_index_options{ 1 })->cells(hive_cell_kind::key).size()); });
+	run("hive", shape, "index parallel", 0, cells, [&] { consume(hive_index::build(hive, hive_index_options{ threads })->cells(hive_cell_kind::key).size()); });
+	hive.build_index();
+	uint64_t keys = scan_with_ranges(hive.root());
+	run("hive", shape, "full scan indexed", 0, keys, [&] { consume(scan_keys_and_values(hive.root(), nullptr)); });
+}
+
+/**
+ * Times writing a generated tree as a hive file, then runs the tree benchmarks against the file it wrote.
+ */
+static void generated_hive_benchmarks(const std::string& shape, memory_key& tree, uint64_t keys)
+{
+	run("hive", shape, "write", 0, keys, [&]
+	{
+		std::stringstream stream;
+		write_hive(tree.open(), stream);
+		consume(static_cast<size_t>(stream.tellp()));
+	});
+	auto path = std::filesystem::temp_directory_path() / ("RegistryPP.Benchmarks." + shape + ".hive");
+	write_hive(tree.open(), path);
+	{
+		auto hive = hive_file::open(path);
+		tree_benchmarks("hive", shape, hive->root());
+		arena_benchmarks("hive", shape, hive->root());
+		index_benchmarks(shape, *hive);
+	}
+	std::filesystem::remove(path);
+}
+
+static void generated_tree_benchmarks()
+{
+	std::pair<const char*, std::shared_ptr<memory_key>(*)(uint32_t)> shapes[] = {
+		{ "wide", wide_tree },
+		{ "deep", deep_tree },
+		{ "values", values_tree },
+		{ "big_values", big_values_tree },
+	};
+	for (const auto& [shape, generate] : shapes)
+	{
+		auto tree = generate(options.scale);
+		tree_benchmarks("memory", shape, tree->open());
+		arena_benchmarks("memory", shape, tree->open());
+		auto captured = snapshot::capture(tree->open());
+		tree_benchmarks("snapshot", shape, captured->open());
+		arena_benchmarks("snapshot", shape, captured->open());
+		saved_snapshot_benchmarks(shape, *captured);
+		generated_hive_benchmarks(shape, *tree, captured->key_count());
+	}
+}
+
+static void hive_benchmarks()
+{
+	if (options.hive)
+	{
+		auto hive = hive_file::open(*options.hive);
+		tree_benchmarks("hive", options.hive->filename().string(), hive->root());
+		arena_benchmarks("hive", options.hive->filename().string(), hive->root());
+	}
+}
+
+/**
+ * Quotes a string for JSON; names only ever hold printable ASCII.
+ */
+static std::string quoted(const std::string& text)
+{
+	std::string result = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			result += '\\';
+		}
+		result += c;
+	}
+	return result + "\"";
+}
+
+static void print_results()
+{
+	if (options.format == output_format::json)
+	{
+		std::printf("{\n  \"scale\": %u,\n  \"benchmarks\": [", options.scale);
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const auto& result = results[i];
+			std::printf("%s\n    { \"backend\": %s, \"shape\": %s, \"name\": %s, \"iterations\": %u, \"operations\": %llu, \"ns_per_iteration\": %.1f, \"allocations_per_iteration\": %.1f }",
+				i == 0 ? "" : ",", quoted(result.backend).c_str(), quoted(result.shape).c_str(), quoted(result.name).c_str(), result.iterations,
+				static_cast<unsigned long long>(result.operations), result.ns_per_iteration, result.allocations_per_iteration);
+		}
+		std::printf("\n  ]\n}\n");
+	}
+	else if (options.format == output_format::csv)
+	{
+		std::printf("backend,shape,name,iterations,operations,ns_per_iteration,allocations_per_iteration\n");
+		for (const auto& result : results)
+		{
+			std::printf("%s,%s,%s,%u,%llu,%.1f,%.1f\n", result.backend.c_str(), result.shape.c_str(), result.name.c_str(), result.iterations,
+				static_cast<unsigned long long>(result.operations), result.ns_per_iteration, result.allocations_per_iteration);
+		}
+	}
+}
+
+static void usage()
+{
+	std::fprintf(stderr,
+		"usage: RegistryPP.Benchmarks [--format text|json|csv] [--filter text] [--scale n] [--min-time ms] [--hive path]\n"
+		"  --format    text (default) prints as it goes; json and csv print everything at the end\n"
+		"  --filter    only runs benchmarks whose backend/shape/name contains the text\n"
+		"  --scale     multiplies the size of the generated wide, deep, values and big_values trees\n"
+		"  --min-time  how long each tree benchmark runs at least, in milliseconds\n"
+		"  --hive      also runs the tree benchmarks against an offline hive file\n");
+}
+
+static bool parse_arguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		std::string value = argv[++i];
+		if (argument == "--format")
+		{
+			if (value == "text")
+			{
+				options.format = output_format::text;
+			}
+			else if (value == "json")
+			{
+				options.format = output_format::json;
+			}
+			else if (value == "csv")
+			{
+				options.format = output_format::csv;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		else if (argument == "--filter")
+		{
+			options.filter = value;
+		}
+		else if (argument == "--scale")
+		{
+			options.scale = (std::max)(1, std::atoi(value.c_str()));
+		}
+		else if (argument == "--min-time")
+		{
+			options.min_time = std::chrono::milliseconds{ (std::max)(1, std::atoi(value.c_str())) };
+		}
+		else if (argument == "--hive")
+		{
+			options.hive = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_arguments(argc, argv))
+	{
+		usage();
+		return 2;
+	}
+	// Before any key is opened, so every allocation routed through memory resources is counted.
+	std::pmr::set_default_resource(&counting_allocations);
+	memory_batch_query();
+	memory_batch_write();
+	generated_tree_benchmarks();
+	hive_benchmarks();
+#ifdef _WIN32
+	win32_batch_query();
+	win32_batch_write();
+#endif // _WIN32
+	print_results();
+	return 0;
+}
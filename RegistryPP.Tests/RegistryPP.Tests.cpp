@@ -1,16 +1,199 @@
 #include "pch.h"
 #include "CppUnitTest.h"
+#include <async_range.h>
+#include <child_index.h>
+#include <hive_file.h>
+#include <hive_format.h>
+#include <hive_index.h>
+#include <hive_writer.h>
+#include <instrumentation.h>
 #include <key_entry.h>
+#include <key_backend.h>
+#include <key_cache.h>
+#include <key_entry_iterator.h>
+#include <memory_backend.h>
+#include <reg_file.h>
+#include <registry_error.h>
+#include <registry_query.h>
+#include <scan_arena.h>
+#include <search_index.h>
+#include <snapshot.h>
+#include <sub_key_range.h>
+#include <tree_diff.h>
+#include <tree_walker.h>
+#include <utf16.h>
+#include <value_batch.h>
+#include <value_entry_iterator.h>
+#include <value_range.h>
+#include <value_stream.h>
+#include <write_batch.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory_resource>
+#include <sstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace win32::registry;
 
+namespace
+{
+	/**
+	 * Counts the allocations made through it.
+	 */
+	class counting_resource final : public std::pmr::memory_resource
+	{
+	public:
+		size_t allocations = 0;
+		size_t deallocations = 0;
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			allocations++;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+		{
+			deallocations++;
+			std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+	};
+
+	/**
+	 * Wraps another backend and counts the calls made through it.
+	 */
+	class counting_backend final : public key_backend
+	{
+	public:
+		counting_backend(std::unique_ptr<key_backend> inner, std::shared_ptr<uint32_t> opens, std::shared_ptr<uint32_t> queries) :
+			m_inner(std::move(inner)), m_opens(std::move(opens)), m_queries(std::move(queries))
+		{
+		}
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override
+		{
+			(*m_opens)++;
+			return std::make_unique<counting_backend>(m_inner->open_subkey(name), m_opens, m_queries);
+		}
+
+		key_info query_info() const override
+		{
+			(*m_queries)++;
+			return m_inner->query_info();
+		}
+
+		std::wstring sub_key_name(uint32_t index) const override
+		{
+			return m_inner->sub_key_name(index);
+		}
+
+		value_view value_at(uint32_t index, value_buffer& buffer) const override
+		{
+			return m_inner->value_at(index, buffer);
+		}
+
+		bool same_key(const key_backend& other) const override
+		{
+			auto rhs = dynamic_cast<const counting_backend*>(&other);
+			return rhs != nullptr && m_inner->same_key(*rhs->m_inner);
+		}
+
+	private:
+		std::unique_ptr<key_backend> m_inner;
+		std::shared_ptr<uint32_t> m_opens;
+		std::shared_ptr<uint32_t> m_queries;
+	};
+
+	/**
+	 * Wraps another backend and fails every value read after a number of them.
+	 */
+	class failing_backend final : public key_backend
+	{
+	public:
+		failing_backend(std::unique_ptr<key_backend> inner, std::shared_ptr<uint32_t> reads_left) :
+			m_inner(std::move(inner)), m_reads_left(std::move(reads_left))
+		{
+		}
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override
+		{
+			return std::make_unique<failing_backend>(m_inner->open_subkey(name), m_reads_left);
+		}
+
+		key_info query_info() const override
+		{
+			return m_inner->query_info();
+		}
+
+		std::wstring sub_key_name(uint32_t index) const override
+		{
+			return m_inner->sub_key_name(index);
+		}
+
+		value_view value_at(uint32_t index, value_buffer& buffer) const override
+		{
+			if (*m_reads_left == 0)
+			{
+				throw registry_error{ registry_errc::not_found, "Value read failed." };
+			}
+			(*m_reads_left)--;
+			return m_inner->value_at(index, buffer);
+		}
+
+		bool same_key(const key_backend& other) const override
+		{
+			auto rhs = dynamic_cast<const failing_backend*>(&other);
+			return rhs != nullptr && m_inner->same_key(*rhs->m_inner);
+		}
+
+	private:
+		std::unique_ptr<key_backend> m_inner;
+		std::shared_ptr<uint32_t> m_reads_left;
+	};
+
+	/**
+	 * A coroutine that runs on its own once started, for driving async ranges.
+	 */
+	struct detached_task
+	{
+		struct promise_type
+		{
+			detached_task get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+	};
+
+	detached_task collect_names(async_range<key_entry>& range, std::vector<std::wstring>& names, std::promise<void>& finished)
+	{
+		while (auto key = co_await range.next())
+		{
+			names.emplace_back(key->interned_path().name());
+		}
+		finished.set_value();
+	}
+}
+
 namespace RegistryPPTests
 {
 	TEST_CLASS(RegistryPPTests)
 	{
 	public:
 
+#ifdef _WIN32
 		TEST_METHOD(RootKeyNameTest)
 		{
 			auto key = key_entry::open_classes_root();
@@ -28,5 +211,1184 @@ namespace RegistryPPTests
 			auto key = key_entry::open_classes_root().open_subkey(L".txt");
 			Assert::AreEqual(key.path(), std::wstring{ L"HKEY_CLASSES_ROOT\\.txt" });
 		}
+#endif // _WIN32
+
+		TEST_METHOD(HiveReaderTest)
+		{
+			using namespace hive_format;
+			// A root key with one sub key holding one value, and an ri list that refers to itself.
+			auto build = [](uint32_t root_list, uint32_t root_sub_keys = 1)
+			{
+				std::vector<uint8_t> file(base_block::size + page_size);
+				auto put = [&file](size_t offset, auto value) { std::memcpy(file.data() + offset, &value, sizeof value); };
+				std::memcpy(file.data(), "regf", 4);
+				put(base_block::primary_sequence, uint32_t{ 1 });
+				put(base_block::secondary_sequence, uint32_t{ 1 });
+				put(base_block::major_version, uint32_t{ 1 });
+				put(base_block::minor_version, uint32_t{ 5 });
+				put(base_block::file_format, uint32_t{ 1 });
+				put(base_block::root_cell, uint32_t{ 32 });
+				put(base_block::hbins_size, page_size);
+				put(base_block::checksum, base_block_checksum(file.data()));
+
+				size_t hbins = base_block::size;
+				std::memcpy(file.data() + hbins, "hbin", 4);
+				put(hbins + hbin::size, page_size);
+				auto key = [&](uint32_t cell, const char* name, uint32_t parent, uint32_t sub_keys, uint32_t list, uint32_t values, uint32_t value_list)
+				{
+					size_t payload = hbins + cell + 4;
+					put(hbins + cell, int32_t{ -88 });
+					put(payload, nk::signature_value);
+					put(payload + nk::flags, static_cast<uint16_t>(nk::flag_compressed_name | (parent == no_offset ? nk::flag_hive_entry : 0)));
+					put(payload + nk::parent, parent);
+					put(payload + nk::sub_keys_count, sub_keys);
+					put(payload + nk::sub_keys_list, list);
+					put(payload + nk::volatile_sub_keys_list, no_offset);
+					put(payload + nk::values_count, values);
+					put(payload + nk::values_list, value_list);
+					put(payload + nk::security, no_offset);
+					put(payload + nk::class_name, no_offset);
+					put(payload + nk::name_length, static_cast<uint16_t>(std::strlen(name)));
+					std::memcpy(file.data() + payload + nk::name, name, std::strlen(name));
+				};
+				key(32, "ROOT", no_offset, root_sub_keys, root_list, 0, no_offset);
+				key(120, "Child", 32, 0, no_offset, 1, 240);
+				put(hbins + 208, int32_t{ -32 });
+				put(hbins + 212, vk::signature_value);
+				put(hbins + 212 + vk::name_length, uint16_t{ 5 });
+				put(hbins + 212 + vk::data_size, 4 | vk::data_inline);
+				put(hbins + 212 + vk::data_offset, uint32_t{ 7 });
+				put(hbins + 212 + vk::type, static_cast<uint32_t>(registry_value_type::dword));
+				put(hbins + 212 + vk::flags, vk::flag_compressed_name);
+				std::memcpy(file.data() + hbins + 212 + vk::name, "Level", 5);
+				put(hbins + 240, int32_t{ -8 });
+				put(hbins + 244, uint32_t{ 208 });
+				put(hbins + 248, int32_t{ -16 });
+				put(hbins + 252, list::lf);
+				put(hbins + 252 + list::count, uint16_t{ 1 });
+				put(hbins + 252 + list::elements, uint32_t{ 120 });
+				std::memcpy(file.data() + hbins + 252 + list::elements + 4, "Chil", 4);
+				put(hbins + 264, int32_t{ -16 });
+				put(hbins + 268, list::ri);
+				put(hbins + 268 + list::count, uint16_t{ 1 });
+				put(hbins + 268 + list::elements, uint32_t{ 264 });
+				put(hbins + 280, static_cast<int32_t>(page_size - 280));
+				return file;
+			};
+			auto path = std::filesystem::temp_directory_path() / L"RegistryPP.HiveReaderTest.hive";
+			auto write_file = [&path](const std::vector<uint8_t>& bytes)
+			{
+				std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+				out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+			};
+
+			write_file(build(248));
+			{
+				auto root = hive_file::open(path, {})->root();
+				Assert::IsTrue(root.name() == L"ROOT");
+				// The keys were never written: a FILETIME of 0, before what system_clock may represent.
+				Assert::AreEqual(time_point_to_filetime(root.last_written()), uint64_t{ 0 });
+				Assert::AreEqual(root.sub_key_count(), uint32_t{ 1 });
+				Assert::IsTrue(root.sub_key_name(0) == L"Child");
+				auto child = root.open_subkey(L"CHILD");
+				Assert::AreEqual(child.value_count(), uint32_t{ 1 });
+				Assert::AreEqual(child.get_value(L"level")->get_dword(), uint32_t{ 7 });
+				Assert::IsFalse(root.try_open_subkey(L"Missing").has_value());
+			}
+
+			uint64_t now = time_point_to_filetime(std::chrono::system_clock::now());
+			Assert::AreEqual(time_point_to_filetime(filetime_to_time_point(now)), now);
+			Assert::IsTrue(filetime_to_time_point(UINT64_MAX) > std::chrono::system_clock::now());
+
+			write_file(build(264));
+			{
+				auto root = hive_file::open(path, {})->root();
+				Assert::ExpectException<registry_error>([&]() { root.open_subkey(L"Child"); });
+				Assert::ExpectException<registry_error>([&]() { root.sub_key_name(0); });
+			}
+
+			// Enough sub keys that the lookup builds a child index instead of walking the lists.
+			write_file(build(264, child_index::min_children));
+			{
+				auto root = hive_file::open(path, {})->root();
+				Assert::ExpectException<registry_error>([&]() { root.open_subkey(L"Child"); });
+			}
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(MemoryKeyPathTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"Software").add_subkey(L"Vendor");
+			auto key = root->open().open_subkey(L"software\\VENDOR");
+			Assert::AreEqual(key.path(), std::wstring{ L"ROOT\\software\\VENDOR" });
+			Assert::AreEqual(key.sub_key_count(), 0U);
+		}
+
+		TEST_METHOD(MemoryValuesTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& settings = root->add_subkey(L"Settings");
+			settings.set_dword(L"Count", 42);
+			settings.set_string(L"Name", L"value");
+			settings.set_qword(L"Big", 1ULL << 40);
+			auto key = root->open().open_subkey(L"Settings");
+			Assert::AreEqual(key.value_count(), 3U);
+			value_entry_iterator values{ key };
+			Assert::AreEqual(values[0].name(), std::wstring{ L"Count" });
+			Assert::AreEqual(values[0].get_dword(), 42U);
+			Assert::IsTrue(values[1].get_string().rfind(L"value", 0) == 0);
+			Assert::IsTrue(values[2].get_qword() == 1ULL << 40);
+		}
+
+		TEST_METHOD(MemoryManyValuesTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			for (uint32_t i = 0; i < 20000; i++)
+			{
+				root->set_dword(L"Value" + std::to_wstring(i), i);
+			}
+			Assert::AreEqual(root->value_count(), uint32_t{ 20000 });
+			Assert::IsTrue(root->delete_value(L"VALUE100"));
+			Assert::IsFalse(root->delete_value(L"Value100"));
+			root->set_dword(L"value19999", 7);
+			auto key = root->open();
+			Assert::AreEqual(key.value_count(), uint32_t{ 19999 });
+			Assert::AreEqual(key.get_value(L"Value101")->get_dword(), uint32_t{ 101 });
+			Assert::AreEqual(key.get_value(L"VALUE19999")->get_dword(), uint32_t{ 7 });
+			Assert::AreEqual(root->find_value(L"value101"), uint32_t{ 100 });
+			Assert::AreEqual(root->find_value(L"Value100"), root->value_count());
+		}
+
+		TEST_METHOD(NamesAndTypesEnumerationTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->set_dword(L"Count", 42);
+			root->set_string(L"Name", L"value");
+			value_entry_iterator values{ root->open(), value_enumeration::names_and_types };
+			Assert::AreEqual(values[1].name(), std::wstring{ L"Name" });
+			Assert::IsTrue(values[1].type() == registry_value_type::string);
+			// The data was never read, so it must not read as an empty value.
+			Assert::IsFalse(values[0].has_data());
+			Assert::ExpectException<registry_error>([&values]() { values[0].get_dword(); });
+			Assert::ExpectException<registry_error>([&values]() { values[1].get_bytes(); });
+			Assert::ExpectException<registry_error>([&values]() { values[1].get_string_view(); });
+			value_entry_iterator full{ root->open() };
+			Assert::IsTrue(full[0].has_data());
+			Assert::AreEqual(full[0].get_dword(), 42U);
+		}
+
+		TEST_METHOD(MemorySubKeyIteratorTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"A");
+			root->add_subkey(L"B");
+			key_entry_iterator sub_keys{ root->open() };
+			Assert::AreEqual(sub_keys[1].name(), std::wstring{ L"B" });
+		}
+
+		TEST_METHOD(LazyMetadataTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"A").add_subkey(L"B").add_subkey(L"C").add_subkey(L"D").set_dword(L"Leaf", 1);
+			auto opens = std::make_shared<uint32_t>(0);
+			auto queries = std::make_shared<uint32_t>(0);
+			auto key = key_entry::from_backend(std::make_unique<counting_backend>(std::make_unique<memory_key_backend>(root), opens, queries), L"ROOT");
+			auto leaf = key.open_subkey(L"A\\B\\C\\D");
+			Assert::AreEqual(*opens, 1U);
+			Assert::AreEqual(*queries, 0U);
+			Assert::AreEqual(leaf.value_count(), 1U);
+			Assert::AreEqual(leaf.sub_key_count(), 0U);
+			Assert::AreEqual(*queries, 1U);
+		}
+
+		TEST_METHOD(InternedKeyPathTest)
+		{
+			key_path root{ L"HKEY_LOCAL_MACHINE\\Software" };
+			auto vendor = root.append(L"Vendor\\Product");
+			Assert::AreEqual(vendor.str(), std::wstring{ L"HKEY_LOCAL_MACHINE\\Software\\Vendor\\Product" });
+			Assert::AreEqual(vendor.depth(), 4U);
+			key_path other{ L"hkey_local_machine\\SOFTWARE\\vendor\\product" };
+			Assert::IsTrue(vendor == other);
+			Assert::IsTrue(vendor.hash() == other.hash());
+			Assert::IsTrue(vendor.parent() != root);
+			Assert::IsTrue(vendor.parent().parent() == root);
+
+			auto tree = memory_key::create(L"ROOT");
+			tree->add_subkey(L"A").add_subkey(L"B");
+			Assert::AreEqual(tree->open().open_subkey(L"A").open_subkey(L"B").path(), std::wstring{ L"ROOT\\A\\B" });
+		}
+
+		TEST_METHOD(KeyCacheTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"A").add_subkey(L"B");
+			root->add_subkey(L"C");
+			auto opens = std::make_shared<uint32_t>(0);
+			auto queries = std::make_shared<uint32_t>(0);
+			key_cache cache{ key_entry::from_backend(std::make_unique<counting_backend>(std::make_unique<memory_key_backend>(root), opens, queries), L"ROOT"), 2 };
+			cache.open(L"A\\B");
+			cache.open(L"a\\b");
+			Assert::AreEqual(*opens, 1U);
+			Assert::IsTrue(cache.hits() == 1 && cache.misses() == 1);
+			cache.open(L"C");
+			cache.open(L"A");
+			Assert::AreEqual(cache.size(), size_t{ 2 });
+			cache.open(L"A\\B");
+			Assert::AreEqual(*opens, 4U);
+			Assert::IsTrue(cache.misses() == 4);
+		}
+
+		TEST_METHOD(BatchValuesTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->set_dword(L"Width", 640);
+			root->set_string(L"Title", L"Main");
+			auto batch = root->open().get_values({ L"width", L"Missing", L"Title" });
+			Assert::AreEqual(batch.size(), size_t{ 3 });
+			Assert::AreEqual(batch[0].get_dword(), 640U);
+			Assert::IsFalse(batch.found(1));
+			Assert::IsTrue(batch[2].get_string().rfind(L"Main", 0) == 0);
+			Assert::IsTrue(root->open().get_value(L"TITLE").has_value());
+			Assert::IsFalse(root->open().get_value(L"Nope").has_value());
+		}
+
+		TEST_METHOD(CrossKeyBatchValuesTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"Window").set_dword(L"Width", 640);
+			root->add_subkey(L"Window").set_dword(L"Height", 480);
+			root->set_dword(L"Version", 3);
+			auto opens = std::make_shared<uint32_t>(0);
+			auto queries = std::make_shared<uint32_t>(0);
+			auto key = key_entry::from_backend(std::make_unique<counting_backend>(std::make_unique<memory_key_backend>(root), opens, queries), L"ROOT");
+			auto batch = key.get_values_by_path({ { L"Window", L"Width" }, { L"", L"Version" }, { L"Absent", L"X" }, { L"WINDOW", L"Height" } });
+			Assert::AreEqual(*opens, 2U);
+			Assert::AreEqual(batch[0].get_dword(), 640U);
+			Assert::AreEqual(batch[1].get_dword(), 3U);
+			Assert::IsFalse(batch.found(2));
+			Assert::AreEqual(batch[3].get_dword(), 480U);
+			Assert::AreEqual(batch.result(3).offset % 8, 0U);
+		}
+
+		TEST_METHOD(MultiStringTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			std::vector<std::wstring> strings{ L"first string that spans more than one vector", L"b", L"third" };
+			root->set_strings(L"List", strings);
+			root->set_string(L"Path", L"C:\\Windows");
+			auto list = root->open().get_value(L"List");
+			Assert::IsTrue(list->get_strings() == strings);
+			Assert::AreEqual(list->get_strings_view().size(), size_t{ 3 });
+			Assert::AreEqual(list->get_strings_view()[1].size(), size_t{ 1 });
+			Assert::AreEqual(root->open().get_value(L"Path")->get_string(), std::wstring{ L"C:\\Windows" });
+
+			// Without the final terminator the last string is still returned.
+			const uint8_t unterminated[]{ 'a', 0, 0, 0, 'b', 0, 'c', 0 };
+			root->set_value(L"Raw", registry_value_type::multi_string, unterminated, sizeof unterminated);
+			auto raw = root->open().get_value(L"Raw")->get_strings();
+			Assert::AreEqual(raw.size(), size_t{ 2 });
+			Assert::AreEqual(raw[1], std::wstring{ L"bc" });
+		}
+
+		TEST_METHOD(Utf8StringTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			const uint8_t text[]{ 'A', 0, 'B', 0, 'C', 0, 'D', 0, 'E', 0, 'F', 0, 'G', 0, 'H', 0, 'I', 0, 0xE9, 0, 0xAC, 0x20, 0x3D, 0xD8, 0x00, 0xDE, 0, 0 };
+			root->set_value(L"Text", registry_value_type::string, text, sizeof text);
+			Assert::IsTrue(root->open().get_value(L"Text")->get_string_utf8() == "ABCDEFGHI\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80");
+			std::vector<std::wstring> strings{ L"one", L"two" };
+			root->set_strings(L"List", strings);
+			auto utf8 = root->open().get_value(L"List")->get_strings_utf8();
+			Assert::IsTrue(utf8 == std::vector<std::string>{ "one", "two" });
+		}
+
+		TEST_METHOD(StreamingSubKeysTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"A");
+			root->add_subkey(L"B");
+			root->add_subkey(L"C");
+			std::wstring names;
+			for (const auto& sub_key : root->open().subkeys())
+			{
+				names += sub_key.name();
+			}
+			Assert::AreEqual(names, std::wstring{ L"ABC" });
+			static_assert(std::ranges::input_range<sub_key_range>);
+			auto filtered = root->open().subkeys() | std::views::filter([](const key_entry& key) { return key.name() != L"B"; });
+			Assert::AreEqual(static_cast<size_t>(std::ranges::distance(filtered)), size_t{ 2 });
+		}
+
+		TEST_METHOD(StreamingValuesTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->set_dword(L"One", 1);
+			root->set_dword(L"Two", 2);
+			uint32_t total = 0;
+			for (const auto& value : root->open().values())
+			{
+				total += value.get_dword();
+			}
+			Assert::AreEqual(total, 3U);
+			uint32_t count = 0;
+			for (const auto& value : root->open().values(value_enumeration::names_and_types))
+			{
+				Assert::IsTrue(value.type() == registry_value_type::dword);
+				count++;
+			}
+			Assert::AreEqual(count, 2U);
+		}
+
+		TEST_METHOD(SnapshotLookupTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& vendor = root->add_subkey(L"Software").add_subkey(L"Vendor");
+			vendor.set_dword(L"Level", 7);
+			root->add_subkey(L"System");
+			auto captured = snapshot::capture(root->open());
+			Assert::AreEqual(captured->key_count(), 4U);
+			auto key = captured->root().find_subkey(L"SOFTWARE\\vendor");
+			Assert::IsTrue(key.has_value());
+			auto value = key->find_value(L"level");
+			Assert::IsTrue(value.has_value());
+			Assert::AreEqual(value->size(), 4U);
+			Assert::AreEqual(captured->open().open_subkey(L"Software\\Vendor").value_count(), 1U);
+		}
+
+		TEST_METHOD(SnapshotSlotTest)
+		{
+			auto first = snapshot::capture(memory_key::create(L"A")->open());
+			auto second = snapshot::capture(memory_key::create(L"B")->open());
+			snapshot_slot slot{ first };
+			Assert::IsTrue(slot.exchange(second) == first);
+			Assert::AreEqual(slot.load()->root().name(), std::wstring{ L"B" });
+		}
+
+		TEST_METHOD(SnapshotSaveLoadTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& vendor = root->add_subkey(L"Software").add_subkey(L"Vendor");
+			vendor.set_dword(L"Level", 7);
+			vendor.set_string(L"Path", L"C:\\Vendor");
+			vendor.set_strings(L"Modules", { L"core", L"ui" });
+			root->add_subkey(L"System").set_qword(L"Boot", 0x123456789ull);
+			std::stringstream stream;
+			snapshot::capture(root->open())->save(stream);
+			auto bytes = stream.str();
+			Assert::AreEqual(bytes.size() % 8, size_t{ 0 });
+
+			auto blob = std::make_shared<std::vector<uint64_t>>(bytes.size() / 8);
+			std::memcpy(blob->data(), bytes.data(), bytes.size());
+			std::span<const uint8_t> view{ reinterpret_cast<const uint8_t*>(blob->data()), bytes.size() };
+			auto loaded = snapshot::load(view, blob);
+			Assert::AreEqual(loaded->key_count(), 4U);
+			Assert::AreEqual(loaded->value_count(), 4U);
+			auto key = loaded->open().open_subkey(L"software\\VENDOR");
+			Assert::AreEqual(key.get_value(L"Level")->get_dword(), uint32_t{ 7 });
+			Assert::IsTrue(key.get_value(L"Path")->get_string() == L"C:\\Vendor");
+			Assert::AreEqual(key.get_value(L"Modules")->get_strings().size(), size_t{ 2 });
+			Assert::AreEqual(loaded->open().open_subkey(L"System").get_value(L"Boot")->get_qword(), uint64_t{ 0x123456789ull });
+
+			auto path = std::filesystem::temp_directory_path() / L"RegistryPP.SnapshotSaveLoadTest.snapshot";
+			{
+				std::ofstream file{ path, std::ios::binary };
+				file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+			}
+			{
+				auto mapped = snapshot::load(path);
+				Assert::IsTrue(mapped->root().find_subkey(L"Software\\Vendor")->find_value(L"path").has_value());
+			}
+			std::filesystem::remove(path);
+
+			// Damaged value data: caught by the checksum, and harmless without it.
+			auto damaged = std::make_shared<std::vector<uint64_t>>(*blob);
+			reinterpret_cast<uint8_t*>(damaged->data())[bytes.size() - 16] ^= 0xFF;
+			std::span<const uint8_t> damaged_view{ reinterpret_cast<const uint8_t*>(damaged->data()), bytes.size() };
+			Assert::ExpectException<registry_error>([&]() { snapshot::load(damaged_view, damaged); });
+			Assert::AreEqual(snapshot::load(damaged_view, damaged, false)->key_count(), 4U);
+			// A key pointing outside the tables is rejected even without the checksum.
+			std::memset(reinterpret_cast<uint8_t*>(damaged->data()) + 72, 0xFF, 8);
+			Assert::ExpectException<registry_error>([&]() { snapshot::load(damaged_view, damaged, false); });
+			Assert::ExpectException<registry_error>([&]() { snapshot::load(view.subspan(0, 40), blob); });
+		}
+
+		TEST_METHOD(ParallelWalkTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			for (int i = 0; i < 10; i++)
+			{
+				auto& child = root->add_subkey(L"K" + std::to_wstring(i));
+				for (int j = 0; j < 10; j++)
+				{
+					child.add_subkey(L"S" + std::to_wstring(j));
+				}
+			}
+			std::atomic<uint32_t> visited{ 0 };
+			walk_options options;
+			options.threads = 4;
+			auto statistics = walk(root->open(), [&visited](const key_entry&, uint32_t) { visited++; }, options);
+			Assert::AreEqual(visited.load(), 111U);
+			Assert::IsTrue(statistics.keys_visited() == 111);
+			Assert::AreEqual(statistics.workers.size(), size_t{ 4 });
+		}
+
+		TEST_METHOD(OrderedPrunedWalkTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"A").add_subkey(L"A1");
+			root->add_subkey(L"B").add_subkey(L"B1").add_subkey(L"B2");
+			std::vector<std::wstring> paths;
+			walk_options options;
+			options.threads = 3;
+			options.ordered = true;
+			options.max_depth = 2;
+			options.prune = [](const key_entry& key, uint32_t) { return key.name() == L"A"; };
+			walk(root->open(), [&paths](const key_entry& key, uint32_t) { paths.push_back(key.path()); }, options);
+			std::vector<std::wstring> expected{ L"ROOT", L"ROOT\\A", L"ROOT\\B", L"ROOT\\B\\B1" };
+			Assert::IsTrue(paths == expected);
+		}
+
+		TEST_METHOD(MemoryWriteTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto key = root->open().create_subkey(L"Software\\Vendor");
+			key.set_dword(L"Width", 640);
+			key.set_strings(L"Paths", { L"C:\\", L"D:\\" });
+			Assert::AreEqual(root->open().open_subkey(L"software\\vendor").get_value(L"WIDTH")->get_dword(), 640U);
+			Assert::IsTrue(key.delete_value(L"width"));
+			Assert::IsFalse(key.delete_value(L"Width"));
+			Assert::IsTrue(root->open().delete_subtree(L"Software"));
+			Assert::IsFalse(root->open().try_open_subkey(L"Software").has_value());
+		}
+
+		TEST_METHOD(WriteBatchTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"Old").add_subkey(L"Child").set_dword(L"X", 1);
+			write_batch batch;
+			batch.set_dword(L"Window", L"Width", 320);
+			batch.set_dword(L"Old\\Child", L"Y", 2);
+			batch.set_string(L"", L"Title", L"Main");
+			batch.set_dword(L"WINDOW", L"width", 640);
+			batch.delete_subtree(L"Old");
+			batch.create_subkey(L"Empty");
+			Assert::AreEqual(batch.size(), size_t{ 4 });
+			Assert::AreEqual(batch.writes()[0].values.size(), size_t{ 1 });
+			batch.commit(root->open());
+			auto key = root->open();
+			Assert::AreEqual(key.open_subkey(L"Window").get_value(L"Width")->get_dword(), 640U);
+			Assert::IsTrue(key.get_value(L"Title").has_value());
+			Assert::IsFalse(key.try_open_subkey(L"Old").has_value());
+			Assert::IsTrue(key.try_open_subkey(L"Empty").has_value());
+		}
+
+		TEST_METHOD(WriteBatchRollbackTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			root->set_dword(L"Version", 1);
+			memory_key_backend backend{ root };
+			std::vector<key_write> writes(3);
+			writes[0].path = L"New";
+			writes[0].create = true;
+			writes[1].values.push_back(value_write{ L"Version", false, registry_value_type::dword, { 2, 0, 0, 0 } });
+			writes[2].delete_subtree = true;
+			Assert::ExpectException<registry_error>([&backend, &writes]() { backend.apply(writes); });
+			Assert::AreEqual(root->sub_key_count(), 0U);
+			Assert::AreEqual(root->open().get_value(L"Version")->get_dword(), 1U);
+		}
+
+		TEST_METHOD(RegFileRoundTripTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& key = root->add_subkey(L"Software").add_subkey(L"Vendor");
+			key.set_string(L"", L"Default");
+			key.set_string(L"Path", L"C:\\Program Files\\\"Vendor\"");
+			key.set_dword(L"Count", 0xDEADBEEF);
+			key.set_qword(L"Big", 0x0123456789ABCDEFULL);
+			key.set_strings(L"List", { L"One", L"Two" });
+			std::vector<uint8_t> blob(100);
+			for (size_t i = 0; i < blob.size(); i++)
+			{
+				blob[i] = static_cast<uint8_t>(i * 7);
+			}
+			key.set_value(L"Blob", registry_value_type::binary, blob.data(), static_cast<uint32_t>(blob.size()));
+			root->add_subkey(L"Empty");
+
+			std::stringstream first;
+			export_reg(root->open(), first);
+			auto copy = import_reg_tree(first);
+			Assert::IsTrue(copy != nullptr);
+			std::stringstream second;
+			export_reg(copy->open(), second);
+			Assert::IsTrue(first.str() == second.str());
+			auto vendor = copy->open().open_subkey(L"Software\\Vendor");
+			Assert::IsTrue(vendor.get_value(L"Path")->get_string() == L"C:\\Program Files\\\"Vendor\"");
+			Assert::IsTrue(vendor.get_value(L"Blob")->get_bytes() == blob);
+			Assert::IsTrue(vendor.get_value(L"Big")->get_qword() == 0x0123456789ABCDEFULL);
+		}
+
+		TEST_METHOD(RegFileImportTest)
+		{
+			auto root = memory_key::create(L"HKEY_CURRENT_USER");
+			root->add_subkey(L"Old").set_dword(L"X", 1);
+			root->add_subkey(L"Keep").set_dword(L"Gone", 1);
+			std::istringstream in{
+				"Windows Registry Editor Version 5.00\r\n"
+				"\r\n"
+				"; comment\r\n"
+				"[-HKEY_CURRENT_USER\\Old]\r\n"
+				"\r\n"
+				"[HKEY_CURRENT_USER\\Keep]\r\n"
+				"\"Gone\"=-\r\n"
+				"@=\"a \\\"quoted\\\" \\\\ value\"\r\n"
+				"\"Data\"=hex:01,02,\\\r\n"
+				"  03,04\r\n"
+				"\"Wide\"=hex(2):41,00,00,00\r\n"
+				"\"Number\"=dword:0000002a\r\n" };
+			import_reg(in, root->open(), 2);
+			auto key = root->open();
+			Assert::IsFalse(key.try_open_subkey(L"Old").has_value());
+			auto keep = key.open_subkey(L"Keep");
+			Assert::IsFalse(keep.get_value(L"Gone").has_value());
+			Assert::IsTrue(keep.get_value(L"")->get_string() == L"a \"quoted\" \\ value");
+			Assert::IsTrue(keep.get_value(L"Data")->get_bytes() == std::vector<uint8_t>{ 1, 2, 3, 4 });
+			Assert::IsTrue(keep.get_value(L"Wide")->type() == registry_value_type::expandable_string);
+			Assert::AreEqual(keep.get_value(L"Number")->get_dword(), 42U);
+
+			std::istringstream bad{ "Windows Registry Editor Version 5.00\r\n[HKEY_CURRENT_USER]\r\n\"X\"=dword:zz\r\n" };
+			Assert::ExpectException<registry_error>([&bad, &root]() { import_reg(bad, root->open()); });
+			std::istringstream delete_root{ "Windows Registry Editor Version 5.00\r\n[-HKEY_CURRENT_USER]\r\n" };
+			Assert::ExpectException<registry_error>([&delete_root, &root]() { import_reg(delete_root, root->open()); });
+			// The last quote is escaped, so the string never ends.
+			std::istringstream escaped{ "Windows Registry Editor Version 5.00\r\n[HKEY_CURRENT_USER]\r\n\"X\"=\"abc\\\"\r\n" };
+			try
+			{
+				import_reg(escaped, root->open());
+				Assert::Fail();
+			}
+			catch (const registry_error& error)
+			{
+				Assert::IsTrue(std::string{ error.what() } == "Line 3: Unterminated string.");
+			}
+		}
+
+		TEST_METHOD(TreeDiffTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& vendor = root->add_subkey(L"Software").add_subkey(L"Vendor");
+			vendor.set_dword(L"Level", 7);
+			vendor.set_string(L"Name", L"Old");
+			root->add_subkey(L"System").add_subkey(L"Deep").set_dword(L"X", 1);
+			root->add_subkey(L"Gone");
+			auto before = snapshot::capture(root->open());
+			Assert::IsTrue(diff(before->open(), root->open()).empty());
+
+			vendor.set_dword(L"Level", 8);
+			vendor.delete_value(L"Name");
+			vendor.set_dword(L"New", 1);
+			root->delete_subkey(L"Gone");
+			root->add_subkey(L"SOFTWARE").add_subkey(L"Added");
+			auto changes = diff(before->open(), root->open());
+			auto has = [&changes](change_kind kind, const std::wstring& path, const std::wstring& name)
+			{
+				return std::any_of(changes.begin(), changes.end(), [&](const tree_change& change) { return change.kind == kind && change.path == path && change.value_name == name; });
+			};
+			Assert::AreEqual(changes.size(), size_t{ 5 });
+			Assert::IsTrue(has(change_kind::value_modified, L"Software\\Vendor", L"Level"));
+			Assert::IsTrue(has(change_kind::value_removed, L"Software\\Vendor", L"Name"));
+			Assert::IsTrue(has(change_kind::value_added, L"Software\\Vendor", L"New"));
+			Assert::IsTrue(has(change_kind::key_removed, L"Gone", L""));
+			Assert::IsTrue(has(change_kind::key_added, L"Software\\Added", L""));
+		}
+
+		TEST_METHOD(TreeDiffCacheTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			for (int i = 0; i < 10; i++)
+			{
+				root->add_subkey(L"Key" + std::to_wstring(i)).set_dword(L"Value", static_cast<uint32_t>(i));
+			}
+			auto other = snapshot::capture(root->open());
+			hash_cache before_cache;
+			hash_cache after_cache;
+			Assert::IsTrue(diff(other->open(), root->open(), {}, before_cache, after_cache).empty());
+			Assert::AreEqual(after_cache.keys_read(), uint64_t{ 11 });
+
+			auto& changed = *root->find_subkey(L"Key3");
+			changed.set_dword(L"Value", 42);
+			auto changes = diff(other->open(), root->open(), {}, before_cache, after_cache);
+			Assert::AreEqual(changes.size(), size_t{ 1 });
+			Assert::IsTrue(changes[0].path == L"Key3");
+			// Only the changed key was read again.
+			Assert::AreEqual(after_cache.keys_read(), uint64_t{ 12 });
+			Assert::AreEqual(before_cache.keys_read(), uint64_t{ 11 });
+
+			// A second edit right after the first, with the same counts, is still seen.
+			changed.set_dword(L"Value", 3);
+			Assert::IsTrue(diff(other->open(), root->open(), {}, before_cache, after_cache).empty());
+			Assert::AreEqual(after_cache.keys_read(), uint64_t{ 13 });
+		}
+
+		TEST_METHOD(SearchIndexTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& microsoft = root->add_subkey(L"Software").add_subkey(L"Microsoft");
+			microsoft.add_subkey(L"Windows").set_string(L"InstallPath", L"C:\\Windows\\System32");
+			microsoft.set_dword(L"InstallCount", 3);
+			root->add_subkey(L"Software").add_subkey(L"Mozilla").set_strings(L"Profiles", { L"default", L"Work Profile" });
+			root->add_subkey(L"System").set_string(L"Shell", L"explorer.exe");
+			auto index = search_index::build(snapshot::capture(root->open())->open());
+			Assert::AreEqual(index.key_count(), size_t{ 6 });
+			Assert::AreEqual(index.value_count(), size_t{ 4 });
+
+			auto keys = index.find_keys(L"software\\M");
+			Assert::AreEqual(keys.size(), size_t{ 3 });
+			Assert::IsTrue(keys[0].path == L"Software\\Microsoft");
+			Assert::IsTrue(keys[1].path == L"Software\\Microsoft\\Windows");
+			Assert::IsTrue(keys[2].path == L"Software\\Mozilla");
+			Assert::AreEqual(index.find_keys(L"").size(), size_t{ 6 });
+			Assert::IsTrue(index.find_keys(L"Nowhere\\").empty());
+
+			auto names = index.find_values_by_name(L"install");
+			Assert::AreEqual(names.size(), size_t{ 2 });
+			auto dwords = index.find_values_by_name(L"INSTALL", registry_value_type::dword);
+			Assert::AreEqual(dwords.size(), size_t{ 1 });
+			Assert::IsTrue(dwords[0].path == L"Software\\Microsoft");
+
+			auto system32 = index.find_values_containing(L"system32");
+			Assert::AreEqual(system32.size(), size_t{ 1 });
+			Assert::IsTrue(system32[0].value_name == L"InstallPath");
+			Assert::AreEqual(index.find_values_containing(L"work prof", registry_value_type::multi_string).size(), size_t{ 1 });
+			Assert::IsTrue(index.find_values_containing(L"work prof", registry_value_type::string).empty());
+			Assert::AreEqual(index.find_values_containing(L"e").size(), size_t{ 3 });
+
+			std::stringstream stream;
+			index.save(stream);
+			auto loaded = search_index::load(stream);
+			Assert::AreEqual(loaded.find_keys(L"software\\").size(), size_t{ 3 });
+			Assert::AreEqual(loaded.find_values_containing(L"EXPLORER").size(), size_t{ 1 });
+			std::stringstream garbage{ "not an index" };
+			Assert::ExpectException<registry_error>([&garbage]() { search_index::load(garbage); });
+
+			// Two keys, where the root lists itself as its child instead of the other key.
+			auto crafted = [](std::initializer_list<uint32_t> words)
+			{
+				std::string bytes = "RPPINDEX";
+				for (uint32_t word : words)
+				{
+					bytes.append(reinterpret_cast<const char*>(&word), sizeof word);
+				}
+				return std::stringstream{ bytes };
+			};
+			auto cycle = crafted({ 1, 2, 0xFFFFFFFF, 0, 0, 0, 3, 0, 1, 1, 1, 0, 0, 0, 0 });
+			Assert::ExpectException<registry_error>([&cycle]() { search_index::load(cycle); });
+			auto valid = crafted({ 1, 2, 0xFFFFFFFF, 0, 0, 0, 3, 0, 1, 1, 1, 1, 0, 0, 0 });
+			Assert::AreEqual(search_index::load(valid).key_count(), size_t{ 2 });
+			auto unsorted = crafted({ 1, 2, 0xFFFFFFFF, 0, 0, 0, 3, 0, 1, 1, 1, 1, 1, 0, 1, 0, 0, 1, 0, 1, 7, 0, 2, 0, 0 });
+			Assert::ExpectException<registry_error>([&unsorted]() { search_index::load(unsorted); });
+
+			// Values named L"CD" and L"AB", each name one word; the name table must list both, in name order.
+			auto named = [&crafted](uint32_t first, uint32_t second)
+			{
+				return crafted({ 1, 2, 0xFFFFFFFF, 0, 0, 0, 3, 0, 1, 1, 1, 1, 2, 0, 1, 2, 0x00440043, 0, 0, 1, 2, 0x00420041, 0, 2, first, second, 0 });
+			};
+			auto by_name = named(1, 0);
+			Assert::AreEqual(search_index::load(by_name).find_values_by_name(L"cd").size(), size_t{ 1 });
+			auto out_of_order = named(0, 1);
+			Assert::ExpectException<registry_error>([&out_of_order]() { search_index::load(out_of_order); });
+			auto repeated = named(1, 1);
+			Assert::ExpectException<registry_error>([&repeated]() { search_index::load(repeated); });
+		}
+
+		TEST_METHOD(RegistryQueryTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& uninstall = root->add_subkey(L"Software").add_subkey(L"Microsoft").add_subkey(L"Windows").add_subkey(L"Uninstall");
+			uninstall.add_subkey(L"KB100").set_string(L"Publisher", L"Microsoft");
+			uninstall.add_subkey(L"KB200").set_dword(L"EstimatedSize", 42);
+			uninstall.add_subkey(L"Firefox").set_string(L"Publisher", L"Mozilla");
+			root->add_subkey(L"Software").add_subkey(L"Mozilla").add_subkey(L"Firefox").add_subkey(L"Uninstall");
+			root->add_subkey(L"System").add_subkey(L"Setup");
+			auto key = root->open();
+
+			auto literal = registry_query{ L"Software\\Microsoft\\Windows\\Uninstall\\*" }.run(key);
+			Assert::AreEqual(literal.keys.size(), size_t{ 3 });
+			Assert::AreEqual(literal.statistics.direct_opens, uint64_t{ 1 });
+			Assert::AreEqual(literal.statistics.keys_visited, uint64_t{ 4 });
+
+			auto deep = registry_query{ L"Software\\**\\Uninstall" }.run(key);
+			Assert::AreEqual(deep.keys.size(), size_t{ 2 });
+			auto pruned = registry_query{ L"*\\Microsoft\\Windows\\Uninstall\\/kb\\d+/" }.run(key);
+			Assert::AreEqual(pruned.keys.size(), size_t{ 2 });
+			Assert::IsTrue(pruned.statistics.keys_pruned > 0);
+			Assert::IsTrue(pruned.statistics.direct_opens >= 2);
+
+			auto microsoft = registry_query::parse(L"Software\\**\\* @Publisher:sz=micro*").run(key);
+			Assert::AreEqual(microsoft.keys.size(), size_t{ 1 });
+			Assert::IsTrue(microsoft.keys[0].interned_path().name() == L"KB100");
+			auto sized = registry_query::parse(L"**\\KB? @EstimatedSize:REG_DWORD=4*").run(key, query_options{ 4, false, true });
+			Assert::AreEqual(sized.keys.size(), size_t{ 0 });
+			sized = registry_query::parse(L"**\\KB??? @EstimatedSize:REG_DWORD=4*").run(key, query_options{ 4, false, true });
+			Assert::AreEqual(sized.keys.size(), size_t{ 1 });
+			Assert::IsTrue(registry_query{ L"Nowhere\\*" }.run(key).keys.empty());
+
+			Assert::IsTrue(registry_query{ L"a\\**\\b?" }.matches_path(L"A\\B1"));
+			Assert::IsTrue(registry_query{ L"a\\**\\b?" }.matches_path(L"a\\x\\y\\bc"));
+			Assert::IsFalse(registry_query{ L"a\\**\\b?" }.matches_path(L"a\\x\\b"));
+			Assert::ExpectException<std::invalid_argument>([]() { registry_query::parse(L"* @Size:float"); });
+			Assert::ExpectException<std::invalid_argument>([]() { registry_query{ L"/[/" }; });
+		}
+
+		TEST_METHOD(AsyncRangeTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			for (int i = 0; i < 50; i++)
+			{
+				root->add_subkey(L"Key" + std::to_wstring(i)).set_dword(L"Index", i);
+			}
+			auto key = root->open();
+			background_executor executor{ 2 };
+
+			auto subkeys = subkeys_async(key, async_options{ 4, &executor });
+			std::vector<std::wstring> names;
+			std::promise<void> finished;
+			collect_names(subkeys, names, finished);
+			finished.get_future().wait();
+			Assert::AreEqual(names.size(), size_t{ 50 });
+			Assert::IsTrue(names[0] == L"Key0" && names[49] == L"Key49");
+			Assert::AreEqual(subkeys.statistics().entries_read, uint64_t{ 50 });
+
+			// Nobody consumes, so reading stops at the prefetch depth.
+			auto paused = subkeys_async(key, async_options{ 3, &executor });
+			while (paused.statistics().entries_read < 3)
+			{
+				std::this_thread::yield();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+			Assert::AreEqual(paused.statistics().entries_read, uint64_t{ 3 });
+			Assert::IsTrue(paused.next_blocking().has_value());
+			paused.cancel();
+			Assert::IsFalse(paused.next_blocking().has_value());
+
+			auto values = values_async(key.open_subkey(L"Key7"), value_enumeration::full, async_options{ 1, &executor });
+			auto value = values.next_blocking();
+			Assert::IsTrue(value.has_value());
+			Assert::AreEqual(value->get_dword(), uint32_t{ 7 });
+			Assert::IsFalse(values.next_blocking().has_value());
+		}
+
+		TEST_METHOD(InstrumentationTest)
+		{
+			auto calls = [](const instrumentation_snapshot& snapshot, backend_operation operation)
+			{
+				return snapshot.operations[static_cast<size_t>(operation)].calls;
+			};
+			auto root = memory_key::create(L"ROOT");
+			root->add_subkey(L"Settings").set_dword(L"Size", 42);
+			auto before = instrumentation::snapshot();
+			{
+				auto key = root->open();
+				auto settings = key.open_subkey(L"Settings");
+				Assert::AreEqual(settings.get_value(L"Size")->get_dword(), uint32_t{ 42 });
+				Assert::AreEqual(settings.sub_key_count(), uint32_t{ 0 });
+				if (instrumentation::enabled())
+				{
+					Assert::AreEqual(instrumentation::snapshot().live_keys, before.live_keys + 2);
+				}
+			}
+			auto after = instrumentation::snapshot();
+			Assert::AreEqual(after.live_keys, before.live_keys);
+			Assert::IsTrue(after.to_json().find("\"open\":{\"calls\":") != std::string::npos);
+			Assert::IsTrue(after.to_prometheus().find("registrypp_backend_calls_total{operation=\"open\"}") != std::string::npos);
+			if (!instrumentation::enabled())
+			{
+				Assert::AreEqual(calls(after, backend_operation::open), uint64_t{ 0 });
+				return;
+			}
+			Assert::AreEqual(calls(after, backend_operation::open) - calls(before, backend_operation::open), uint64_t{ 1 });
+			Assert::AreEqual(calls(after, backend_operation::read_value) - calls(before, backend_operation::read_value), uint64_t{ 1 });
+			Assert::AreEqual(calls(after, backend_operation::query_info) - calls(before, backend_operation::query_info), uint64_t{ 1 });
+			Assert::AreEqual(calls(after, backend_operation::close) - calls(before, backend_operation::close), uint64_t{ 2 });
+			Assert::AreEqual(after.bytes_decoded - before.bytes_decoded, uint64_t{ 4 });
+			Assert::IsTrue(after.bytes_read - before.bytes_read >= 4);
+			uint64_t histogram = 0;
+			for (uint64_t bucket : after.operations[static_cast<size_t>(backend_operation::open)].histogram)
+			{
+				histogram += bucket;
+			}
+			Assert::AreEqual(histogram, calls(after, backend_operation::open));
+		}
+
+		TEST_METHOD(ArenaScanTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			for (int i = 0; i < 50; i++)
+			{
+				auto& key = root->add_subkey(L"Key" + std::to_wstring(i));
+				key.set_string(L"Name", L"Value " + std::to_wstring(i));
+				key.set_strings(L"List", { L"a", L"b" });
+			}
+			auto scan = [&root](std::pmr::memory_resource* strings)
+			{
+				size_t read = 0;
+				for (const auto& key : root->open().subkeys())
+				{
+					for (const auto& value : key.values())
+					{
+						read += value.type() == registry_value_type::string ? value.get_string(strings).size() : value.get_strings(strings).size();
+					}
+				}
+				return read;
+			};
+
+			// Keys, paths and values allocate from the resource in scope.
+			counting_resource direct;
+			size_t expected = 0;
+			{
+				arena_scope scope{ &direct };
+				expected = scan(&direct);
+			}
+			Assert::IsTrue(direct.allocations > 100);
+
+			// In an arena they take a handful of blocks from upstream instead, and give them all back in one reset.
+			counting_resource upstream;
+			scan_arena arena{ 4096, &upstream };
+			size_t read = 0;
+			{
+				arena_scope scope{ arena };
+				Assert::IsTrue(arena_scope::current() == arena.resource());
+				read = scan(arena.resource());
+			}
+			Assert::AreEqual(read, expected);
+			Assert::IsTrue(upstream.allocations > 0 && upstream.allocations < 20);
+			Assert::IsTrue(arena_scope::current() == std::pmr::get_default_resource());
+			arena.reset();
+
+			// The pmr getters allocate where they are told to, wherever the entry came from.
+			auto value = root->open().open_subkey(L"Key3").get_value(L"List");
+			auto strings = value->get_strings(arena.resource());
+			Assert::IsTrue(strings.get_allocator().resource() == arena.resource());
+			Assert::IsTrue(strings[1] == L"b");
+			Assert::IsTrue(strings[1].get_allocator().resource() == arena.resource());
+			Assert::IsTrue(root->open().open_subkey(L"Key3").get_value(L"Name")->get_string(arena.resource()) == L"Value 3");
+
+			// Caches and batches filled inside a scope keep nothing in its resource.
+			counting_resource scoped;
+			key_cache keys{ root->open(), 8 };
+			hash_cache hashes;
+			write_batch batch;
+			{
+				arena_scope scope{ &scoped };
+				keys.open(L"Key4");
+				subtree_hash(root->open(), diff_options{}, hashes);
+				batch.set_dword(L"Key5\\New", L"Value", 1);
+			}
+			Assert::IsTrue(scoped.allocations > 0);
+			Assert::AreEqual(scoped.deallocations, scoped.allocations);
+			Assert::AreEqual(keys.size(), size_t{ 1 });
+			Assert::AreEqual(hashes.size(), size_t{ 51 });
+			Assert::AreEqual(batch.size(), size_t{ 1 });
+		}
+
+		TEST_METHOD(HashedChildLookupTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& clsid = root->add_subkey(L"CLSID");
+			for (int i = 0; i < 1000; i++)
+			{
+				clsid.add_subkey(L"{Class" + std::to_wstring(i) + L"}").set_dword(L"Index", static_cast<uint32_t>(i));
+			}
+			clsid.add_subkey(L"\u00C4pfel");
+			clsid.add_subkey(L"\u0416\u0443\u043A");
+			auto captured = snapshot::capture(root->open());
+			auto key = captured->open().open_subkey(L"CLSID");
+			Assert::IsTrue(key.sub_key_count() >= child_index::min_children);
+
+			Assert::AreEqual(key.open_subkey(L"{CLASS123}").get_value(L"Index")->get_dword(), uint32_t{ 123 });
+			Assert::AreEqual(captured->open().open_subkey(L"clsid\\{class999}").get_value(L"Index")->get_dword(), uint32_t{ 999 });
+			Assert::IsFalse(key.try_open_subkey(L"{Class1000}").has_value());
+			// Case folding beyond ASCII, whatever the C locale.
+			Assert::IsTrue(key.try_open_subkey(L"\u00E4PFEL").has_value());
+			Assert::IsTrue(key.try_open_subkey(L"\u0436\u0423\u041A").has_value());
+			Assert::IsTrue(utf16::equals_ignore_case(L"\u03A3\u03B1", L"\u03C3\u0391"));
+			Assert::IsFalse(utf16::equals_ignore_case(L"\u0131", L"I"));
+			Assert::AreEqual(utf16::name_hash(L"\u00E4pfel"), utf16::name_hash(L"\u00C4PFEL"));
+
+			// Equality is by root and path, ignoring case, and never by name alone.
+			auto first = key.open_subkey(L"{Class5}");
+			Assert::IsTrue(first == first);
+			Assert::IsTrue(first == captured->open().open_subkey(L"CLSID\\{class5}"));
+			Assert::IsTrue(first != key.open_subkey(L"{Class6}"));
+			Assert::IsTrue(key == captured->open().open_subkey(L"clsid"));
+			Assert::IsTrue(first != snapshot::capture(root->open())->open().open_subkey(L"CLSID\\{Class5}"));
+			Assert::IsTrue(root->open().open_subkey(L"CLSID\\{Class5}") != first);
+		}
+
+		TEST_METHOD(ValueStreamTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			std::vector<uint8_t> blob(100000);
+			for (size_t i = 0; i < blob.size(); i++)
+			{
+				blob[i] = static_cast<uint8_t>(i * 7 + i / 251);
+			}
+			root->set_value(L"Blob", registry_value_type::binary, blob.data(), static_cast<uint32_t>(blob.size()));
+			root->set_dword(L"Small", 5);
+
+			for (const auto& key : { root->open(), snapshot::capture(root->open())->open() })
+			{
+				value_stream stream{ key, std::wstring{ L"blob" } };
+				Assert::IsTrue(stream.name() == L"Blob");
+				Assert::IsTrue(stream.type() == registry_value_type::binary);
+				Assert::AreEqual(stream.size(), static_cast<uint32_t>(blob.size()));
+				std::vector<uint8_t> read;
+				std::vector<uint8_t> chunk(4096);
+				while (size_t length = stream.read(chunk))
+				{
+					read.insert(read.end(), chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(length));
+				}
+				Assert::IsTrue(read == blob);
+
+				stream.seek(99990);
+				Assert::AreEqual(stream.read(chunk), size_t{ 10 });
+				Assert::AreEqual(chunk[9], blob[99999]);
+				Assert::AreEqual(stream.read(chunk), size_t{ 0 });
+			}
+
+			value_stream small{ root->open(), std::wstring{ L"Small" } };
+			uint32_t dword = 0;
+			Assert::AreEqual(small.read(std::span<uint8_t>{ reinterpret_cast<uint8_t*>(&dword), sizeof dword }), sizeof dword);
+			Assert::AreEqual(dword, uint32_t{ 5 });
+			Assert::ExpectException<registry_error>([&]() { value_stream{ root->open(), std::wstring{ L"Missing" } }; });
+		}
+
+		TEST_METHOD(HiveWriterTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			auto& software = root->add_subkey(L"Software");
+			software.set_key_class(L"Vendor class");
+			software.set_string(L"Name", L"Registry++");
+			software.set_strings(L"List", { L"One", L"Two" });
+			software.set_dword(L"Level", 7);
+			software.set_string(L"\u0416\u0443\u043A", L"\u00C4pfel");
+			std::vector<uint8_t> blob(50000);
+			for (size_t i = 0; i < blob.size(); i++)
+			{
+				blob[i] = static_cast<uint8_t>(i * 13 + i / 509);
+			}
+			software.set_value(L"Blob", registry_value_type::binary, blob.data(), static_cast<uint32_t>(blob.size()));
+			auto& clsid = root->add_subkey(L"CLSID");
+			for (int i = 0; i < 1200; i++)
+			{
+				clsid.add_subkey(L"{Class" + std::to_wstring(i) + L"}").set_dword(L"Index", static_cast<uint32_t>(i));
+			}
+			clsid.add_subkey(L"\u00C4pfel").add_subkey(L"\u0436\u0443\u043A");
+
+			auto path = std::filesystem::temp_directory_path() / L"RegistryPP.HiveWriterTest.hive";
+			write_hive(root->open(), path);
+			{
+				auto hive = hive_file::open(path);
+				Assert::AreEqual(hive->minor_version(), uint32_t{ 5 });
+				auto written = hive->root();
+				Assert::IsTrue(written.name() == L"ROOT");
+				Assert::IsTrue(diff(root->open(), written).empty());
+				Assert::IsTrue(written.open_subkey(L"Software").key_class() == L"Vendor class");
+				Assert::AreEqual(written.open_subkey(L"clsid\\{CLASS1150}").get_value(L"Index")->get_dword(), uint32_t{ 1150 });
+				Assert::IsTrue(written.try_open_subkey(L"CLSID\\\u00E4PFEL\\\u0416\u0423\u041A").has_value());
+
+				// Big data: a chunk that spans two segments.
+				value_stream stream{ written.open_subkey(L"Software"), std::wstring{ L"Blob" } };
+				std::vector<uint8_t> chunk(1000);
+				stream.seek(16000);
+				Assert::AreEqual(stream.read(chunk), chunk.size());
+				Assert::IsTrue(std::equal(chunk.begin(), chunk.end(), blob.begin() + 16000));
+			}
+			std::filesystem::remove(path);
+
+			hive_write_options old{ 3 };
+			std::stringstream stream;
+			write_hive(root->open(), stream, old);
+			Assert::AreEqual(stream.str().size() % 4096, size_t{ 0 });
+
+			// A source that reads values whole has each read once for the layout and twice for the data, not once per
+			// big data segment.
+			auto reads_left = std::make_shared<uint32_t>(3 * software.value_count());
+			auto whole = key_entry::from_backend(std::make_unique<failing_backend>(std::make_unique<memory_key_backend>(software.shared_from_this()), reads_left), L"Software");
+			std::stringstream whole_stream;
+			write_hive(whole, whole_stream);
+			Assert::IsTrue(whole_stream.str().find(std::string(reinterpret_cast<const char*>(blob.data()) + 20000, 1000)) != std::string::npos);
+
+			// A failed write leaves no file behind.
+			*reads_left = software.value_count();
+			auto failing = key_entry::from_backend(std::make_unique<failing_backend>(std::make_unique<memory_key_backend>(software.shared_from_this()), reads_left), L"Software");
+			Assert::ExpectException<registry_error>([&]() { write_hive(failing, path); });
+			Assert::IsFalse(std::filesystem::exists(path));
+		}
+
+		TEST_METHOD(HiveLogReplayTest)
+		{
+			using namespace hive_format;
+			auto root = memory_key::create(L"ROOT");
+			for (int i = 0; i < 300; i++)
+			{
+				root->add_subkey(L"Key" + std::to_wstring(i)).set_dword(L"Index", static_cast<uint32_t>(i));
+			}
+			auto hive_bytes = [&root]()
+			{
+				std::stringstream stream;
+				write_hive(root->open(), stream);
+				return stream.str();
+			};
+			// One log entry holding every page that differs between two versions of the hive.
+			auto log_entry_bytes = [](uint32_t sequence, const std::string& before, const std::string& after)
+			{
+				std::vector<std::pair<uint32_t, uint32_t>> pages;
+				for (size_t offset = base_block::size; offset < after.size(); offset += page_size)
+				{
+					if (offset >= before.size() || before.compare(offset, page_size, after, offset, page_size) != 0)
+					{
+						pages.emplace_back(static_cast<uint32_t>(offset - base_block::size), page_size);
+					}
+				}
+				size_t size = log_entry::dirty_pages + 8 * pages.size() + page_size * pages.size();
+				std::vector<uint8_t> entry((size + log_entry::alignment - 1) / log_entry::alignment * log_entry::alignment);
+				auto put = [&entry](size_t offset, auto value) { std::memcpy(entry.data() + offset, &value, sizeof value); };
+				std::memcpy(entry.data(), "HvLE", 4);
+				put(log_entry::size, static_cast<uint32_t>(entry.size()));
+				put(log_entry::sequence, sequence);
+				put(log_entry::hbins_size, static_cast<uint32_t>(after.size() - base_block::size));
+				put(log_entry::dirty_pages_count, static_cast<uint32_t>(pages.size()));
+				size_t data = log_entry::dirty_pages + 8 * pages.size();
+				for (size_t i = 0; i < pages.size(); i++)
+				{
+					put(log_entry::dirty_pages + 8 * i, pages[i].first);
+					put(log_entry::dirty_pages + 8 * i + 4, pages[i].second);
+					std::memcpy(entry.data() + data + page_size * i, after.data() + base_block::size + pages[i].first, page_size);
+				}
+				put(log_entry::data_hash, marvin32(entry.data() + log_entry::dirty_pages, entry.size() - log_entry::dirty_pages));
+				put(log_entry::header_hash, marvin32(entry.data(), 32));
+				return std::make_pair(entry, pages.size());
+			};
+
+			auto original = hive_bytes();
+			uint32_t seventy = 70;
+			root->open().open_subkey(L"Key7").set_value(L"Index", registry_value_type::dword, &seventy, sizeof seventy);
+			auto changed = hive_bytes();
+			for (int i = 300; i < 600; i++)
+			{
+				root->add_subkey(L"Key" + std::to_wstring(i)).set_dword(L"Index", static_cast<uint32_t>(i));
+			}
+			auto grown = hive_bytes();
+			auto [first, first_pages] = log_entry_bytes(1, original, changed);
+			auto [second, second_pages] = log_entry_bytes(2, changed, grown);
+			// Changing a value in place dirties one page.
+			Assert::AreEqual(first_pages, size_t{ 1 });
+
+			auto path = std::filesystem::temp_directory_path() / L"RegistryPP.HiveLogReplayTest.hive";
+			auto log_path = path;
+			log_path += L".LOG1";
+			auto write_file = [](const std::filesystem::path& file, const std::vector<std::span<const uint8_t>>& parts)
+			{
+				std::ofstream out{ file, std::ios::binary | std::ios::trunc };
+				for (auto part : parts)
+				{
+					out.write(reinterpret_cast<const char*>(part.data()), static_cast<std::streamsize>(part.size()));
+				}
+			};
+			std::span<const uint8_t> original_span{ reinterpret_cast<const uint8_t*>(original.data()), original.size() };
+			// The log's base block is the hive's after both entries.
+			std::vector<uint8_t> log_base(grown.begin(), grown.begin() + log_entry::first);
+			uint32_t sequence = 3;
+			std::memcpy(log_base.data() + base_block::primary_sequence, &sequence, 4);
+			std::memcpy(log_base.data() + base_block::secondary_sequence, &sequence, 4);
+			uint32_t checksum = base_block_checksum(log_base.data());
+			std::memcpy(log_base.data() + base_block::checksum, &checksum, 4);
+			write_file(path, { original_span });
+			write_file(log_path, { log_base, first, second });
+			{
+				auto hive = hive_file::open(path);
+				Assert::AreEqual(hive->replayed_pages(), first_pages + second_pages);
+				Assert::IsTrue(diff(root->open(), hive->root()).empty());
+				Assert::AreEqual(hive->root().open_subkey(L"Key7").get_value(L"Index")->get_dword(), uint32_t{ 70 });
+			}
+
+			// A torn entry ends the log; what came before it still applies.
+			second[second.size() - 1] ^= 1;
+			write_file(log_path, { log_base, first, second });
+			{
+				auto hive = hive_file::open(path);
+				Assert::AreEqual(hive->replayed_pages(), first_pages);
+				Assert::AreEqual(hive->root().open_subkey(L"Key7").get_value(L"Index")->get_dword(), uint32_t{ 70 });
+				Assert::IsFalse(hive->root().try_open_subkey(L"Key300").has_value());
+				Assert::AreEqual(hive_file::open(path, {})->root().open_subkey(L"Key7").get_value(L"Index")->get_dword(), uint32_t{ 7 });
+			}
+
+			// Without the entry numbered the hive's secondary sequence number, later ones do not apply.
+			second[second.size() - 1] ^= 1;
+			write_file(log_path, { log_base, second });
+			{
+				auto hive = hive_file::open(path);
+				Assert::AreEqual(hive->replayed_pages(), size_t{ 0 });
+				Assert::AreEqual(hive->root().open_subkey(L"Key7").get_value(L"Index")->get_dword(), uint32_t{ 7 });
+				Assert::IsFalse(hive->root().try_open_subkey(L"Key300").has_value());
+			}
+			std::filesystem::remove(log_path);
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(HiveIndexTest)
+		{
+			auto root = memory_key::create(L"ROOT");
+			for (int i = 0; i < 1500; i++)
+			{
+				auto& key = root->add_subkey(L"Key" + std::to_wstring(i));
+				key.set_string(L"Name", std::to_wstring(i));
+				for (int j = 0; j < i % 4; j++)
+				{
+					key.add_subkey(L"Child" + std::to_wstring(j));
+				}
+			}
+			std::vector<uint8_t> blob(40000, 7);
+			root->set_value(L"Blob", registry_value_type::binary, blob.data(), static_cast<uint32_t>(blob.size()));
+			auto path = std::filesystem::temp_directory_path() / L"RegistryPP.HiveIndexTest.hive";
+			write_hive(root->open(), path);
+			{
+				auto hive = hive_file::open(path);
+				std::vector<std::wstring> expected;
+				for (const auto& key : hive->root().subkeys())
+				{
+					expected.push_back(key.name());
+				}
+
+				auto single = hive_index::build(*hive, hive_index_options{ 1 });
+				auto parallel = hive_index::build(*hive, hive_index_options{ 8 });
+				for (auto kind : { hive_cell_kind::key, hive_cell_kind::value, hive_cell_kind::security, hive_cell_kind::sub_key_list, hive_cell_kind::big_data, hive_cell_kind::other })
+				{
+					Assert::IsTrue(std::ranges::equal(single->cells(kind), parallel->cells(kind)));
+				}
+				Assert::AreEqual(parallel->cells(hive_cell_kind::key).size(), size_t{ 1 + 1500 + 2250 });
+				Assert::AreEqual(parallel->cells(hive_cell_kind::value).size(), size_t{ 1501 });
+				Assert::AreEqual(parallel->cells(hive_cell_kind::security).size(), size_t{ 1 });
+				Assert::AreEqual(parallel->cells(hive_cell_kind::big_data).size(), size_t{ 1 });
+				// An ri list and its lh lists, and one list per key with children.
+				Assert::AreEqual(parallel->cells(hive_cell_kind::sub_key_list).size(), size_t{ 1 + 3 + 1125 });
+				Assert::AreEqual(parallel->children(hive->root_offset())->size(), size_t{ 1500 });
+				Assert::IsFalse(parallel->children(hive->root_offset() + 8).has_value());
+
+				Assert::IsTrue(hive->index() == nullptr);
+				hive->build_index();
+				Assert::IsTrue(hive->index() != nullptr);
+				std::vector<std::wstring> indexed;
+				for (const auto& key : hive->root().subkeys())
+				{
+					indexed.push_back(key.name());
+				}
+				Assert::IsTrue(indexed == expected);
+				Assert::AreEqual(hive->root().open_subkey(L"Key1499").sub_key_count(), uint32_t{ 3 });
+				Assert::IsTrue(diff(root->open(), hive->root()).empty());
+			}
+			std::filesystem::remove(path);
+		}
 	};
 }
@@ -0,0 +1,103 @@
+#include "async_range.h"
+#include "sub_key_range.h"
+#include "value_range.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	/** Adapts a single pass range to a source that returns one entry per call. */
+	template<typename Range, typename T>
+	std::function<std::optional<T>()> source_of(std::shared_ptr<Range> range)
+	{
+		return [range, started = false, it = decltype(range->begin()){}]() mutable -> std::optional<T>
+		{
+			if (!started)
+			{
+				it = range->begin();
+				started = true;
+			}
+			else
+			{
+				++it;
+			}
+			if (it == std::default_sentinel)
+			{
+				return std::nullopt;
+			}
+			return *it;
+		};
+	}
+}
+
+background_executor::background_executor(uint32_t threads) :
+	m_mutex(), m_changed(), m_work(), m_stopping(false), m_threads()
+{
+	if (threads == 0)
+	{
+		threads = (std::max)(1U, std::thread::hardware_concurrency());
+	}
+	m_threads.reserve(threads);
+	for (uint32_t i = 0; i < threads; i++)
+	{
+		m_threads.emplace_back([this] { run(); });
+	}
+}
+
+background_executor::~background_executor()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_stopping = true;
+	}
+	m_changed.notify_all();
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void background_executor::post(std::function<void()> work)
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_work.push_back(std::move(work));
+	}
+	m_changed.notify_one();
+}
+
+background_executor& background_executor::shared()
+{
+	// Never destroyed: joining threads while the process, or the DLL, is being torn down can deadlock.
+	static background_executor* executor = new background_executor{};
+	return *executor;
+}
+
+void background_executor::run()
+{
+	while (true)
+	{
+		std::function<void()> work;
+		{
+			std::unique_lock<std::mutex> lock{ m_mutex };
+			m_changed.wait(lock, [this] { return m_stopping || !m_work.empty(); });
+			if (m_work.empty())
+			{
+				return;
+			}
+			work = std::move(m_work.front());
+			m_work.pop_front();
+		}
+		work();
+	}
+}
+
+async_range<key_entry> win32::registry::subkeys_async(const key_entry& key, const async_options& options)
+{
+	return async_range<key_entry>{ source_of<sub_key_range, key_entry>(std::make_shared<sub_key_range>(key)), options };
+}
+
+async_range<value_entry> win32::registry::values_async(const key_entry& key, value_enumeration mode, const async_options& options)
+{
+	return async_range<value_entry>{ source_of<value_range, value_entry>(std::make_shared<value_range>(key, mode)), options };
+}
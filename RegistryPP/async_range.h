@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "key_entry.h"
+#include "value_entry.h"
+#include "value_entry_iterator.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A pool of threads that runs posted work in order of posting.
+	 *
+	 * Async ranges read from their backend and resume waiting coroutines on one. Work must not block waiting for
+	 * other work posted to the same executor.
+	 */
+	class DllExport background_executor
+	{
+	public:
+		/**
+		 * @brief Starts the threads.
+		 * @param threads The number of threads, or 0 for one per hardware thread.
+		 */
+		explicit background_executor(uint32_t threads = 0);
+
+		/**
+		 * @brief Runs the work already posted, then stops the threads.
+		 */
+		~background_executor();
+
+		background_executor(const background_executor&) = delete;
+		background_executor& operator=(const background_executor&) = delete;
+
+		/**
+		 * @brief Queues work to run on one of the threads.
+		 * @param work The work.
+		 */
+		void post(std::function<void()> work);
+
+		/**
+		 * @brief Gets the executor async ranges use unless told otherwise.
+		 * @return The executor. It lives until the process exits.
+		 */
+		static background_executor& shared();
+
+	private:
+		void run();
+
+		std::mutex m_mutex;
+		std::condition_variable m_changed;
+		std::deque<std::function<void()>> m_work;
+		bool m_stopping;
+		std::vector<std::thread> m_threads;
+	};
+
+	struct DllExport async_options
+	{
+		/** The most entries read ahead of the consumer. Reading pauses once this many are waiting. */
+		uint32_t prefetch = 16;
+		/** Where entries are read and waiting coroutines resumed; background_executor::shared() if not set. */
+		background_executor* executor = nullptr;
+	};
+
+	struct DllExport async_statistics
+	{
+		/** Entries read from the backend. */
+		uint64_t entries_read = 0;
+		/** Times the consumer asked for an entry before it was read. */
+		uint64_t consumer_waits = 0;
+		/** Times reading paused because the consumer had fallen prefetch entries behind. */
+		uint64_t producer_pauses = 0;
+	};
+
+	namespace detail
+	{
+		template<typename T>
+		struct async_state
+		{
+			std::mutex mutex;
+			std::condition_variable changed;
+			std::deque<T> buffer;
+			/** Reads the next entry; only ever called by one fill at a time. Reset to release the key once done. */
+			std::function<std::optional<T>()> source;
+			background_executor* executor = nullptr;
+			uint32_t capacity = 0;
+			/** A fill is queued or running. */
+			bool filling = false;
+			bool done = false;
+			bool cancelled = false;
+			std::exception_ptr error;
+			std::coroutine_handle<> waiter;
+			async_statistics statistics;
+
+			/** Queues a fill unless one is already pending. Call with the mutex held. */
+			bool start_fill()
+			{
+				if (filling || done || cancelled || buffer.size() >= capacity)
+				{
+					return false;
+				}
+				filling = true;
+				return true;
+			}
+
+			static void post_fill(const std::shared_ptr<async_state>& state)
+			{
+				state->executor->post([state] { fill(state); });
+			}
+
+			static void fill(const std::shared_ptr<async_state>& state)
+			{
+				std::function<std::optional<T>()> source;
+				{
+					std::lock_guard<std::mutex> lock{ state->mutex };
+					source = std::move(state->source);
+				}
+				while (true)
+				{
+					std::optional<T> item;
+					std::exception_ptr error;
+					if (source)
+					{
+						try
+						{
+							item = source();
+						}
+						catch (...)
+						{
+							error = std::current_exception();
+						}
+					}
+					std::coroutine_handle<> resume;
+					bool more = false;
+					{
+						std::lock_guard<std::mutex> lock{ state->mutex };
+						if (state->cancelled)
+						{
+							// Dropping the source here releases the key and the entry being read.
+							state->filling = false;
+							state->changed.notify_all();
+							return;
+						}
+						if (item)
+						{
+							state->buffer.push_back(std::move(*item));
+							state->statistics.entries_read++;
+							more = state->buffer.size() < state->capacity;
+							if (!more)
+							{
+								state->statistics.producer_pauses++;
+							}
+						}
+						else
+						{
+							state->error = error;
+							state->done = true;
+						}
+						// While more is set this fill keeps going, and consumers do not queue another one.
+						if (!more)
+						{
+							if (!state->done)
+							{
+								state->source = std::move(source);
+							}
+							state->filling = false;
+						}
+						resume = std::exchange(state->waiter, nullptr);
+						state->changed.notify_all();
+					}
+					if (resume)
+					{
+						state->executor->post([resume] { resume.resume(); });
+					}
+					if (!more)
+					{
+						return;
+					}
+				}
+			}
+		};
+	}
+
+	/**
+	 * @brief Entries of a key, read ahead on a background executor while the consumer works on earlier ones.
+	 *
+	 * Coroutines take entries with co_await range.next(), which suspends only if the next entry has not been read yet
+	 * and resumes on the executor once it has. Reading pauses when prefetch entries are waiting, and picks up again as
+	 * the consumer takes them, so a slow consumer never has more than prefetch entries (and their open keys) buffered.
+	 * Cancelling, or destroying, the range drops the buffered entries at once; an entry being read when that happens
+	 * is released as soon as the read returns.
+	 *
+	 * One consumer at a time.
+	 */
+	template<typename T>
+	class async_range
+	{
+	public:
+		class next_awaiter
+		{
+		public:
+			explicit next_awaiter(std::shared_ptr<detail::async_state<T>> state) :
+				m_state(std::move(state))
+			{
+			}
+
+			bool await_ready() const
+			{
+				std::lock_guard<std::mutex> lock{ m_state->mutex };
+				return !m_state->buffer.empty() || m_state->done || m_state->cancelled;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				bool fill = false;
+				{
+					std::lock_guard<std::mutex> lock{ m_state->mutex };
+					if (!m_state->buffer.empty() || m_state->done || m_state->cancelled)
+					{
+						return false;
+					}
+					m_state->statistics.consumer_waits++;
+					m_state->waiter = handle;
+					fill = m_state->start_fill();
+				}
+				if (fill)
+				{
+					detail::async_state<T>::post_fill(m_state);
+				}
+				return true;
+			}
+
+			/**
+			 * @return The next entry, or nothing once all were read or the range was cancelled.
+			 * @exception wil::ResultException
+			 * @exception registry_error
+			 */
+			std::optional<T> await_resume()
+			{
+				return take(m_state);
+			}
+
+		private:
+			std::shared_ptr<detail::async_state<T>> m_state;
+		};
+
+		/**
+		 * @brief Starts reading ahead.
+		 * @param source Reads the next entry, or returns nothing after the last one.
+		 * @param options How far and where to read ahead.
+		 */
+		async_range(std::function<std::optional<T>()> source, const async_options& options) :
+			m_state(std::make_shared<detail::async_state<T>>())
+		{
+			m_state->source = std::move(source);
+			m_state->executor = options.executor != nullptr ? options.executor : &background_executor::shared();
+			m_state->capacity = (std::max)(options.prefetch, 1U);
+			m_state->filling = true;
+			detail::async_state<T>::post_fill(m_state);
+		}
+
+		async_range(async_range&&) noexcept = default;
+		async_range& operator=(async_range&& other) noexcept
+		{
+			if (this != &other)
+			{
+				cancel();
+				m_state = std::move(other.m_state);
+			}
+			return *this;
+		}
+
+		async_range(const async_range&) = delete;
+		async_range& operator=(const async_range&) = delete;
+
+		~async_range()
+		{
+			cancel();
+		}
+
+		/**
+		 * @brief Takes the next entry, for co_await.
+		 * @return An awaitable whose result is the next entry, or nothing after the last one.
+		 */
+		next_awaiter next()
+		{
+			return next_awaiter{ m_state };
+		}
+
+		/**
+		 * @brief Takes the next entry, blocking until it was read. Must not be called from the executor's threads.
+		 * @return The next entry, or nothing after the last one.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		std::optional<T> next_blocking()
+		{
+			bool fill = false;
+			{
+				std::unique_lock<std::mutex> lock{ m_state->mutex };
+				if (m_state->buffer.empty() && !m_state->done && !m_state->cancelled)
+				{
+					m_state->statistics.consumer_waits++;
+					fill = m_state->start_fill();
+				}
+			}
+			if (fill)
+			{
+				detail::async_state<T>::post_fill(m_state);
+			}
+			{
+				std::unique_lock<std::mutex> lock{ m_state->mutex };
+				m_state->changed.wait(lock, [this] { return !m_state->buffer.empty() || m_state->done || m_state->cancelled; });
+			}
+			return take(m_state);
+		}
+
+		/**
+		 * @brief Stops reading and drops the buffered entries. A coroutine waiting in next() resumes with nothing.
+		 */
+		void cancel()
+		{
+			if (!m_state)
+			{
+				return;
+			}
+			std::deque<T> dropped;
+			std::function<std::optional<T>()> source;
+			std::coroutine_handle<> resume;
+			{
+				std::lock_guard<std::mutex> lock{ m_state->mutex };
+				if (m_state->cancelled)
+				{
+					return;
+				}
+				m_state->cancelled = true;
+				dropped.swap(m_state->buffer);
+				source = std::move(m_state->source);
+				resume = std::exchange(m_state->waiter, nullptr);
+				m_state->changed.notify_all();
+			}
+			if (resume)
+			{
+				m_state->executor->post([resume] { resume.resume(); });
+			}
+		}
+
+		/**
+		 * @brief Gets how reading and consuming overlapped so far.
+		 * @return The statistics.
+		 */
+		async_statistics statistics() const
+		{
+			std::lock_guard<std::mutex> lock{ m_state->mutex };
+			return m_state->statistics;
+		}
+
+	private:
+		static std::optional<T> take(const std::shared_ptr<detail::async_state<T>>& state)
+		{
+			std::optional<T> item;
+			bool fill = false;
+			{
+				std::lock_guard<std::mutex> lock{ state->mutex };
+				if (state->buffer.empty())
+				{
+					if (state->error && !state->cancelled)
+					{
+						std::rethrow_exception(std::exchange(state->error, nullptr));
+					}
+					return std::nullopt;
+				}
+				item.emplace(std::move(state->buffer.front()));
+				state->buffer.pop_front();
+				fill = state->start_fill();
+			}
+			if (fill)
+			{
+				detail::async_state<T>::post_fill(state);
+			}
+			return item;
+		}
+
+		std::shared_ptr<detail::async_state<T>> m_state;
+	};
+
+	/**
+	 * @brief Opens the sub keys of a key ahead of the consumer.
+	 * @param key The key.
+	 * @param options How far and where to read ahead.
+	 * @return The sub keys, in enumeration order.
+	 */
+	DllExport async_range<key_entry> subkeys_async(const key_entry& key, const async_options& options = {});
+
+	/**
+	 * @brief Reads the values of a key ahead of the consumer.
+	 * @param key The key.
+	 * @param mode Whether to read the data or only names and types.
+	 * @param options How far and where to read ahead.
+	 * @return The values, in enumeration order.
+	 */
+	DllExport async_range<value_entry> values_async(const key_entry& key, value_enumeration mode = value_enumeration::full, const async_options& options = {});
+}
@@ -0,0 +1,29 @@
+#include <algorithm>
+#include <bit>
+#include "child_index.h"
+
+using namespace win32::registry;
+
+child_index::child_index(const std::vector<entry>& entries) :
+	m_slots(), m_mask(0), m_shift(0), m_size(entries.size())
+{
+	// At most half full, so probe runs stay short.
+	size_t capacity = std::bit_ceil((std::max)(entries.size() * 2, size_t{ 2 }));
+	m_slots.assign(capacity, entry{ 0, empty });
+	m_mask = capacity - 1;
+	m_shift = 64 - static_cast<uint32_t>(std::countr_zero(capacity));
+	for (const auto& item : entries)
+	{
+		size_t slot = slot_of(item.hash);
+		while (m_slots[slot].location != empty)
+		{
+			slot = (slot + 1) & m_mask;
+		}
+		m_slots[slot] = item;
+	}
+}
+
+size_t child_index::size() const
+{
+	return m_size;
+}
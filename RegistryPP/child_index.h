@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "dll_export.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A hash table from the names of a key's sub keys to where each sub key is stored.
+	 *
+	 * Names are hashed with utf16::name_hash, the hash a hive's lh lists store, so hives fill the table without reading
+	 * a single name. Different names can share a hash, so lookups confirm candidates with a name comparison.
+	 */
+	class DllExport child_index
+	{
+	public:
+		/** Keys with fewer sub keys than this are searched directly; a table would not pay for itself. */
+		static constexpr uint32_t min_children = 64;
+
+		struct entry
+		{
+			/** The utf16::name_hash of the sub key's name. */
+			uint32_t hash;
+			/** Where the sub key is stored, e.g. the offset of its nk cell. */
+			uint32_t location;
+		};
+
+		/**
+		 * @brief Builds the table.
+		 * @param entries One entry per sub key.
+		 */
+		explicit child_index(const std::vector<entry>& entries);
+
+		/**
+		 * @brief Finds a sub key in constant expected time.
+		 * @param hash The utf16::name_hash of the name looked for.
+		 * @param matches Called with the location of each sub key with that hash; returns whether its name matches.
+		 * @return The location of the matching sub key, if any.
+		 */
+		template<typename Matches>
+		std::optional<uint32_t> find(uint32_t hash, Matches&& matches) const
+		{
+			for (size_t slot = slot_of(hash); m_slots[slot].location != empty; slot = (slot + 1) & m_mask)
+			{
+				if (m_slots[slot].hash == hash && matches(m_slots[slot].location))
+				{
+					return m_slots[slot].location;
+				}
+			}
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief Gets the number of sub keys in the table.
+		 * @return The number of sub keys.
+		 */
+		size_t size() const;
+
+	private:
+		static constexpr uint32_t empty = UINT32_MAX;
+
+		size_t slot_of(uint32_t hash) const
+		{
+			// The lh hash multiplies by 37 per character, which leaves its low bits poorly mixed.
+			return static_cast<size_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> m_shift);
+		}
+
+		std::vector<entry> m_slots;
+		size_t m_mask;
+		uint32_t m_shift;
+		size_t m_size;
+	};
+
+	/**
+	 * @brief The child indexes of one tree, built the first time a large key is searched by name.
+	 *
+	 * For immutable sources only: an index is never rebuilt. Safe to use from several threads.
+	 */
+	class DllExport child_index_cache
+	{
+	public:
+		child_index_cache() = default;
+
+		child_index_cache(const child_index_cache&) = delete;
+		child_index_cache& operator=(const child_index_cache&) = delete;
+
+		/**
+		 * @brief Gets the index of a key, building it if needed.
+		 * @param key Identifies the key within the tree.
+		 * @param build Returns the entries of the key's sub keys. Runs without the cache locked.
+		 * @return The index.
+		 */
+		template<typename Build>
+		std::shared_ptr<const child_index> get(uint32_t key, Build&& build)
+		{
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				auto it = m_indexes.find(key);
+				if (it != m_indexes.end())
+				{
+					return it->second;
+				}
+			}
+			auto index = std::make_shared<const child_index>(build());
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			// Another thread may have built the same index meanwhile; keep the first.
+			return m_indexes.emplace(key, std::move(index)).first->second;
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::unordered_map<uint32_t, std::shared_ptr<const child_index>> m_indexes;
+	};
+}
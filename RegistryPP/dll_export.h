@@ -0,0 +1,7 @@
+#pragma once
+
+#if defined(_WIN32) && defined(_DLL)
+#define DllExport __declspec( dllexport )
+#else
+#define DllExport
+#endif // _DLL
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <cstring>
+#include "hive_backend.h"
+#include "hive_format.h"
+#include "registry_error.h"
+#include "utf16.h"
+
+using namespace win32::registry;
+using namespace win32::registry::hive_format;
+
+static void read_name(const hive_cell& cell, size_t name_offset, uint16_t length, bool compressed, std::wstring& out)
+{
+	if (name_offset + length > cell.size)
+	{
+		throw registry_error{ registry_errc::corrupt, "Name extends past its cell." };
+	}
+	out.clear();
+	if (compressed)
+	{
+		utf16::append_latin1(out, cell.data + name_offset, length);
+	}
+	else
+	{
+		utf16::append(out, cell.data + name_offset, length / 2);
+	}
+}
+
+static value_view read_value_header(const hive_cell& value, value_buffer& buffer)
+{
+	read_name(value, vk::name, read<uint16_t>(value.data + vk::name_length), (read<uint16_t>(value.data + vk::flags) & vk::flag_compressed_name) != 0, buffer.name);
+	value_view view;
+	view.name = buffer.name;
+	view.type = static_cast<registry_value_type>(read<uint32_t>(value.data + vk::type));
+	uint32_t raw_size = read<uint32_t>(value.data + vk::data_size);
+	view.size = raw_size & ~vk::data_inline;
+	if ((raw_size & vk::data_inline) != 0)
+	{
+		// Up to 4 bytes are stored in the data offset field itself.
+		view.size = (std::min)(view.size, 4U);
+	}
+	return view;
+}
+
+static void read_key_name(const hive_cell& node, std::wstring& out)
+{
+	read_name(node, nk::name, read<uint16_t>(node.data + nk::name_length), (read<uint16_t>(node.data + nk::flags) & nk::flag_compressed_name) != 0, out);
+}
+
+hive_key_backend::hive_key_backend(std::shared_ptr<const hive_file> hive, uint32_t offset) :
+	m_hive(std::move(hive)), m_offset(offset)
+{
+}
+
+std::unique_ptr<key_backend> hive_key_backend::open_subkey(const std::wstring& name) const
+{
+	uint32_t current = m_offset;
+	size_t start = 0;
+	while (start <= name.size())
+	{
+		size_t end = name.find(L'\\', start);
+		if (end == std::wstring::npos)
+		{
+			end = name.size();
+		}
+		if (end > start)
+		{
+			auto found = find_subkey(current, std::wstring_view{ name }.substr(start, end - start));
+			if (!found)
+			{
+				throw registry_error{ registry_errc::not_found, "Sub key not found." };
+			}
+			current = *found;
+		}
+		start = end + 1;
+	}
+	return std::make_unique<hive_key_backend>(m_hive, current);
+}
+
+key_info hive_key_backend::query_info() const
+{
+	auto node = key_node();
+	key_info info;
+	info.sub_keys_count = read<uint32_t>(node.data + nk::sub_keys_count);
+	// Maximum lengths are stored in bytes; the upper bits of the sub key name length hold flags.
+	info.max_sub_key_name_length = (read<uint32_t>(node.data + nk::max_sub_key_name) & 0xFFFF) / 2;
+	info.max_class_length = read<uint32_t>(node.data + nk::max_class) / 2;
+	info.values_count = read<uint32_t>(node.data + nk::values_count);
+	info.max_value_name_length = read<uint32_t>(node.data + nk::max_value_name) / 2;
+	info.max_value_data_length = read<uint32_t>(node.data + nk::max_value_data);
+	info.last_written = filetime_to_time_point(read<uint64_t>(node.data + nk::last_written));
+	uint32_t class_offset = read<uint32_t>(node.data + nk::class_name);
+	uint16_t class_length = read<uint16_t>(node.data + nk::class_length);
+	if (class_offset != no_offset && class_length != 0)
+	{
+		auto class_cell = m_hive->cell(class_offset, class_length);
+		utf16::append(info.key_class, class_cell.data, class_length / 2);
+	}
+	return info;
+}
+
+std::wstring hive_key_backend::sub_key_name(uint32_t index) const
+{
+	auto node = key_node();
+	if (index >= read<uint32_t>(node.data + nk::sub_keys_count))
+	{
+		throw registry_error{ registry_errc::not_found, "No sub key at index." };
+	}
+	std::optional<std::span<const uint32_t>> children;
+	if (m_hive->index() != nullptr)
+	{
+		children = m_hive->index()->children(m_offset);
+	}
+	uint32_t offset = children && index < children->size() ? (*children)[index] : subkey_at(read<uint32_t>(node.data + nk::sub_keys_list), index);
+	auto sub_key = m_hive->cell(offset, nk::name);
+	std::wstring name;
+	read_key_name(sub_key, name);
+	return name;
+}
+
+value_view hive_key_backend::value_at(uint32_t index, value_buffer& buffer) const
+{
+	auto value = value_node(index);
+	auto view = read_value_header(value, buffer);
+	if (view.size == 0)
+	{
+		return view;
+	}
+	auto data = value_data(value, view.size);
+	if (data.data != nullptr)
+	{
+		view.data = data.data;
+		view.owner = m_hive;
+	}
+	else
+	{
+		// Big data is split over several cells; gather it once, into storage the entry can keep.
+		auto owned = std::make_shared<std::vector<uint8_t>>(view.size);
+		copy_big_data(data.segment_list, data.segments, 0, *owned);
+		view.data = owned->data();
+		view.owner = std::move(owned);
+	}
+	return view;
+}
+
+size_t hive_key_backend::read_value_data(uint32_t index, uint32_t offset, std::span<uint8_t> out, value_buffer&) const
+{
+	auto value = value_node(index);
+	uint32_t size = read<uint32_t>(value.data + vk::data_size) & ~vk::data_inline;
+	if ((read<uint32_t>(value.data + vk::data_size) & vk::data_inline) != 0)
+	{
+		size = (std::min)(size, 4U);
+	}
+	if (offset >= size)
+	{
+		return 0;
+	}
+	out = out.first((std::min)(out.size(), static_cast<size_t>(size - offset)));
+	auto data = value_data(value, size);
+	if (data.data != nullptr)
+	{
+		std::memcpy(out.data(), data.data + offset, out.size());
+	}
+	else
+	{
+		copy_big_data(data.segment_list, data.segments, offset, out);
+	}
+	return out.size();
+}
+
+bool hive_key_backend::reads_value_parts() const
+{
+	return true;
+}
+
+hive_key_backend::data_location hive_key_backend::value_data(const hive_cell& value, uint32_t size) const
+{
+	if ((read<uint32_t>(value.data + vk::data_size) & vk::data_inline) != 0)
+	{
+		// Up to 4 bytes are stored in the data offset field itself.
+		return data_location{ value.data + vk::data_offset, nullptr, 0 };
+	}
+	auto data = m_hive->cell(read<uint32_t>(value.data + vk::data_offset));
+	if (size > db::segment_size && m_hive->minor_version() >= db::min_minor_version && data.signature() == db::signature_value && data.size >= 8)
+	{
+		uint16_t segments = read<uint16_t>(data.data + db::segments_count);
+		auto segment_list = m_hive->cell(read<uint32_t>(data.data + db::segments_list), segments * 4U);
+		if (static_cast<uint64_t>(segments) * db::segment_size < size)
+		{
+			throw registry_error{ registry_errc::corrupt, "Big data segments are shorter than the value." };
+		}
+		return data_location{ nullptr, segment_list.data, segments };
+	}
+	if (size > data.size)
+	{
+		throw registry_error{ registry_errc::corrupt, "Value data extends past its cell." };
+	}
+	return data_location{ data.data, nullptr, 0 };
+}
+
+void hive_key_backend::copy_big_data(const uint8_t* segment_list, uint16_t segments, uint32_t offset, std::span<uint8_t> out) const
+{
+	// Every segment but the last holds exactly segment_size bytes, so the first one needed is found by division.
+	size_t copied = 0;
+	for (uint32_t i = offset / db::segment_size; i < segments && copied < out.size(); i++)
+	{
+		auto segment = m_hive->cell(read<uint32_t>(segment_list + 4 * static_cast<size_t>(i)));
+		uint32_t skip = copied == 0 ? offset % db::segment_size : 0;
+		uint32_t available = (std::min)(segment.size, db::segment_size);
+		if (skip >= available)
+		{
+			break;
+		}
+		size_t length = (std::min)(static_cast<size_t>(available - skip), out.size() - copied);
+		std::memcpy(out.data() + copied, segment.data + skip, length);
+		copied += length;
+	}
+	if (copied != out.size())
+	{
+		throw registry_error{ registry_errc::corrupt, "Big data segments are shorter than the value." };
+	}
+}
+
+value_view hive_key_backend::value_header_at(uint32_t index, value_buffer& buffer) const
+{
+	return read_value_header(value_node(index), buffer);
+}
+
+bool hive_key_backend::same_key(const key_backend& other) const
+{
+	auto rhs = dynamic_cast<const hive_key_backend*>(&other);
+	return rhs != nullptr && rhs->m_hive == m_hive && rhs->m_offset == m_offset;
+}
+
+std::wstring hive_key_backend::name() const
+{
+	std::wstring name;
+	read_key_name(key_node(), name);
+	return name;
+}
+
+uint32_t hive_key_backend::offset() const
+{
+	return m_offset;
+}
+
+hive_cell hive_key_backend::key_node() const
+{
+	auto node = m_hive->cell(m_offset, nk::name);
+	if (node.signature() != nk::signature_value)
+	{
+		throw registry_error{ registry_errc::corrupt, "Expected an nk cell." };
+	}
+	return node;
+}
+
+hive_cell hive_key_backend::value_node(uint32_t index) const
+{
+	auto node = key_node();
+	uint32_t count = read<uint32_t>(node.data + nk::values_count);
+	if (index >= count)
+	{
+		throw registry_error{ registry_errc::not_found, "No value at index." };
+	}
+	auto list = m_hive->cell(read<uint32_t>(node.data + nk::values_list), (index + 1) * 4);
+	auto value = m_hive->cell(read<uint32_t>(list.data + 4 * static_cast<size_t>(index)), vk::name);
+	if (value.signature() != vk::signature_value)
+	{
+		throw registry_error{ registry_errc::corrupt, "Expected a vk cell." };
+	}
+	return value;
+}
+
+std::optional<uint32_t> hive_key_backend::find_subkey(uint32_t parent, std::wstring_view name) const
+{
+	auto node = m_hive->cell(parent, nk::name);
+	uint32_t count = read<uint32_t>(node.data + nk::sub_keys_count);
+	if (count == 0)
+	{
+		return std::nullopt;
+	}
+	uint32_t list = read<uint32_t>(node.data + nk::sub_keys_list);
+	uint32_t hash = utf16::name_hash(name);
+	std::wstring scratch;
+	if (count < child_index::min_children)
+	{
+		return find_in_list(list, name, hash, scratch);
+	}
+	auto index = m_hive->child_indexes().get(parent, [&]
+	{
+		std::vector<child_index::entry> entries;
+		entries.reserve(count);
+		index_list(list, entries, scratch);
+		return entries;
+	});
+	return index->find(hash, [&](uint32_t offset)
+	{
+		read_key_name(m_hive->cell(offset, nk::name), scratch);
+		return utf16::equals_ignore_case(scratch, name);
+	});
+}
+
+std::optional<uint32_t> hive_key_backend::find_in_list(uint32_t list_offset, std::wstring_view name, uint32_t hash, std::wstring& scratch, bool nested) const
+{
+	auto list = m_hive->cell(list_offset, list::elements);
+	uint16_t signature = list.signature();
+	uint16_t count = read<uint16_t>(list.data + list::count);
+	size_t stride = (signature == list::lf || signature == list::lh) ? 8 : 4;
+	if (signature != list::li && signature != list::lf && signature != list::lh && signature != list::ri)
+	{
+		throw registry_error{ registry_errc::corrupt, "Unknown sub key list." };
+	}
+	if (signature == list::ri && nested)
+	{
+		throw registry_error{ registry_errc::corrupt, "An ri list refers to another ri list." };
+	}
+	if (list::elements + count * stride > list.size)
+	{
+		throw registry_error{ registry_errc::corrupt, "Sub key list extends past its cell." };
+	}
+	for (uint16_t i = 0; i < count; i++)
+	{
+		const uint8_t* element = list.data + list::elements + i * stride;
+		uint32_t offset = read<uint32_t>(element);
+		if (signature == list::ri)
+		{
+			if (auto found = find_in_list(offset, name, hash, scratch, true))
+			{
+				return found;
+			}
+			continue;
+		}
+		if (signature == list::lh && read<uint32_t>(element + 4) != hash)
+		{
+			continue;
+		}
+		read_key_name(m_hive->cell(offset, nk::name), scratch);
+		if (utf16::equals_ignore_case(scratch, name))
+		{
+			return offset;
+		}
+	}
+	return std::nullopt;
+}
+
+void hive_key_backend::index_list(uint32_t list_offset, std::vector<child_index::entry>& entries, std::wstring& scratch, bool nested) const
+{
+	auto list = m_hive->cell(list_offset, list::elements);
+	uint16_t signature = list.signature();
+	uint16_t count = read<uint16_t>(list.data + list::count);
+	size_t stride = (signature == list::lf || signature == list::lh) ? 8 : 4;
+	if (signature != list::li && signature != list::lf && signature != list::lh && signature != list::ri)
+	{
+		throw registry_error{ registry_errc::corrupt, "Unknown sub key list." };
+	}
+	if (signature == list::ri && nested)
+	{
+		throw registry_error{ registry_errc::corrupt, "An ri list refers to another ri list." };
+	}
+	if (list::elements + count * stride > list.size)
+	{
+		throw registry_error{ registry_errc::corrupt, "Sub key list extends past its cell." };
+	}
+	for (uint16_t i = 0; i < count; i++)
+	{
+		const uint8_t* element = list.data + list::elements + i * stride;
+		uint32_t offset = read<uint32_t>(element);
+		if (signature == list::ri)
+		{
+			index_list(offset, entries, scratch, true);
+		}
+		else if (signature == list::lh)
+		{
+			entries.push_back(child_index::entry{ read<uint32_t>(element + 4), offset });
+		}
+		else
+		{
+			read_key_name(m_hive->cell(offset, nk::name), scratch);
+			entries.push_back(child_index::entry{ utf16::name_hash(scratch), offset });
+		}
+	}
+}
+
+uint32_t hive_key_backend::subkey_at(uint32_t list_offset, uint32_t index, bool nested) const
+{
+	auto list = m_hive->cell(list_offset, list::elements);
+	uint16_t signature = list.signature();
+	uint16_t count = read<uint16_t>(list.data + list::count);
+	size_t stride = (signature == list::lf || signature == list::lh) ? 8 : 4;
+	if (signature == list::ri && nested)
+	{
+		throw registry_error{ registry_errc::corrupt, "An ri list refers to another ri list." };
+	}
+	if (list::elements + count * stride > list.size)
+	{
+		throw registry_error{ registry_errc::corrupt, "Sub key list extends past its cell." };
+	}
+	if (signature == list::ri)
+	{
+		for (uint16_t i = 0; i < count; i++)
+		{
+			uint32_t sub_list = read<uint32_t>(list.data + list::elements + i * stride);
+			uint16_t sub_count = read<uint16_t>(m_hive->cell(sub_list, list::elements).data + list::count);
+			if (index < sub_count)
+			{
+				return subkey_at(sub_list, index, true);
+			}
+			index -= sub_count;
+		}
+	}
+	else if (signature == list::li || signature == list::lf || signature == list::lh)
+	{
+		if (index < count)
+		{
+			return read<uint32_t>(list.data + list::elements + index * stride);
+		}
+	}
+	else
+	{
+		throw registry_error{ registry_errc::corrupt, "Unknown sub key list." };
+	}
+	throw registry_error{ registry_errc::corrupt, "Sub key list is shorter than the key's sub key count." };
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <optional>
+#include "hive_file.h"
+#include "key_backend.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Backend for keys of an offline hive file, reading nk/vk/lf/lh/li/ri cells in place.
+	 */
+	class DllExport hive_key_backend final : public key_backend
+	{
+	public:
+		/**
+		 * @brief Creates a backend for a key node.
+		 * @param hive The hive holding the key.
+		 * @param offset The offset of the key's nk cell.
+		 */
+		explicit hive_key_backend(std::shared_ptr<const hive_file> hive, uint32_t offset);
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override;
+		key_info query_info() const override;
+		std::wstring sub_key_name(uint32_t index) const override;
+		value_view value_at(uint32_t index, value_buffer& buffer) const override;
+		value_view value_header_at(uint32_t index, value_buffer& buffer) const override;
+		size_t read_value_data(uint32_t index, uint32_t offset, std::span<uint8_t> out, value_buffer& buffer) const override;
+		bool reads_value_parts() const override;
+		bool same_key(const key_backend& other) const override;
+
+		/**
+		 * @brief Gets the name stored in the key's nk cell.
+		 * @return The name of the key.
+		 */
+		std::wstring name() const;
+
+		/**
+		 * @brief Gets the offset of the key's nk cell.
+		 * @return The offset of the key's nk cell.
+		 */
+		uint32_t offset() const;
+
+	private:
+		/** Where a value's data lives: in one place, or split over the big data segments of a db cell. */
+		struct data_location
+		{
+			const uint8_t* data;
+			const uint8_t* segment_list;
+			uint16_t segments;
+		};
+
+		hive_cell key_node() const;
+		hive_cell value_node(uint32_t index) const;
+
+		std::optional<uint32_t> find_subkey(uint32_t parent, std::wstring_view name) const;
+
+		/** An ri list may only refer to li, lf and lh lists; nested is set when following one, and another ri is corrupt. */
+		std::optional<uint32_t> find_in_list(uint32_t list, std::wstring_view name, uint32_t hash, std::wstring& scratch, bool nested = false) const;
+
+		/** Adds the hashes and nk offsets of the sub keys in a list, taking the hashes from lh lists where there are any. Rejects nested ri lists like find_in_list. */
+		void index_list(uint32_t list, std::vector<child_index::entry>& entries, std::wstring& scratch, bool nested = false) const;
+
+		uint32_t subkey_at(uint32_t list, uint32_t index, bool nested = false) const;
+
+		data_location value_data(const hive_cell& value, uint32_t size) const;
+
+		/** Copies out.size() bytes of big data, starting offset bytes in, reading only the segments that hold them. */
+		void copy_big_data(const uint8_t* segment_list, uint16_t segments, uint32_t offset, std::span<uint8_t> out) const;
+
+		std::shared_ptr<const hive_file> m_hive;
+		uint32_t m_offset;
+	};
+}
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <system_error>
+#include "hive_file.h"
+#include "hive_backend.h"
+#include "hive_format.h"
+#include "hive_log.h"
+#include "registry_error.h"
+
+using namespace win32::registry;
+
+uint16_t hive_cell::signature() const
+{
+	return size >= 2 ? hive_format::read<uint16_t>(data) : 0;
+}
+
+std::shared_ptr<hive_file> hive_file::open(const std::filesystem::path& path)
+{
+	std::vector<std::filesystem::path> logs;
+	for (const char* extension : { ".LOG1", ".LOG2" })
+	{
+		auto log = path;
+		log += extension;
+		std::error_code error;
+		if (std::filesystem::is_regular_file(log, error))
+		{
+			logs.push_back(std::move(log));
+		}
+	}
+	return open(path, logs);
+}
+
+std::shared_ptr<hive_file> hive_file::open(const std::filesystem::path& path, const std::vector<std::filesystem::path>& logs)
+{
+	return std::shared_ptr<hive_file>{ new hive_file{ path, logs } };
+}
+
+hive_file::hive_file(const std::filesystem::path& path, const std::vector<std::filesystem::path>& logs) :
+	m_file(path), m_hbins(nullptr), m_hbins_size(0), m_root(0), m_minor_version(0), m_file_hbins_size(0), m_overlay(),
+	m_replayed_pages(0), m_child_indexes(), m_index_mutex(), m_index(), m_index_view(nullptr)
+{
+	using namespace hive_format;
+
+	const uint8_t* base = m_file.data();
+	if (m_file.size() < base_block::size || std::memcmp(base + base_block::signature, "regf", 4) != 0)
+	{
+		throw registry_error{ registry_errc::corrupt, "Not a registry hive file." };
+	}
+	if (read<uint32_t>(base + base_block::major_version) != 1)
+	{
+		throw registry_error{ registry_errc::corrupt, "Unsupported hive format version." };
+	}
+	m_minor_version = read<uint32_t>(base + base_block::minor_version);
+	m_root = read<uint32_t>(base + base_block::root_cell);
+	m_hbins = base + base_block::size;
+	m_hbins_size = read<uint32_t>(base + base_block::hbins_size);
+	// Truncated copies are common; read whatever is there.
+	m_file_hbins_size = static_cast<uint32_t>((std::min)(static_cast<size_t>(m_hbins_size), m_file.size() - base_block::size));
+	if (!logs.empty())
+	{
+		replay(logs);
+	}
+	if (m_overlay.empty())
+	{
+		m_hbins_size = m_file_hbins_size;
+	}
+}
+
+void hive_file::replay(const std::vector<std::filesystem::path>& paths)
+{
+	using namespace hive_format;
+
+	std::vector<std::unique_ptr<hive_log>> logs;
+	for (const auto& path : paths)
+	{
+		logs.push_back(std::make_unique<hive_log>(path));
+	}
+	// Entries older than the hive's last complete write are already in it.
+	uint32_t next = read<uint32_t>(m_file.data() + base_block::secondary_sequence);
+	std::map<uint32_t, std::pair<const hive_log::entry*, const hive_log*>> entries;
+	for (const auto& log : logs)
+	{
+		for (const auto& entry : log->entries())
+		{
+			if (entry.sequence >= next)
+			{
+				entries.emplace(entry.sequence, std::make_pair(&entry, log.get()));
+			}
+		}
+	}
+
+	// Only an unbroken run starting at the secondary sequence number is replayed; later entries with an earlier one
+	// missing would be applied over pages they never saw.
+	const hive_log* last = nullptr;
+	for (auto it = entries.find(next); it != entries.end() && it->first == next; ++it)
+	{
+		const auto& entry = *it->second.first;
+		m_hbins_size = entry.hbins_size;
+		for (const auto& page : entry.pages)
+		{
+			apply_page(page.offset, page.data);
+			m_replayed_pages++;
+		}
+		next = it->first + 1;
+		last = it->second.second;
+	}
+
+	// A log's base block is the hive's after the log's entries, when its sequence number follows theirs.
+	const uint8_t* base = last != nullptr ? last->base_block() : nullptr;
+	if (base != nullptr && read<uint32_t>(base + base_block::primary_sequence) == next)
+	{
+		m_root = read<uint32_t>(base + base_block::root_cell);
+		m_minor_version = read<uint32_t>(base + base_block::minor_version);
+	}
+}
+
+void hive_file::apply_page(uint32_t offset, std::span<const uint8_t> data)
+{
+	if (data.empty())
+	{
+		return;
+	}
+	uint32_t end = offset + static_cast<uint32_t>(data.size());
+	cover(offset, end);
+	auto block = std::prev(m_overlay.upper_bound(offset));
+	std::memcpy(block->second.data() + (offset - block->first), data.data(), data.size());
+	// Cells never cross an hbin, so a replayed region always holds whole hbins and a cell is either all replayed
+	// or all in the file. This reads the page just applied, which may be a new hbin's header.
+	cover(hbin_start(offset), hbin_end(end));
+}
+
+void hive_file::cover(uint32_t begin, uint32_t end)
+{
+	using namespace hive_format;
+
+	begin -= begin % page_size;
+	end = static_cast<uint32_t>((std::min<uint64_t>)((static_cast<uint64_t>(end) + page_size - 1) / page_size * page_size, m_hbins_size));
+	if (begin >= end)
+	{
+		return;
+	}
+	auto first = m_overlay.upper_bound(begin);
+	if (first != m_overlay.begin() && std::prev(first)->first + std::prev(first)->second.size() > begin)
+	{
+		--first;
+	}
+	auto last = first;
+	while (last != m_overlay.end() && last->first < end)
+	{
+		++last;
+	}
+	if (first != last && first->first <= begin && first->first + first->second.size() >= end)
+	{
+		// Already covered.
+		return;
+	}
+
+	// Merge the overlapping regions and the file around them into one.
+	if (first != last)
+	{
+		begin = (std::min)(begin, first->first);
+		auto back = std::prev(last);
+		end = (std::max)(end, static_cast<uint32_t>(back->first + back->second.size()));
+	}
+	std::vector<uint8_t> region(end - begin, 0);
+	if (begin < m_file_hbins_size)
+	{
+		std::memcpy(region.data(), m_hbins + begin, (std::min)(end, m_file_hbins_size) - begin);
+	}
+	for (auto it = first; it != last; ++it)
+	{
+		std::memcpy(region.data() + (it->first - begin), it->second.data(), it->second.size());
+	}
+	m_overlay.erase(first, last);
+	m_overlay.emplace(begin, std::move(region));
+}
+
+uint32_t hive_file::hbin_start(uint32_t offset) const
+{
+	using namespace hive_format;
+
+	for (uint32_t page = offset - offset % page_size;; page -= page_size)
+	{
+		uint32_t available = 0;
+		const uint8_t* header = at(page, available);
+		if (header != nullptr && available >= hbin::header_size && std::memcmp(header + hbin::signature, "hbin", 4) == 0 &&
+			read<uint32_t>(header + hbin::offset) == page)
+		{
+			return page;
+		}
+		if (page == 0)
+		{
+			return offset - offset % page_size;
+		}
+	}
+}
+
+uint32_t hive_file::hbin_end(uint32_t offset) const
+{
+	using namespace hive_format;
+
+	if (offset == 0)
+	{
+		return 0;
+	}
+	uint32_t start = hbin_start(offset - 1);
+	uint32_t available = 0;
+	const uint8_t* header = at(start, available);
+	if (header != nullptr && available >= hbin::header_size && std::memcmp(header + hbin::signature, "hbin", 4) == 0)
+	{
+		uint32_t size = read<uint32_t>(header + hbin::size);
+		if (size != 0 && size % page_size == 0 && size <= m_hbins_size - start && start + size >= offset)
+		{
+			return start + size;
+		}
+	}
+	return offset;
+}
+
+key_entry hive_file::root() const
+{
+	auto backend = std::make_unique<hive_key_backend>(shared_from_this(), m_root);
+	std::wstring name = backend->name();
+	return key_entry::from_backend(std::move(backend), name);
+}
+
+uint32_t hive_file::root_offset() const
+{
+	return m_root;
+}
+
+uint32_t hive_file::minor_version() const
+{
+	return m_minor_version;
+}
+
+hive_cell hive_file::cell(uint32_t offset) const
+{
+	uint32_t available = 0;
+	const uint8_t* cell = at(offset, available);
+	if (cell == nullptr || available < 4)
+	{
+		throw registry_error{ registry_errc::corrupt, "Cell offset out of bounds." };
+	}
+	int32_t raw_size = hive_format::read<int32_t>(cell);
+	// Allocated cells have a negative size; free cells should never be referenced but are tolerated.
+	uint32_t size = raw_size < 0 ? static_cast<uint32_t>(-static_cast<int64_t>(raw_size)) : static_cast<uint32_t>(raw_size);
+	if (size < 4 || size > available)
+	{
+		throw registry_error{ registry_errc::corrupt, "Cell size out of bounds." };
+	}
+	return hive_cell{ cell + 4, size - 4 };
+}
+
+const uint8_t* hive_file::at(uint32_t offset, uint32_t& available) const
+{
+	if (offset == hive_format::no_offset || offset >= m_hbins_size)
+	{
+		return nullptr;
+	}
+	if (m_overlay.empty())
+	{
+		available = m_file_hbins_size - offset;
+		return offset < m_file_hbins_size ? m_hbins + offset : nullptr;
+	}
+	auto next = m_overlay.upper_bound(offset);
+	if (next != m_overlay.begin())
+	{
+		auto block = std::prev(next);
+		if (offset - block->first < block->second.size())
+		{
+			available = static_cast<uint32_t>(block->second.size() - (offset - block->first));
+			return block->second.data() + (offset - block->first);
+		}
+	}
+	uint32_t end = next == m_overlay.end() ? m_file_hbins_size : (std::min)(next->first, m_file_hbins_size);
+	if (offset >= end)
+	{
+		return nullptr;
+	}
+	available = end - offset;
+	return m_hbins + offset;
+}
+
+hive_cell hive_file::cell(uint32_t offset, uint32_t required) const
+{
+	auto result = cell(offset);
+	if (result.size < required)
+	{
+		throw registry_error{ registry_errc::corrupt, "Cell too small." };
+	}
+	return result;
+}
+
+child_index_cache& hive_file::child_indexes() const
+{
+	return m_child_indexes;
+}
+
+size_t hive_file::replayed_pages() const
+{
+	return m_replayed_pages;
+}
+
+std::shared_ptr<const hive_index> hive_file::build_index(const hive_index_options& options) const
+{
+	std::lock_guard<std::mutex> lock{ m_index_mutex };
+	if (!m_index)
+	{
+		m_index = hive_index::build(*this, options);
+		m_index_view.store(m_index.get(), std::memory_order_release);
+	}
+	return m_index;
+}
+
+const hive_index* hive_file::index() const
+{
+	return m_index_view.load(std::memory_order_acquire);
+}
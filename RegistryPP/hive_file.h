@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include "child_index.h"
+#include "hive_index.h"
+#include "key_entry.h"
+#include "mapped_file.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A cell of a hive file, referring directly into the mapped file.
+	 */
+	struct DllExport hive_cell
+	{
+		/** The cell's payload, just past its size field. */
+		const uint8_t* data;
+		/** The size of the payload in bytes. */
+		uint32_t size;
+
+		/**
+		 * @brief Gets the 2 character signature at the start of the payload.
+		 * @return The signature, or 0 if the payload is too small to hold one.
+		 */
+		uint16_t signature() const;
+	};
+
+	/**
+	 * @brief An offline registry hive file (SYSTEM, SOFTWARE, NTUSER.DAT, ...).
+	 *
+	 * The file is mapped into memory once and its cells are read in place; nothing is copied until a caller asks for
+	 * owned strings or byte vectors. The only exception is the hbins that replayed transaction logs changed.
+	 */
+	class DllExport hive_file : public std::enable_shared_from_this<hive_file>
+	{
+	public:
+		/**
+		 * @brief Opens a hive file, replaying the transaction logs next to it (path.LOG1 and path.LOG2) if there are any.
+		 * @param path The path of the hive file.
+		 * @return The hive file.
+		 * @exception std::system_error
+		 * @exception registry_error
+		 */
+		static std::shared_ptr<hive_file> open(const std::filesystem::path& path);
+
+		/**
+		 * @brief Opens a hive file and replays transaction logs onto it.
+		 *
+		 * Log entries are applied in sequence, from whichever log holds each, starting with the one numbered the hive's
+		 * secondary sequence number and stopping at the first one missing or failing its hashes; if the first is
+		 * missing nothing is replayed. The file itself is never written: replayed pages go to an
+		 * overlay over the mapped file, covering only the hbins they touch, so replay costs time and memory in
+		 * proportion to the dirty pages rather than the size of the hive.
+		 * @param path The path of the hive file.
+		 * @param logs The paths of the logs, typically .LOG1 and .LOG2.
+		 * @return The hive file.
+		 * @exception std::system_error
+		 * @exception registry_error
+		 */
+		static std::shared_ptr<hive_file> open(const std::filesystem::path& path, const std::vector<std::filesystem::path>& logs);
+
+		/**
+		 * @brief Gets the root key of the hive.
+		 * @return The root key of the hive.
+		 * @exception registry_error
+		 */
+		key_entry root() const;
+
+		/**
+		 * @brief Gets the offset of the root key's cell.
+		 * @return The offset of the root key's cell.
+		 */
+		uint32_t root_offset() const;
+
+		/**
+		 * @brief Gets the minor version of the hive format.
+		 * @return The minor version of the hive format.
+		 */
+		uint32_t minor_version() const;
+
+		/**
+		 * @brief Gets a cell.
+		 * @param offset The offset of the cell, relative to the first hbin.
+		 * @return The cell.
+		 * @exception registry_error if the offset or the cell's size is out of bounds.
+		 */
+		hive_cell cell(uint32_t offset) const;
+
+		/**
+		 * @brief Gets a cell that must be at least a given size.
+		 * @param offset The offset of the cell, relative to the first hbin.
+		 * @param required The minimum size of the payload.
+		 * @return The cell.
+		 * @exception registry_error if the cell is out of bounds or too small.
+		 */
+		hive_cell cell(uint32_t offset, uint32_t required) const;
+
+		/**
+		 * @brief Gets the sub key indexes built for large keys of the hive so far.
+		 * @return The indexes, by the offset of the key's nk cell.
+		 */
+		child_index_cache& child_indexes() const;
+
+		/**
+		 * @brief Gets the number of dirty pages replayed from transaction logs when the hive was opened.
+		 * @return The number of pages, 0 if the hive was clean.
+		 */
+		size_t replayed_pages() const;
+
+		/**
+		 * @brief Indexes the hive, so keys opened from it from then on enumerate their sub keys from the index.
+		 *
+		 * Worth it before reading most of a large hive: the index is built with several threads and keeps the sub keys
+		 * of every key in one array. Building it again does nothing.
+		 * @param options How to index the hive.
+		 * @return The index.
+		 */
+		std::shared_ptr<const hive_index> build_index(const hive_index_options& options = {}) const;
+
+		/**
+		 * @brief Gets the index of the hive.
+		 * @return The index, or nullptr if build_index has not been called.
+		 */
+		const hive_index* index() const;
+
+	private:
+		friend class hive_index;
+
+		hive_file(const std::filesystem::path& path, const std::vector<std::filesystem::path>& logs);
+
+		/**
+		 * @brief Finds the bytes at an offset, in the overlay or in the mapped file.
+		 * @param offset The offset, relative to the first hbin.
+		 * @param available Receives how many bytes can be read from there.
+		 * @return The bytes, or nullptr if the offset is out of bounds.
+		 */
+		const uint8_t* at(uint32_t offset, uint32_t& available) const;
+
+		void replay(const std::vector<std::filesystem::path>& logs);
+		void apply_page(uint32_t offset, std::span<const uint8_t> data);
+		void cover(uint32_t begin, uint32_t end);
+		uint32_t hbin_start(uint32_t offset) const;
+		uint32_t hbin_end(uint32_t offset) const;
+
+		mapped_file m_file;
+		const uint8_t* m_hbins;
+		uint32_t m_hbins_size;
+		uint32_t m_root;
+		uint32_t m_minor_version;
+		/** How much of the hbins the mapped file holds. */
+		uint32_t m_file_hbins_size;
+		/** Replayed hbins, by their offset; each a whole number of hbins that replaces the file's. */
+		std::map<uint32_t, std::vector<uint8_t>> m_overlay;
+		size_t m_replayed_pages;
+		mutable child_index_cache m_child_indexes;
+		mutable std::mutex m_index_mutex;
+		mutable std::shared_ptr<const hive_index> m_index;
+		/** m_index, readable without the lock once set. */
+		mutable std::atomic<const hive_index*> m_index_view;
+	};
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Layout of the Windows registry hive file format (regf).
+ *
+ * Offsets inside a cell are relative to the start of the cell's payload, i.e. just past its 4 byte size field. Cell
+ * offsets stored in the hive are relative to the start of the first hbin, which follows the base block.
+ */
+namespace win32::registry::hive_format
+{
+	/**
+	 * @brief Reads a little-endian integer from an unaligned location.
+	 */
+	template <typename T>
+	inline T read(const uint8_t* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof value);
+		return value;
+	}
+
+	/**
+	 * @brief Builds the 16 bit signature stored at the start of a cell.
+	 */
+	constexpr uint16_t signature(char a, char b)
+	{
+		return static_cast<uint16_t>(static_cast<uint8_t>(a) | (static_cast<uint8_t>(b) << 8));
+	}
+
+	constexpr uint32_t no_offset = 0xFFFFFFFF;
+	constexpr uint32_t page_size = 4096;
+
+	namespace base_block
+	{
+		constexpr uint32_t size = 4096;
+		constexpr size_t signature = 0;
+		constexpr size_t primary_sequence = 4;
+		constexpr size_t secondary_sequence = 8;
+		constexpr size_t last_written = 12;
+		constexpr size_t major_version = 20;
+		constexpr size_t minor_version = 24;
+		constexpr size_t file_type = 28;
+		constexpr size_t file_format = 32;
+		constexpr size_t root_cell = 36;
+		constexpr size_t hbins_size = 40;
+		constexpr size_t clustering_factor = 44;
+		constexpr size_t file_name = 48;
+		constexpr size_t file_name_size = 64;
+		constexpr size_t checksum = 508;
+	}
+
+	/**
+	 * @brief The checksum of a base block: the XOR of its first 127 double words, avoiding 0 and 0xFFFFFFFF.
+	 */
+	inline uint32_t base_block_checksum(const uint8_t* base)
+	{
+		uint32_t sum = 0;
+		for (size_t i = 0; i < base_block::checksum; i += 4)
+		{
+			sum ^= read<uint32_t>(base + i);
+		}
+		if (sum == 0xFFFFFFFF)
+		{
+			return 0xFFFFFFFE;
+		}
+		return sum == 0 ? 1 : sum;
+	}
+
+	namespace hbin
+	{
+		constexpr size_t header_size = 32;
+		constexpr size_t signature = 0;
+		constexpr size_t offset = 4;
+		constexpr size_t size = 8;
+		constexpr size_t timestamp = 20;
+	}
+
+	namespace nk
+	{
+		constexpr uint16_t signature_value = signature('n', 'k');
+		constexpr uint16_t flag_hive_exit = 0x0002;
+		constexpr uint16_t flag_hive_entry = 0x0004;
+		constexpr uint16_t flag_no_delete = 0x0008;
+		constexpr uint16_t flag_compressed_name = 0x0020;
+		constexpr size_t flags = 2;
+		constexpr size_t last_written = 4;
+		constexpr size_t parent = 16;
+		constexpr size_t sub_keys_count = 20;
+		constexpr size_t volatile_sub_keys_count = 24;
+		constexpr size_t sub_keys_list = 28;
+		constexpr size_t volatile_sub_keys_list = 32;
+		constexpr size_t values_count = 36;
+		constexpr size_t values_list = 40;
+		constexpr size_t security = 44;
+		constexpr size_t class_name = 48;
+		constexpr size_t max_sub_key_name = 52;
+		constexpr size_t max_class = 56;
+		constexpr size_t max_value_name = 60;
+		constexpr size_t max_value_data = 64;
+		constexpr size_t name_length = 72;
+		constexpr size_t class_length = 74;
+		constexpr size_t name = 76;
+	}
+
+	namespace vk
+	{
+		constexpr uint16_t signature_value = signature('v', 'k');
+		constexpr uint16_t flag_compressed_name = 0x0001;
+		constexpr uint32_t data_inline = 0x80000000;
+		constexpr size_t name_length = 2;
+		constexpr size_t data_size = 4;
+		constexpr size_t data_offset = 8;
+		constexpr size_t type = 12;
+		constexpr size_t flags = 16;
+		constexpr size_t name = 20;
+	}
+
+	namespace sk
+	{
+		constexpr uint16_t signature_value = signature('s', 'k');
+		constexpr size_t flink = 4;
+		constexpr size_t blink = 8;
+		constexpr size_t reference_count = 12;
+		constexpr size_t descriptor_size = 16;
+		constexpr size_t descriptor = 20;
+	}
+
+	/**
+	 * @brief Sub key lists: li (offsets), lf (offset and name hint), lh (offset and name hash) and ri (lists of lists).
+	 */
+	namespace list
+	{
+		constexpr uint16_t li = signature('l', 'i');
+		constexpr uint16_t lf = signature('l', 'f');
+		constexpr uint16_t lh = signature('l', 'h');
+		constexpr uint16_t ri = signature('r', 'i');
+		constexpr size_t count = 2;
+		constexpr size_t elements = 4;
+	}
+
+	/**
+	 * @brief Entries of a transaction log (.LOG1, .LOG2) as Windows 8.1 and later write them: after the log's 512 byte
+	 * base block, a run of HvLE entries, each holding the hive's dirty pages at one sequence number.
+	 */
+	namespace log_entry
+	{
+		constexpr size_t first = 512;
+		constexpr size_t alignment = 512;
+		constexpr size_t signature = 0;
+		constexpr size_t size = 4;
+		constexpr size_t sequence = 12;
+		constexpr size_t hbins_size = 16;
+		constexpr size_t dirty_pages_count = 20;
+		/** Hash of everything past the header. */
+		constexpr size_t data_hash = 24;
+		/** Hash of the first 32 bytes of the header. */
+		constexpr size_t header_hash = 32;
+		/** Offset and size pairs, relative to the first hbin, followed by the pages themselves. */
+		constexpr size_t dirty_pages = 40;
+		constexpr uint64_t hash_seed = 0x82EF4D887A4E55C5;
+	}
+
+	/**
+	 * @brief The Marvin32 hash log entries are checked with.
+	 */
+	inline uint64_t marvin32(const uint8_t* data, size_t size, uint64_t seed = log_entry::hash_seed)
+	{
+		uint32_t low = static_cast<uint32_t>(seed);
+		uint32_t high = static_cast<uint32_t>(seed >> 32);
+		auto block = [&low, &high]()
+		{
+			high ^= low;
+			low = std::rotl(low, 20) + high;
+			high = std::rotl(high, 9) ^ low;
+			low = std::rotl(low, 27) + high;
+			high = std::rotl(high, 19);
+		};
+		for (; size >= 4; data += 4, size -= 4)
+		{
+			low += read<uint32_t>(data);
+			block();
+		}
+		// The remaining bytes, then a single 0x80 byte.
+		uint32_t last = 0x80;
+		for (size_t i = size; i-- > 0;)
+		{
+			last = (last << 8) | data[i];
+		}
+		low += last;
+		block();
+		block();
+		return (static_cast<uint64_t>(high) << 32) | low;
+	}
+
+	namespace db
+	{
+		constexpr uint16_t signature_value = signature('d', 'b');
+		/** Values larger than this are split into big data segments (hive version 1.4 and newer). */
+		constexpr uint32_t segment_size = 16344;
+		constexpr uint32_t min_minor_version = 4;
+		constexpr size_t segments_count = 2;
+		constexpr size_t segments_list = 4;
+	}
+}
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "hive_index.h"
+#include "hive_file.h"
+#include "hive_format.h"
+#include "registry_error.h"
+
+using namespace win32::registry;
+using namespace win32::registry::hive_format;
+
+namespace
+{
+	constexpr size_t kind_count = 6;
+
+	/** Runs of hbins per thread, so threads that finish early take over work from slower ones. */
+	constexpr size_t runs_per_thread = 8;
+
+	struct bin_range
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	hive_cell_kind classify(uint16_t signature)
+	{
+		switch (signature)
+		{
+		case nk::signature_value:
+			return hive_cell_kind::key;
+		case vk::signature_value:
+			return hive_cell_kind::value;
+		case sk::signature_value:
+			return hive_cell_kind::security;
+		case list::li:
+		case list::lf:
+		case list::lh:
+		case list::ri:
+			return hive_cell_kind::sub_key_list;
+		case db::signature_value:
+			return hive_cell_kind::big_data;
+		default:
+			return hive_cell_kind::other;
+		}
+	}
+
+	/**
+	 * Calls work(i) for every i below count, spread over up to threads threads, the calling one included.
+	 */
+	template <typename Work>
+	void parallel_for(size_t count, uint32_t threads, const Work& work)
+	{
+		std::atomic<size_t> next{ 0 };
+		std::mutex mutex;
+		std::exception_ptr error;
+		auto worker = [&]()
+		{
+			try
+			{
+				for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+				{
+					work(i);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+				next = count;
+			}
+		};
+		std::vector<std::thread> pool;
+		for (size_t i = 1; i < (std::min)(static_cast<size_t>(threads), count); i++)
+		{
+			pool.emplace_back(worker);
+		}
+		worker();
+		for (auto& thread : pool)
+		{
+			thread.join();
+		}
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	/**
+	 * Appends the sub keys a list names to out, failing if there are more than fit.
+	 */
+	bool collect(const hive_file& hive, uint32_t list_offset, uint32_t*& out, const uint32_t* end, bool nested)
+	{
+		auto cell = hive.cell(list_offset, list::elements);
+		uint16_t signature = cell.signature();
+		uint16_t count = read<uint16_t>(cell.data + list::count);
+		size_t stride = (signature == list::lf || signature == list::lh) ? 8 : 4;
+		if ((signature != list::li && signature != list::lf && signature != list::lh && signature != list::ri) ||
+			(signature == list::ri && nested) || list::elements + count * stride > cell.size)
+		{
+			return false;
+		}
+		for (uint16_t i = 0; i < count; i++)
+		{
+			uint32_t offset = read<uint32_t>(cell.data + list::elements + i * stride);
+			if (signature == list::ri)
+			{
+				if (!collect(hive, offset, out, end, true))
+				{
+					return false;
+				}
+			}
+			else if (out == end)
+			{
+				return false;
+			}
+			else
+			{
+				*out++ = offset;
+			}
+		}
+		return true;
+	}
+}
+
+std::shared_ptr<const hive_index> hive_index::build(const hive_file& hive, const hive_index_options& options)
+{
+	uint32_t threads = options.threads != 0 ? options.threads : (std::max)(1U, std::thread::hardware_concurrency());
+	std::shared_ptr<hive_index> index{ new hive_index{} };
+
+	// Bins only say where the next one starts, so finding them is serial; it reads one header per bin.
+	std::vector<bin_range> bins;
+	uint64_t total = 0;
+	for (uint32_t offset = 0; offset < hive.m_hbins_size;)
+	{
+		uint32_t available = 0;
+		const uint8_t* header = hive.at(offset, available);
+		if (header == nullptr || available < hbin::header_size || std::memcmp(header + hbin::signature, "hbin", 4) != 0)
+		{
+			break;
+		}
+		uint32_t size = read<uint32_t>(header + hbin::size);
+		if (size < hbin::header_size || size % page_size != 0 || size > available)
+		{
+			break;
+		}
+		bins.push_back(bin_range{ offset, offset + size });
+		total += size;
+		offset += size;
+	}
+
+	std::vector<bin_range> runs;
+	uint64_t run_size = (std::max<uint64_t>)(total / (static_cast<uint64_t>(threads) * runs_per_thread), page_size);
+	for (size_t first = 0, last = 0; first < bins.size(); first = last)
+	{
+		uint64_t size = 0;
+		for (last = first; last < bins.size() && (last == first || size < run_size); last++)
+		{
+			size += bins[last].end - bins[last].begin;
+		}
+		runs.push_back(bin_range{ static_cast<uint32_t>(first), static_cast<uint32_t>(last) });
+	}
+
+	std::vector<std::array<std::vector<uint32_t>, kind_count>> found(runs.size());
+	parallel_for(runs.size(), threads, [&](size_t i)
+	{
+		auto& cells = found[i];
+		for (uint32_t bin = runs[i].begin; bin < runs[i].end; bin++)
+		{
+			uint32_t begin = bins[bin].begin;
+			uint32_t end = bins[bin].end;
+			uint32_t available = 0;
+			// The bin starts at data; cells are found relative to it, and recorded by their offset in the hive.
+			const uint8_t* data = hive.at(begin, available);
+			for (uint32_t offset = begin + hbin::header_size; end - offset >= 8;)
+			{
+				const uint8_t* cell = data + (offset - begin);
+				int32_t raw_size = read<int32_t>(cell);
+				uint32_t size = raw_size < 0 ? static_cast<uint32_t>(-static_cast<int64_t>(raw_size)) : static_cast<uint32_t>(raw_size);
+				if (size < 8 || size % 8 != 0 || size > end - offset)
+				{
+					// The rest of the bin cannot be walked.
+					break;
+				}
+				if (raw_size < 0)
+				{
+					cells[static_cast<size_t>(classify(read<uint16_t>(cell + 4)))].push_back(offset);
+				}
+				offset += size;
+			}
+		}
+	});
+	for (size_t kind = 0; kind < kind_count; kind++)
+	{
+		size_t count = 0;
+		for (const auto& cells : found)
+		{
+			count += cells[kind].size();
+		}
+		index->m_cells[kind].reserve(count);
+		for (auto& cells : found)
+		{
+			index->m_cells[kind].insert(index->m_cells[kind].end(), cells[kind].begin(), cells[kind].end());
+			cells[kind] = {};
+		}
+	}
+
+	// Lay the children of every key out one after the other, then resolve all sub key lists in parallel.
+	const auto& keys = index->m_cells[static_cast<size_t>(hive_cell_kind::key)];
+	index->m_first.resize(keys.size());
+	index->m_counts.resize(keys.size());
+	size_t batch = (std::max<size_t>)(keys.size() / (static_cast<size_t>(threads) * runs_per_thread), 1024);
+	size_t batches = (keys.size() + batch - 1) / batch;
+	parallel_for(batches, threads, [&](size_t i)
+	{
+		for (size_t key = i * batch; key < (std::min)(keys.size(), (i + 1) * batch); key++)
+		{
+			auto node = hive.cell(keys[key]);
+			index->m_counts[key] = node.size >= nk::name ? read<uint32_t>(node.data + nk::sub_keys_count) : unreadable;
+		}
+	});
+	uint64_t children = 0;
+	for (size_t key = 0; key < keys.size(); key++)
+	{
+		// Every key has one parent, so counts adding up to more than the keys there are are corrupt.
+		if (index->m_counts[key] > keys.size() - children)
+		{
+			index->m_counts[key] = unreadable;
+		}
+		index->m_first[key] = static_cast<uint32_t>(children);
+		if (index->m_counts[key] != unreadable)
+		{
+			children += index->m_counts[key];
+		}
+	}
+	index->m_children.resize(static_cast<size_t>(children));
+	parallel_for(batches, threads, [&](size_t i)
+	{
+		for (size_t key = i * batch; key < (std::min)(keys.size(), (i + 1) * batch); key++)
+		{
+			uint32_t count = index->m_counts[key];
+			if (count == 0 || count == unreadable)
+			{
+				continue;
+			}
+			uint32_t* out = index->m_children.data() + index->m_first[key];
+			const uint32_t* end = out + count;
+			try
+			{
+				if (!collect(hive, read<uint32_t>(hive.cell(keys[key]).data + nk::sub_keys_list), out, end, false) || out != end)
+				{
+					index->m_counts[key] = unreadable;
+				}
+			}
+			catch (const registry_error&)
+			{
+				index->m_counts[key] = unreadable;
+			}
+		}
+	});
+	return index;
+}
+
+std::span<const uint32_t> hive_index::cells(hive_cell_kind kind) const
+{
+	return m_cells[static_cast<size_t>(kind)];
+}
+
+std::optional<std::span<const uint32_t>> hive_index::children(uint32_t key) const
+{
+	const auto& keys = m_cells[static_cast<size_t>(hive_cell_kind::key)];
+	auto it = std::lower_bound(keys.begin(), keys.end(), key);
+	if (it == keys.end() || *it != key)
+	{
+		return std::nullopt;
+	}
+	size_t slot = static_cast<size_t>(it - keys.begin());
+	if (m_counts[slot] == unreadable)
+	{
+		return std::nullopt;
+	}
+	return std::span<const uint32_t>{ m_children.data() + m_first[slot], m_counts[slot] };
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+#include "dll_export.h"
+
+namespace win32::registry
+{
+	class hive_file;
+
+	/**
+	 * @brief What an allocated cell of a hive holds, by its signature.
+	 */
+	enum class hive_cell_kind : uint8_t
+	{
+		/** nk */
+		key,
+		/** vk */
+		value,
+		/** sk */
+		security,
+		/** li, lf, lh and ri */
+		sub_key_list,
+		/** db */
+		big_data,
+		/** Anything else: value data, classes, value lists and big data segments. */
+		other,
+	};
+
+	struct DllExport hive_index_options
+	{
+		/** The number of threads, or 0 for one per hardware thread. */
+		uint32_t threads = 0;
+	};
+
+	/**
+	 * @brief Every allocated cell of a hive by kind, and the sub keys of every key as flat arrays.
+	 *
+	 * Built in one parallel pass: the hbins are split into runs of about equal size, and each thread walks the cells
+	 * of its runs and classifies them. The per run tables are then joined in file order, and the sub key lists of all
+	 * keys are resolved in parallel into one array of children, so enumerating a key reads consecutive offsets
+	 * instead of following lf, lh and ri lists.
+	 */
+	class DllExport hive_index
+	{
+	public:
+		/**
+		 * @brief Indexes a hive.
+		 * @param hive The hive.
+		 * @param options How to index the hive.
+		 * @return The index.
+		 */
+		static std::shared_ptr<const hive_index> build(const hive_file& hive, const hive_index_options& options = {});
+
+		/**
+		 * @brief Gets the allocated cells of a kind.
+		 * @param kind The kind of cell.
+		 * @return The offsets of the cells, ascending.
+		 */
+		std::span<const uint32_t> cells(hive_cell_kind kind) const;
+
+		/**
+		 * @brief Gets the sub keys of a key in enumeration order.
+		 * @param key The offset of the key's nk cell.
+		 * @return The offsets of the sub keys' nk cells, or nothing if the key is not an allocated key or its sub key
+		 * list could not be read.
+		 */
+		std::optional<std::span<const uint32_t>> children(uint32_t key) const;
+
+	private:
+		hive_index() = default;
+
+		static constexpr uint32_t unreadable = UINT32_MAX;
+
+		/** Cell offsets, by hive_cell_kind. */
+		std::vector<uint32_t> m_cells[6];
+		/** Per key, in the order of cells(hive_cell_kind::key): where its children start in m_children. */
+		std::vector<uint32_t> m_first;
+		/** Per key: its number of children, or unreadable. */
+		std::vector<uint32_t> m_counts;
+		std::vector<uint32_t> m_children;
+	};
+}
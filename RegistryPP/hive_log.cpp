@@ -0,0 +1,73 @@
+#include "hive_log.h"
+#include "hive_format.h"
+
+using namespace win32::registry;
+using namespace win32::registry::hive_format;
+
+hive_log::hive_log(const std::filesystem::path& path) :
+	m_file(path), m_entries()
+{
+	const uint8_t* data = m_file.data();
+	size_t size = m_file.size();
+	for (size_t position = log_entry::first; position < size && size - position >= log_entry::dirty_pages;)
+	{
+		const uint8_t* header = data + position;
+		uint32_t entry_size = read<uint32_t>(header + log_entry::size);
+		uint32_t count = read<uint32_t>(header + log_entry::dirty_pages_count);
+		if (std::memcmp(header + log_entry::signature, "HvLE", 4) != 0 || entry_size % log_entry::alignment != 0 ||
+			entry_size < log_entry::dirty_pages || entry_size > size - position ||
+			count > (entry_size - log_entry::dirty_pages) / 8)
+		{
+			break;
+		}
+		// Logs are reused from the start, so whatever follows the last entry written is stale.
+		uint32_t sequence = read<uint32_t>(header + log_entry::sequence);
+		if (!m_entries.empty() && sequence != m_entries.back().sequence + 1)
+		{
+			break;
+		}
+		if (marvin32(header, 32) != read<uint64_t>(header + log_entry::header_hash) ||
+			marvin32(header + log_entry::dirty_pages, entry_size - log_entry::dirty_pages) != read<uint64_t>(header + log_entry::data_hash))
+		{
+			break;
+		}
+
+		entry item{ sequence, read<uint32_t>(header + log_entry::hbins_size), {} };
+		size_t page_position = log_entry::dirty_pages + 8 * static_cast<size_t>(count);
+		bool valid = true;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t offset = read<uint32_t>(header + log_entry::dirty_pages + 8 * static_cast<size_t>(i));
+			uint32_t page_size = read<uint32_t>(header + log_entry::dirty_pages + 8 * static_cast<size_t>(i) + 4);
+			if (page_size > entry_size - page_position || offset > item.hbins_size || page_size > item.hbins_size - offset)
+			{
+				valid = false;
+				break;
+			}
+			item.pages.push_back(dirty_page{ offset, std::span<const uint8_t>{ header + page_position, page_size } });
+			page_position += page_size;
+		}
+		if (!valid)
+		{
+			break;
+		}
+		m_entries.push_back(std::move(item));
+		position += entry_size;
+	}
+}
+
+const std::vector<hive_log::entry>& hive_log::entries() const
+{
+	return m_entries;
+}
+
+const uint8_t* hive_log::base_block() const
+{
+	const uint8_t* data = m_file.data();
+	if (m_file.size() < log_entry::first || std::memcmp(data + base_block::signature, "regf", 4) != 0 ||
+		base_block_checksum(data) != read<uint32_t>(data + base_block::checksum))
+	{
+		return nullptr;
+	}
+	return data;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+#include "mapped_file.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A transaction log of a hive file (.LOG1, .LOG2), in the HvLE format Windows 8.1 and later write.
+	 *
+	 * The log is mapped and its pages are referred to in place. Logs in the older format read as having no entries.
+	 */
+	class DllExport hive_log
+	{
+	public:
+		struct dirty_page
+		{
+			/** Where the page goes, relative to the first hbin. */
+			uint32_t offset;
+			/** The page's new contents, in the mapped log. */
+			std::span<const uint8_t> data;
+		};
+
+		struct entry
+		{
+			uint32_t sequence;
+			/** The size of the hive's hbins once the entry is applied. */
+			uint32_t hbins_size;
+			std::vector<dirty_page> pages;
+		};
+
+		/**
+		 * @brief Maps a log and reads its entries.
+		 * @param path The path of the log.
+		 * @exception std::system_error
+		 */
+		explicit hive_log(const std::filesystem::path& path);
+
+		hive_log(const hive_log&) = delete;
+		hive_log& operator=(const hive_log&) = delete;
+
+		/**
+		 * @brief Gets the entries of the log, in the order they were written.
+		 * @return The entries up to the first one that is torn, fails its hashes or breaks the sequence.
+		 */
+		const std::vector<entry>& entries() const;
+
+		/**
+		 * @brief Gets the base block the log starts with, a copy of the hive's base block when the log was written.
+		 * @return The base block, or nullptr if it is missing or fails its checksum.
+		 */
+		const uint8_t* base_block() const;
+
+	private:
+		mapped_file m_file;
+		std::vector<entry> m_entries;
+	};
+}
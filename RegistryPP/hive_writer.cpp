@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <vector>
+#include "hive_writer.h"
+#include "hive_format.h"
+#include "key_backend.h"
+#include "registry_error.h"
+#include "sub_key_range.h"
+#include "utf16.h"
+#include "value_stream.h"
+
+using namespace win32::registry;
+using namespace win32::registry::hive_format;
+
+namespace
+{
+	template <typename T>
+	void write(uint8_t* p, T value)
+	{
+		std::memcpy(p, &value, sizeof value);
+	}
+
+	/** Sub keys per lh list. Keys with more get an ri list of lh lists, so that every leaf fits in a page. */
+	constexpr uint32_t max_leaf_elements = 507;
+
+	/** Bins gathered before they are written to the stream. */
+	constexpr size_t flush_size = 1 << 20;
+
+	/** Orders names the way Windows orders sub key lists: by their folded characters. */
+	bool name_less(std::wstring_view lhs, std::wstring_view rhs)
+	{
+		size_t length = (std::min)(lhs.size(), rhs.size());
+		for (size_t i = 0; i < length; i++)
+		{
+			wchar_t l = utf16::fold(lhs[i]);
+			wchar_t r = utf16::fold(rhs[i]);
+			if (l != r)
+			{
+				return l < r;
+			}
+		}
+		return lhs.size() < rhs.size();
+	}
+
+	/**
+	 * A name as nk and vk cells store it: one byte per character when every character is Latin-1, UTF-16LE otherwise.
+	 */
+	struct stored_name
+	{
+		std::vector<uint8_t> bytes;
+		bool compressed = false;
+		/** The length of the UTF-16 form in bytes, which is what the maximum lengths of a key count. */
+		uint32_t utf16_size = 0;
+
+		void assign(std::wstring_view name)
+		{
+			bytes.clear();
+			compressed = std::all_of(name.begin(), name.end(), [](wchar_t c) { return static_cast<uint32_t>(c) < 0x100; });
+			if (compressed)
+			{
+				for (wchar_t c : name)
+				{
+					bytes.push_back(static_cast<uint8_t>(c));
+				}
+				utf16_size = static_cast<uint32_t>(name.size() * 2);
+			}
+			else
+			{
+				utf16::append_bytes(bytes, name);
+				utf16_size = static_cast<uint32_t>(bytes.size());
+			}
+		}
+	};
+
+	uint32_t utf16_size(std::wstring_view text)
+	{
+		stored_name name;
+		name.assign(text);
+		return name.utf16_size;
+	}
+
+	/** O:BAG:SYD:(A;CI;KA;;;BA)(A;CI;KA;;;SY)(A;CI;KR;;;WD) in self-relative form. */
+	std::vector<uint8_t> default_security_descriptor()
+	{
+		std::vector<uint8_t> descriptor;
+		auto append = [&descriptor](std::initializer_list<uint8_t> bytes) { descriptor.insert(descriptor.end(), bytes); };
+		auto append32 = [&descriptor](uint32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				descriptor.push_back(static_cast<uint8_t>(value >> (8 * i)));
+			}
+		};
+		auto ace = [&](uint32_t mask, std::initializer_list<uint8_t> sid)
+		{
+			// ACCESS_ALLOWED_ACE, inherited by sub keys.
+			append({ 0x00, 0x02, static_cast<uint8_t>(8 + sid.size()), 0x00 });
+			append32(mask);
+			append(sid);
+		};
+		constexpr uint32_t key_all_access = 0xF003F;
+		constexpr uint32_t key_read = 0x20019;
+		// Revision 1, self-relative with a DACL; owner at 20, group at 36, no SACL, DACL at 48.
+		append({ 0x01, 0x00, 0x04, 0x80 });
+		append32(20);
+		append32(36);
+		append32(0);
+		append32(48);
+		append({ 0x01, 0x02, 0, 0, 0, 0, 0, 5, 32, 0, 0, 0, 0x20, 0x02, 0, 0 });
+		append({ 0x01, 0x01, 0, 0, 0, 0, 0, 5, 18, 0, 0, 0 });
+		// ACL revision 2, 72 bytes, 3 entries.
+		append({ 0x02, 0x00, 72, 0x00, 0x03, 0x00, 0x00, 0x00 });
+		ace(key_all_access, { 0x01, 0x02, 0, 0, 0, 0, 0, 5, 32, 0, 0, 0, 0x20, 0x02, 0, 0 });
+		ace(key_all_access, { 0x01, 0x01, 0, 0, 0, 0, 0, 5, 18, 0, 0, 0 });
+		ace(key_read, { 0x01, 0x01, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0 });
+		return descriptor;
+	}
+
+	/**
+	 * Lays cells out in bins, one after the other, and writes each bin once it is full. Without a stream it only
+	 * works out where every cell goes.
+	 */
+	class cell_allocator
+	{
+	public:
+		explicit cell_allocator(std::ostream* out) :
+			m_out(out), m_bin(), m_pending(), m_scratch(), m_bin_offset(0), m_bin_size(0), m_used(0)
+		{
+		}
+
+		bool writing() const
+		{
+			return m_out != nullptr;
+		}
+
+		/**
+		 * Allocates a cell.
+		 * @param payload_size The size of the cell without its size field.
+		 * @param offset Receives the offset of the cell.
+		 * @return The zeroed payload; scratch space when only laying out.
+		 */
+		uint8_t* allocate(uint64_t payload_size, uint32_t& offset)
+		{
+			uint64_t size = (payload_size + 4 + 7) & ~uint64_t{ 7 };
+			if (m_bin_size == 0 || m_used + size > m_bin_size)
+			{
+				close_bin();
+				uint64_t bin_size = (std::max<uint64_t>)(page_size, (size + hbin::header_size + page_size - 1) / page_size * page_size);
+				if (m_bin_offset + bin_size > UINT32_MAX - page_size)
+				{
+					throw registry_error{ registry_errc::not_supported, "The hive would be larger than 4 GB." };
+				}
+				m_bin_size = static_cast<uint32_t>(bin_size);
+				m_used = hbin::header_size;
+				if (writing())
+				{
+					m_bin.assign(m_bin_size, 0);
+				}
+			}
+			offset = static_cast<uint32_t>(m_bin_offset + m_used);
+			uint8_t* payload;
+			if (writing())
+			{
+				write<int32_t>(m_bin.data() + m_used, -static_cast<int32_t>(size));
+				payload = m_bin.data() + m_used + 4;
+			}
+			else
+			{
+				m_scratch.assign(static_cast<size_t>(payload_size), 0);
+				payload = m_scratch.data();
+			}
+			m_used += static_cast<uint32_t>(size);
+			return payload;
+		}
+
+		/**
+		 * Writes the last bin.
+		 * @return The size of all bins.
+		 */
+		uint32_t finish()
+		{
+			close_bin();
+			flush();
+			return static_cast<uint32_t>(m_bin_offset);
+		}
+
+	private:
+		void close_bin()
+		{
+			if (m_bin_size == 0)
+			{
+				return;
+			}
+			if (writing())
+			{
+				if (m_used < m_bin_size)
+				{
+					// The rest of the bin is one free cell.
+					write<int32_t>(m_bin.data() + m_used, static_cast<int32_t>(m_bin_size - m_used));
+				}
+				std::memcpy(m_bin.data() + hbin::signature, "hbin", 4);
+				write<uint32_t>(m_bin.data() + hbin::offset, static_cast<uint32_t>(m_bin_offset));
+				write<uint32_t>(m_bin.data() + hbin::size, m_bin_size);
+				m_pending.insert(m_pending.end(), m_bin.begin(), m_bin.end());
+				if (m_pending.size() >= flush_size)
+				{
+					flush();
+				}
+			}
+			m_bin_offset += m_bin_size;
+			m_bin_size = 0;
+		}
+
+		void flush()
+		{
+			if (writing() && !m_pending.empty())
+			{
+				m_out->write(reinterpret_cast<const char*>(m_pending.data()), static_cast<std::streamsize>(m_pending.size()));
+				m_pending.clear();
+			}
+		}
+
+		std::ostream* m_out;
+		std::vector<uint8_t> m_bin;
+		std::vector<uint8_t> m_pending;
+		std::vector<uint8_t> m_scratch;
+		uint64_t m_bin_offset;
+		uint32_t m_bin_size;
+		uint32_t m_used;
+	};
+
+	struct key_plan
+	{
+		/** The offset of the key's nk cell. */
+		uint32_t cell;
+		/** The keys in the key's subtree, itself included. */
+		uint32_t keys;
+	};
+
+	/**
+	 * Writes the cells of a tree, children after their parent. Run once to lay the tree out, recording a plan per key
+	 * in depth first order, then again to write it, when sub key lists take their children's offsets from the plans.
+	 */
+	class hive_builder
+	{
+	public:
+		hive_builder(cell_allocator& cells, const hive_write_options& options, std::vector<key_plan>& plans) :
+			m_cells(cells), m_options(options), m_plans(plans), m_next(0), m_security(no_offset), m_name(), m_data()
+		{
+		}
+
+		void write_security(uint32_t references)
+		{
+			static const std::vector<uint8_t> descriptor = default_security_descriptor();
+			uint8_t* cell = m_cells.allocate(sk::descriptor + descriptor.size(), m_security);
+			write<uint16_t>(cell, sk::signature_value);
+			// The only descriptor: the list of descriptors is just this one.
+			write<uint32_t>(cell + sk::flink, m_security);
+			write<uint32_t>(cell + sk::blink, m_security);
+			write<uint32_t>(cell + sk::reference_count, references);
+			write<uint32_t>(cell + sk::descriptor_size, static_cast<uint32_t>(descriptor.size()));
+			std::memcpy(cell + sk::descriptor, descriptor.data(), descriptor.size());
+		}
+
+		void write_key(const key_entry& key, uint32_t parent, bool root)
+		{
+			uint32_t index = m_next++;
+			if (!m_cells.writing())
+			{
+				m_plans.push_back(key_plan{ 0, 0 });
+			}
+			else if (index >= m_plans.size())
+			{
+				changed();
+			}
+
+			std::vector<key_entry> children;
+			for (const auto& child : key.subkeys())
+			{
+				children.push_back(child);
+			}
+			std::sort(children.begin(), children.end(), [](const key_entry& lhs, const key_entry& rhs) { return name_less(lhs.name(), rhs.name()); });
+
+			uint32_t class_offset = no_offset;
+			uint32_t class_size = utf16_size(key.key_class());
+			if (class_size != 0)
+			{
+				uint8_t* cell = m_cells.allocate(class_size, class_offset);
+				if (m_cells.writing())
+				{
+					std::vector<uint8_t> bytes;
+					utf16::append_bytes(bytes, key.key_class());
+					std::memcpy(cell, bytes.data(), bytes.size());
+				}
+			}
+
+			uint32_t max_value_name = 0;
+			uint32_t max_value_data = 0;
+			uint32_t value_count = key.value_count();
+			uint32_t values_offset = write_values(key, value_count, max_value_name, max_value_data);
+
+			uint32_t max_sub_key_name = 0;
+			uint32_t max_class = 0;
+			for (const auto& child : children)
+			{
+				max_sub_key_name = (std::max)(max_sub_key_name, utf16_size(child.name()));
+				max_class = (std::max)(max_class, utf16_size(child.key_class()));
+			}
+			uint32_t sub_keys_offset = write_sub_keys(children, index);
+
+			m_name.assign(key.name());
+			uint32_t offset = 0;
+			uint8_t* cell = m_cells.allocate(nk::name + m_name.bytes.size(), offset);
+			uint16_t flags = m_name.compressed ? nk::flag_compressed_name : 0;
+			if (root)
+			{
+				flags |= nk::flag_hive_entry | nk::flag_no_delete;
+			}
+			write<uint16_t>(cell, nk::signature_value);
+			write<uint16_t>(cell + nk::flags, flags);
+			write<uint64_t>(cell + nk::last_written, time_point_to_filetime(key.last_written()));
+			write<uint32_t>(cell + nk::parent, parent);
+			write<uint32_t>(cell + nk::sub_keys_count, static_cast<uint32_t>(children.size()));
+			write<uint32_t>(cell + nk::sub_keys_list, sub_keys_offset);
+			write<uint32_t>(cell + nk::volatile_sub_keys_list, no_offset);
+			write<uint32_t>(cell + nk::values_count, value_count);
+			write<uint32_t>(cell + nk::values_list, values_offset);
+			write<uint32_t>(cell + nk::security, m_security);
+			write<uint32_t>(cell + nk::class_name, class_offset);
+			write<uint32_t>(cell + nk::max_sub_key_name, max_sub_key_name);
+			write<uint32_t>(cell + nk::max_class, max_class);
+			write<uint32_t>(cell + nk::max_value_name, max_value_name);
+			write<uint32_t>(cell + nk::max_value_data, max_value_data);
+			write<uint16_t>(cell + nk::name_length, static_cast<uint16_t>(m_name.bytes.size()));
+			write<uint16_t>(cell + nk::class_length, static_cast<uint16_t>(class_size));
+			std::memcpy(cell + nk::name, m_name.bytes.data(), m_name.bytes.size());
+
+			if (!m_cells.writing())
+			{
+				m_plans[index].cell = offset;
+			}
+			else if (m_plans[index].cell != offset)
+			{
+				changed();
+			}
+			for (const auto& child : children)
+			{
+				write_key(child, offset, false);
+			}
+			if (!m_cells.writing())
+			{
+				m_plans[index].keys = m_next - index;
+			}
+			else if (m_plans[index].keys != m_next - index)
+			{
+				changed();
+			}
+		}
+
+	private:
+		[[noreturn]] static void changed()
+		{
+			throw registry_error{ registry_errc::corrupt, "The tree changed while the hive was written." };
+		}
+
+		uint32_t write_values(const key_entry& key, uint32_t count, uint32_t& max_name, uint32_t& max_data)
+		{
+			if (count == 0)
+			{
+				return no_offset;
+			}
+			std::vector<uint32_t> cells(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				value_stream value{ key, i };
+				uint32_t size = value.size();
+				max_name = (std::max)(max_name, utf16_size(value.name()));
+				max_data = (std::max)(max_data, size);
+
+				uint32_t data_size = size;
+				uint32_t data_offset = 0;
+				if (size <= 4)
+				{
+					data_size |= vk::data_inline;
+				}
+				else
+				{
+					data_offset = write_data(value);
+				}
+				m_name.assign(value.name());
+				uint8_t* cell = m_cells.allocate(vk::name + m_name.bytes.size(), cells[i]);
+				write<uint16_t>(cell, vk::signature_value);
+				write<uint16_t>(cell + vk::name_length, static_cast<uint16_t>(m_name.bytes.size()));
+				write<uint32_t>(cell + vk::data_size, data_size);
+				write<uint32_t>(cell + vk::data_offset, data_offset);
+				if (size <= 4 && m_cells.writing())
+				{
+					// Up to 4 bytes are stored in the data offset field itself.
+					value.read(std::span<uint8_t>{ cell + vk::data_offset, size });
+				}
+				write<uint32_t>(cell + vk::type, static_cast<uint32_t>(value.type()));
+				write<uint16_t>(cell + vk::flags, m_name.compressed ? vk::flag_compressed_name : 0);
+				std::memcpy(cell + vk::name, m_name.bytes.data(), m_name.bytes.size());
+			}
+			uint32_t list = 0;
+			uint8_t* cell = m_cells.allocate(4ULL * count, list);
+			std::memcpy(cell, cells.data(), 4ULL * count);
+			return list;
+		}
+
+		/**
+		 * Writes data larger than 4 bytes, as one cell or as big data segments. Big data is streamed a segment at a
+		 * time when the source can read values in parts cheaply, and read whole first otherwise.
+		 */
+		uint32_t write_data(value_stream& value)
+		{
+			uint32_t size = value.size();
+			uint32_t offset = 0;
+			if (size <= db::segment_size || m_options.minor_version < db::min_minor_version)
+			{
+				uint8_t* cell = m_cells.allocate(size, offset);
+				if (m_cells.writing())
+				{
+					value.read(std::span<uint8_t>{ cell, size });
+				}
+				return offset;
+			}
+			uint32_t count = (size + db::segment_size - 1) / db::segment_size;
+			if (count > UINT16_MAX)
+			{
+				throw registry_error{ registry_errc::not_supported, "Value too large for a hive." };
+			}
+			bool in_parts = value.reads_in_parts();
+			if (m_cells.writing() && !in_parts)
+			{
+				// Reading a segment at a time would read the whole value again for every segment.
+				m_data.resize(size);
+				value.read(m_data);
+			}
+			std::vector<uint32_t> segments(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t length = (std::min)(db::segment_size, size - i * db::segment_size);
+				uint8_t* cell = m_cells.allocate(length, segments[i]);
+				if (m_cells.writing() && in_parts)
+				{
+					value.read(std::span<uint8_t>{ cell, length });
+				}
+				else if (m_cells.writing())
+				{
+					std::memcpy(cell, m_data.data() + static_cast<size_t>(i) * db::segment_size, length);
+				}
+			}
+			uint32_t list = 0;
+			uint8_t* cell = m_cells.allocate(4ULL * count, list);
+			std::memcpy(cell, segments.data(), 4ULL * count);
+			cell = m_cells.allocate(8, offset);
+			write<uint16_t>(cell, db::signature_value);
+			write<uint16_t>(cell + db::segments_count, static_cast<uint16_t>(count));
+			write<uint32_t>(cell + db::segments_list, list);
+			return offset;
+		}
+
+		uint32_t write_sub_keys(const std::vector<key_entry>& children, uint32_t index)
+		{
+			if (children.empty())
+			{
+				return no_offset;
+			}
+			// Children follow their parent depth first, each after the whole subtree of the one before.
+			std::vector<uint32_t> offsets(children.size());
+			if (m_cells.writing())
+			{
+				uint32_t child = index + 1;
+				for (auto& offset : offsets)
+				{
+					if (child >= m_plans.size())
+					{
+						changed();
+					}
+					offset = m_plans[child].cell;
+					child += m_plans[child].keys;
+				}
+			}
+			std::vector<uint32_t> leaves;
+			for (size_t first = 0; first < children.size(); first += max_leaf_elements)
+			{
+				size_t count = (std::min)(children.size() - first, static_cast<size_t>(max_leaf_elements));
+				uint32_t leaf = 0;
+				uint8_t* cell = m_cells.allocate(list::elements + 8 * count, leaf);
+				write<uint16_t>(cell, list::lh);
+				write<uint16_t>(cell + list::count, static_cast<uint16_t>(count));
+				for (size_t i = 0; i < count; i++)
+				{
+					write<uint32_t>(cell + list::elements + 8 * i, offsets[first + i]);
+					write<uint32_t>(cell + list::elements + 8 * i + 4, utf16::name_hash(children[first + i].name()));
+				}
+				leaves.push_back(leaf);
+			}
+			if (leaves.size() == 1)
+			{
+				return leaves.front();
+			}
+			uint32_t offset = 0;
+			uint8_t* cell = m_cells.allocate(list::elements + 4 * leaves.size(), offset);
+			write<uint16_t>(cell, list::ri);
+			write<uint16_t>(cell + list::count, static_cast<uint16_t>(leaves.size()));
+			std::memcpy(cell + list::elements, leaves.data(), 4 * leaves.size());
+			return offset;
+		}
+
+		cell_allocator& m_cells;
+		const hive_write_options& m_options;
+		std::vector<key_plan>& m_plans;
+		uint32_t m_next;
+		uint32_t m_security;
+		stored_name m_name;
+		/** A whole big data value, for sources that cannot read one in parts cheaply. */
+		std::vector<uint8_t> m_data;
+	};
+}
+
+void win32::registry::write_hive(const key_entry& root, std::ostream& out, const hive_write_options& options)
+{
+	std::vector<key_plan> plans;
+	uint32_t hbins_size = 0;
+	{
+		cell_allocator layout{ nullptr };
+		hive_builder builder{ layout, options, plans };
+		builder.write_security(0);
+		builder.write_key(root, no_offset, true);
+		hbins_size = layout.finish();
+	}
+
+	std::vector<uint8_t> base(base_block::size, 0);
+	std::memcpy(base.data() + base_block::signature, "regf", 4);
+	// Equal sequence numbers: the hive is clean and has nothing to replay.
+	write<uint32_t>(base.data() + base_block::primary_sequence, 1);
+	write<uint32_t>(base.data() + base_block::secondary_sequence, 1);
+	write<uint64_t>(base.data() + base_block::last_written, time_point_to_filetime(root.last_written()));
+	write<uint32_t>(base.data() + base_block::major_version, 1);
+	write<uint32_t>(base.data() + base_block::minor_version, options.minor_version);
+	write<uint32_t>(base.data() + base_block::file_type, 0);
+	write<uint32_t>(base.data() + base_block::file_format, 1);
+	write<uint32_t>(base.data() + base_block::root_cell, plans.front().cell);
+	write<uint32_t>(base.data() + base_block::hbins_size, hbins_size);
+	write<uint32_t>(base.data() + base_block::clustering_factor, 1);
+	write<uint32_t>(base.data() + base_block::checksum, base_block_checksum(base.data()));
+	out.write(reinterpret_cast<const char*>(base.data()), static_cast<std::streamsize>(base.size()));
+
+	cell_allocator cells{ &out };
+	hive_builder builder{ cells, options, plans };
+	builder.write_security(static_cast<uint32_t>(plans.size()));
+	builder.write_key(root, no_offset, true);
+	if (cells.finish() != hbins_size)
+	{
+		throw registry_error{ registry_errc::corrupt, "The tree changed while the hive was written." };
+	}
+}
+
+void win32::registry::write_hive(const key_entry& root, const std::filesystem::path& path, const hive_write_options& options)
+{
+	std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+	if (!file)
+	{
+		throw std::system_error(std::make_error_code(std::errc::io_error), path.string());
+	}
+	try
+	{
+		write_hive(root, file, options);
+		file.close();
+		if (!file)
+		{
+			throw std::system_error(std::make_error_code(std::errc::io_error), path.string());
+		}
+	}
+	catch (...)
+	{
+		// A partly written hive would only fail to load later; leave nothing behind instead.
+		file.close();
+		std::error_code ignored;
+		std::filesystem::remove(path, ignored);
+		throw;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include "key_entry.h"
+
+namespace win32::registry
+{
+	struct DllExport hive_write_options
+	{
+		/** The minor version of the regf format. Values too large for one cell are split into big data from 4 on. */
+		uint32_t minor_version = 5;
+	};
+
+	/**
+	 * @brief Writes a key and everything below it as a regf hive file, the format RegSaveKey writes.
+	 *
+	 * A first pass reads only names and sizes to lay the file out. A second pass reads the data and writes the file
+	 * front to back, a few bins at a time, so memory does not grow with the size of the tree. Two passes are needed
+	 * because a key's sub key list is written before its children, yet must hold their offsets, and the stream is
+	 * never seeked back to fill them in. Sub key lists are lh lists sorted the way Windows sorts them, split under an
+	 * ri list for keys with many sub keys. All keys share one security descriptor that gives Administrators and SYSTEM
+	 * full control and everyone else read access.
+	 * @param root The key to write. It becomes the root of the hive.
+	 * @param out The stream, opened in binary mode.
+	 * @param options How to write the hive.
+	 * @exception wil::ResultException
+	 * @exception registry_error registry_errc::not_supported if a value or the hive is too large for the format.
+	 */
+	DllExport void write_hive(const key_entry& root, std::ostream& out, const hive_write_options& options = {});
+
+	/**
+	 * @brief Writes a key and everything below it to a regf hive file.
+	 *
+	 * If writing fails the partly written file is removed.
+	 * @param root The key to write. It becomes the root of the hive.
+	 * @param path The file, replaced if it exists.
+	 * @param options How to write the hive.
+	 * @exception std::system_error The file cannot be written.
+	 * @exception wil::ResultException
+	 * @exception registry_error registry_errc::not_supported if a value or the hive is too large for the format.
+	 */
+	DllExport void write_hive(const key_entry& root, const std::filesystem::path& path, const hive_write_options& options = {});
+}
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <type_traits>
+#include "instrumentation.h"
+#include "key_backend.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	constexpr const char* operation_names[backend_operation_count] = {
+		"open",
+		"query_info",
+		"enum_key",
+		"enum_value",
+		"read_value",
+		"write",
+		"close",
+	};
+
+	void append(std::string& out, const char* format, ...)
+	{
+		va_list arguments;
+		va_start(arguments, format);
+		va_list copy;
+		va_copy(copy, arguments);
+		int length = std::vsnprintf(nullptr, 0, format, copy);
+		va_end(copy);
+		if (length > 0)
+		{
+			size_t start = out.size();
+			out.resize(start + length + 1);
+			std::vsnprintf(out.data() + start, length + 1, format, arguments);
+			out.resize(start + length);
+		}
+		va_end(arguments);
+	}
+
+#ifdef REGISTRYPP_INSTRUMENTATION
+	struct atomic_operation
+	{
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> errors{ 0 };
+		std::atomic<uint64_t> total_nanoseconds{ 0 };
+		std::array<std::atomic<uint64_t>, operation_statistics::buckets> histogram{};
+	};
+
+	/**
+	 * One thread's share of the counters. Threads are spread over a fixed number of shards, so counting is a relaxed
+	 * add to a cache line that is rarely shared.
+	 */
+	struct alignas(64) shard
+	{
+		std::array<atomic_operation, backend_operation_count> operations;
+		std::atomic<uint64_t> bytes_read{ 0 };
+		std::atomic<uint64_t> bytes_decoded{ 0 };
+	};
+
+	constexpr size_t shard_count = 16;
+
+	struct counters
+	{
+		std::array<shard, shard_count> shards;
+		std::atomic<size_t> next_shard{ 0 };
+		std::atomic<int64_t> live_keys{ 0 };
+		std::atomic<int64_t> open_handles{ 0 };
+	};
+
+	counters& global()
+	{
+		static counters instance;
+		return instance;
+	}
+
+	shard& local()
+	{
+		thread_local shard& mine = global().shards[global().next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count];
+		return mine;
+	}
+
+	void record(backend_operation operation, std::chrono::steady_clock::time_point start, bool failed)
+	{
+		auto nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		auto& counters = local().operations[static_cast<size_t>(operation)];
+		counters.calls.fetch_add(1, std::memory_order_relaxed);
+		if (failed)
+		{
+			counters.errors.fetch_add(1, std::memory_order_relaxed);
+		}
+		counters.total_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+		size_t bucket = (std::min)(static_cast<size_t>(std::bit_width(nanoseconds)), operation_statistics::buckets - 1);
+		counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/** Runs a backend call, counting and timing it. */
+	template<typename Call>
+	auto timed(backend_operation operation, Call&& call) -> decltype(call())
+	{
+		auto start = std::chrono::steady_clock::now();
+		try
+		{
+			if constexpr (std::is_void_v<decltype(call())>)
+			{
+				call();
+				record(operation, start, false);
+			}
+			else
+			{
+				auto result = call();
+				record(operation, start, false);
+				return result;
+			}
+		}
+		catch (...)
+		{
+			record(operation, start, true);
+			throw;
+		}
+	}
+
+	void add_read(const value_view& view)
+	{
+		local().bytes_read.fetch_add(view.name.size() * sizeof(wchar_t) + view.size, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Forwards to another backend, counting and timing every call. Sub keys are returned unwrapped; key_entry wraps
+	 * every backend it takes ownership of.
+	 */
+	class instrumented_backend final : public key_backend
+	{
+	public:
+		explicit instrumented_backend(std::unique_ptr<key_backend> inner) :
+			m_inner(std::move(inner))
+		{
+		}
+
+		~instrumented_backend() override
+		{
+			timed(backend_operation::close, [this] { m_inner.reset(); });
+		}
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override
+		{
+			return timed(backend_operation::open, [&] { return m_inner->open_subkey(name); });
+		}
+
+		std::unique_ptr<key_backend> try_open_subkey(const std::wstring& name) const override
+		{
+			return timed(backend_operation::open, [&] { return m_inner->try_open_subkey(name); });
+		}
+
+		key_info query_info() const override
+		{
+			return timed(backend_operation::query_info, [&] { return m_inner->query_info(); });
+		}
+
+		std::wstring sub_key_name(uint32_t index) const override
+		{
+			return timed(backend_operation::enum_key, [&] { return m_inner->sub_key_name(index); });
+		}
+
+		value_view value_at(uint32_t index, value_buffer& buffer) const override
+		{
+			auto view = timed(backend_operation::enum_value, [&] { return m_inner->value_at(index, buffer); });
+			add_read(view);
+			return view;
+		}
+
+		value_view value_header_at(uint32_t index, value_buffer& buffer) const override
+		{
+			auto view = timed(backend_operation::enum_value, [&] { return m_inner->value_header_at(index, buffer); });
+			local().bytes_read.fetch_add(view.name.size() * sizeof(wchar_t), std::memory_order_relaxed);
+			return view;
+		}
+
+		std::optional<uint32_t> find_value_index(const std::wstring& name, value_buffer& buffer) const override
+		{
+			return timed(backend_operation::enum_value, [&] { return m_inner->find_value_index(name, buffer); });
+		}
+
+		size_t read_value_data(uint32_t index, uint32_t offset, std::span<uint8_t> out, value_buffer& buffer) const override
+		{
+			size_t length = timed(backend_operation::read_value, [&] { return m_inner->read_value_data(index, offset, out, buffer); });
+			local().bytes_read.fetch_add(length, std::memory_order_relaxed);
+			return length;
+		}
+
+		bool reads_value_parts() const override
+		{
+			return m_inner->reads_value_parts();
+		}
+
+		std::optional<value_view> find_value(const std::wstring& name, value_buffer& buffer) const override
+		{
+			auto view = timed(backend_operation::read_value, [&] { return m_inner->find_value(name, buffer); });
+			if (view)
+			{
+				add_read(*view);
+			}
+			return view;
+		}
+
+		void query_values(const std::vector<std::wstring>& names, std::vector<batch_value>& results, std::vector<uint8_t>& data) const override
+		{
+			timed(backend_operation::read_value, [&] { m_inner->query_values(names, results, data); });
+			uint64_t bytes = 0;
+			for (const auto& result : results)
+			{
+				bytes += result.size;
+			}
+			local().bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+		}
+
+		void set_value(const std::wstring& name, registry_value_type type, const uint8_t* data, uint32_t size) const override
+		{
+			timed(backend_operation::write, [&] { m_inner->set_value(name, type, data, size); });
+		}
+
+		bool delete_value(const std::wstring& name) const override
+		{
+			return timed(backend_operation::write, [&] { return m_inner->delete_value(name); });
+		}
+
+		std::unique_ptr<key_backend> create_subkey(const std::wstring& name) const override
+		{
+			return timed(backend_operation::open, [&] { return m_inner->create_subkey(name); });
+		}
+
+		bool delete_subtree(const std::wstring& name) const override
+		{
+			return timed(backend_operation::write, [&] { return m_inner->delete_subtree(name); });
+		}
+
+		void apply(const std::vector<key_write>& writes) const override
+		{
+			timed(backend_operation::write, [&] { m_inner->apply(writes); });
+		}
+
+		void reserve(value_buffer& buffer, uint32_t max_name_length, uint32_t max_data_length) const override
+		{
+			m_inner->reserve(buffer, max_name_length, max_data_length);
+		}
+
+		bool same_key(const key_backend& other) const override
+		{
+			auto rhs = dynamic_cast<const instrumented_backend*>(&other);
+			return m_inner->same_key(rhs != nullptr ? *rhs->m_inner : other);
+		}
+
+	private:
+		std::unique_ptr<key_backend> m_inner;
+	};
+#endif // REGISTRYPP_INSTRUMENTATION
+}
+
+#ifdef REGISTRYPP_INSTRUMENTATION
+std::unique_ptr<key_backend> instrumentation_hooks::wrap(std::unique_ptr<key_backend> backend)
+{
+	if (!backend)
+	{
+		return backend;
+	}
+	return std::make_unique<instrumented_backend>(std::move(backend));
+}
+
+void instrumentation_hooks::add_decoded(uint64_t bytes)
+{
+	local().bytes_decoded.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void instrumentation_hooks::add_live_keys(int64_t delta)
+{
+	global().live_keys.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void instrumentation_hooks::add_open_handles(int64_t delta)
+{
+	global().open_handles.fetch_add(delta, std::memory_order_relaxed);
+}
+#endif // REGISTRYPP_INSTRUMENTATION
+
+bool instrumentation::enabled()
+{
+#ifdef REGISTRYPP_INSTRUMENTATION
+	return true;
+#else
+	return false;
+#endif // REGISTRYPP_INSTRUMENTATION
+}
+
+instrumentation_snapshot instrumentation::snapshot()
+{
+	instrumentation_snapshot result;
+#ifdef REGISTRYPP_INSTRUMENTATION
+	for (const auto& shard : global().shards)
+	{
+		for (size_t i = 0; i < backend_operation_count; i++)
+		{
+			const auto& from = shard.operations[i];
+			auto& to = result.operations[i];
+			to.calls += from.calls.load(std::memory_order_relaxed);
+			to.errors += from.errors.load(std::memory_order_relaxed);
+			to.total_nanoseconds += from.total_nanoseconds.load(std::memory_order_relaxed);
+			for (size_t bucket = 0; bucket < operation_statistics::buckets; bucket++)
+			{
+				to.histogram[bucket] += from.histogram[bucket].load(std::memory_order_relaxed);
+			}
+		}
+		result.bytes_read += shard.bytes_read.load(std::memory_order_relaxed);
+		result.bytes_decoded += shard.bytes_decoded.load(std::memory_order_relaxed);
+	}
+	result.live_keys = global().live_keys.load(std::memory_order_relaxed);
+	result.open_handles = global().open_handles.load(std::memory_order_relaxed);
+#endif // REGISTRYPP_INSTRUMENTATION
+	return result;
+}
+
+void instrumentation::reset()
+{
+#ifdef REGISTRYPP_INSTRUMENTATION
+	for (auto& shard : global().shards)
+	{
+		for (auto& operation : shard.operations)
+		{
+			operation.calls.store(0, std::memory_order_relaxed);
+			operation.errors.store(0, std::memory_order_relaxed);
+			operation.total_nanoseconds.store(0, std::memory_order_relaxed);
+			for (auto& bucket : operation.histogram)
+			{
+				bucket.store(0, std::memory_order_relaxed);
+			}
+		}
+		shard.bytes_read.store(0, std::memory_order_relaxed);
+		shard.bytes_decoded.store(0, std::memory_order_relaxed);
+	}
+#endif // REGISTRYPP_INSTRUMENTATION
+}
+
+std::string instrumentation_snapshot::to_json() const
+{
+	std::string out = "{\"operations\":{";
+	for (size_t i = 0; i < backend_operation_count; i++)
+	{
+		const auto& operation = operations[i];
+		append(out, "%s\"%s\":{\"calls\":%llu,\"errors\":%llu,\"total_nanoseconds\":%llu,\"histogram\":[", i == 0 ? "" : ",", operation_names[i],
+			static_cast<unsigned long long>(operation.calls), static_cast<unsigned long long>(operation.errors), static_cast<unsigned long long>(operation.total_nanoseconds));
+		for (size_t bucket = 0; bucket < operation_statistics::buckets; bucket++)
+		{
+			append(out, "%s%llu", bucket == 0 ? "" : ",", static_cast<unsigned long long>(operation.histogram[bucket]));
+		}
+		out += "]}";
+	}
+	append(out, "},\"bytes_read\":%llu,\"bytes_decoded\":%llu,\"live_keys\":%lld,\"open_handles\":%lld}", static_cast<unsigned long long>(bytes_read),
+		static_cast<unsigned long long>(bytes_decoded), static_cast<long long>(live_keys), static_cast<long long>(open_handles));
+	return out;
+}
+
+std::string instrumentation_snapshot::to_prometheus() const
+{
+	std::string out;
+	out += "# HELP registrypp_backend_calls_total Backend calls by operation.\n# TYPE registrypp_backend_calls_total counter\n";
+	for (size_t i = 0; i < backend_operation_count; i++)
+	{
+		append(out, "registrypp_backend_calls_total{operation=\"%s\"} %llu\n", operation_names[i], static_cast<unsigned long long>(operations[i].calls));
+	}
+	out += "# HELP registrypp_backend_errors_total Backend calls that failed, by operation.\n# TYPE registrypp_backend_errors_total counter\n";
+	for (size_t i = 0; i < backend_operation_count; i++)
+	{
+		append(out, "registrypp_backend_errors_total{operation=\"%s\"} %llu\n", operation_names[i], static_cast<unsigned long long>(operations[i].errors));
+	}
+	out += "# HELP registrypp_backend_call_duration_seconds Backend call latency by operation.\n# TYPE registrypp_backend_call_duration_seconds histogram\n";
+	for (size_t i = 0; i < backend_operation_count; i++)
+	{
+		const auto& operation = operations[i];
+		uint64_t cumulative = 0;
+		// The last bucket is open ended, so it is only reported as +Inf.
+		for (size_t bucket = 0; bucket + 1 < operation_statistics::buckets; bucket++)
+		{
+			cumulative += operation.histogram[bucket];
+			append(out, "registrypp_backend_call_duration_seconds_bucket{operation=\"%s\",le=\"%.9g\"} %llu\n", operation_names[i],
+				static_cast<double>(uint64_t{ 1 } << bucket) * 1e-9, static_cast<unsigned long long>(cumulative));
+		}
+		append(out, "registrypp_backend_call_duration_seconds_bucket{operation=\"%s\",le=\"+Inf\"} %llu\n", operation_names[i], static_cast<unsigned long long>(operation.calls));
+		append(out, "registrypp_backend_call_duration_seconds_sum{operation=\"%s\"} %.9f\n", operation_names[i], static_cast<double>(operation.total_nanoseconds) * 1e-9);
+		append(out, "registrypp_backend_call_duration_seconds_count{operation=\"%s\"} %llu\n", operation_names[i], static_cast<unsigned long long>(operation.calls));
+	}
+	append(out, "# HELP registrypp_bytes_read_total Value name and data bytes returned by backends.\n# TYPE registrypp_bytes_read_total counter\nregistrypp_bytes_read_total %llu\n",
+		static_cast<unsigned long long>(bytes_read));
+	append(out, "# HELP registrypp_bytes_decoded_total Value bytes decoded into strings and numbers.\n# TYPE registrypp_bytes_decoded_total counter\nregistrypp_bytes_decoded_total %llu\n",
+		static_cast<unsigned long long>(bytes_decoded));
+	append(out, "# HELP registrypp_live_keys Open keys.\n# TYPE registrypp_live_keys gauge\nregistrypp_live_keys %lld\n", static_cast<long long>(live_keys));
+	append(out, "# HELP registrypp_open_handles Open registry handles.\n# TYPE registrypp_open_handles gauge\nregistrypp_open_handles %lld\n", static_cast<long long>(open_handles));
+	return out;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "dll_export.h"
+
+namespace win32::registry
+{
+	class key_backend;
+
+	/**
+	 * @brief The kinds of backend call the instrumentation tells apart.
+	 */
+	enum class backend_operation : uint8_t
+	{
+		/** open_subkey, try_open_subkey and create_subkey. */
+		open,
+		/** query_info. */
+		query_info,
+		/** sub_key_name. */
+		enum_key,
+		/** value_at, value_header_at and find_value_index. */
+		enum_value,
+		/** find_value and query_values. */
+		read_value,
+		/** set_value, delete_value, delete_subtree and apply. */
+		write,
+		/** Releasing a key's backend, which closes its handle. */
+		close,
+	};
+
+	/** The number of backend_operation values. */
+	constexpr size_t backend_operation_count = 7;
+
+	/**
+	 * @brief Calls of one kind, and how long they took.
+	 */
+	struct DllExport operation_statistics
+	{
+		/** Latency bucket i counts calls that took less than 2^i nanoseconds, and at least 2^(i-1). */
+		static constexpr size_t buckets = 32;
+
+		uint64_t calls = 0;
+		/** Calls that threw. */
+		uint64_t errors = 0;
+		uint64_t total_nanoseconds = 0;
+		std::array<uint64_t, buckets> histogram{};
+	};
+
+	/**
+	 * @brief The counters at one point in time.
+	 */
+	struct DllExport instrumentation_snapshot
+	{
+		std::array<operation_statistics, backend_operation_count> operations{};
+		/** Value name and data bytes returned by backends. */
+		uint64_t bytes_read = 0;
+		/** Bytes turned into strings and numbers by value_entry. */
+		uint64_t bytes_decoded = 0;
+		/** key_entry data objects alive: every open key, however many key_entry copies share it. */
+		int64_t live_keys = 0;
+		/** Live registry handles owned by the library. */
+		int64_t open_handles = 0;
+
+		/**
+		 * @brief Formats the counters as a JSON object.
+		 * @return The JSON text.
+		 */
+		std::string to_json() const;
+
+		/**
+		 * @brief Formats the counters in the Prometheus text exposition format.
+		 * @return The exposition text, with registrypp_ metric names.
+		 */
+		std::string to_prometheus() const;
+	};
+
+	/**
+	 * @brief Counts backend calls by kind with latency histograms, value bytes read and decoded, and live keys and
+	 * handles.
+	 *
+	 * Only collected when the library is built with REGISTRYPP_INSTRUMENTATION defined. Otherwise every hook compiles
+	 * to nothing and snapshots stay empty. Counters are sharded per thread, so parallel walks do not contend on them.
+	 */
+	class DllExport instrumentation
+	{
+	public:
+		/**
+		 * @brief Gets whether the library was built with instrumentation.
+		 * @return true if counters are collected; otherwise false.
+		 */
+		static bool enabled();
+
+		/**
+		 * @brief Reads the counters.
+		 * @return The counters. Concurrent calls may or may not be included.
+		 */
+		static instrumentation_snapshot snapshot();
+
+		/**
+		 * @brief Sets the call counters and byte counts back to zero. Live keys and handles are kept.
+		 */
+		static void reset();
+	};
+
+#ifdef REGISTRYPP_INSTRUMENTATION
+	namespace instrumentation_hooks
+	{
+		/** Wraps a backend so its calls are counted and timed. Null stays null. */
+		std::unique_ptr<key_backend> wrap(std::unique_ptr<key_backend> backend);
+
+		void add_decoded(uint64_t bytes);
+
+		void add_live_keys(int64_t delta);
+
+		void add_open_handles(int64_t delta);
+	}
+#define REGISTRYPP_INSTRUMENT_BACKEND(backend) ::win32::registry::instrumentation_hooks::wrap(backend)
+#define REGISTRYPP_COUNT_DECODED(bytes) ::win32::registry::instrumentation_hooks::add_decoded(bytes)
+#define REGISTRYPP_TRACK_KEY(delta) ::win32::registry::instrumentation_hooks::add_live_keys(delta)
+#define REGISTRYPP_TRACK_HANDLE(delta) ::win32::registry::instrumentation_hooks::add_open_handles(delta)
+#else
+#define REGISTRYPP_INSTRUMENT_BACKEND(backend) (backend)
+#define REGISTRYPP_COUNT_DECODED(bytes) ((void)0)
+#define REGISTRYPP_TRACK_KEY(delta) ((void)0)
+#define REGISTRYPP_TRACK_HANDLE(delta) ((void)0)
+#endif // REGISTRYPP_INSTRUMENTATION
+}
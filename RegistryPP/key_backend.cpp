@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "key_backend.h"
+#include "registry_error.h"
+#include "utf16.h"
+
+using namespace win32::registry;
+
+std::unique_ptr<key_backend> key_backend::try_open_subkey(const std::wstring& name) const
+{
+	try
+	{
+		return open_subkey(name);
+	}
+	catch (const registry_error& error)
+	{
+		if (error.code() != registry_errc::not_found)
+		{
+			throw;
+		}
+		return nullptr;
+	}
+}
+
+value_view key_backend::value_header_at(uint32_t index, value_buffer& buffer) const
+{
+	auto view = value_at(index, buffer);
+	view.data = nullptr;
+	view.owner = nullptr;
+	return view;
+}
+
+size_t key_backend::read_value_data(uint32_t index, uint32_t offset, std::span<uint8_t> out, value_buffer& buffer) const
+{
+	auto view = value_at(index, buffer);
+	if (offset >= view.size)
+	{
+		return 0;
+	}
+	size_t length = (std::min)(out.size(), static_cast<size_t>(view.size - offset));
+	std::memcpy(out.data(), view.data + offset, length);
+	return length;
+}
+
+bool key_backend::reads_value_parts() const
+{
+	return false;
+}
+
+std::optional<value_view> key_backend::find_value(const std::wstring& name, value_buffer& buffer) const
+{
+	auto index = find_value_index(name, buffer);
+	if (!index)
+	{
+		return std::nullopt;
+	}
+	return value_at(*index, buffer);
+}
+
+std::optional<uint32_t> key_backend::find_value_index(const std::wstring& name, value_buffer& buffer) const
+{
+	uint32_t count = query_info().values_count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (utf16::equals_ignore_case(value_header_at(i, buffer).name, name))
+		{
+			return i;
+		}
+	}
+	return std::nullopt;
+}
+
+void key_backend::query_values(const std::vector<std::wstring>& names, std::vector<batch_value>& results, std::vector<uint8_t>& data) const
+{
+	value_buffer buffer;
+	results.assign(names.size(), batch_value{});
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		auto view = find_value(names[i], buffer);
+		if (!view)
+		{
+			continue;
+		}
+		data.resize((data.size() + 7) & ~static_cast<size_t>(7));
+		results[i] = batch_value{ true, view->type, static_cast<uint32_t>(data.size()), view->size };
+		data.insert(data.end(), view->data, view->data + view->size);
+	}
+}
+
+void key_backend::set_value(const std::wstring&, registry_value_type, const uint8_t*, uint32_t) const
+{
+	throw registry_error{ registry_errc::not_supported, "The key is read-only." };
+}
+
+bool key_backend::delete_value(const std::wstring&) const
+{
+	throw registry_error{ registry_errc::not_supported, "The key is read-only." };
+}
+
+std::unique_ptr<key_backend> key_backend::create_subkey(const std::wstring&) const
+{
+	throw registry_error{ registry_errc::not_supported, "The key is read-only." };
+}
+
+bool key_backend::delete_subtree(const std::wstring&) const
+{
+	throw registry_error{ registry_errc::not_supported, "The key is read-only." };
+}
+
+void key_backend::apply(const std::vector<key_write>&) const
+{
+	throw registry_error{ registry_errc::not_supported, "The key does not support atomic writes." };
+}
+
+void key_backend::reserve(value_buffer&, uint32_t, uint32_t) const
+{
+}
+
+/** FILETIME ticks: 100-nanosecond intervals. */
+using filetime_ticks = std::chrono::duration<int64_t, std::ratio<1, 10000000>>;
+
+/** The FILETIME of the Unix epoch, which system_clock counts from. */
+constexpr filetime_ticks unix_epoch_filetime{ 116444736000000000LL };
+
+std::chrono::system_clock::time_point win32::registry::filetime_to_time_point(uint64_t filetime)
+{
+	using clock = std::chrono::system_clock;
+	// system_clock often counts nanoseconds in 64 bits, which only spans the years 1678 to 2262; stamps outside that,
+	// such as the 0 many hives store, are clamped rather than overflowing.
+	constexpr auto earliest = std::chrono::duration_cast<filetime_ticks>(clock::duration::min());
+	constexpr auto latest = std::chrono::duration_cast<filetime_ticks>(clock::duration::max());
+	auto ticks = filetime_ticks{ static_cast<int64_t>((std::min<uint64_t>)(filetime, INT64_MAX)) } - unix_epoch_filetime;
+	if (ticks <= earliest)
+	{
+		return clock::time_point::min();
+	}
+	if (ticks >= latest)
+	{
+		return clock::time_point::max();
+	}
+	return clock::time_point{ std::chrono::duration_cast<clock::duration>(ticks) };
+}
+
+uint64_t win32::registry::time_point_to_filetime(std::chrono::system_clock::time_point time_point)
+{
+	using clock = std::chrono::system_clock;
+	// The limits stand for the stamps filetime_to_time_point clamped, so they map back to the ends of FILETIME.
+	auto ticks = std::chrono::duration_cast<filetime_ticks>(time_point.time_since_epoch());
+	if (time_point == clock::time_point::min() || ticks <= -unix_epoch_filetime)
+	{
+		return 0;
+	}
+	if (time_point == clock::time_point::max() || ticks >= filetime_ticks::max() - unix_epoch_filetime)
+	{
+		return INT64_MAX;
+	}
+	return static_cast<uint64_t>((ticks + unix_epoch_filetime).count());
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "key_entry.h"
+#include "registry_value_type.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Metadata about a key, the same information RegQueryInfoKey returns.
+	 *
+	 * Lengths are in characters and do not include a terminating null.
+	 */
+	struct DllExport key_info
+	{
+		std::wstring key_class;
+		uint32_t sub_keys_count = 0;
+		uint32_t max_sub_key_name_length = 0;
+		uint32_t max_class_length = 0;
+		uint32_t values_count = 0;
+		uint32_t max_value_name_length = 0;
+		uint32_t max_value_data_length = 0;
+		std::chrono::system_clock::time_point last_written;
+	};
+
+	/**
+	 * @brief Scratch storage reused across value reads.
+	 */
+	struct DllExport value_buffer
+	{
+		std::wstring name;
+		std::vector<uint8_t> data;
+	};
+
+	/**
+	 * @brief A value as read from a backend, without taking ownership of anything.
+	 *
+	 * The name always refers to the value_buffer the value was read with. When owner is empty the data is only valid
+	 * until the next read through the same buffer; otherwise it refers to storage that stays alive, unchanged, for as
+	 * long as owner does.
+	 */
+	struct DllExport value_view
+	{
+		std::wstring_view name;
+		registry_value_type type = registry_value_type::none;
+		const uint8_t* data = nullptr;
+		uint32_t size = 0;
+		std::shared_ptr<const void> owner;
+	};
+
+	/**
+	 * @brief The outcome of reading one value of a batch.
+	 */
+	struct DllExport batch_value
+	{
+		/** Whether the value exists. The other members are zero when it does not. */
+		bool found = false;
+		registry_value_type type = registry_value_type::none;
+		/** Where the data starts in the batch's shared buffer. */
+		uint32_t offset = 0;
+		uint32_t size = 0;
+	};
+
+	/**
+	 * @brief A pending change to one value, as collected by a write_batch.
+	 */
+	struct DllExport value_write
+	{
+		std::wstring name;
+		/** Whether the value is deleted instead of set. */
+		bool erase = false;
+		registry_value_type type = registry_value_type::none;
+		std::vector<uint8_t> data;
+	};
+
+	/**
+	 * @brief The pending changes to one key, as collected by a write_batch.
+	 */
+	struct DllExport key_write
+	{
+		/** The path of the key, relative to the key the changes are applied to; empty for that key itself. */
+		std::wstring path;
+		/** Whether the key and everything below it is deleted before anything else is written. Needs a path. */
+		bool delete_subtree = false;
+		/** Whether the key is created, if missing, even when no value is written. */
+		bool create = false;
+		std::vector<value_write> values;
+	};
+
+	/**
+	 * @brief The storage behind a single open key.
+	 *
+	 * key_entry owns one backend per open key and routes every read through it, so the same key_entry,
+	 * key_entry_iterator and value_entry_iterator code works over the live registry and offline hive files alike.
+	*/
+	class DllExport key_backend
+	{
+	public:
+		virtual ~key_backend() = default;
+
+		/**
+		 * @brief Opens a sub key.
+		 * @param name The sub key's name. May contain several backslash separated components.
+		 * @return The backend of the sub key.
+		 */
+		virtual std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const = 0;
+
+		/**
+		 * @brief Opens a sub key that may not exist.
+		 *
+		 * The default implementation treats a registry_error with registry_errc::not_found as a missing key.
+		 * @param name The sub key's name. May contain several backslash separated components.
+		 * @return The backend of the sub key, or null if it does not exist.
+		 */
+		virtual std::unique_ptr<key_backend> try_open_subkey(const std::wstring& name) const;
+
+		/**
+		 * @brief Reads the key's metadata.
+		 * @return The key's metadata.
+		 */
+		virtual key_info query_info() const = 0;
+
+		/**
+		 * @brief Gets the name of a sub key by index.
+		 * @param index The index of the sub key.
+		 * @return The name of the sub key.
+		 */
+		virtual std::wstring sub_key_name(uint32_t index) const = 0;
+
+		/**
+		 * @brief Reads a value by index.
+		 * @param index The index of the value.
+		 * @param buffer Scratch storage the returned view may refer to.
+		 * @return The value.
+		 */
+		virtual value_view value_at(uint32_t index, value_buffer& buffer) const = 0;
+
+		/**
+		 * @brief Reads the name, type and size of a value by index, without reading its data.
+		 * @param index The index of the value.
+		 * @param buffer Scratch storage the returned view may refer to.
+		 * @return The value, with no data.
+		 */
+		virtual value_view value_header_at(uint32_t index, value_buffer& buffer) const;
+
+		/**
+		 * @brief Copies part of a value's data into a caller's buffer, without reading the rest of it.
+		 *
+		 * The default implementation reads the whole value with value_at and copies the part asked for, which costs
+		 * nothing extra for backends that hand out data in place.
+		 * @param index The index of the value.
+		 * @param offset Where in the data to start, in bytes.
+		 * @param out Receives up to out.size() bytes.
+		 * @param buffer Scratch storage.
+		 * @return The number of bytes copied; fewer than out.size() only when the data ends first.
+		 */
+		virtual size_t read_value_data(uint32_t index, uint32_t offset, std::span<uint8_t> out, value_buffer& buffer) const;
+
+		/**
+		 * @brief Gets whether read_value_data costs only the bytes asked for.
+		 *
+		 * When it does not, every part read reads the whole value, and a value wanted in full is better read in one go.
+		 * The default implementation returns false.
+		 * @return true if values can be read in parts cheaply; otherwise false.
+		 */
+		virtual bool reads_value_parts() const;
+
+		/**
+		 * @brief Reads a value by name, ignoring case.
+		 *
+		 * The default implementation scans the values of the key.
+		 * @param name The name of the value.
+		 * @param buffer Scratch storage the returned view may refer to.
+		 * @return The value, or nothing if the key has no such value.
+		 */
+		virtual std::optional<value_view> find_value(const std::wstring& name, value_buffer& buffer) const;
+
+		/**
+		 * @brief Finds the index of a value by name, ignoring case, without reading its data.
+		 *
+		 * The default implementation scans the headers of the values of the key.
+		 * @param name The name of the value.
+		 * @param buffer Scratch storage.
+		 * @return The index of the value, or nothing if the key has no such value.
+		 */
+		virtual std::optional<uint32_t> find_value_index(const std::wstring& name, value_buffer& buffer) const;
+
+		/**
+		 * @brief Reads several values by name, appending all their data to one buffer.
+		 *
+		 * The default implementation calls find_value for every name.
+		 * @param names The names of the values.
+		 * @param results Receives the outcome for every name, in the same order.
+		 * @param data The buffer the data is appended to. Offsets in results are relative to its start.
+		 */
+		virtual void query_values(const std::vector<std::wstring>& names, std::vector<batch_value>& results, std::vector<uint8_t>& data) const;
+
+		/**
+		 * @brief Creates or replaces a value.
+		 *
+		 * The default implementation throws registry_error with registry_errc::not_supported.
+		 * @param name The name of the value.
+		 * @param type The type of the value.
+		 * @param data The raw data of the value.
+		 * @param size The size of the data in bytes.
+		 */
+		virtual void set_value(const std::wstring& name, registry_value_type type, const uint8_t* data, uint32_t size) const;
+
+		/**
+		 * @brief Deletes a value.
+		 *
+		 * The default implementation throws registry_error with registry_errc::not_supported.
+		 * @param name The name of the value.
+		 * @return true if the value existed; otherwise false.
+		 */
+		virtual bool delete_value(const std::wstring& name) const;
+
+		/**
+		 * @brief Opens a sub key, creating it and any missing parents first.
+		 *
+		 * The default implementation throws registry_error with registry_errc::not_supported.
+		 * @param name The sub key's name. May contain several backslash separated components.
+		 * @return The backend of the sub key.
+		 */
+		virtual std::unique_ptr<key_backend> create_subkey(const std::wstring& name) const;
+
+		/**
+		 * @brief Deletes a sub key with all of its sub keys and values.
+		 *
+		 * The default implementation throws registry_error with registry_errc::not_supported.
+		 * @param name The sub key's name. May contain several backslash separated components.
+		 * @return true if the sub key existed; otherwise false.
+		 */
+		virtual bool delete_subtree(const std::wstring& name) const;
+
+		/**
+		 * @brief Applies a set of changes below the key, all of them or none.
+		 *
+		 * Keys are processed in order: a key's subtree is deleted first if asked to, then the key is created if it
+		 * is written to, then its values are written. The default implementation throws registry_error with
+		 * registry_errc::not_supported, since it cannot make the changes atomic.
+		 * @param writes The changes.
+		 */
+		virtual void apply(const std::vector<key_write>& writes) const;
+
+		/**
+		 * @brief Sizes a buffer so that reading any value of the key needs no further allocation.
+		 *
+		 * Only backends that copy value data into the buffer need to do anything.
+		 * @param buffer The buffer to size.
+		 * @param max_name_length The longest value name of the key, in characters.
+		 * @param max_data_length The largest value data of the key, in bytes.
+		 */
+		virtual void reserve(value_buffer& buffer, uint32_t max_name_length, uint32_t max_data_length) const;
+
+		/**
+		 * @brief Gets whether another backend refers to the very same key.
+		 * @param other The backend to compare with.
+		 * @return true if both refer to the same key; otherwise false.
+		 */
+		virtual bool same_key(const key_backend& other) const = 0;
+	};
+
+	/**
+	 * @brief Converts a FILETIME tick count into a time point.
+	 * @param filetime 100-nanosecond intervals since January 1, 1601 (UTC).
+	 * @return The equivalent time point, clamped to the range system_clock can represent.
+	 */
+	DllExport std::chrono::system_clock::time_point filetime_to_time_point(uint64_t filetime);
+
+	/**
+	 * @brief Converts a time point into a FILETIME tick count.
+	 * @param time_point The time point.
+	 * @return 100-nanosecond intervals since January 1, 1601 (UTC); 0 for earlier time points and for
+	 * system_clock::time_point::min().
+	 */
+	DllExport uint64_t time_point_to_filetime(std::chrono::system_clock::time_point time_point);
+}
@@ -0,0 +1,79 @@
+#include <iterator>
+#include "key_cache.h"
+#include "scan_arena.h"
+
+using namespace win32::registry;
+
+key_cache::key_cache(const key_entry& root, size_t capacity) :
+	m_root(root), m_capacity(capacity), m_mutex(), m_entries(), m_index(), m_hits(0), m_misses(0)
+{
+}
+
+key_entry key_cache::open(std::wstring_view path)
+{
+	// Cached keys outlive any scan arena the caller has in scope, so they are always opened on the heap.
+	arena_scope heap{ std::pmr::get_default_resource() };
+	key_path key{ path };
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		auto it = m_index.find(key);
+		if (it != m_index.end())
+		{
+			m_entries.splice(m_entries.begin(), m_entries, it->second);
+			m_hits++;
+			return it->second->second;
+		}
+		m_misses++;
+	}
+
+	// Opened without holding the lock so a slow open does not block hits on other paths.
+	key_entry opened = m_root.open_subkey(std::wstring{ path });
+
+	// Declared before the lock so an evicted key is closed after the lock is released.
+	entry_list evicted;
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	auto it = m_index.find(key);
+	if (it != m_index.end())
+	{
+		// Another thread opened the same key meanwhile; keep theirs.
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		return it->second->second;
+	}
+	if (m_capacity == 0)
+	{
+		return opened;
+	}
+	if (m_entries.size() >= m_capacity)
+	{
+		m_index.erase(m_entries.back().first);
+		evicted.splice(evicted.begin(), m_entries, std::prev(m_entries.end()));
+	}
+	m_entries.emplace_front(key, opened);
+	m_index.emplace(std::move(key), m_entries.begin());
+	return opened;
+}
+
+uint64_t key_cache::hits() const
+{
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_hits;
+}
+
+uint64_t key_cache::misses() const
+{
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_misses;
+}
+
+size_t key_cache::size() const
+{
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_entries.size();
+}
+
+void key_cache::clear()
+{
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	m_index.clear();
+	m_entries.clear();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include "key_entry.h"
+#include "key_path.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Keeps recently opened keys below a root open, so opening the same path again reuses them.
+	 *
+	 * Paths are compared ignoring case. Once full, the least recently used key is closed to make room. Safe to use
+	 * from several threads. Cached keys are opened on the heap even inside an arena_scope.
+	 */
+	class DllExport key_cache
+	{
+	public:
+		/**
+		 * @brief Creates an empty cache.
+		 * @param root The key paths are relative to.
+		 * @param capacity The number of keys kept open.
+		 */
+		explicit key_cache(const key_entry& root, size_t capacity);
+
+		key_cache(const key_cache&) = delete;
+		key_cache& operator=(const key_cache&) = delete;
+
+		/**
+		 * @brief Opens a key, reusing the cached key if there is one.
+		 * @param path The path of the key, relative to the root.
+		 * @return The key.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		key_entry open(std::wstring_view path);
+
+		/**
+		 * @brief Gets the number of opens served from the cache.
+		 * @return The number of hits.
+		 */
+		uint64_t hits() const;
+
+		/**
+		 * @brief Gets the number of opens that had to open the key.
+		 * @return The number of misses.
+		 */
+		uint64_t misses() const;
+
+		/**
+		 * @brief Gets the number of keys currently cached.
+		 * @return The number of keys.
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief Closes all cached keys. Keys still referenced elsewhere stay open.
+		 */
+		void clear();
+
+	private:
+		using entry_list = std::list<std::pair<key_path, key_entry>>;
+
+		key_entry m_root;
+		size_t m_capacity;
+		mutable std::mutex m_mutex;
+		/** Most recently used first. */
+		entry_list m_entries;
+		std::unordered_map<key_path, entry_list::iterator> m_index;
+		uint64_t m_hits;
+		uint64_t m_misses;
+	};
+}
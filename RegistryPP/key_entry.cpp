@@ -1,10 +1,21 @@
-#include <wil/result.h>
-#include <wil/win32_helpers.h>
 #include "key_entry.h"
+#include <unordered_map>
+#include "instrumentation.h"
+#include "key_backend.h"
+#include "scan_arena.h"
+#include "value_batch.h"
+#include "value_entry.h"
+#include "sub_key_range.h"
+#include "utf16.h"
+#include "value_range.h"
+#ifdef _WIN32
+#include "win32_backend.h"
+#endif // _WIN32
 
 using namespace win32::registry;
 
-#define OPEN_ROOT(root) key_entry(nullptr, root, L#root)
+#ifdef _WIN32
+#define OPEN_ROOT(root) key_entry(nullptr, std::make_unique<win32_key_backend>(root, false), L#root)
 
 /**
 * @brief Opens the HKEY_LOCAL_MACHINE root key.
@@ -70,6 +81,21 @@ key_entry key_entry::open_current_config()
 {
 	return OPEN_ROOT(HKEY_CURRENT_CONFIG);
 }
+#endif // _WIN32
+
+/**
+* @brief Creates a root key served by a storage backend.
+* @param root The backend of the root key.
+* @param name The name of the root key.
+* @return The root key.
+* @exception wil::ResultException
+* @exception registry_error
+*/
+
+key_entry key_entry::from_backend(std::unique_ptr<key_backend> root, const std::wstring& name)
+{
+	return key_entry(nullptr, std::move(root), name);
+}
 
 /**
 * @brief Open a sub key.
@@ -80,9 +106,141 @@ key_entry key_entry::open_current_config()
 
 key_entry key_entry::open_subkey(const std::wstring& name) const
 {
-	HKEY self;
-	THROW_IF_NTSTATUS_FAILED(RegOpenKeyEx(m_data->m_self, name.c_str(), 0, KEY_READ | KEY_WRITE, &self));
-	return key_entry(m_data, self, name);
+	return key_entry(m_data, m_data->m_self->open_subkey(name), name);
+}
+
+std::optional<key_entry> key_entry::try_open_subkey(const std::wstring& name) const
+{
+	auto backend = m_data->m_self->try_open_subkey(name);
+	if (!backend)
+	{
+		return std::nullopt;
+	}
+	return key_entry(m_data, std::move(backend), name);
+}
+
+std::optional<value_entry> key_entry::get_value(const std::wstring& name) const
+{
+	value_buffer buffer;
+	auto view = m_data->m_self->find_value(name, buffer);
+	if (!view)
+	{
+		return std::nullopt;
+	}
+	return value_entry::from_view(*view, *this);
+}
+
+value_batch key_entry::get_values(const std::vector<std::wstring>& names) const
+{
+	value_batch batch;
+	batch.m_keys.push_back(*this);
+	batch.m_key_of.assign(names.size(), 0);
+	batch.m_names = names;
+	m_data->m_self->query_values(names, batch.m_results, *batch.m_data);
+	return batch;
+}
+
+value_batch key_entry::get_values_by_path(const std::vector<std::pair<std::wstring, std::wstring>>& requests) const
+{
+	value_batch batch;
+	batch.m_key_of.resize(requests.size());
+	batch.m_names.reserve(requests.size());
+	batch.m_results.resize(requests.size());
+
+	// Group the requests by key, in order of first appearance.
+	std::unordered_map<key_path, uint32_t> group_of;
+	std::vector<key_path> paths;
+	std::vector<std::vector<size_t>> groups;
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		auto [it, inserted] = group_of.try_emplace(key_path{ requests[i].first }, static_cast<uint32_t>(groups.size()));
+		if (inserted)
+		{
+			paths.push_back(it->first);
+			groups.emplace_back();
+		}
+		groups[it->second].push_back(i);
+		batch.m_names.push_back(requests[i].second);
+	}
+
+	std::vector<std::wstring> names;
+	std::vector<batch_value> results;
+	for (size_t group = 0; group < groups.size(); group++)
+	{
+		std::optional<key_entry> key = paths[group].empty() ? std::optional<key_entry>{ *this } : try_open_subkey(paths[group].str());
+		if (!key)
+		{
+			// Results stay "not found".
+			continue;
+		}
+		uint32_t key_index = static_cast<uint32_t>(batch.m_keys.size());
+		batch.m_keys.push_back(*key);
+		names.clear();
+		for (size_t request : groups[group])
+		{
+			names.push_back(requests[request].second);
+		}
+		key->m_data->m_self->query_values(names, results, *batch.m_data);
+		for (size_t j = 0; j < groups[group].size(); j++)
+		{
+			batch.m_key_of[groups[group][j]] = key_index;
+			batch.m_results[groups[group][j]] = results[j];
+		}
+	}
+	return batch;
+}
+
+void key_entry::set_value(const std::wstring& name, registry_value_type type, const void* data, uint32_t size) const
+{
+	m_data->m_self->set_value(name, type, static_cast<const uint8_t*>(data), size);
+}
+
+void key_entry::set_dword(const std::wstring& name, uint32_t data) const
+{
+	set_value(name, registry_value_type::dword, &data, sizeof data);
+}
+
+void key_entry::set_qword(const std::wstring& name, uint64_t data) const
+{
+	set_value(name, registry_value_type::qword, &data, sizeof data);
+}
+
+void key_entry::set_string(const std::wstring& name, std::wstring_view data) const
+{
+	std::vector<uint8_t> bytes;
+	utf16::append_bytes(bytes, data);
+	bytes.push_back(0);
+	bytes.push_back(0);
+	set_value(name, registry_value_type::string, bytes.data(), static_cast<uint32_t>(bytes.size()));
+}
+
+void key_entry::set_strings(const std::wstring& name, const std::vector<std::wstring>& data) const
+{
+	std::vector<uint8_t> bytes;
+	for (const auto& string : data)
+	{
+		utf16::append_bytes(bytes, string);
+		bytes.push_back(0);
+		bytes.push_back(0);
+	}
+	bytes.push_back(0);
+	bytes.push_back(0);
+	set_value(name, registry_value_type::multi_string, bytes.data(), static_cast<uint32_t>(bytes.size()));
+}
+
+bool key_entry::delete_value(const std::wstring& name) const
+{
+	return m_data->m_self->delete_value(name);
+}
+
+key_entry key_entry::create_subkey(const std::wstring& name) const
+{
+	return key_entry(m_data, m_data->m_self->create_subkey(name), name);
+}
+
+bool key_entry::delete_subtree(const std::wstring& name) const
+{
+	return m_data->m_self->delete_subtree(name);
 }
 
 /**
@@ -102,6 +260,7 @@ std::wstring& key_entry::name() const
 
 std::wstring& key_entry::key_class() const
 {
+	m_data->load_info();
 	return m_data->m_class;
 }
 
@@ -112,6 +271,7 @@ std::wstring& key_entry::key_class() const
 
 uint32_t key_entry::sub_key_count() const
 {
+	m_data->load_info();
 	return m_data->m_sub_keys_count;
 }
 
@@ -122,9 +282,30 @@ uint32_t key_entry::sub_key_count() const
 
 uint32_t key_entry::value_count() const
 {
+	m_data->load_info();
 	return m_data->m_values_count;
 }
 
+std::wstring key_entry::sub_key_name(uint32_t index) const
+{
+	return m_data->m_self->sub_key_name(index);
+}
+
+sub_key_range key_entry::subkeys() const
+{
+	return sub_key_range{ *this };
+}
+
+value_range key_entry::values() const
+{
+	return value_range{ *this };
+}
+
+value_range key_entry::values(value_enumeration mode) const
+{
+	return value_range{ *this, mode };
+}
+
 /**
 * @brief Gets the last time the key was written.
 * @return The last time the key was written.
@@ -132,33 +313,22 @@ uint32_t key_entry::value_count() const
 
 std::chrono::system_clock::time_point& key_entry::last_written() const
 {
+	m_data->load_info();
 	return m_data->m_last_written;
 }
 
 bool key_entry::operator==(key_entry rhs) const
 {
-	if (is_root())
-	{
-		return m_data->m_self == rhs.m_data->m_self;
-	}
-	if (rhs.is_root())
+	if (m_data == rhs.m_data)
 	{
-		return false;
+		return true;
 	}
-	return name() == rhs.name() && parent() == rhs.parent();
+	return m_data->m_path == rhs.m_data->m_path && m_data->m_root->m_self->same_key(*rhs.m_data->m_root->m_self);
 }
 
 bool key_entry::operator!=(key_entry rhs) const
 {
-	if (is_root())
-	{
-		return m_data->m_self != rhs.m_data->m_self;
-	}
-	if (rhs.is_root())
-	{
-		return false;
-	}
-	return parent() != rhs.parent() || name() != rhs.name();
+	return !(*this == rhs);
 }
 
 bool win32::registry::key_entry::is_root() const
@@ -168,51 +338,41 @@ bool win32::registry::key_entry::is_root() const
 
 std::wstring win32::registry::key_entry::path() const
 {
-	if (is_root())
-	{
-		return name();
-	}
-	return parent().path() + L"\\" + name();
+	return m_data->m_path.str();
 }
 
-std::chrono::system_clock::time_point filetime_to_time_point(const FILETIME& ft)
+const key_path& key_entry::interned_path() const
 {
-	// number of seconds
-	ULARGE_INTEGER ull;
-	ull.LowPart = ft.dwLowDateTime;
-	ull.HighPart = ft.dwHighDateTime;
-
-	time_t secs = (LONGLONG)ull.QuadPart / wil::filetime_duration::one_second - 11644473600LL;
-	std::chrono::milliseconds ms((ull.QuadPart / 10000LL) % 1000);
-
-	auto tp = std::chrono::system_clock::from_time_t(secs);
-	tp += ms;
-	return tp;
+	return m_data->m_path;
 }
 
 uint32_t key_entry::max_sub_key_name_length() const
 {
+	m_data->load_info();
 	return m_data->m_max_sub_key_name_length;
 }
 
 uint32_t key_entry::max_class_length() const
 {
+	m_data->load_info();
 	return m_data->m_max_class_length;
 }
 
 uint32_t key_entry::max_value_name_length() const
 {
+	m_data->load_info();
 	return m_data->m_max_value_name_length;
 }
 
 uint32_t key_entry::max_value_data_length() const
 {
+	m_data->load_info();
 	return m_data->m_max_value_data_length;
 }
 
-HKEY key_entry::self() const
+key_backend& key_entry::self() const
 {
-	return m_data->m_self;
+	return *m_data->m_self;
 }
 
 key_entry win32::registry::key_entry::parent() const
@@ -220,40 +380,36 @@ key_entry win32::registry::key_entry::parent() const
 	return key_entry{ m_data->m_parent };
 }
 
-key_entry::data::data(const std::shared_ptr<data> parent, HKEY self, const std::wstring& name) :
-	m_parent(parent), m_self(self), m_name(name)
-{
-	WCHAR    $class[MAX_PATH] = TEXT(""); // buffer for class name
-	DWORD    class_length = MAX_PATH;     // size of class string
-	DWORD    cb_security_descriptor;      // size of security descriptor
-	FILETIME last_written;                // last write time
-	THROW_IF_NTSTATUS_FAILED(RegQueryInfoKey(
-		self,                                // key handle
-		$class,                              // buffer for class name
-		&class_length,                       // size of class string
-		nullptr,                             // reserved
-		(LPDWORD)&m_sub_keys_count,          // number of subkeys
-		(LPDWORD)&m_max_sub_key_name_length, // longest subkey size
-		(LPDWORD)&m_max_class_length,        // longest class string
-		(LPDWORD)&m_values_count,            // number of values for this key
-		(LPDWORD)&m_max_value_name_length,   // longest value name
-		(LPDWORD)&m_max_value_data_length,   // longest value data
-		&cb_security_descriptor,             // security descriptor
-		&last_written));                     // last write time
-	m_last_written = filetime_to_time_point(last_written);
-	m_class = std::wstring{ $class, class_length };
+key_entry::data::data(const std::shared_ptr<data> parent, std::unique_ptr<key_backend> self, const std::wstring& name) :
+	m_parent(parent), m_root(parent ? parent->m_root : this), m_self(REGISTRYPP_INSTRUMENT_BACKEND(std::move(self))), m_name(name), m_path(parent ? parent->m_path.append(name) : key_path{ name }), m_sub_keys_count(0), m_max_sub_key_name_length(0), m_max_class_length(0),
+	m_values_count(0), m_max_value_name_length(0), m_max_value_data_length(0)
+{
+	REGISTRYPP_TRACK_KEY(1);
 }
 
-win32::registry::key_entry::data::~data()
+void key_entry::data::load_info()
 {
-	if (m_parent)
+	std::call_once(m_info_loaded, [this]
 	{
-		LOG_IF_NTSTATUS_FAILED(RegCloseKey(m_self));
-	}
+		key_info info = m_self->query_info();
+		m_class = std::move(info.key_class);
+		m_sub_keys_count = info.sub_keys_count;
+		m_max_sub_key_name_length = info.max_sub_key_name_length;
+		m_max_class_length = info.max_class_length;
+		m_values_count = info.values_count;
+		m_max_value_name_length = info.max_value_name_length;
+		m_max_value_data_length = info.max_value_data_length;
+		m_last_written = info.last_written;
+	});
+}
+
+win32::registry::key_entry::data::~data()
+{
+	REGISTRYPP_TRACK_KEY(-1);
 }
 
-key_entry::key_entry(const std::shared_ptr<data> parent, HKEY self, const std::wstring& name) :
-	m_data(std::make_shared<data>(parent, self, name))
+key_entry::key_entry(const std::shared_ptr<data> parent, std::unique_ptr<key_backend> self, const std::wstring& name) :
+	m_data(std::allocate_shared<data>(std::pmr::polymorphic_allocator<data>{ arena_scope::current() }, parent, std::move(self), name))
 {
 }
 
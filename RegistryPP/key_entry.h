@@ -1,21 +1,28 @@
 #pragma once
 
-#define WIN32_LEAN_AND_MEAN 1
-
-#include <Windows.h>
+#include <cstdint>
 #include <string>
 #include <chrono>
 #include <memory>
-
-#ifdef _DLL
-#define DllExport __declspec( dllexport )
-#else
-#define DllExport
-#endif // _DLL
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "dll_export.h"
+#include "key_path.h"
+#include "registry_value_type.h"
 
 
 namespace win32::registry
 {
+	class key_backend;
+	class sub_key_range;
+	class value_range;
+	class value_entry;
+	class value_batch;
+	class write_batch;
+	enum class value_enumeration : uint8_t;
+
 	/**
 	 * @brief A key in the registry.
 	*/
@@ -24,7 +31,11 @@ namespace win32::registry
 	public:
 		friend class key_entry_iterator;
 		friend class value_entry_iterator;
+		friend class value_range;
+		friend class value_stream;
+		friend class write_batch;
 
+#ifdef _WIN32
 		/**
 		 * @brief Opens the HKEY_LOCAL_MACHINE root key.
 		 * @return The HKEY_LOCAL_MACHINE key.
@@ -66,6 +77,17 @@ namespace win32::registry
 		 * @exception wil::ResultException
 		*/
 		static key_entry open_current_config();
+#endif // _WIN32
+
+		/**
+		 * @brief Creates a root key served by a storage backend.
+		 * @param root The backend of the root key.
+		 * @param name The name of the root key.
+		 * @return The root key.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		*/
+		static key_entry from_backend(std::unique_ptr<key_backend> root, const std::wstring& name);
 
 		/**
 		 * @brief Open a sub key.
@@ -75,6 +97,124 @@ namespace win32::registry
 		*/
 		key_entry open_subkey(const std::wstring& name) const;
 
+		/**
+		 * @brief Opens a sub key that may not exist.
+		 * @param name The desired key's name.
+		 * @return The sub key, or nothing if it does not exist.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		*/
+		std::optional<key_entry> try_open_subkey(const std::wstring& name) const;
+
+		/**
+		 * @brief Reads a single value by name. Include value_entry.h to use the result.
+		 * @param name The name of the value.
+		 * @return The value, or nothing if it does not exist.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		*/
+		std::optional<value_entry> get_value(const std::wstring& name) const;
+
+		/**
+		 * @brief Reads several values of the key at once, into one shared buffer.
+		 *
+		 * Include value_batch.h to use the result. Values that do not exist are reported per entry.
+		 * @param names The names of the values.
+		 * @return The values, in the same order as names.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		*/
+		value_batch get_values(const std::vector<std::wstring>& names) const;
+
+		/**
+		 * @brief Reads values spread over several keys at once, into one shared buffer.
+		 *
+		 * Requests are grouped by key so every key is opened and queried once. Missing keys and values are reported per
+		 * entry.
+		 * @param requests Pairs of a key path, relative to this key (empty for this key), and a value name.
+		 * @return The values, in the same order as requests.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		*/
+		value_batch get_values_by_path(const std::vector<std::pair<std::wstring, std::wstring>>& requests) const;
+
+		/**
+		 * @brief Creates or replaces a value of the key.
+		 *
+		 * Metadata already read from this entry, such as value_count, is not refreshed; open the key again to see it.
+		 * To change several values at once, all or none of them, use a write_batch.
+		 * @param name The name of the value.
+		 * @param type The type of the value.
+		 * @param data The raw data of the value.
+		 * @param size The size of the data in bytes.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		void set_value(const std::wstring& name, registry_value_type type, const void* data, uint32_t size) const;
+
+		/**
+		 * @brief Creates or replaces a REG_DWORD value of the key.
+		 * @param name The name of the value.
+		 * @param data The value.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		void set_dword(const std::wstring& name, uint32_t data) const;
+
+		/**
+		 * @brief Creates or replaces a REG_QWORD value of the key.
+		 * @param name The name of the value.
+		 * @param data The value.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		void set_qword(const std::wstring& name, uint64_t data) const;
+
+		/**
+		 * @brief Creates or replaces a REG_SZ value of the key.
+		 * @param name The name of the value.
+		 * @param data The value.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		void set_string(const std::wstring& name, std::wstring_view data) const;
+
+		/**
+		 * @brief Creates or replaces a REG_MULTI_SZ value of the key.
+		 * @param name The name of the value.
+		 * @param data The strings.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		void set_strings(const std::wstring& name, const std::vector<std::wstring>& data) const;
+
+		/**
+		 * @brief Deletes a value of the key.
+		 * @param name The name of the value.
+		 * @return true if the value existed; otherwise false.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		bool delete_value(const std::wstring& name) const;
+
+		/**
+		 * @brief Opens a sub key, creating it and any missing parents first.
+		 * @param name The desired key's name.
+		 * @return The sub key.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		key_entry create_subkey(const std::wstring& name) const;
+
+		/**
+		 * @brief Deletes a sub key with all of its sub keys and values.
+		 * @param name The sub key's name.
+		 * @return true if the sub key existed; otherwise false.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		*/
+		bool delete_subtree(const std::wstring& name) const;
+
 		/**
 		 * @brief Gets the name of the key.
 		 * @return The name of the key.
@@ -99,12 +239,50 @@ namespace win32::registry
 		*/
 		uint32_t value_count() const;
 
+		/**
+		 * @brief Gets the name of a sub key without opening it.
+		 * @param index The index of the sub key.
+		 * @return The name of the sub key.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		*/
+		std::wstring sub_key_name(uint32_t index) const;
+
+		/**
+		 * @brief Gets the sub keys as a single pass range that keeps only one sub key open at a time.
+		 *
+		 * Include sub_key_range.h to use the result.
+		 * @return The sub keys.
+		*/
+		sub_key_range subkeys() const;
+
+		/**
+		 * @brief Gets the values as a single pass range that keeps only one value in memory at a time.
+		 *
+		 * Include value_range.h to use the result.
+		 * @return The values.
+		*/
+		value_range values() const;
+
+		/**
+		 * @brief Gets the values as a single pass range that keeps only one value in memory at a time.
+		 * @param mode What to read for every value.
+		 * @return The values.
+		*/
+		value_range values(value_enumeration mode) const;
+
 		/**
 		 * @brief Gets the last time the key was written.
 		 * @return The last time the key was written.
 		*/
 		std::chrono::system_clock::time_point& last_written() const;
 
+		/**
+		 * @brief Compares two keys by root and path, ignoring case.
+		 *
+		 * Copies of one entry compare by identity and keys at different paths by path hash, both in constant time. Only
+		 * keys at the same path compare their names, stopping at the first segment their paths share.
+		 */
 		bool operator ==(key_entry rhs) const;
 		bool operator !=(key_entry rhs) const;
 
@@ -123,17 +301,34 @@ namespace win32::registry
 		 */
 		std::wstring path() const;
 
+		/**
+		 * @brief Gets the path of the registry key without building a string.
+		 *
+		 * The path shares its segments with the key's parent and siblings.
+		 *
+		 * @return The path of the registry key.
+		 */
+		const key_path& interned_path() const;
+
 	private:
 		struct DllExport data
 		{
 		public:
-			explicit data(const std::shared_ptr<data> parent, HKEY self, const std::wstring& name);
+			explicit data(const std::shared_ptr<data> parent, std::unique_ptr<key_backend> self, const std::wstring& name);
 
 			~data();
 
+			/**
+			 * Queries the key's metadata the first time any of it is needed. Opening a key never queries it.
+			 */
+			void load_info();
+
 			std::shared_ptr<data> m_parent;
-			HKEY m_self;
+			/** The root the key was opened from; the parent chain keeps it alive. */
+			const data* m_root;
+			std::unique_ptr<key_backend> m_self;
 			std::wstring m_name;
+			key_path m_path;
 			std::wstring m_class;
 			uint32_t m_sub_keys_count;
 			uint32_t m_max_sub_key_name_length;
@@ -142,9 +337,10 @@ namespace win32::registry
 			uint32_t m_max_value_name_length;
 			uint32_t m_max_value_data_length;
 			std::chrono::system_clock::time_point m_last_written;
+			std::once_flag m_info_loaded;
 		};
 
-		explicit key_entry(const std::shared_ptr<data> parent, HKEY self, const std::wstring& name);
+		explicit key_entry(const std::shared_ptr<data> parent, std::unique_ptr<key_backend> self, const std::wstring& name);
 
 		explicit key_entry(const std::shared_ptr<data> self_data);
 
@@ -156,7 +352,7 @@ namespace win32::registry
 
 		uint32_t max_value_data_length() const;
 
-		HKEY self() const;
+		key_backend& self() const;
 
 		key_entry parent() const;
 
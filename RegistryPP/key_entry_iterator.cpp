@@ -1,4 +1,5 @@
 #include "key_entry_iterator.h"
+#include "key_backend.h"
 
 using namespace win32::registry;
 
@@ -13,10 +14,7 @@ key_entry_iterator::reference key_entry_iterator::get(difference_type i)
 	{
 		return it->second;
 	}
-	WCHAR name[MAX_PATH] = TEXT("");
-	DWORD name_length = MAX_PATH;
-	THROW_IF_NTSTATUS_FAILED(RegEnumKeyEx(m_entry.self(), i, name, &name_length, nullptr, nullptr, nullptr, nullptr));
-	auto sub_entry = m_entry.open_subkey(std::wstring{ name, name_length });
+	auto sub_entry = m_entry.open_subkey(m_entry.self().sub_key_name(i));
 	return m_sub_entries.insert_or_assign(i, sub_entry).first->second;
 }
 
@@ -33,7 +31,7 @@ key_entry_iterator& key_entry_iterator::operator++()
 
 bool key_entry_iterator::operator==(key_entry_iterator rhs) const
 {
-	return m_entry == rhs.m_entry && m_current == m_current;
+	return m_entry == rhs.m_entry && m_current == rhs.m_current;
 }
 
 bool key_entry_iterator::operator!=(key_entry_iterator rhs) const
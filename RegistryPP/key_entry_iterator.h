@@ -2,12 +2,15 @@
 
 #include <iterator>
 #include <map>
-#include <Windows.h>
-#include <wil/result.h>
 #include "key_entry.h"
 
 namespace win32::registry
 {
+	/**
+	 * @brief Random access iterator that caches every sub key it has visited for as long as it lives.
+	 *
+	 * Prefer key_entry::subkeys() for scans; it keeps only the current sub key in memory.
+	 */
 	class DllExport key_entry_iterator
 	{
 	public:
@@ -35,7 +38,7 @@ namespace win32::registry
 		reference get(difference_type i);
 
 		difference_type                       m_current;
-		byte                                  m_reserved[4];
+		uint8_t                               m_reserved[4];
 		value_type                            m_entry;
 		std::map<difference_type, value_type> m_sub_entries;
 	};
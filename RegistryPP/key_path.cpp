@@ -0,0 +1,124 @@
+#include "key_path.h"
+#include "scan_arena.h"
+#include "utf16.h"
+
+using namespace win32::registry;
+
+struct key_path::segment
+{
+	std::shared_ptr<const segment> parent;
+	std::pmr::wstring name;
+	uint64_t hash;
+	size_t length;
+	uint32_t depth;
+};
+
+key_path::key_path(std::wstring_view path) :
+	key_path(key_path{}.append(path))
+{
+}
+
+key_path::key_path(std::shared_ptr<const segment> last) :
+	m_last(std::move(last))
+{
+}
+
+key_path key_path::append(std::wstring_view relative) const
+{
+	std::shared_ptr<const segment> last = m_last;
+	while (!relative.empty())
+	{
+		size_t separator = relative.find(L'\\');
+		std::wstring_view name = relative.substr(0, separator);
+		relative = separator == std::wstring_view::npos ? std::wstring_view{} : relative.substr(separator + 1);
+		if (name.empty())
+		{
+			continue;
+		}
+		uint64_t hash = utf16::fold_hash_seed;
+		size_t length = name.size();
+		uint32_t depth = 1;
+		if (last)
+		{
+			hash = utf16::fold_hash(last->hash, L"\\");
+			length += last->length + 1;
+			depth += last->depth;
+		}
+		hash = utf16::fold_hash(hash, name);
+		auto* resource = arena_scope::current();
+		last = std::allocate_shared<const segment>(std::pmr::polymorphic_allocator<segment>{ resource }, segment{ std::move(last), std::pmr::wstring{ name, resource }, hash, length, depth });
+	}
+	return key_path{ std::move(last) };
+}
+
+key_path key_path::parent() const
+{
+	return m_last ? key_path{ m_last->parent } : key_path{};
+}
+
+std::wstring_view key_path::name() const
+{
+	return m_last ? std::wstring_view{ m_last->name } : std::wstring_view{};
+}
+
+uint32_t key_path::depth() const
+{
+	return m_last ? m_last->depth : 0;
+}
+
+size_t key_path::length() const
+{
+	return m_last ? m_last->length : 0;
+}
+
+uint64_t key_path::hash() const
+{
+	return m_last ? m_last->hash : utf16::fold_hash_seed;
+}
+
+bool key_path::empty() const
+{
+	return !m_last;
+}
+
+std::wstring key_path::str() const
+{
+	std::wstring result(length(), L'\\');
+	size_t end = result.size();
+	for (const segment* current = m_last.get(); current != nullptr; current = current->parent.get())
+	{
+		end -= current->name.size();
+		result.replace(end, current->name.size(), current->name);
+		if (end != 0)
+		{
+			end--;
+		}
+	}
+	return result;
+}
+
+bool key_path::operator==(const key_path& rhs) const
+{
+	const segment* lhs_segment = m_last.get();
+	const segment* rhs_segment = rhs.m_last.get();
+	if (hash() != rhs.hash() || length() != rhs.length() || depth() != rhs.depth())
+	{
+		return false;
+	}
+	// Shared parents end the comparison early; siblings only compare their last segment.
+	while (lhs_segment != rhs_segment)
+	{
+		if (!utf16::equals_ignore_case(lhs_segment->name, rhs_segment->name))
+		{
+			return false;
+		}
+		lhs_segment = lhs_segment->parent.get();
+		rhs_segment = rhs_segment->parent.get();
+	}
+	return true;
+}
+
+bool key_path::operator!=(const key_path& rhs) const
+{
+	return !(*this == rhs);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "dll_export.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief An immutable key path, stored as a chain of segments that point to their parent.
+	 *
+	 * Appending shares the parent's segments, so all children of a key share one copy of its path. The length, depth
+	 * and case-insensitive hash of the path are kept up to date as segments are appended, so none of them walk the
+	 * chain, and the path is only turned into a string, with a single allocation, when asked to.
+	 */
+	class DllExport key_path
+	{
+	public:
+		/**
+		 * @brief Creates the empty path.
+		 */
+		key_path() = default;
+
+		/**
+		 * @brief Creates a path from its backslash separated string form.
+		 * @param path The path. Empty components are ignored.
+		 */
+		explicit key_path(std::wstring_view path);
+
+		/**
+		 * @brief Gets a path below this one.
+		 * @param relative The relative path. May contain several backslash separated components.
+		 * @return The combined path.
+		 */
+		key_path append(std::wstring_view relative) const;
+
+		/**
+		 * @brief Gets the path without its last segment.
+		 * @return The parent path; the empty path for paths with less than two segments.
+		 */
+		key_path parent() const;
+
+		/**
+		 * @brief Gets the last segment.
+		 * @return The last segment, or an empty string for the empty path.
+		 */
+		std::wstring_view name() const;
+
+		/**
+		 * @brief Gets the number of segments.
+		 * @return The number of segments.
+		 */
+		uint32_t depth() const;
+
+		/**
+		 * @brief Gets the length of the string form of the path.
+		 * @return The length in characters.
+		 */
+		size_t length() const;
+
+		/**
+		 * @brief Gets a hash of the path that ignores case, computed in constant time.
+		 * @return The hash of the path.
+		 */
+		uint64_t hash() const;
+
+		bool empty() const;
+
+		/**
+		 * @brief Builds the backslash separated string form of the path.
+		 * @return The path.
+		 */
+		std::wstring str() const;
+
+		/**
+		 * @brief Compares two paths the way the registry does, ignoring case.
+		 */
+		bool operator==(const key_path& rhs) const;
+		bool operator!=(const key_path& rhs) const;
+
+	private:
+		struct segment;
+
+		explicit key_path(std::shared_ptr<const segment> last);
+
+		std::shared_ptr<const segment> m_last;
+	};
+}
+
+template<>
+struct std::hash<win32::registry::key_path>
+{
+	size_t operator()(const win32::registry::key_path& path) const noexcept
+	{
+		return static_cast<size_t>(path.hash());
+	}
+};
@@ -0,0 +1,118 @@
+#include <system_error>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+using namespace win32::registry;
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const std::filesystem::path& path) :
+	m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{
+	m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), path.string());
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		auto error = GetLastError();
+		CloseHandle(m_file);
+		throw std::system_error(static_cast<int>(error), std::system_category(), path.string());
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0)
+	{
+		return;
+	}
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr)
+	{
+		m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (m_data == nullptr)
+	{
+		auto error = GetLastError();
+		if (m_mapping != nullptr)
+		{
+			CloseHandle(m_mapping);
+		}
+		CloseHandle(m_file);
+		throw std::system_error(static_cast<int>(error), std::system_category(), path.string());
+	}
+}
+
+mapped_file::~mapped_file()
+{
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+	}
+	CloseHandle(m_file);
+}
+
+#else
+
+mapped_file::mapped_file(const std::filesystem::path& path) :
+	m_data(nullptr), m_size(0)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		throw std::system_error(errno, std::generic_category(), path.string());
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+	{
+		int error = errno;
+		::close(fd);
+		throw std::system_error(error, std::generic_category(), path.string());
+	}
+	m_size = static_cast<size_t>(st.st_size);
+	if (m_size != 0)
+	{
+		void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			int error = errno;
+			::close(fd);
+			throw std::system_error(error, std::generic_category(), path.string());
+		}
+		m_data = static_cast<const uint8_t*>(data);
+	}
+	// The mapping keeps the file alive on its own.
+	::close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+	if (m_data != nullptr)
+	{
+		::munmap(const_cast<uint8_t*>(m_data), m_size);
+	}
+}
+
+#endif // _WIN32
+
+const uint8_t* mapped_file::data() const
+{
+	return m_data;
+}
+
+size_t mapped_file::size() const
+{
+	return m_size;
+}
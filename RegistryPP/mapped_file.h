@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include "key_entry.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A read-only memory mapping of a whole file.
+	 */
+	class DllExport mapped_file
+	{
+	public:
+		/**
+		 * @brief Maps a file into memory.
+		 * @param path The path of the file.
+		 * @exception std::system_error
+		 */
+		explicit mapped_file(const std::filesystem::path& path);
+
+		~mapped_file();
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		/**
+		 * @brief Gets the start of the mapping.
+		 * @return The start of the mapping.
+		 */
+		const uint8_t* data() const;
+
+		/**
+		 * @brief Gets the size of the file.
+		 * @return The size of the file in bytes.
+		 */
+		size_t size() const;
+
+	private:
+		const uint8_t* m_data;
+		size_t m_size;
+#ifdef _WIN32
+		void* m_file;
+		void* m_mapping;
+#endif // _WIN32
+	};
+}
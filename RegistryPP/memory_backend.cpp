@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include "memory_backend.h"
+#include "registry_error.h"
+#include "utf16.h"
+
+using namespace win32::registry;
+
+static std::vector<std::wstring_view> split_path(std::wstring_view path)
+{
+	std::vector<std::wstring_view> components;
+	size_t start = 0;
+	while (start <= path.size())
+	{
+		size_t end = path.find(L'\\', start);
+		if (end == std::wstring_view::npos)
+		{
+			end = path.size();
+		}
+		if (end > start)
+		{
+			components.push_back(path.substr(start, end - start));
+		}
+		start = end + 1;
+	}
+	return components;
+}
+
+std::shared_ptr<memory_key> memory_key::create(const std::wstring& name)
+{
+	return std::shared_ptr<memory_key>{ new memory_key{ name, nullptr } };
+}
+
+memory_key::memory_key(const std::wstring& name, memory_key* parent) :
+	m_name(name), m_class(), m_last_written(std::chrono::system_clock::now()), m_parent(parent), m_children(), m_children_index(),
+	m_values(), m_values_index(), m_value_data(), m_live_data(0)
+{
+}
+
+key_entry memory_key::open()
+{
+	return key_entry::from_backend(std::make_unique<memory_key_backend>(shared_from_this()), m_name);
+}
+
+const std::wstring& memory_key::name() const
+{
+	return m_name;
+}
+
+const std::wstring& memory_key::key_class() const
+{
+	return m_class;
+}
+
+void memory_key::set_key_class(const std::wstring& key_class)
+{
+	m_class = key_class;
+}
+
+std::chrono::system_clock::time_point memory_key::last_written() const
+{
+	return m_last_written;
+}
+
+void memory_key::set_last_written(std::chrono::system_clock::time_point last_written)
+{
+	m_last_written = last_written;
+}
+
+memory_key& memory_key::add_subkey(const std::wstring& name)
+{
+	auto folded = utf16::fold(name);
+	auto it = m_children_index.find(folded);
+	if (it != m_children_index.end())
+	{
+		return *m_children[it->second];
+	}
+	m_children_index.emplace(std::move(folded), static_cast<uint32_t>(m_children.size()));
+	m_children.push_back(std::shared_ptr<memory_key>{ new memory_key{ name, this } });
+	touch();
+	return *m_children.back();
+}
+
+bool memory_key::delete_subkey(std::wstring_view name)
+{
+	auto it = m_children_index.find(utf16::fold(name));
+	if (it == m_children_index.end())
+	{
+		return false;
+	}
+	uint32_t index = it->second;
+	m_children_index.erase(it);
+	m_children.erase(m_children.begin() + index);
+	for (auto& entry : m_children_index)
+	{
+		if (entry.second > index)
+		{
+			entry.second--;
+		}
+	}
+	touch();
+	return true;
+}
+
+memory_key* memory_key::find_subkey(std::wstring_view name) const
+{
+	auto it = m_children_index.find(utf16::fold(name));
+	return it != m_children_index.end() ? m_children[it->second].get() : nullptr;
+}
+
+uint32_t memory_key::sub_key_count() const
+{
+	return static_cast<uint32_t>(m_children.size());
+}
+
+memory_key& memory_key::subkey_at(uint32_t index) const
+{
+	if (index >= m_children.size())
+	{
+		throw registry_error{ registry_errc::not_found, "No sub key at index." };
+	}
+	return *m_children[index];
+}
+
+// Value data starts 8-byte aligned so it can be read, and strings viewed, in place.
+static size_t align_data(size_t offset)
+{
+	return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+void memory_key::set_value(const std::wstring& name, registry_value_type type, const void* data, uint32_t size)
+{
+	auto folded = utf16::fold(name);
+	auto it = m_values_index.find(folded);
+	uint32_t index = it != m_values_index.end() ? it->second : static_cast<uint32_t>(m_values.size());
+	if (it == m_values_index.end())
+	{
+		m_values_index.emplace(std::move(folded), index);
+		m_values.push_back(value_record{ name, type, 0, 0 });
+	}
+	auto& record = m_values[index];
+	record.type = type;
+	m_live_data = m_live_data - record.size + size;
+	if (size <= record.size)
+	{
+		// Shrinking values are rewritten in place.
+		if (size != 0)
+		{
+			std::memcpy(m_value_data.data() + record.offset, data, size);
+		}
+	}
+	else
+	{
+		// Growing values move to the end of the buffer; compact once at least half of it is dead.
+		if (m_value_data.size() > 2 * m_live_data)
+		{
+			std::vector<uint8_t> compacted;
+			compacted.reserve(m_live_data + size);
+			for (auto& value : m_values)
+			{
+				auto start = m_value_data.begin() + value.offset;
+				compacted.resize(align_data(compacted.size()));
+				value.offset = static_cast<uint32_t>(compacted.size());
+				compacted.insert(compacted.end(), start, start + value.size);
+			}
+			m_value_data = std::move(compacted);
+		}
+		m_value_data.resize(align_data(m_value_data.size()));
+		record.offset = static_cast<uint32_t>(m_value_data.size());
+		auto bytes = static_cast<const uint8_t*>(data);
+		m_value_data.insert(m_value_data.end(), bytes, bytes + size);
+	}
+	record.size = size;
+	touch();
+}
+
+void memory_key::set_dword(const std::wstring& name, uint32_t data)
+{
+	set_value(name, registry_value_type::dword, &data, sizeof data);
+}
+
+void memory_key::set_qword(const std::wstring& name, uint64_t data)
+{
+	set_value(name, registry_value_type::qword, &data, sizeof data);
+}
+
+void memory_key::set_string(const std::wstring& name, std::wstring_view data, registry_value_type type)
+{
+	std::vector<uint8_t> bytes;
+	utf16::append_bytes(bytes, data);
+	bytes.push_back(0);
+	bytes.push_back(0);
+	set_value(name, type, bytes.data(), static_cast<uint32_t>(bytes.size()));
+}
+
+void memory_key::set_strings(const std::wstring& name, const std::vector<std::wstring>& data)
+{
+	std::vector<uint8_t> bytes;
+	for (const auto& string : data)
+	{
+		utf16::append_bytes(bytes, string);
+		bytes.push_back(0);
+		bytes.push_back(0);
+	}
+	bytes.push_back(0);
+	bytes.push_back(0);
+	set_value(name, registry_value_type::multi_string, bytes.data(), static_cast<uint32_t>(bytes.size()));
+}
+
+bool memory_key::delete_value(std::wstring_view name)
+{
+	auto it = m_values_index.find(utf16::fold(name));
+	if (it == m_values_index.end())
+	{
+		return false;
+	}
+	uint32_t index = it->second;
+	m_values_index.erase(it);
+	// The data becomes dead space, reclaimed by the next compaction.
+	m_live_data -= m_values[index].size;
+	m_values.erase(m_values.begin() + index);
+	for (auto& entry : m_values_index)
+	{
+		if (entry.second > index)
+		{
+			entry.second--;
+		}
+	}
+	touch();
+	return true;
+}
+
+uint32_t memory_key::value_count() const
+{
+	return static_cast<uint32_t>(m_values.size());
+}
+
+value_view memory_key::value_at(uint32_t index) const
+{
+	if (index >= m_values.size())
+	{
+		throw registry_error{ registry_errc::not_found, "No value at index." };
+	}
+	const auto& record = m_values[index];
+	return value_view{ record.name, record.type, m_value_data.data() + record.offset, record.size, nullptr };
+}
+
+uint32_t memory_key::find_value(std::wstring_view name) const
+{
+	auto it = m_values_index.find(utf16::fold(name));
+	return it != m_values_index.end() ? it->second : static_cast<uint32_t>(m_values.size());
+}
+
+memory_key::saved_state memory_key::save()
+{
+	return saved_state{ this, m_last_written, m_children, m_children_index, m_values, m_values_index, m_value_data };
+}
+
+void memory_key::restore(saved_state& state)
+{
+	m_last_written = state.last_written;
+	m_children.swap(state.children);
+	m_children_index.swap(state.children_index);
+	m_values.swap(state.values);
+	m_values_index.swap(state.values_index);
+	m_value_data.swap(state.value_data);
+	m_live_data = 0;
+	for (const auto& value : m_values)
+	{
+		m_live_data += value.size;
+	}
+}
+
+void memory_key::touch()
+{
+	m_last_written = (std::max)(std::chrono::system_clock::now(), m_last_written + std::chrono::system_clock::duration{ 1 });
+}
+
+memory_key_backend::memory_key_backend(std::shared_ptr<memory_key> key) :
+	m_key(std::move(key))
+{
+}
+
+std::unique_ptr<key_backend> memory_key_backend::open_subkey(const std::wstring& name) const
+{
+	memory_key* current = m_key.get();
+	for (auto component : split_path(name))
+	{
+		current = current->find_subkey(component);
+		if (current == nullptr)
+		{
+			throw registry_error{ registry_errc::not_found, "Sub key not found." };
+		}
+	}
+	return std::make_unique<memory_key_backend>(current->shared_from_this());
+}
+
+key_info memory_key_backend::query_info() const
+{
+	key_info info;
+	info.key_class = m_key->key_class();
+	info.last_written = m_key->last_written();
+	info.sub_keys_count = m_key->sub_key_count();
+	for (uint32_t i = 0; i < info.sub_keys_count; i++)
+	{
+		const auto& sub_key = m_key->subkey_at(i);
+		info.max_sub_key_name_length = (std::max)(info.max_sub_key_name_length, static_cast<uint32_t>(sub_key.name().size()));
+		info.max_class_length = (std::max)(info.max_class_length, static_cast<uint32_t>(sub_key.key_class().size()));
+	}
+	info.values_count = m_key->value_count();
+	for (uint32_t i = 0; i < info.values_count; i++)
+	{
+		auto value = m_key->value_at(i);
+		info.max_value_name_length = (std::max)(info.max_value_name_length, static_cast<uint32_t>(value.name.size()));
+		info.max_value_data_length = (std::max)(info.max_value_data_length, value.size);
+	}
+	return info;
+}
+
+std::wstring memory_key_backend::sub_key_name(uint32_t index) const
+{
+	return m_key->subkey_at(index).name();
+}
+
+value_view memory_key_backend::value_at(uint32_t index, value_buffer& buffer) const
+{
+	auto view = m_key->value_at(index);
+	buffer.name.assign(view.name);
+	view.name = buffer.name;
+	return view;
+}
+
+std::optional<uint32_t> memory_key_backend::find_value_index(const std::wstring& name, value_buffer&) const
+{
+	uint32_t index = m_key->find_value(name);
+	if (index == m_key->value_count())
+	{
+		return std::nullopt;
+	}
+	return index;
+}
+
+bool memory_key_backend::reads_value_parts() const
+{
+	// Data is handed out in place, so the default read_value_data copies only the part asked for.
+	return true;
+}
+
+bool memory_key_backend::same_key(const key_backend& other) const
+{
+	auto rhs = dynamic_cast<const memory_key_backend*>(&other);
+	return rhs != nullptr && rhs->m_key == m_key;
+}
+
+void memory_key_backend::set_value(const std::wstring& name, registry_value_type type, const uint8_t* data, uint32_t size) const
+{
+	m_key->set_value(name, type, data, size);
+}
+
+bool memory_key_backend::delete_value(const std::wstring& name) const
+{
+	return m_key->delete_value(name);
+}
+
+std::unique_ptr<key_backend> memory_key_backend::create_subkey(const std::wstring& name) const
+{
+	memory_key* current = m_key.get();
+	for (auto component : split_path(name))
+	{
+		current = &current->add_subkey(std::wstring{ component });
+	}
+	return std::make_unique<memory_key_backend>(current->shared_from_this());
+}
+
+bool memory_key_backend::delete_subtree(const std::wstring& name) const
+{
+	auto components = split_path(name);
+	if (components.empty())
+	{
+		throw registry_error{ registry_errc::not_supported, "A key cannot delete itself." };
+	}
+	memory_key* parent = m_key.get();
+	for (size_t i = 0; i + 1 < components.size() && parent != nullptr; i++)
+	{
+		parent = parent->find_subkey(components[i]);
+	}
+	return parent != nullptr && parent->delete_subkey(components.back());
+}
+
+void memory_key_backend::apply(const std::vector<key_write>& writes) const
+{
+	// Every key is saved before its first change, so a failure part way through restores the tree exactly.
+	std::vector<memory_key::saved_state> saved;
+	std::unordered_set<memory_key*> touched;
+	auto touch = [&saved, &touched](memory_key* key)
+	{
+		if (touched.insert(key).second)
+		{
+			saved.push_back(key->save());
+		}
+	};
+	try
+	{
+		for (const auto& write : writes)
+		{
+			auto components = split_path(write.path);
+			if (write.delete_subtree)
+			{
+				if (components.empty())
+				{
+					throw registry_error{ registry_errc::not_supported, "A key cannot delete itself." };
+				}
+				memory_key* parent = m_key.get();
+				for (size_t i = 0; i + 1 < components.size() && parent != nullptr; i++)
+				{
+					parent = parent->find_subkey(components[i]);
+				}
+				if (parent != nullptr && parent->find_subkey(components.back()) != nullptr)
+				{
+					touch(parent);
+					parent->delete_subkey(components.back());
+				}
+			}
+			if (!write.create && write.values.empty())
+			{
+				continue;
+			}
+			memory_key* key = m_key.get();
+			for (auto component : components)
+			{
+				memory_key* child = key->find_subkey(component);
+				if (child == nullptr)
+				{
+					touch(key);
+					child = &key->add_subkey(std::wstring{ component });
+				}
+				key = child;
+			}
+			for (const auto& value : write.values)
+			{
+				touch(key);
+				if (value.erase)
+				{
+					key->delete_value(value.name);
+				}
+				else
+				{
+					key->set_value(value.name, value.type, value.data.data(), static_cast<uint32_t>(value.data.size()));
+				}
+			}
+		}
+	}
+	catch (...)
+	{
+		for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+		{
+			it->key->restore(*it);
+		}
+		throw;
+	}
+}
+
+const memory_key& memory_key_backend::key() const
+{
+	return *m_key;
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "key_backend.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A key of a registry tree held entirely in memory.
+	 *
+	 * Children are found through a hash of their case folded names and the data of all values of a key is kept in one
+	 * contiguous buffer, so reads never leave the process. Reads may happen from any number of threads; modifications
+	 * must not run concurrently with anything else.
+	 */
+	class DllExport memory_key : public std::enable_shared_from_this<memory_key>
+	{
+	public:
+		/**
+		 * @brief Creates the root of a new tree.
+		 * @param name The name of the root key.
+		 * @return The root key.
+		 */
+		static std::shared_ptr<memory_key> create(const std::wstring& name);
+
+		/**
+		 * @brief Opens the key as the root of a key_entry hierarchy.
+		 * @return The key.
+		 */
+		key_entry open();
+
+		/**
+		 * @brief Gets the name of the key.
+		 * @return The name of the key.
+		 */
+		const std::wstring& name() const;
+
+		/**
+		 * @brief Gets the class of the key.
+		 * @return The class of the key.
+		 */
+		const std::wstring& key_class() const;
+
+		/**
+		 * @brief Sets the class of the key.
+		 * @param key_class The class of the key.
+		 */
+		void set_key_class(const std::wstring& key_class);
+
+		/**
+		 * @brief Gets the last time the key was written.
+		 *
+		 * Every write moves it forward, even several writes within one tick of the clock, so caches can rely on it to
+		 * tell whether a key changed.
+		 * @return The last time the key was written.
+		 */
+		std::chrono::system_clock::time_point last_written() const;
+
+		/**
+		 * @brief Sets the last time the key was written.
+		 * @param last_written The last time the key was written.
+		 */
+		void set_last_written(std::chrono::system_clock::time_point last_written);
+
+		/**
+		 * @brief Gets the sub key with a name, creating it if needed.
+		 * @param name The name of the sub key. Must be a single path component.
+		 * @return The sub key.
+		 */
+		memory_key& add_subkey(const std::wstring& name);
+
+		/**
+		 * @brief Deletes a sub key with everything below it.
+		 * @param name The name of the sub key. Must be a single path component.
+		 * @return true if the sub key existed; otherwise false.
+		 */
+		bool delete_subkey(std::wstring_view name);
+
+		/**
+		 * @brief Finds a sub key by name, ignoring case.
+		 * @param name The name of the sub key. Must be a single path component.
+		 * @return The sub key, or nullptr if there is none.
+		 */
+		memory_key* find_subkey(std::wstring_view name) const;
+
+		/**
+		 * @brief Gets the number of sub keys.
+		 * @return The number of sub keys.
+		 */
+		uint32_t sub_key_count() const;
+
+		/**
+		 * @brief Gets a sub key by index.
+		 * @param index The index of the sub key.
+		 * @return The sub key.
+		 */
+		memory_key& subkey_at(uint32_t index) const;
+
+		/**
+		 * @brief Sets a value, replacing any value with the same name.
+		 * @param name The name of the value.
+		 * @param type The type of the value.
+		 * @param data The raw data of the value.
+		 * @param size The size of the data in bytes.
+		 */
+		void set_value(const std::wstring& name, registry_value_type type, const void* data, uint32_t size);
+
+		void set_dword(const std::wstring& name, uint32_t data);
+
+		void set_qword(const std::wstring& name, uint64_t data);
+
+		void set_string(const std::wstring& name, std::wstring_view data, registry_value_type type = registry_value_type::string);
+
+		void set_strings(const std::wstring& name, const std::vector<std::wstring>& data);
+
+		/**
+		 * @brief Deletes a value.
+		 * @param name The name of the value.
+		 * @return true if the value existed; otherwise false.
+		 */
+		bool delete_value(std::wstring_view name);
+
+		/**
+		 * @brief Gets the number of values.
+		 * @return The number of values.
+		 */
+		uint32_t value_count() const;
+
+		/**
+		 * @brief Reads a value by index without copying its data.
+		 * @param index The index of the value.
+		 * @return The value. The data stays valid until the key is modified.
+		 */
+		value_view value_at(uint32_t index) const;
+
+		/**
+		 * @brief Finds a value by name, ignoring case.
+		 * @param name The name of the value.
+		 * @return The index of the value, or value_count() if there is none.
+		 */
+		uint32_t find_value(std::wstring_view name) const;
+
+	private:
+		friend class memory_key_backend;
+
+		struct value_record
+		{
+			std::wstring name;
+			registry_value_type type;
+			uint32_t offset;
+			uint32_t size;
+		};
+
+		/**
+		 * Everything about a key that a write can change, kept to roll back a failed write_batch commit.
+		 */
+		struct saved_state
+		{
+			memory_key* key;
+			std::chrono::system_clock::time_point last_written;
+			std::vector<std::shared_ptr<memory_key>> children;
+			std::unordered_map<std::wstring, uint32_t> children_index;
+			std::vector<value_record> values;
+			std::unordered_map<std::wstring, uint32_t> values_index;
+			std::vector<uint8_t> value_data;
+		};
+
+		explicit memory_key(const std::wstring& name, memory_key* parent);
+
+		saved_state save();
+
+		void restore(saved_state& state);
+
+		void touch();
+
+		std::wstring m_name;
+		std::wstring m_class;
+		std::chrono::system_clock::time_point m_last_written;
+		memory_key* m_parent;
+		std::vector<std::shared_ptr<memory_key>> m_children;
+		std::unordered_map<std::wstring, uint32_t> m_children_index;
+		std::vector<value_record> m_values;
+		/** The index of each value in m_values, by folded name. */
+		std::unordered_map<std::wstring, uint32_t> m_values_index;
+		std::vector<uint8_t> m_value_data;
+		/** The bytes of m_value_data that live values use; the rest is dead space. */
+		size_t m_live_data;
+	};
+
+	/**
+	 * @brief Backend for keys of an in-memory tree.
+	 */
+	class DllExport memory_key_backend final : public key_backend
+	{
+	public:
+		/**
+		 * @brief Creates a backend for a key.
+		 * @param key The key. The backend keeps it alive.
+		 */
+		explicit memory_key_backend(std::shared_ptr<memory_key> key);
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override;
+		key_info query_info() const override;
+		std::wstring sub_key_name(uint32_t index) const override;
+		value_view value_at(uint32_t index, value_buffer& buffer) const override;
+		std::optional<uint32_t> find_value_index(const std::wstring& name, value_buffer& buffer) const override;
+		bool reads_value_parts() const override;
+		bool same_key(const key_backend& other) const override;
+		void set_value(const std::wstring& name, registry_value_type type, const uint8_t* data, uint32_t size) const override;
+		bool delete_value(const std::wstring& name) const override;
+		std::unique_ptr<key_backend> create_subkey(const std::wstring& name) const override;
+		bool delete_subtree(const std::wstring& name) const override;
+		void apply(const std::vector<key_write>& writes) const override;
+
+		/**
+		 * @brief Gets the key.
+		 * @return The key.
+		 */
+		const memory_key& key() const;
+
+	private:
+		std::shared_ptr<memory_key> m_key;
+	};
+}
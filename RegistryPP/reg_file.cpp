@@ -0,0 +1,775 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "reg_file.h"
+#include "registry_error.h"
+#include "sub_key_range.h"
+#include "utf16.h"
+#include "value_entry.h"
+#include "value_range.h"
+#include "write_batch.h"
+
+using namespace win32::registry;
+
+// Both directions move data in chunks of this size.
+constexpr size_t chunk_size = 64 * 1024;
+
+// regedit breaks hex data so lines stay within 80 columns.
+constexpr size_t hex_line_width = 80;
+
+namespace
+{
+	/**
+	 * Buffers UTF-16LE output and tracks the column of the current line.
+	 */
+	class reg_output
+	{
+	public:
+		explicit reg_output(std::ostream& out) :
+			m_out(out), m_buffer(), m_column(0)
+		{
+			m_buffer.reserve(chunk_size + 256);
+		}
+
+		~reg_output()
+		{
+			flush();
+		}
+
+		void byte_order_mark()
+		{
+			m_buffer.push_back(0xFF);
+			m_buffer.push_back(0xFE);
+		}
+
+		void put(char c)
+		{
+			m_buffer.push_back(static_cast<uint8_t>(c));
+			m_buffer.push_back(0);
+			m_column++;
+		}
+
+		void put(const char* text)
+		{
+			while (*text != '\0')
+			{
+				put(*text++);
+			}
+		}
+
+		void put(std::wstring_view text)
+		{
+			size_t start = m_buffer.size();
+			utf16::append_bytes(m_buffer, text);
+			m_column += (m_buffer.size() - start) / 2;
+		}
+
+		/** Writes a quoted string, escaping backslashes and quotes the way regedit does. */
+		void put_quoted(utf16_string_view text)
+		{
+			put('"');
+			for (utf16_unit c : text)
+			{
+				if (c == u'\\' || c == u'"')
+				{
+					put('\\');
+				}
+				m_buffer.push_back(static_cast<uint8_t>(c & 0xFF));
+				m_buffer.push_back(static_cast<uint8_t>(c >> 8));
+			}
+			m_column += text.size();
+			put('"');
+			maybe_flush();
+		}
+
+#if WCHAR_MAX > 0xFFFF
+		void put_quoted(std::wstring_view text)
+		{
+			std::vector<uint8_t> bytes;
+			utf16::append_bytes(bytes, text);
+			put_quoted(utf16_string_view{ reinterpret_cast<const utf16_unit*>(bytes.data()), bytes.size() / 2 });
+		}
+#endif
+
+		void put_hex(uint32_t value, int digits)
+		{
+			static const char hex_digits[] = "0123456789abcdef";
+			for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+			{
+				put(hex_digits[(value >> shift) & 0xF]);
+			}
+		}
+
+		/** Writes bytes as comma separated hex pairs, continuing long data on indented lines. */
+		void put_bytes(std::span<const uint8_t> data)
+		{
+			for (size_t i = 0; i < data.size(); i++)
+			{
+				put_hex(data[i], 2);
+				if (i + 1 < data.size())
+				{
+					put(',');
+					if (m_column + 3 >= hex_line_width - 1)
+					{
+						put('\\');
+						end_line();
+						put("  ");
+					}
+				}
+			}
+		}
+
+		void end_line()
+		{
+			put("\r\n");
+			m_column = 0;
+			maybe_flush();
+		}
+
+		void flush()
+		{
+			if (!m_buffer.empty())
+			{
+				m_out.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+				m_buffer.clear();
+			}
+		}
+
+	private:
+		void maybe_flush()
+		{
+			if (m_buffer.size() >= chunk_size)
+			{
+				flush();
+			}
+		}
+
+		std::ostream& m_out;
+		std::vector<uint8_t> m_buffer;
+		size_t m_column;
+	};
+
+	/** Whether a REG_SZ value can be written as a quoted string and read back unchanged. */
+	bool quotable(std::span<const uint8_t> data)
+	{
+		if (data.size() < 2 || data.size() % 2 != 0)
+		{
+			return false;
+		}
+		auto units = reinterpret_cast<const utf16_unit*>(data.data());
+		size_t count = data.size() / 2;
+		if (utf16::find_null(units, count) != count - 1)
+		{
+			return false;
+		}
+		return std::none_of(units, units + count - 1, [](utf16_unit c) { return c == u'\r' || c == u'\n'; });
+	}
+
+	void write_value(reg_output& out, const value_entry& value)
+	{
+		auto name = value.name();
+		if (name.empty())
+		{
+			out.put('@');
+		}
+		else
+		{
+			out.put_quoted(std::wstring_view{ name });
+		}
+		out.put('=');
+		auto data = value.get_bytes_view();
+		auto type = value.type();
+		if (type == registry_value_type::string && quotable(data))
+		{
+			out.put_quoted(utf16::trim_nulls(data.data(), data.size()));
+		}
+		else if (type == registry_value_type::dword && data.size() == 4)
+		{
+			uint32_t dword;
+			std::memcpy(&dword, data.data(), sizeof dword);
+			out.put("dword:");
+			out.put_hex(dword, 8);
+		}
+		else
+		{
+			if (type == registry_value_type::binary)
+			{
+				out.put("hex:");
+			}
+			else
+			{
+				out.put("hex(");
+				uint32_t raw = static_cast<uint32_t>(type);
+				int digits = 1;
+				while (digits < 8 && (raw >> (digits * 4)) != 0)
+				{
+					digits++;
+				}
+				out.put_hex(raw, digits);
+				out.put("):");
+			}
+			out.put_bytes(data);
+		}
+		out.end_line();
+	}
+
+	void write_key(reg_output& out, const key_entry& key)
+	{
+		out.put('[');
+		out.put(std::wstring_view{ key.path() });
+		out.put(']');
+		out.end_line();
+		for (const auto& value : key.values())
+		{
+			write_value(out, value);
+		}
+		out.end_line();
+		for (const auto& sub_key : key.subkeys())
+		{
+			write_key(out, sub_key);
+		}
+	}
+
+	void push_code_point(std::wstring& out, char32_t c)
+	{
+#if WCHAR_MAX <= 0xFFFF
+		if (c > 0xFFFF)
+		{
+			out.push_back(static_cast<wchar_t>(0xD800 + ((c - 0x10000) >> 10)));
+			out.push_back(static_cast<wchar_t>(0xDC00 + ((c - 0x10000) & 0x3FF)));
+			return;
+		}
+#endif
+		out.push_back(static_cast<wchar_t>(c));
+	}
+
+	/** Decodes UTF-8; bytes that do not form a valid sequence are taken as Latin-1, as older files are ANSI. */
+	void append_utf8_line(std::wstring& out, const uint8_t* data, size_t size)
+	{
+		size_t i = 0;
+		while (i < size)
+		{
+			uint8_t lead = data[i];
+			if (lead < 0x80)
+			{
+				out.push_back(static_cast<wchar_t>(lead));
+				i++;
+				continue;
+			}
+			size_t length = lead >= 0xF0 && lead < 0xF5 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 && lead < 0xE0 ? 2 : 0;
+			if (length != 0 && i + length <= size && std::all_of(data + i + 1, data + i + length, [](uint8_t b) { return (b & 0xC0) == 0x80; }))
+			{
+				char32_t c = lead & (0x7F >> length);
+				for (size_t j = 1; j < length; j++)
+				{
+					c = (c << 6) | (data[i + j] & 0x3F);
+				}
+				push_code_point(out, c);
+				i += length;
+			}
+			else
+			{
+				out.push_back(static_cast<wchar_t>(lead));
+				i++;
+			}
+		}
+	}
+
+	int hex_value(wchar_t c)
+	{
+		if (c >= L'0' && c <= L'9')
+		{
+			return c - L'0';
+		}
+		if (c >= L'a' && c <= L'f')
+		{
+			return c - L'a' + 10;
+		}
+		if (c >= L'A' && c <= L'F')
+		{
+			return c - L'A' + 10;
+		}
+		return -1;
+	}
+
+	bool is_blank(wchar_t c)
+	{
+		return c == L' ' || c == L'\t';
+	}
+
+	std::wstring_view trim(std::wstring_view text)
+	{
+		while (!text.empty() && is_blank(text.front()))
+		{
+			text.remove_prefix(1);
+		}
+		while (!text.empty() && is_blank(text.back()))
+		{
+			text.remove_suffix(1);
+		}
+		return text;
+	}
+
+	bool starts_with_ignore_case(std::wstring_view text, std::wstring_view prefix)
+	{
+		return text.size() >= prefix.size() && utf16::equals_ignore_case(text.substr(0, prefix.size()), prefix);
+	}
+
+	std::vector<std::wstring_view> split_path(std::wstring_view path)
+	{
+		std::vector<std::wstring_view> components;
+		size_t start = 0;
+		while (start <= path.size())
+		{
+			size_t end = std::min(path.find(L'\\', start), path.size());
+			if (end > start)
+			{
+				components.push_back(path.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		return components;
+	}
+}
+
+reg_reader::reg_reader(std::istream& in) :
+	m_in(in), m_chunk(), m_position(0), m_encoding(encoding::unknown), m_header_read(false), m_line(0), m_text(), m_current_key()
+{
+	m_chunk.reserve(chunk_size);
+}
+
+bool reg_reader::next(reg_record& record)
+{
+	while (read_line(m_text))
+	{
+		std::wstring_view line = trim(m_text);
+		if (!m_header_read)
+		{
+			if (line != L"Windows Registry Editor Version 5.00" && line != L"REGEDIT4")
+			{
+				fail("Not a .reg file.");
+			}
+			m_header_read = true;
+			continue;
+		}
+		if (line.empty() || line.front() == L';')
+		{
+			continue;
+		}
+		if (line.front() == L'[')
+		{
+			if (line.back() != L']')
+			{
+				fail("Unterminated key path.");
+			}
+			bool remove = line.size() > 1 && line[1] == L'-';
+			record.kind = remove ? reg_record_kind::delete_key : reg_record_kind::key;
+			record.path.assign(line.substr(remove ? 2 : 1, line.size() - (remove ? 3 : 2)));
+			record.name.clear();
+			record.type = registry_value_type::none;
+			record.data.clear();
+			if (remove)
+			{
+				m_current_key.clear();
+			}
+			else
+			{
+				m_current_key = record.path;
+			}
+			return true;
+		}
+		if (line.front() == L'"' || line.front() == L'@')
+		{
+			if (m_current_key.empty())
+			{
+				fail("Value outside of a key.");
+			}
+			parse_value(line, record);
+			return true;
+		}
+		fail("Unrecognized line.");
+	}
+	if (!m_header_read)
+	{
+		fail("Not a .reg file.");
+	}
+	return false;
+}
+
+uint64_t reg_reader::line() const
+{
+	return m_line;
+}
+
+void reg_reader::parse_value(std::wstring_view text, reg_record& record)
+{
+	record.path = m_current_key;
+	record.name.clear();
+	record.data.clear();
+	size_t i = 0;
+	if (text[0] == L'@')
+	{
+		i = 1;
+	}
+	else
+	{
+		for (i = 1; i < text.size() && text[i] != L'"'; i++)
+		{
+			if (text[i] == L'\\' && i + 1 < text.size())
+			{
+				i++;
+			}
+			record.name.push_back(text[i]);
+		}
+		if (i == text.size())
+		{
+			fail("Unterminated value name.");
+		}
+		i++;
+	}
+	text = trim(text.substr(i));
+	if (text.empty() || text.front() != L'=')
+	{
+		fail("Expected '=' after the value name.");
+	}
+	text = trim(text.substr(1));
+
+	if (text == L"-")
+	{
+		record.kind = reg_record_kind::delete_value;
+		record.type = registry_value_type::none;
+		return;
+	}
+	record.kind = reg_record_kind::value;
+	if (!text.empty() && text.front() == L'"')
+	{
+		std::wstring string;
+		string.reserve(text.size());
+		size_t j = 1;
+		for (; j < text.size() && text[j] != L'"'; j++)
+		{
+			if (text[j] == L'\\' && j + 1 < text.size())
+			{
+				j++;
+			}
+			string.push_back(text[j]);
+		}
+		// The closing quote must be unescaped: in "abc\" the last quote belongs to the string.
+		if (j == text.size())
+		{
+			fail("Unterminated string.");
+		}
+		if (j + 1 != text.size())
+		{
+			fail("Unexpected text after the string.");
+		}
+		record.type = registry_value_type::string;
+		utf16::append_bytes(record.data, string);
+		record.data.push_back(0);
+		record.data.push_back(0);
+		return;
+	}
+	if (starts_with_ignore_case(text, L"dword:"))
+	{
+		text.remove_prefix(6);
+		if (text.empty() || text.size() > 8)
+		{
+			fail("Malformed dword.");
+		}
+		uint32_t dword = 0;
+		for (wchar_t c : text)
+		{
+			int digit = hex_value(c);
+			if (digit < 0)
+			{
+				fail("Malformed dword.");
+			}
+			dword = (dword << 4) | static_cast<uint32_t>(digit);
+		}
+		record.type = registry_value_type::dword;
+		record.data.resize(sizeof dword);
+		std::memcpy(record.data.data(), &dword, sizeof dword);
+		return;
+	}
+	if (starts_with_ignore_case(text, L"hex:"))
+	{
+		record.type = registry_value_type::binary;
+		parse_hex(text.substr(4), record);
+		return;
+	}
+	if (starts_with_ignore_case(text, L"hex("))
+	{
+		size_t close = text.find(L"):");
+		if (close == std::wstring_view::npos || close == 4 || close > 12)
+		{
+			fail("Malformed value type.");
+		}
+		uint32_t type = 0;
+		for (wchar_t c : text.substr(4, close - 4))
+		{
+			int digit = hex_value(c);
+			if (digit < 0)
+			{
+				fail("Malformed value type.");
+			}
+			type = (type << 4) | static_cast<uint32_t>(digit);
+		}
+		record.type = static_cast<registry_value_type>(type);
+		parse_hex(text.substr(close + 2), record);
+		return;
+	}
+	fail("Unrecognized value data.");
+}
+
+void reg_reader::parse_hex(std::wstring_view text, reg_record& record)
+{
+	// Data continues on the next line for as long as a line ends with a backslash.
+	std::wstring continuation;
+	for (;;)
+	{
+		text = trim(text);
+		bool more = !text.empty() && text.back() == L'\\';
+		if (more)
+		{
+			text.remove_suffix(1);
+		}
+		size_t i = 0;
+		while (i < text.size())
+		{
+			if (is_blank(text[i]) || text[i] == L',')
+			{
+				i++;
+				continue;
+			}
+			int high = hex_value(text[i]);
+			int low = i + 1 < text.size() ? hex_value(text[i + 1]) : -1;
+			if (high < 0 || low < 0)
+			{
+				fail("Malformed hex data.");
+			}
+			record.data.push_back(static_cast<uint8_t>((high << 4) | low));
+			i += 2;
+		}
+		if (!more)
+		{
+			return;
+		}
+		if (!read_line(continuation))
+		{
+			fail("Hex data continues past the end of the file.");
+		}
+		text = continuation;
+	}
+}
+
+bool reg_reader::read_line(std::wstring& line)
+{
+	line.clear();
+	if (m_encoding == encoding::unknown)
+	{
+		fill();
+		if (m_chunk.size() >= 2 && m_chunk[0] == 0xFF && m_chunk[1] == 0xFE)
+		{
+			m_encoding = encoding::utf16;
+			m_position = 2;
+		}
+		else
+		{
+			m_encoding = encoding::utf8;
+			if (m_chunk.size() >= 3 && m_chunk[0] == 0xEF && m_chunk[1] == 0xBB && m_chunk[2] == 0xBF)
+			{
+				m_position = 3;
+			}
+		}
+	}
+	// Lines are decoded whole, so a code unit or UTF-8 sequence is never split across chunks.
+	size_t unit = m_encoding == encoding::utf16 ? 2 : 1;
+	size_t scanned = 0;
+	size_t length;
+	for (;;)
+	{
+		const uint8_t* start = m_chunk.data() + m_position;
+		size_t available = (m_chunk.size() - m_position) / unit * unit;
+		length = scanned;
+		if (unit == 1)
+		{
+			auto found = available > scanned ? std::memchr(start + scanned, '\n', available - scanned) : nullptr;
+			length = found != nullptr ? static_cast<size_t>(static_cast<const uint8_t*>(found) - start) : available;
+		}
+		else
+		{
+			while (length < available && !(start[length] == '\n' && start[length + 1] == 0))
+			{
+				length += 2;
+			}
+		}
+		if (length < available)
+		{
+			break;
+		}
+		scanned = available;
+		if (!fill())
+		{
+			if (available == 0)
+			{
+				return false;
+			}
+			break;
+		}
+	}
+	const uint8_t* start = m_chunk.data() + m_position;
+	if (unit == 1)
+	{
+		append_utf8_line(line, start, length);
+	}
+	else
+	{
+		utf16::append(line, start, length / 2);
+	}
+	m_position = std::min(m_position + length + unit, m_chunk.size());
+	if (!line.empty() && line.back() == L'\r')
+	{
+		line.pop_back();
+	}
+	m_line++;
+	return true;
+}
+
+bool reg_reader::fill()
+{
+	// Keep the unread part of the buffer, usually the start of a line.
+	m_chunk.erase(m_chunk.begin(), m_chunk.begin() + m_position);
+	m_position = 0;
+	size_t kept = m_chunk.size();
+	m_chunk.resize(kept + chunk_size);
+	m_in.read(reinterpret_cast<char*>(m_chunk.data() + kept), static_cast<std::streamsize>(chunk_size));
+	m_chunk.resize(kept + static_cast<size_t>(m_in.gcount()));
+	return m_chunk.size() > kept;
+}
+
+void reg_reader::fail(const char* message) const
+{
+	throw registry_error{ registry_errc::corrupt, "Line " + std::to_string(m_line) + ": " + message };
+}
+
+void win32::registry::export_reg(const key_entry& key, std::ostream& out)
+{
+	reg_output output{ out };
+	output.byte_order_mark();
+	output.put("Windows Registry Editor Version 5.00");
+	output.end_line();
+	output.end_line();
+	write_key(output, key);
+}
+
+void win32::registry::import_reg(std::istream& in, const key_entry& root, size_t batch_values)
+{
+	std::wstring root_path = root.path();
+	auto relative = [&root_path](const std::wstring& path) -> std::wstring_view
+	{
+		std::wstring_view view{ path };
+		if (!starts_with_ignore_case(view, root_path) || (view.size() > root_path.size() && view[root_path.size()] != L'\\'))
+		{
+			throw registry_error{ registry_errc::not_found, "A key of the file is outside the key it is imported to." };
+		}
+		view.remove_prefix(std::min(root_path.size() + 1, view.size()));
+		return view;
+	};
+
+	reg_reader reader{ in };
+	reg_record record;
+	write_batch batch;
+	size_t pending = 0;
+	while (reader.next(record))
+	{
+		switch (record.kind)
+		{
+		case reg_record_kind::key:
+			if (auto path = relative(record.path); !path.empty())
+			{
+				batch.create_subkey(path);
+			}
+			break;
+		case reg_record_kind::delete_key:
+			if (auto path = relative(record.path); !path.empty())
+			{
+				batch.delete_subtree(path);
+			}
+			else
+			{
+				throw registry_error{ registry_errc::corrupt, "Line " + std::to_string(reader.line()) + ": Cannot delete the key the file is imported to." };
+			}
+			break;
+		case reg_record_kind::value:
+			batch.set_value(relative(record.path), record.name, record.type, record.data.data(), static_cast<uint32_t>(record.data.size()));
+			break;
+		case reg_record_kind::delete_value:
+			batch.delete_value(relative(record.path), record.name);
+			break;
+		}
+		if (++pending >= batch_values)
+		{
+			batch.commit(root);
+			batch.clear();
+			pending = 0;
+		}
+	}
+	batch.commit(root);
+}
+
+std::shared_ptr<memory_key> win32::registry::import_reg_tree(std::istream& in)
+{
+	std::shared_ptr<memory_key> root;
+	memory_key* current = nullptr;
+	reg_reader reader{ in };
+	reg_record record;
+	while (reader.next(record))
+	{
+		if (record.kind == reg_record_kind::value || record.kind == reg_record_kind::delete_value)
+		{
+			if (record.kind == reg_record_kind::value)
+			{
+				current->set_value(record.name, record.type, record.data.data(), static_cast<uint32_t>(record.data.size()));
+			}
+			else
+			{
+				current->delete_value(record.name);
+			}
+			continue;
+		}
+
+		auto components = split_path(record.path);
+		if (components.empty())
+		{
+			throw registry_error{ registry_errc::corrupt, "Line " + std::to_string(reader.line()) + ": Empty key path." };
+		}
+		if (!root)
+		{
+			root = memory_key::create(std::wstring{ components[0] });
+		}
+		else if (!utf16::equals_ignore_case(components[0], root->name()))
+		{
+			throw registry_error{ registry_errc::not_supported, "An in-memory tree has a single root key." };
+		}
+		if (record.kind == reg_record_kind::key)
+		{
+			current = root.get();
+			for (size_t i = 1; i < components.size(); i++)
+			{
+				current = &current->add_subkey(std::wstring{ components[i] });
+			}
+			continue;
+		}
+		memory_key* parent = root.get();
+		for (size_t i = 1; i + 1 < components.size() && parent != nullptr; i++)
+		{
+			parent = parent->find_subkey(components[i]);
+		}
+		if (parent != nullptr && components.size() > 1)
+		{
+			parent->delete_subkey(components.back());
+		}
+		current = nullptr;
+	}
+	return root;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "key_entry.h"
+#include "memory_backend.h"
+#include "registry_value_type.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief What a line of a .reg file does.
+	 */
+	enum class DllExport reg_record_kind : uint8_t
+	{
+		/** [path]: creates the key; the values that follow belong to it. */
+		key,
+		/** [-path]: deletes the key and everything below it. */
+		delete_key,
+		/** "name"=data or @=data: sets a value of the current key. */
+		value,
+		/** "name"=-: deletes a value of the current key. */
+		delete_value
+	};
+
+	/**
+	 * @brief A single entry of a .reg file.
+	 */
+	struct DllExport reg_record
+	{
+		reg_record_kind kind = reg_record_kind::key;
+		/** The full path of the key, as written in the file. For values, the key they belong to. */
+		std::wstring path;
+		/** The name of the value; empty for the default value and for keys. */
+		std::wstring name;
+		registry_value_type type = registry_value_type::none;
+		/** The raw data of the value. */
+		std::vector<uint8_t> data;
+	};
+
+	/**
+	 * @brief Parses a .reg file one entry at a time.
+	 *
+	 * Accepts "Windows Registry Editor Version 5.00" and "REGEDIT4" files, encoded as UTF-16LE with a byte order mark
+	 * or as UTF-8. The input is read in fixed size chunks, so memory does not grow with the size of the file.
+	 */
+	class DllExport reg_reader
+	{
+	public:
+		/**
+		 * @brief Starts parsing a stream.
+		 * @param in The stream, opened in binary mode.
+		 */
+		explicit reg_reader(std::istream& in);
+
+		reg_reader(const reg_reader&) = delete;
+		reg_reader& operator=(const reg_reader&) = delete;
+
+		/**
+		 * @brief Reads the next entry.
+		 * @param record Receives the entry. Reusing the same record across calls reuses its buffers.
+		 * @return true if an entry was read; false at the end of the input.
+		 * @exception registry_error The input is not a .reg file or a line is malformed.
+		 */
+		bool next(reg_record& record);
+
+		/**
+		 * @brief Gets the number of the line last read, starting at 1.
+		 * @return The line number.
+		 */
+		uint64_t line() const;
+
+	private:
+		bool read_line(std::wstring& line);
+
+		bool fill();
+
+		void parse_value(std::wstring_view text, reg_record& record);
+
+		void parse_hex(std::wstring_view text, reg_record& record);
+
+		[[noreturn]] void fail(const char* message) const;
+
+		enum class encoding : uint8_t { unknown, utf8, utf16 };
+
+		std::istream& m_in;
+		std::vector<uint8_t> m_chunk;
+		size_t m_position;
+		encoding m_encoding;
+		bool m_header_read;
+		uint64_t m_line;
+		std::wstring m_text;
+		std::wstring m_current_key;
+	};
+
+	/**
+	 * @brief Writes a key and everything below it as a "Windows Registry Editor Version 5.00" file.
+	 *
+	 * The output is UTF-16LE with a byte order mark, as written by regedit. Keys are visited depth first through the
+	 * streaming ranges and the output is buffered in fixed size chunks, so memory does not grow with the size of the
+	 * tree.
+	 * @param key The key to export.
+	 * @param out The stream, opened in binary mode.
+	 * @exception wil::ResultException
+	 * @exception registry_error
+	 */
+	DllExport void export_reg(const key_entry& key, std::ostream& out);
+
+	/**
+	 * @brief Applies a .reg file below a key through batched writes.
+	 *
+	 * Paths in the file must start with the path of the key. Changes are committed every batch_values entries: each
+	 * commit is all or none, the import as a whole is not.
+	 * @param in The stream, opened in binary mode.
+	 * @param root The key the file's paths start at.
+	 * @param batch_values The number of entries to collect before committing.
+	 * @exception wil::ResultException
+	 * @exception registry_error The input is malformed, or a path is outside the key.
+	 */
+	DllExport void import_reg(std::istream& in, const key_entry& root, size_t batch_values = 4096);
+
+	/**
+	 * @brief Builds an in-memory tree from a .reg file.
+	 *
+	 * The root is named after the first component of the first key in the file; every other key must be below it.
+	 * @param in The stream, opened in binary mode.
+	 * @return The root of the tree, or nullptr if the file has no keys.
+	 * @exception registry_error The input is malformed, or names more than one root.
+	 */
+	DllExport std::shared_ptr<memory_key> import_reg_tree(std::istream& in);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include "key_entry.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief The kind of failure a registry_error reports.
+	 */
+	enum class DllExport registry_errc
+	{
+		/** The requested key or value does not exist. */
+		not_found,
+		/** The underlying storage is malformed. */
+		corrupt,
+		/** The operation is not supported by the storage backing the key. */
+		not_supported
+	};
+
+	/**
+	 * @brief Error raised by storage backends that do not go through the Win32 API.
+	 *
+	 * Keys opened from the live registry report failures as wil::ResultException instead.
+	 */
+	class DllExport registry_error : public std::runtime_error
+	{
+	public:
+		registry_error(registry_errc code, const std::string& message) :
+			std::runtime_error(message), m_code(code)
+		{
+		}
+
+		/**
+		 * @brief Gets the kind of failure.
+		 * @return The kind of failure.
+		 */
+		registry_errc code() const noexcept
+		{
+			return m_code;
+		}
+
+	private:
+		registry_errc m_code;
+	};
+}
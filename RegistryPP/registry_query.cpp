@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include "registry_query.h"
+#include "tree_walker.h"
+#include "utf16.h"
+#include "value_entry.h"
+#include "value_range.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	/** Matches * and ? wildcards, ignoring case, backtracking only to the last star. */
+	bool glob_match(std::wstring_view pattern, std::wstring_view text)
+	{
+		size_t p = 0;
+		size_t t = 0;
+		size_t star = std::wstring_view::npos;
+		size_t resume = 0;
+		while (t < text.size())
+		{
+			if (p < pattern.size() && (pattern[p] == L'?' || (pattern[p] != L'*' && utf16::fold(pattern[p]) == utf16::fold(text[t]))))
+			{
+				p++;
+				t++;
+			}
+			else if (p < pattern.size() && pattern[p] == L'*')
+			{
+				star = p++;
+				resume = t;
+			}
+			else if (star != std::wstring_view::npos)
+			{
+				p = star + 1;
+				t = ++resume;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		while (p < pattern.size() && pattern[p] == L'*')
+		{
+			p++;
+		}
+		return p == pattern.size();
+	}
+
+	bool has_wildcards(std::wstring_view text)
+	{
+		return text.find_first_of(L"*?") != std::wstring_view::npos;
+	}
+
+	registry_value_type parse_type(std::wstring_view name)
+	{
+		if (name.size() > 4 && utf16::equals_ignore_case(name.substr(0, 4), L"REG_"))
+		{
+			name.remove_prefix(4);
+		}
+		static const std::pair<const wchar_t*, registry_value_type> names[] = {
+			{ L"none", registry_value_type::none },
+			{ L"sz", registry_value_type::string },
+			{ L"expand_sz", registry_value_type::expandable_string },
+			{ L"binary", registry_value_type::binary },
+			{ L"dword", registry_value_type::dword },
+			{ L"multi_sz", registry_value_type::multi_string },
+			{ L"qword", registry_value_type::qword },
+		};
+		for (const auto& [text, type] : names)
+		{
+			if (utf16::equals_ignore_case(name, text))
+			{
+				return type;
+			}
+		}
+		throw std::invalid_argument{ "Unknown value type in query." };
+	}
+
+	bool matches_data(const value_entry& value, const std::wstring& pattern)
+	{
+		switch (value.type())
+		{
+		case registry_value_type::string:
+		case registry_value_type::expandable_string:
+			return glob_match(pattern, value.get_string());
+		case registry_value_type::multi_string:
+		{
+			auto strings = value.get_strings();
+			return std::any_of(strings.begin(), strings.end(), [&pattern](const std::wstring& string) { return glob_match(pattern, string); });
+		}
+		case registry_value_type::dword:
+			return glob_match(pattern, std::to_wstring(value.get_dword()));
+		case registry_value_type::qword:
+			return glob_match(pattern, std::to_wstring(value.get_qword()));
+		default:
+			return false;
+		}
+	}
+
+	bool matches_value(const value_entry& value, const value_predicate& predicate)
+	{
+		return (!predicate.type || value.type() == *predicate.type) && (!predicate.data || matches_data(value, *predicate.data));
+	}
+}
+
+registry_query::registry_query(std::wstring_view pattern)
+{
+	size_t start = 0;
+	while (start <= pattern.size())
+	{
+		size_t end = (std::min)(pattern.find(L'\\', start), pattern.size());
+		auto text = pattern.substr(start, end - start);
+		// A regular expression may itself contain backslashes; it runs up to the next slash followed by a separator.
+		if (text.size() >= 1 && text.front() == L'/')
+		{
+			size_t close = pattern.find(L'/', start + 1);
+			while (close != std::wstring_view::npos && close + 1 < pattern.size() && pattern[close + 1] != L'\\')
+			{
+				close = pattern.find(L'/', close + 1);
+			}
+			if (close == std::wstring_view::npos)
+			{
+				throw std::invalid_argument{ "Unterminated regular expression in query." };
+			}
+			end = close + 1;
+			text = pattern.substr(start, end - start);
+		}
+		start = end + 1;
+		if (text.empty())
+		{
+			continue;
+		}
+		if (text == L"**")
+		{
+			m_segments.push_back(segment{ segment_kind::any_depth, {}, std::nullopt });
+		}
+		else if (text.size() >= 2 && text.front() == L'/' && text.back() == L'/')
+		{
+			try
+			{
+				std::wregex regex{ text.begin() + 1, text.end() - 1, std::regex_constants::ECMAScript | std::regex_constants::icase | std::regex_constants::optimize };
+				m_segments.push_back(segment{ segment_kind::regex, std::wstring{ text }, std::move(regex) });
+			}
+			catch (const std::regex_error&)
+			{
+				throw std::invalid_argument{ "Malformed regular expression in query." };
+			}
+		}
+		else
+		{
+			m_segments.push_back(segment{ has_wildcards(text) ? segment_kind::glob : segment_kind::literal, std::wstring{ text }, std::nullopt });
+		}
+	}
+}
+
+registry_query registry_query::parse(std::wstring_view text)
+{
+	size_t at = text.find(L" @");
+	registry_query query{ text.substr(0, at) };
+	while (at != std::wstring_view::npos)
+	{
+		size_t start = at + 2;
+		at = text.find(L" @", start);
+		auto predicate_text = text.substr(start, at == std::wstring_view::npos ? std::wstring_view::npos : at - start);
+		value_predicate predicate;
+		size_t equals = predicate_text.find(L'=');
+		if (equals != std::wstring_view::npos)
+		{
+			predicate.data = std::wstring{ predicate_text.substr(equals + 1) };
+			predicate_text = predicate_text.substr(0, equals);
+		}
+		size_t colon = predicate_text.rfind(L':');
+		if (colon != std::wstring_view::npos)
+		{
+			predicate.type = parse_type(predicate_text.substr(colon + 1));
+			predicate_text = predicate_text.substr(0, colon);
+		}
+		predicate.name = std::wstring{ predicate_text };
+		query.where(std::move(predicate));
+	}
+	return query;
+}
+
+registry_query& registry_query::where(value_predicate predicate)
+{
+	m_predicates.push_back(std::move(predicate));
+	return *this;
+}
+
+bool registry_query::matches_path(std::wstring_view path) const
+{
+	std::vector<uint32_t> states{ 0 };
+	close(states);
+	std::vector<uint32_t> next;
+	size_t start = 0;
+	while (start <= path.size() && !states.empty())
+	{
+		size_t end = (std::min)(path.find(L'\\', start), path.size());
+		if (end > start)
+		{
+			step(states, path.substr(start, end - start), next);
+			states.swap(next);
+		}
+		start = end + 1;
+	}
+	return accepts(states);
+}
+
+query_result registry_query::run(const key_entry& root, const query_options& options) const
+{
+	query_result result;
+
+	// Leading literal segments are opened in one go.
+	size_t first = 0;
+	std::wstring prefix;
+	while (first < m_segments.size() && m_segments[first].kind == segment_kind::literal)
+	{
+		prefix += (prefix.empty() ? L"" : L"\\") + m_segments[first].text;
+		first++;
+	}
+	std::optional<key_entry> start = prefix.empty() ? std::optional<key_entry>{ root } : root.try_open_subkey(prefix);
+	if (!start)
+	{
+		return result;
+	}
+	uint32_t start_depth = start->interned_path().depth();
+
+	// The states a key is in follow from the names on its path below the start; the workers recompute them per key.
+	auto states_of = [this, first, start_depth](const key_entry& key, std::vector<uint32_t>& states)
+	{
+		// The names view segments the key's own path keeps alive.
+		std::vector<std::wstring_view> names;
+		key_path path = key.interned_path();
+		while (path.depth() > start_depth)
+		{
+			names.push_back(path.name());
+			path = path.parent();
+		}
+		states.assign(1, static_cast<uint32_t>(first));
+		close(states);
+		std::vector<uint32_t> next;
+		for (auto it = names.rbegin(); it != names.rend() && !states.empty(); ++it)
+		{
+			step(states, *it, next);
+			states.swap(next);
+		}
+	};
+
+	bool unbounded = std::any_of(m_segments.begin() + first, m_segments.end(), [](const segment& segment) { return segment.kind == segment_kind::any_depth; });
+
+	walk_options walk;
+	walk.threads = options.threads;
+	walk.ordered = options.ordered;
+	walk.ignore_errors = options.ignore_errors;
+	if (!unbounded)
+	{
+		walk.max_depth = static_cast<uint32_t>(m_segments.size() - first);
+	}
+	walk.prune = [this, &states_of](const key_entry& key, uint32_t)
+	{
+		std::vector<uint32_t> states;
+		states_of(key, states);
+		// Only the final state left: nothing below this key can match.
+		return std::all_of(states.begin(), states.end(), [this](uint32_t state) { return state == m_segments.size(); });
+	};
+	walk.expand = [this, &states_of](const key_entry& key, uint32_t, std::vector<std::wstring>& names)
+	{
+		std::vector<uint32_t> states;
+		states_of(key, states);
+		for (uint32_t state : states)
+		{
+			if (state == m_segments.size())
+			{
+				continue;
+			}
+			if (m_segments[state].kind != segment_kind::literal)
+			{
+				// Enumerate, and let the filter decide by name.
+				names.clear();
+				return false;
+			}
+			if (std::none_of(names.begin(), names.end(), [&](const std::wstring& name) { return utf16::equals_ignore_case(name, m_segments[state].text); }))
+			{
+				names.push_back(m_segments[state].text);
+			}
+		}
+		return true;
+	};
+	walk.filter = [this, &states_of](const key_entry& parent, const std::wstring& name, uint32_t)
+	{
+		// Workers see the sub keys of one parent in a row, so remember the parent's states.
+		thread_local const registry_query* cached_query = nullptr;
+		thread_local key_path cached_path;
+		thread_local std::vector<uint32_t> cached_states;
+		if (cached_query != this || cached_path != parent.interned_path())
+		{
+			states_of(parent, cached_states);
+			cached_query = this;
+			cached_path = parent.interned_path();
+		}
+		std::vector<uint32_t> next;
+		step(cached_states, name, next);
+		return !next.empty();
+	};
+
+	std::mutex mutex;
+	auto statistics = win32::registry::walk(*start, [&](const key_entry& key, uint32_t)
+	{
+		std::vector<uint32_t> states;
+		states_of(key, states);
+		if (accepts(states) && matches_values(key))
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			result.keys.push_back(key);
+		}
+	}, walk);
+
+	result.statistics.direct_opens = prefix.empty() ? 0 : 1;
+	for (const auto& worker : statistics.workers)
+	{
+		result.statistics.keys_visited += worker.keys_visited;
+		result.statistics.keys_pruned += worker.keys_filtered;
+		result.statistics.subtrees_pruned += worker.subtrees_pruned;
+		result.statistics.direct_opens += worker.direct_opens;
+	}
+	return result;
+}
+
+void registry_query::close(std::vector<uint32_t>& states) const
+{
+	// "**" may match no segment at all.
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		if (states[i] < m_segments.size() && m_segments[states[i]].kind == segment_kind::any_depth)
+		{
+			states.push_back(states[i] + 1);
+		}
+	}
+	std::sort(states.begin(), states.end());
+	states.erase(std::unique(states.begin(), states.end()), states.end());
+}
+
+void registry_query::step(const std::vector<uint32_t>& states, std::wstring_view name, std::vector<uint32_t>& next) const
+{
+	next.clear();
+	for (uint32_t state : states)
+	{
+		if (state == m_segments.size())
+		{
+			continue;
+		}
+		const auto& segment = m_segments[state];
+		if (segment.kind == segment_kind::any_depth)
+		{
+			next.push_back(state);
+		}
+		else if (matches_segment(segment, name))
+		{
+			next.push_back(state + 1);
+		}
+	}
+	close(next);
+}
+
+bool registry_query::accepts(const std::vector<uint32_t>& states) const
+{
+	return !states.empty() && states.back() == m_segments.size();
+}
+
+bool registry_query::matches_segment(const segment& segment, std::wstring_view name) const
+{
+	switch (segment.kind)
+	{
+	case segment_kind::literal:
+		return utf16::equals_ignore_case(segment.text, name);
+	case segment_kind::glob:
+		return glob_match(segment.text, name);
+	case segment_kind::regex:
+		return std::regex_match(name.begin(), name.end(), *segment.regex);
+	default:
+		return true;
+	}
+}
+
+bool registry_query::matches_values(const key_entry& key) const
+{
+	for (const auto& predicate : m_predicates)
+	{
+		bool found = false;
+		if (!has_wildcards(predicate.name))
+		{
+			auto value = key.get_value(predicate.name);
+			found = value && matches_value(*value, predicate);
+		}
+		else
+		{
+			for (const auto& value : key.values())
+			{
+				if (glob_match(predicate.name, value.name()) && matches_value(value, predicate))
+				{
+					found = true;
+					break;
+				}
+			}
+		}
+		if (!found)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "key_entry.h"
+#include "registry_value_type.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A condition on the values of a key.
+	 */
+	struct DllExport value_predicate
+	{
+		/** The name of the value; may contain * and ? wildcards. Empty for the default value. */
+		std::wstring name;
+		/** Only values of this type, if given. */
+		std::optional<registry_value_type> type;
+		/**
+		 * The data of the value, with * and ? wildcards, if given. Matches the text of string values, any string of a
+		 * REG_MULTI_SZ value, and the decimal form of REG_DWORD and REG_QWORD values.
+		 */
+		std::optional<std::wstring> data;
+	};
+
+	struct DllExport query_options
+	{
+		/** The number of worker threads, or 0 for one per hardware thread. */
+		uint32_t threads = 1;
+		/** Whether matches are returned in depth first order. Otherwise they come in whatever order workers find them. */
+		bool ordered = true;
+		/** Whether keys that fail to open are skipped instead of failing the query. */
+		bool ignore_errors = true;
+	};
+
+	struct DllExport query_statistics
+	{
+		/** Keys opened and checked against the query. */
+		uint64_t keys_visited = 0;
+		/** Sub keys that were enumerated but not opened, because their name could not lead to a match. */
+		uint64_t keys_pruned = 0;
+		/** Keys whose sub keys were not enumerated at all, because nothing below them could match. */
+		uint64_t subtrees_pruned = 0;
+		/** Keys opened directly by name, for literal path segments, instead of found by enumeration. */
+		uint64_t direct_opens = 0;
+	};
+
+	struct DllExport query_result
+	{
+		/** The matching keys. */
+		std::vector<key_entry> keys;
+		query_statistics statistics;
+	};
+
+	/**
+	 * @brief Finds the keys below a root whose path matches a pattern and whose values match a set of predicates.
+	 *
+	 * Paths are matched one backslash separated segment at a time, ignoring case. A segment is either a literal
+	 * name, a glob with * (any run of characters) and ? (any single character), "**" for any number of segments,
+	 * including none, or a regular expression between slashes, such as /KB\\d+/, that must match the whole name.
+	 *
+	 * Literal segments are opened directly instead of enumerated, sub keys are only opened when their name can still
+	 * lead to a match, and nothing is enumerated below keys that cannot have matching descendants. The query runs on
+	 * the tree walker, so it can fan out over several threads.
+	 *
+	 * The text form is the path pattern followed by value predicates, each introduced by " @":
+	 * "Software\\*\\Uninstall\\* @DisplayVersion @EstimatedSize:dword @Publisher=Micro*". A predicate is a
+	 * value name, optionally followed by :type (sz, expand_sz, binary, dword, multi_sz, qword or none) and =data.
+	 */
+	class DllExport registry_query
+	{
+	public:
+		/**
+		 * @brief Creates a query from a path pattern, without value predicates.
+		 * @param pattern The path pattern, relative to the root the query runs on.
+		 * @exception std::invalid_argument A regular expression segment is malformed.
+		 */
+		explicit registry_query(std::wstring_view pattern);
+
+		/**
+		 * @brief Creates a query from its text form.
+		 * @param text The path pattern followed by any value predicates.
+		 * @return The query.
+		 * @exception std::invalid_argument The text is malformed.
+		 */
+		static registry_query parse(std::wstring_view text);
+
+		/**
+		 * @brief Adds a value predicate. Keys must satisfy all predicates to match.
+		 * @param predicate The predicate.
+		 * @return This query.
+		 */
+		registry_query& where(value_predicate predicate);
+
+		/**
+		 * @brief Checks a path against the path pattern only.
+		 * @param path The path, relative to the root.
+		 * @return true if the path matches; otherwise false.
+		 */
+		bool matches_path(std::wstring_view path) const;
+
+		/**
+		 * @brief Runs the query.
+		 * @param root The key paths are relative to.
+		 * @param options How to run.
+		 * @return The matching keys and what it took to find them.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		query_result run(const key_entry& root, const query_options& options = {}) const;
+
+	private:
+		enum class segment_kind : uint8_t { literal, glob, regex, any_depth };
+
+		struct segment
+		{
+			segment_kind kind;
+			std::wstring text;
+			std::optional<std::wregex> regex;
+		};
+
+		/** The states reachable, without consuming a name, from the given ones. Sorted, without duplicates. */
+		void close(std::vector<uint32_t>& states) const;
+
+		/** The states reached by consuming a name. */
+		void step(const std::vector<uint32_t>& states, std::wstring_view name, std::vector<uint32_t>& next) const;
+
+		bool accepts(const std::vector<uint32_t>& states) const;
+
+		bool matches_segment(const segment& segment, std::wstring_view name) const;
+
+		bool matches_values(const key_entry& key) const;
+
+		std::vector<segment> m_segments;
+		std::vector<value_predicate> m_predicates;
+	};
+}
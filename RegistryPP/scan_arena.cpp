@@ -0,0 +1,44 @@
+#include "scan_arena.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	thread_local std::pmr::memory_resource* current_resource = nullptr;
+}
+
+scan_arena::scan_arena(size_t initial_size, std::pmr::memory_resource* upstream) :
+	m_resource(initial_size, upstream)
+{
+}
+
+std::pmr::memory_resource* scan_arena::resource()
+{
+	return &m_resource;
+}
+
+void scan_arena::reset()
+{
+	m_resource.release();
+}
+
+arena_scope::arena_scope(scan_arena& arena) :
+	arena_scope(arena.resource())
+{
+}
+
+arena_scope::arena_scope(std::pmr::memory_resource* resource) :
+	m_previous(current_resource)
+{
+	current_resource = resource;
+}
+
+arena_scope::~arena_scope()
+{
+	current_resource = m_previous;
+}
+
+std::pmr::memory_resource* arena_scope::current()
+{
+	return current_resource != nullptr ? current_resource : std::pmr::get_default_resource();
+}
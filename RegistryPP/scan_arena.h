@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include "dll_export.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A monotonic arena for the temporaries of one scan.
+	 *
+	 * Allocating is a pointer bump, freeing does nothing, and reset() hands back everything at once. Entries made
+	 * while an arena_scope routes allocations here must all be gone before the arena is reset or destroyed.
+	 */
+	class DllExport scan_arena
+	{
+	public:
+		/**
+		 * @brief Creates an empty arena.
+		 * @param initial_size The size of the first block taken from upstream. Later blocks grow geometrically.
+		 * @param upstream Where blocks come from.
+		 */
+		explicit scan_arena(size_t initial_size = 64 * 1024, std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+		scan_arena(const scan_arena&) = delete;
+		scan_arena& operator=(const scan_arena&) = delete;
+
+		/**
+		 * @brief Gets the arena as a memory resource.
+		 * @return The resource.
+		 */
+		std::pmr::memory_resource* resource();
+
+		/**
+		 * @brief Releases every block back upstream, keeping none.
+		 */
+		void reset();
+
+	private:
+		std::pmr::monotonic_buffer_resource m_resource;
+	};
+
+	/**
+	 * @brief Routes the allocations of keys and values opened on this thread to a memory resource while in scope.
+	 *
+	 * Covers key_entry state, key path segments, value names and copied value data. Backend objects and the strings
+	 * key_entry hands out by reference stay on the heap. Scopes nest; the innermost one wins. Keys and values kept past
+	 * the scope must not be created inside it; key_cache, hash_cache and write_batch open a heap scope of their own for
+	 * what they keep.
+	 */
+	class DllExport arena_scope
+	{
+	public:
+		/**
+		 * @brief Routes allocations to an arena.
+		 * @param arena The arena.
+		 */
+		explicit arena_scope(scan_arena& arena);
+
+		/**
+		 * @brief Routes allocations to a memory resource.
+		 * @param resource The resource.
+		 */
+		explicit arena_scope(std::pmr::memory_resource* resource);
+
+		/**
+		 * @brief Goes back to the resource in use before this scope.
+		 */
+		~arena_scope();
+
+		arena_scope(const arena_scope&) = delete;
+		arena_scope& operator=(const arena_scope&) = delete;
+
+		/**
+		 * @brief Gets the resource keys and values allocate from on this thread.
+		 * @return The innermost scope's resource, or std::pmr::get_default_resource() outside any scope.
+		 */
+		static std::pmr::memory_resource* current();
+
+	private:
+		std::pmr::memory_resource* m_previous;
+	};
+}
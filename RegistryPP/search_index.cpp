@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include "search_index.h"
+#include "registry_error.h"
+#include "utf16.h"
+#include "value_entry.h"
+#include "value_range.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	constexpr uint32_t no_parent = 0xFFFFFFFF;
+	constexpr char index_magic[8] = { 'R', 'P', 'P', 'I', 'N', 'D', 'E', 'X' };
+	constexpr uint32_t index_version = 1;
+
+	/** Orders names the way the registry compares them: by their folded characters. */
+	int compare_folded(std::wstring_view lhs, std::wstring_view rhs)
+	{
+		size_t length = std::min(lhs.size(), rhs.size());
+		for (size_t i = 0; i < length; i++)
+		{
+			wchar_t l = utf16::fold(lhs[i]);
+			wchar_t r = utf16::fold(rhs[i]);
+			if (l != r)
+			{
+				return l < r ? -1 : 1;
+			}
+		}
+		return lhs.size() < rhs.size() ? -1 : lhs.size() > rhs.size() ? 1 : 0;
+	}
+
+	bool starts_with_folded(std::wstring_view text, std::wstring_view prefix)
+	{
+		return text.size() >= prefix.size() && utf16::equals_ignore_case(text.substr(0, prefix.size()), prefix);
+	}
+
+	bool is_text(registry_value_type type)
+	{
+		return type == registry_value_type::string || type == registry_value_type::expandable_string || type == registry_value_type::multi_string;
+	}
+
+	/** Packs three folded characters; 21 bits hold any code point. */
+	uint64_t trigram(const wchar_t* text)
+	{
+		constexpr uint64_t mask = 0x1FFFFF;
+		return ((static_cast<uint64_t>(text[0]) & mask) << 42) | ((static_cast<uint64_t>(text[1]) & mask) << 21) | (static_cast<uint64_t>(text[2]) & mask);
+	}
+
+	void write_u32(std::ostream& out, uint32_t value)
+	{
+		uint8_t bytes[4] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24) };
+		out.write(reinterpret_cast<const char*>(bytes), sizeof bytes);
+	}
+
+	void write_u64(std::ostream& out, uint64_t value)
+	{
+		write_u32(out, static_cast<uint32_t>(value));
+		write_u32(out, static_cast<uint32_t>(value >> 32));
+	}
+
+	void write_string(std::ostream& out, std::wstring_view string, std::vector<uint8_t>& scratch)
+	{
+		scratch.clear();
+		utf16::append_bytes(scratch, string);
+		write_u32(out, static_cast<uint32_t>(scratch.size() / 2));
+		out.write(reinterpret_cast<const char*>(scratch.data()), static_cast<std::streamsize>(scratch.size()));
+	}
+
+	void write_indices(std::ostream& out, const std::vector<uint32_t>& indices)
+	{
+		write_u32(out, static_cast<uint32_t>(indices.size()));
+		for (uint32_t index : indices)
+		{
+			write_u32(out, index);
+		}
+	}
+
+	class index_input
+	{
+	public:
+		explicit index_input(std::istream& in) :
+			m_in(in), m_scratch()
+		{
+		}
+
+		void read(void* data, size_t size)
+		{
+			m_in.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+			if (static_cast<size_t>(m_in.gcount()) != size)
+			{
+				throw registry_error{ registry_errc::corrupt, "The search index is truncated." };
+			}
+		}
+
+		uint32_t u32()
+		{
+			uint8_t bytes[4];
+			read(bytes, sizeof bytes);
+			return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) | (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+		}
+
+		uint64_t u64()
+		{
+			uint64_t low = u32();
+			return low | (static_cast<uint64_t>(u32()) << 32);
+		}
+
+		std::wstring string()
+		{
+			uint32_t units = u32();
+			m_scratch.resize(static_cast<size_t>(units) * 2);
+			read(m_scratch.data(), m_scratch.size());
+			std::wstring string;
+			utf16::append(string, m_scratch.data(), units);
+			return string;
+		}
+
+		std::vector<uint32_t> indices(uint32_t bound)
+		{
+			uint32_t count = u32();
+			std::vector<uint32_t> indices;
+			// Counts come from the file; grow as data arrives rather than trusting them up front.
+			indices.reserve(std::min<uint32_t>(count, 1 << 20));
+			for (uint32_t i = 0; i < count; i++)
+			{
+				indices.push_back(checked(u32(), bound));
+			}
+			return indices;
+		}
+
+		static uint32_t checked(uint32_t index, uint32_t bound)
+		{
+			if (index >= bound)
+			{
+				throw registry_error{ registry_errc::corrupt, "The search index refers past its end." };
+			}
+			return index;
+		}
+
+	private:
+		std::istream& m_in;
+		std::vector<uint8_t> m_scratch;
+	};
+}
+
+search_index search_index::build(const key_entry& root)
+{
+	search_index index;
+	index.index_key(root, no_parent);
+	index.finish();
+	return index;
+}
+
+void search_index::index_key(const key_entry& key, uint32_t parent)
+{
+	uint32_t id = static_cast<uint32_t>(m_key_parent.size());
+	m_key_parent.push_back(parent);
+	m_key_name.push_back(key.name());
+	for (const auto& value : key.values())
+	{
+		m_values.push_back(value_record{ id, value.type(), value.name() });
+		std::wstring text;
+		if (value.type() == registry_value_type::multi_string)
+		{
+			for (const auto& string : value.get_strings())
+			{
+				text.append(string);
+				text.push_back(L'\0');
+			}
+		}
+		else if (is_text(value.type()))
+		{
+			text = value.get_string();
+		}
+		m_text.push_back(utf16::fold(text));
+	}
+	uint32_t count = key.sub_key_count();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		index_key(key.open_subkey(key.sub_key_name(i)), id);
+	}
+}
+
+void search_index::finish()
+{
+	uint32_t keys = static_cast<uint32_t>(m_key_parent.size());
+	m_child_offset.assign(keys + 1, 0);
+	for (uint32_t key = 1; key < keys; key++)
+	{
+		m_child_offset[m_key_parent[key] + 1]++;
+	}
+	for (uint32_t key = 0; key < keys; key++)
+	{
+		m_child_offset[key + 1] += m_child_offset[key];
+	}
+	m_children.resize(keys == 0 ? 0 : keys - 1);
+	std::vector<uint32_t> next(m_child_offset.begin(), m_child_offset.end() - 1);
+	for (uint32_t key = 1; key < keys; key++)
+	{
+		m_children[next[m_key_parent[key]]++] = key;
+	}
+	auto by_key_name = [this](uint32_t lhs, uint32_t rhs) { return compare_folded(m_key_name[lhs], m_key_name[rhs]) < 0; };
+	for (uint32_t key = 0; key < keys; key++)
+	{
+		std::sort(m_children.begin() + m_child_offset[key], m_children.begin() + m_child_offset[key + 1], by_key_name);
+	}
+
+	m_by_name.resize(m_values.size());
+	for (uint32_t i = 0; i < m_by_name.size(); i++)
+	{
+		m_by_name[i] = i;
+	}
+	std::stable_sort(m_by_name.begin(), m_by_name.end(), [this](uint32_t lhs, uint32_t rhs) { return compare_folded(m_values[lhs].name, m_values[rhs].name) < 0; });
+
+	for (uint32_t value = 0; value < m_text.size(); value++)
+	{
+		const auto& text = m_text[value];
+		for (size_t i = 0; i + 3 <= text.size(); i++)
+		{
+			auto& postings = m_trigrams[trigram(text.data() + i)];
+			if (postings.empty() || postings.back() != value)
+			{
+				postings.push_back(value);
+			}
+		}
+	}
+}
+
+search_index search_index::load(std::istream& in)
+{
+	index_input input{ in };
+	char magic[sizeof index_magic];
+	input.read(magic, sizeof magic);
+	if (std::memcmp(magic, index_magic, sizeof magic) != 0 || input.u32() != index_version)
+	{
+		throw registry_error{ registry_errc::corrupt, "Not a search index." };
+	}
+
+	search_index index;
+	uint32_t keys = input.u32();
+	for (uint32_t key = 0; key < keys; key++)
+	{
+		uint32_t parent = input.u32();
+		if (key == 0 ? parent != no_parent : parent >= key)
+		{
+			throw registry_error{ registry_errc::corrupt, "The search index has a malformed key tree." };
+		}
+		index.m_key_parent.push_back(parent);
+		index.m_key_name.push_back(input.string());
+	}
+	index.m_child_offset = input.indices(keys + 1);
+	index.m_children = input.indices(keys);
+	if (index.m_child_offset.size() != static_cast<size_t>(keys) + 1 || index.m_children.size() != (keys == 0 ? 0 : keys - 1) ||
+		!std::is_sorted(index.m_child_offset.begin(), index.m_child_offset.end()) || index.m_child_offset.back() != index.m_children.size())
+	{
+		throw registry_error{ registry_errc::corrupt, "The search index has a malformed key tree." };
+	}
+	// Every key lists only keys whose parent it is, and parents come first, so walking the tree always ends.
+	for (uint32_t key = 0; key < keys; key++)
+	{
+		for (uint32_t i = index.m_child_offset[key]; i < index.m_child_offset[key + 1]; i++)
+		{
+			if (index.m_key_parent[index.m_children[i]] != key || index.m_children[i] <= key)
+			{
+				throw registry_error{ registry_errc::corrupt, "The search index has a malformed key tree." };
+			}
+		}
+	}
+
+	uint32_t values = input.u32();
+	for (uint32_t value = 0; value < values; value++)
+	{
+		uint32_t key = index_input::checked(input.u32(), keys);
+		auto type = static_cast<registry_value_type>(input.u32());
+		index.m_values.push_back(value_record{ key, type, input.string() });
+		index.m_text.push_back(input.string());
+	}
+	index.m_by_name = input.indices(values);
+	if (index.m_by_name.size() != values)
+	{
+		throw registry_error{ registry_errc::corrupt, "The search index has a malformed name table." };
+	}
+	// find_values_by_name binary searches the table, so it must list every value once, in name order.
+	std::vector<bool> listed(values);
+	for (uint32_t value : index.m_by_name)
+	{
+		if (listed[value])
+		{
+			throw registry_error{ registry_errc::corrupt, "The search index has a malformed name table." };
+		}
+		listed[value] = true;
+	}
+	if (!std::is_sorted(index.m_by_name.begin(), index.m_by_name.end(), [&index](uint32_t lhs, uint32_t rhs) { return compare_folded(index.m_values[lhs].name, index.m_values[rhs].name) < 0; }))
+	{
+		throw registry_error{ registry_errc::corrupt, "The search index has an unsorted name table." };
+	}
+
+	uint32_t trigrams = input.u32();
+	for (uint32_t i = 0; i < trigrams; i++)
+	{
+		uint64_t gram = input.u64();
+		auto postings = input.indices(values);
+		if (std::adjacent_find(postings.begin(), postings.end(), std::greater_equal<uint32_t>{}) != postings.end())
+		{
+			throw registry_error{ registry_errc::corrupt, "The search index has an unsorted postings list." };
+		}
+		index.m_trigrams.emplace(gram, std::move(postings));
+	}
+	return index;
+}
+
+void search_index::save(std::ostream& out) const
+{
+	std::vector<uint8_t> scratch;
+	out.write(index_magic, sizeof index_magic);
+	write_u32(out, index_version);
+
+	write_u32(out, static_cast<uint32_t>(m_key_parent.size()));
+	for (size_t key = 0; key < m_key_parent.size(); key++)
+	{
+		write_u32(out, m_key_parent[key]);
+		write_string(out, m_key_name[key], scratch);
+	}
+	write_indices(out, m_child_offset);
+	write_indices(out, m_children);
+
+	write_u32(out, static_cast<uint32_t>(m_values.size()));
+	for (size_t value = 0; value < m_values.size(); value++)
+	{
+		write_u32(out, m_values[value].key);
+		write_u32(out, static_cast<uint32_t>(m_values[value].type));
+		write_string(out, m_values[value].name, scratch);
+		write_string(out, m_text[value], scratch);
+	}
+	write_indices(out, m_by_name);
+
+	write_u32(out, static_cast<uint32_t>(m_trigrams.size()));
+	for (const auto& [gram, postings] : m_trigrams)
+	{
+		write_u64(out, gram);
+		write_indices(out, postings);
+	}
+}
+
+size_t search_index::key_count() const
+{
+	return m_key_parent.size();
+}
+
+size_t search_index::value_count() const
+{
+	return m_values.size();
+}
+
+std::vector<search_hit> search_index::find_keys(std::wstring_view prefix, size_t limit) const
+{
+	std::vector<search_hit> hits;
+	if (m_key_parent.empty() || limit == 0)
+	{
+		return hits;
+	}
+
+	// Follow the complete components down the tree; the text after the last separator is a prefix of a name.
+	std::vector<uint32_t> starts;
+	if (prefix.empty())
+	{
+		starts.push_back(0);
+	}
+	else
+	{
+		uint32_t key = 0;
+		size_t start = 0;
+		size_t end;
+		while ((end = prefix.find(L'\\', start)) != std::wstring_view::npos)
+		{
+			auto component = prefix.substr(start, end - start);
+			start = end + 1;
+			if (component.empty())
+			{
+				continue;
+			}
+			auto first = m_children.begin() + m_child_offset[key];
+			auto last = m_children.begin() + m_child_offset[key + 1];
+			auto it = std::lower_bound(first, last, component, [this](uint32_t child, std::wstring_view name) { return compare_folded(m_key_name[child], name) < 0; });
+			if (it == last || compare_folded(m_key_name[*it], component) != 0)
+			{
+				return hits;
+			}
+			key = *it;
+		}
+		auto partial = prefix.substr(start);
+		auto first = m_children.begin() + m_child_offset[key];
+		auto last = m_children.begin() + m_child_offset[key + 1];
+		for (auto it = std::lower_bound(first, last, partial, [this](uint32_t child, std::wstring_view name) { return compare_folded(m_key_name[child], name) < 0; });
+			it != last && starts_with_folded(m_key_name[*it], partial); ++it)
+		{
+			starts.push_back(*it);
+		}
+	}
+
+	// Each match brings its whole subtree, depth first.
+	std::vector<uint32_t> stack;
+	for (uint32_t start : starts)
+	{
+		stack.push_back(start);
+		while (!stack.empty())
+		{
+			uint32_t key = stack.back();
+			stack.pop_back();
+			hits.push_back(search_hit{ path_of(key), {}, registry_value_type::none });
+			if (hits.size() == limit)
+			{
+				return hits;
+			}
+			for (uint32_t i = m_child_offset[key + 1]; i > m_child_offset[key]; i--)
+			{
+				stack.push_back(m_children[i - 1]);
+			}
+		}
+	}
+	return hits;
+}
+
+std::vector<search_hit> search_index::find_values_by_name(std::wstring_view prefix, std::optional<registry_value_type> type, size_t limit) const
+{
+	std::vector<search_hit> hits;
+	auto it = std::lower_bound(m_by_name.begin(), m_by_name.end(), prefix, [this](uint32_t value, std::wstring_view name) { return compare_folded(m_values[value].name, name) < 0; });
+	for (; it != m_by_name.end() && hits.size() < limit && starts_with_folded(m_values[*it].name, prefix); ++it)
+	{
+		if (!type || m_values[*it].type == *type)
+		{
+			hits.push_back(hit(*it));
+		}
+	}
+	return hits;
+}
+
+std::vector<search_hit> search_index::find_values_containing(std::wstring_view text, std::optional<registry_value_type> type, size_t limit) const
+{
+	std::vector<search_hit> hits;
+	if ((type && !is_text(*type)) || limit == 0)
+	{
+		return hits;
+	}
+	auto folded = utf16::fold(text);
+	auto matches = [&](uint32_t value)
+	{
+		return is_text(m_values[value].type) && (!type || m_values[value].type == *type) && m_text[value].find(folded) != std::wstring::npos;
+	};
+
+	if (folded.size() < 3)
+	{
+		for (uint32_t value = 0; value < m_values.size() && hits.size() < limit; value++)
+		{
+			if (matches(value))
+			{
+				hits.push_back(hit(value));
+			}
+		}
+		return hits;
+	}
+
+	// Intersect the postings of every trigram of the text, shortest first, then check the survivors.
+	std::vector<const std::vector<uint32_t>*> postings;
+	for (size_t i = 0; i + 3 <= folded.size(); i++)
+	{
+		auto it = m_trigrams.find(trigram(folded.data() + i));
+		if (it == m_trigrams.end())
+		{
+			return hits;
+		}
+		postings.push_back(&it->second);
+	}
+	std::sort(postings.begin(), postings.end(), [](const auto* lhs, const auto* rhs) { return lhs->size() < rhs->size(); });
+	std::vector<uint32_t> candidates = *postings.front();
+	std::vector<uint32_t> intersection;
+	for (size_t i = 1; i < postings.size() && !candidates.empty(); i++)
+	{
+		if (postings[i] == postings[i - 1])
+		{
+			continue;
+		}
+		intersection.clear();
+		std::set_intersection(candidates.begin(), candidates.end(), postings[i]->begin(), postings[i]->end(), std::back_inserter(intersection));
+		candidates.swap(intersection);
+	}
+	for (uint32_t value : candidates)
+	{
+		if (matches(value))
+		{
+			hits.push_back(hit(value));
+			if (hits.size() == limit)
+			{
+				break;
+			}
+		}
+	}
+	return hits;
+}
+
+std::wstring search_index::path_of(uint32_t key) const
+{
+	std::vector<uint32_t> chain;
+	size_t length = 0;
+	for (; key != 0; key = m_key_parent[key])
+	{
+		chain.push_back(key);
+		length += m_key_name[key].size() + 1;
+	}
+	std::wstring path;
+	path.reserve(length);
+	for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+	{
+		if (!path.empty())
+		{
+			path.push_back(L'\\');
+		}
+		path.append(m_key_name[*it]);
+	}
+	return path;
+}
+
+search_hit search_index::hit(uint32_t value) const
+{
+	const auto& record = m_values[value];
+	return search_hit{ path_of(record.key), record.name, record.type };
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "key_entry.h"
+#include "registry_value_type.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief A key or value found by a search_index.
+	 */
+	struct DllExport search_hit
+	{
+		/** The path of the key, relative to the indexed root; empty for the root itself. */
+		std::wstring path;
+		/** The name of the value; empty for keys and for the default value. */
+		std::wstring value_name;
+		/** The type of the value; registry_value_type::none for keys. */
+		registry_value_type type = registry_value_type::none;
+	};
+
+	/**
+	 * @brief An index over the key paths, value names and string data of a tree, so searches need no walk.
+	 *
+	 * Key names are kept sorted per parent, which makes the key tree itself a case-insensitive trie of path
+	 * components: path prefix lookups follow one branch. Value names are kept in one sorted table, and the folded text
+	 * of REG_SZ, REG_EXPAND_SZ and REG_MULTI_SZ data is indexed by trigram, so substring searches only check values
+	 * that contain every trigram of the search text. All comparisons ignore case.
+	 *
+	 * Build it once, typically over a snapshot or a hive file, and save it next to the source to reuse it. Saved
+	 * indexes are not portable between platforms: trigrams are built from wchar_t units, which are UTF-16 on Windows
+	 * and UTF-32 elsewhere, so text with characters outside the BMP indexes differently.
+	 * Immutable once built, so any number of threads may search it at the same time.
+	 */
+	class DllExport search_index
+	{
+	public:
+		/** No limit on the number of results. */
+		static constexpr size_t unlimited = (std::numeric_limits<size_t>::max)();
+
+		/**
+		 * @brief Indexes a key and everything below it.
+		 * @param root The key to index.
+		 * @return The index.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		static search_index build(const key_entry& root);
+
+		/**
+		 * @brief Reads an index written by save.
+		 * @param in The stream, opened in binary mode.
+		 * @return The index.
+		 * @exception registry_error The stream does not hold an index, for example one saved on another platform.
+		 */
+		static search_index load(std::istream& in);
+
+		/**
+		 * @brief Writes the index.
+		 * @param out The stream, opened in binary mode.
+		 */
+		void save(std::ostream& out) const;
+
+		/**
+		 * @brief Gets the number of indexed keys.
+		 * @return The number of keys.
+		 */
+		size_t key_count() const;
+
+		/**
+		 * @brief Gets the number of indexed values.
+		 * @return The number of values.
+		 */
+		size_t value_count() const;
+
+		/**
+		 * @brief Finds the keys whose path, relative to the root, starts with a prefix.
+		 *
+		 * "Software\\Micro" finds Software\\Microsoft and everything below it; "Software\\" finds everything below
+		 * Software; the empty prefix finds every key.
+		 * @param prefix The path prefix.
+		 * @param limit The most keys to return.
+		 * @return The keys, parents before their sub keys.
+		 */
+		std::vector<search_hit> find_keys(std::wstring_view prefix, size_t limit = unlimited) const;
+
+		/**
+		 * @brief Finds the values whose name starts with a prefix.
+		 * @param prefix The name prefix; empty for every value.
+		 * @param type Only values of this type, if given.
+		 * @param limit The most values to return.
+		 * @return The values, ordered by name.
+		 */
+		std::vector<search_hit> find_values_by_name(std::wstring_view prefix, std::optional<registry_value_type> type = std::nullopt, size_t limit = unlimited) const;
+
+		/**
+		 * @brief Finds the string values whose data contains some text.
+		 * @param text The text. Searches for fewer than three characters check every string value.
+		 * @param type Only values of this type, if given.
+		 * @param limit The most values to return.
+		 * @return The values, in the order they were indexed.
+		 */
+		std::vector<search_hit> find_values_containing(std::wstring_view text, std::optional<registry_value_type> type = std::nullopt, size_t limit = unlimited) const;
+
+	private:
+		struct value_record
+		{
+			uint32_t key;
+			registry_value_type type;
+			std::wstring name;
+		};
+
+		search_index() = default;
+
+		void index_key(const key_entry& key, uint32_t parent);
+
+		void finish();
+
+		std::wstring path_of(uint32_t key) const;
+
+		search_hit hit(uint32_t value) const;
+
+		std::vector<uint32_t> m_key_parent;
+		std::vector<std::wstring> m_key_name;
+		/** The sub keys of key i are m_children[m_child_offset[i]] to m_children[m_child_offset[i + 1]], by name. */
+		std::vector<uint32_t> m_child_offset;
+		std::vector<uint32_t> m_children;
+		std::vector<value_record> m_values;
+		/** Value indices, ordered by name. */
+		std::vector<uint32_t> m_by_name;
+		/** The folded text of each string value, in value order; empty for other values. */
+		std::vector<std::wstring> m_text;
+		/** For every trigram of folded text, the values containing it, in ascending order. */
+		std::unordered_map<uint64_t, std::vector<uint32_t>> m_trigrams;
+	};
+}
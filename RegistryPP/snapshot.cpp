@@ -0,0 +1,686 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <deque>
+#include "snapshot.h"
+#include "mapped_file.h"
+#include "registry_error.h"
+#include "sub_key_range.h"
+#include "utf16.h"
+#include "value_range.h"
+
+using namespace win32::registry;
+
+static std::u16string to_utf16(std::wstring_view string)
+{
+	std::vector<uint8_t> bytes;
+	utf16::append_bytes(bytes, string);
+	std::u16string result(bytes.size() / 2, u'\0');
+	for (size_t i = 0; i < result.size(); i++)
+	{
+		result[i] = static_cast<char16_t>(bytes[2 * i] | (bytes[2 * i + 1] << 8));
+	}
+	return result;
+}
+
+static std::wstring to_wstring(std::u16string_view string)
+{
+	std::wstring result;
+	std::vector<uint8_t> bytes;
+	bytes.reserve(string.size() * 2);
+	for (char16_t unit : string)
+	{
+		bytes.push_back(static_cast<uint8_t>(unit & 0xFF));
+		bytes.push_back(static_cast<uint8_t>(unit >> 8));
+	}
+	utf16::append(result, bytes.data(), string.size());
+	return result;
+}
+
+static int compare_folded(std::u16string_view lhs, std::u16string_view rhs)
+{
+	size_t length = (std::min)(lhs.size(), rhs.size());
+	for (size_t i = 0; i < length; i++)
+	{
+		if (lhs[i] != rhs[i])
+		{
+			auto l = utf16::fold(static_cast<wchar_t>(lhs[i]));
+			auto r = utf16::fold(static_cast<wchar_t>(rhs[i]));
+			if (l != r)
+			{
+				return l < r ? -1 : 1;
+			}
+		}
+	}
+	return lhs.size() == rhs.size() ? 0 : (lhs.size() < rhs.size() ? -1 : 1);
+}
+
+namespace
+{
+	/** The tables of a captured snapshot; the snapshot views them. */
+	struct snapshot_tables
+	{
+		std::vector<snapshot::key_record> keys;
+		std::vector<snapshot::value_record> values;
+		std::vector<char16_t> names;
+		std::vector<uint8_t> data;
+	};
+
+	constexpr char snapshot_magic[8] = { 'R', 'P', 'P', 'S', 'N', 'A', 'P', '\0' };
+	constexpr uint32_t snapshot_version = 1;
+
+	/**
+	 * The start of a saved snapshot. Offsets are from the start of the file; the checksum follows the last section.
+	 */
+	struct snapshot_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size;
+		uint32_t key_count;
+		uint32_t value_count;
+		uint64_t name_units;
+		uint64_t data_size;
+		uint64_t keys_offset;
+		uint64_t values_offset;
+		uint64_t names_offset;
+		uint64_t data_offset;
+	};
+
+	static_assert(sizeof(snapshot_header) == 72);
+	static_assert(sizeof(snapshot::key_record) == 48);
+	static_assert(sizeof(snapshot::value_record) == 20);
+
+	constexpr uint64_t align8(uint64_t offset)
+	{
+		return (offset + 7) & ~uint64_t{ 7 };
+	}
+
+	/**
+	 * A 64-bit checksum over bytes fed in any number of pieces. Works a word at a time, so checking a mapped
+	 * snapshot runs at close to memory speed.
+	 */
+	class checksum
+	{
+	public:
+		void update(const uint8_t* data, size_t size)
+		{
+			m_length += size;
+			if (m_pending_size > 0)
+			{
+				size_t take = (std::min)(8 - m_pending_size, size);
+				std::memcpy(m_pending + m_pending_size, data, take);
+				m_pending_size += take;
+				data += take;
+				size -= take;
+				if (m_pending_size < 8)
+				{
+					return;
+				}
+				mix(m_pending);
+				m_pending_size = 0;
+			}
+			for (; size >= 8; data += 8, size -= 8)
+			{
+				mix(data);
+			}
+			std::memcpy(m_pending, data, size);
+			m_pending_size = size;
+		}
+
+		uint64_t finish()
+		{
+			std::fill(m_pending + m_pending_size, m_pending + 8, uint8_t{ 0 });
+			mix(m_pending);
+			uint64_t hash = m_hash ^ m_length;
+			hash ^= hash >> 33;
+			hash *= 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 33;
+			return hash;
+		}
+
+	private:
+		void mix(const uint8_t* word)
+		{
+			uint64_t value;
+			std::memcpy(&value, word, sizeof value);
+			m_hash = std::rotl(m_hash ^ (value * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+		}
+
+		uint64_t m_hash = 0x9E3779B97F4A7C15ull;
+		uint64_t m_length = 0;
+		uint8_t m_pending[8] = {};
+		size_t m_pending_size = 0;
+	};
+
+	[[noreturn]] void corrupt(const char* message)
+	{
+		throw registry_error{ registry_errc::corrupt, message };
+	}
+}
+
+snapshot_value::snapshot_value(const snapshot* owner, uint32_t index) :
+	m_owner(owner), m_index(index)
+{
+}
+
+std::wstring snapshot_value::name() const
+{
+	return to_wstring(raw_name());
+}
+
+std::u16string_view snapshot_value::raw_name() const
+{
+	const auto& record = m_owner->m_values[m_index];
+	return m_owner->string_at(record.name_offset, record.name_length);
+}
+
+registry_value_type snapshot_value::type() const
+{
+	return static_cast<registry_value_type>(m_owner->m_values[m_index].type);
+}
+
+const uint8_t* snapshot_value::data() const
+{
+	return m_owner->m_data.data() + m_owner->m_values[m_index].data_offset;
+}
+
+uint32_t snapshot_value::size() const
+{
+	return m_owner->m_values[m_index].data_size;
+}
+
+snapshot_key::snapshot_key(const snapshot* owner, uint32_t index) :
+	m_owner(owner), m_index(index)
+{
+}
+
+std::wstring snapshot_key::name() const
+{
+	return to_wstring(raw_name());
+}
+
+std::u16string_view snapshot_key::raw_name() const
+{
+	const auto& record = m_owner->m_keys[m_index];
+	return m_owner->string_at(record.name_offset, record.name_length);
+}
+
+std::wstring snapshot_key::key_class() const
+{
+	const auto& record = m_owner->m_keys[m_index];
+	return to_wstring(m_owner->string_at(record.class_offset, record.class_length));
+}
+
+std::chrono::system_clock::time_point snapshot_key::last_written() const
+{
+	return filetime_to_time_point(m_owner->m_keys[m_index].last_written);
+}
+
+bool snapshot_key::is_root() const
+{
+	return m_owner->m_keys[m_index].parent == snapshot::no_index;
+}
+
+snapshot_key snapshot_key::parent() const
+{
+	return snapshot_key{ m_owner, m_owner->m_keys[m_index].parent };
+}
+
+uint32_t snapshot_key::sub_key_count() const
+{
+	return m_owner->m_keys[m_index].child_count;
+}
+
+snapshot_key snapshot_key::sub_key(uint32_t index) const
+{
+	const auto& record = m_owner->m_keys[m_index];
+	if (index >= record.child_count)
+	{
+		throw registry_error{ registry_errc::not_found, "No sub key at index." };
+	}
+	return snapshot_key{ m_owner, record.first_child + index };
+}
+
+std::optional<snapshot_key> snapshot_key::find_subkey(std::wstring_view name) const
+{
+	uint32_t current = m_index;
+	size_t start = 0;
+	while (start <= name.size())
+	{
+		size_t end = name.find(L'\\', start);
+		if (end == std::wstring_view::npos)
+		{
+			end = name.size();
+		}
+		if (end > start)
+		{
+			auto component = to_utf16(name.substr(start, end - start));
+			const auto& record = m_owner->m_keys[current];
+			uint32_t low = record.first_child;
+			uint32_t high = record.first_child + record.child_count;
+			while (low < high)
+			{
+				uint32_t middle = low + (high - low) / 2;
+				const auto& child = m_owner->m_keys[middle];
+				if (compare_folded(m_owner->string_at(child.name_offset, child.name_length), component) < 0)
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+			if (low == record.first_child + record.child_count)
+			{
+				return std::nullopt;
+			}
+			const auto& found = m_owner->m_keys[low];
+			if (compare_folded(m_owner->string_at(found.name_offset, found.name_length), component) != 0)
+			{
+				return std::nullopt;
+			}
+			current = low;
+		}
+		start = end + 1;
+	}
+	return snapshot_key{ m_owner, current };
+}
+
+uint32_t snapshot_key::value_count() const
+{
+	return m_owner->m_keys[m_index].value_count;
+}
+
+snapshot_value snapshot_key::value(uint32_t index) const
+{
+	const auto& record = m_owner->m_keys[m_index];
+	if (index >= record.value_count)
+	{
+		throw registry_error{ registry_errc::not_found, "No value at index." };
+	}
+	return snapshot_value{ m_owner, record.first_value + index };
+}
+
+std::optional<snapshot_value> snapshot_key::find_value(std::wstring_view name) const
+{
+	auto target = to_utf16(name);
+	const auto& record = m_owner->m_keys[m_index];
+	auto begin = m_owner->m_values.begin() + record.first_value;
+	auto end = begin + record.value_count;
+	auto it = std::lower_bound(begin, end, target, [this](const snapshot::value_record& value, const std::u16string& rhs)
+		{
+			return compare_folded(m_owner->string_at(value.name_offset, value.name_length), rhs) < 0;
+		});
+	if (it == end || compare_folded(m_owner->string_at(it->name_offset, it->name_length), target) != 0)
+	{
+		return std::nullopt;
+	}
+	return snapshot_value{ m_owner, static_cast<uint32_t>(it - m_owner->m_values.begin()) };
+}
+
+uint32_t snapshot_key::index() const
+{
+	return m_index;
+}
+
+std::shared_ptr<const snapshot> snapshot::capture(const key_entry& root)
+{
+	auto tables = std::make_shared<snapshot_tables>();
+	auto add_string = [&tables](std::wstring_view string, uint32_t& offset, uint32_t& length)
+	{
+		auto units = to_utf16(string);
+		offset = static_cast<uint32_t>(tables->names.size());
+		length = static_cast<uint32_t>(units.size());
+		tables->names.insert(tables->names.end(), units.begin(), units.end());
+	};
+	auto add_key = [&](const key_entry& entry, uint32_t parent)
+	{
+		key_record record{};
+		add_string(entry.name(), record.name_offset, record.name_length);
+		add_string(entry.key_class(), record.class_offset, record.class_length);
+		record.parent = parent;
+		record.first_child = 0;
+		record.last_written = time_point_to_filetime(entry.last_written());
+		tables->keys.push_back(record);
+	};
+
+	std::deque<std::pair<key_entry, uint32_t>> pending;
+	add_key(root, no_index);
+	pending.emplace_back(root, 0);
+	while (!pending.empty())
+	{
+		auto [entry, index] = std::move(pending.front());
+		pending.pop_front();
+
+		struct captured_value
+		{
+			std::u16string folded;
+			value_entry value;
+		};
+		std::vector<captured_value> values;
+		for (const auto& value : entry.values())
+		{
+			values.push_back(captured_value{ to_utf16(value.name()), value });
+		}
+		std::sort(values.begin(), values.end(), [](const captured_value& lhs, const captured_value& rhs) { return compare_folded(lhs.folded, rhs.folded) < 0; });
+		tables->keys[index].first_value = static_cast<uint32_t>(tables->values.size());
+		tables->keys[index].value_count = static_cast<uint32_t>(values.size());
+		for (const auto& captured : values)
+		{
+			value_record record{};
+			add_string(captured.value.name(), record.name_offset, record.name_length);
+			record.type = static_cast<uint32_t>(captured.value.type());
+			auto bytes = captured.value.get_bytes();
+			// 8-byte aligned so values can be read, and strings viewed, in place.
+			tables->data.resize((tables->data.size() + 7) & ~static_cast<size_t>(7));
+			record.data_offset = static_cast<uint32_t>(tables->data.size());
+			record.data_size = static_cast<uint32_t>(bytes.size());
+			tables->data.insert(tables->data.end(), bytes.begin(), bytes.end());
+			tables->values.push_back(record);
+		}
+
+		std::vector<std::pair<std::u16string, key_entry>> children;
+		for (const auto& child : entry.subkeys())
+		{
+			children.emplace_back(to_utf16(child.name()), child);
+		}
+		std::sort(children.begin(), children.end(), [](const auto& lhs, const auto& rhs) { return compare_folded(lhs.first, rhs.first) < 0; });
+		tables->keys[index].first_child = static_cast<uint32_t>(tables->keys.size());
+		tables->keys[index].child_count = static_cast<uint32_t>(children.size());
+		for (auto& child : children)
+		{
+			uint32_t child_index = static_cast<uint32_t>(tables->keys.size());
+			add_key(child.second, index);
+			pending.emplace_back(std::move(child.second), child_index);
+		}
+	}
+
+	std::shared_ptr<snapshot> result{ new snapshot{} };
+	result->m_keys = tables->keys;
+	result->m_values = tables->values;
+	result->m_names = tables->names;
+	result->m_data = tables->data;
+	result->m_storage = std::move(tables);
+	return result;
+}
+
+void snapshot::save(std::ostream& out) const
+{
+	snapshot_header header{};
+	std::memcpy(header.magic, snapshot_magic, sizeof header.magic);
+	header.version = snapshot_version;
+	header.header_size = sizeof header;
+	header.key_count = static_cast<uint32_t>(m_keys.size());
+	header.value_count = static_cast<uint32_t>(m_values.size());
+	header.name_units = m_names.size();
+	header.data_size = m_data.size();
+	header.keys_offset = align8(sizeof header);
+	header.values_offset = align8(header.keys_offset + m_keys.size_bytes());
+	header.names_offset = align8(header.values_offset + m_values.size_bytes());
+	header.data_offset = align8(header.names_offset + m_names.size_bytes());
+
+	checksum sum;
+	uint64_t written = 0;
+	auto write = [&](const void* data, size_t size)
+	{
+		out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		sum.update(static_cast<const uint8_t*>(data), size);
+		written += size;
+	};
+	auto pad = [&](uint64_t offset)
+	{
+		static constexpr uint8_t zeros[8] = {};
+		write(zeros, static_cast<size_t>(offset - written));
+	};
+	write(&header, sizeof header);
+	pad(header.keys_offset);
+	write(m_keys.data(), m_keys.size_bytes());
+	pad(header.values_offset);
+	write(m_values.data(), m_values.size_bytes());
+	pad(header.names_offset);
+	write(m_names.data(), m_names.size_bytes());
+	pad(header.data_offset);
+	write(m_data.data(), m_data.size_bytes());
+	pad(align8(written));
+	uint64_t total = sum.finish();
+	out.write(reinterpret_cast<const char*>(&total), sizeof total);
+}
+
+std::shared_ptr<const snapshot> snapshot::load(const std::filesystem::path& path, bool verify_checksum)
+{
+	auto file = std::make_shared<mapped_file>(path);
+	return load(std::span<const uint8_t>{ file->data(), file->size() }, file, verify_checksum);
+}
+
+std::shared_ptr<const snapshot> snapshot::load(std::span<const uint8_t> blob, std::shared_ptr<const void> owner, bool verify_checksum)
+{
+	if constexpr (std::endian::native != std::endian::little)
+	{
+		throw registry_error{ registry_errc::not_supported, "Saved snapshots are little endian." };
+	}
+	snapshot_header header;
+	if (blob.size() < sizeof header + sizeof(uint64_t))
+	{
+		corrupt("Not a snapshot.");
+	}
+	std::memcpy(&header, blob.data(), sizeof header);
+	if (std::memcmp(header.magic, snapshot_magic, sizeof header.magic) != 0)
+	{
+		corrupt("Not a snapshot.");
+	}
+	if (header.version != snapshot_version)
+	{
+		throw registry_error{ registry_errc::not_supported, "Unsupported snapshot version." };
+	}
+	if (reinterpret_cast<uintptr_t>(blob.data()) % 8 != 0)
+	{
+		throw registry_error{ registry_errc::not_supported, "Snapshots must be 8-byte aligned in memory." };
+	}
+	uint64_t end = blob.size() - sizeof(uint64_t);
+	auto section = [end](uint64_t offset, uint64_t count, uint64_t size)
+	{
+		// Counts are at most 32 bits and sizes at most 48 bytes, so the products cannot overflow.
+		if (offset % 8 != 0 || offset > end || count * size > end - offset)
+		{
+			corrupt("Snapshot section out of bounds.");
+		}
+	};
+	section(header.keys_offset, header.key_count, sizeof(key_record));
+	section(header.values_offset, header.value_count, sizeof(value_record));
+	if (header.name_units > 0xFFFFFFFFull || header.data_size > 0xFFFFFFFFull)
+	{
+		corrupt("Snapshot section out of bounds.");
+	}
+	section(header.names_offset, header.name_units, sizeof(char16_t));
+	section(header.data_offset, header.data_size, 1);
+	if (header.key_count == 0)
+	{
+		corrupt("Snapshot without a root key.");
+	}
+	if (verify_checksum)
+	{
+		checksum sum;
+		sum.update(blob.data(), static_cast<size_t>(end));
+		uint64_t expected;
+		std::memcpy(&expected, blob.data() + end, sizeof expected);
+		if (sum.finish() != expected)
+		{
+			corrupt("Snapshot checksum mismatch.");
+		}
+	}
+
+	std::shared_ptr<snapshot> result{ new snapshot{} };
+	result->m_keys = { reinterpret_cast<const key_record*>(blob.data() + header.keys_offset), header.key_count };
+	result->m_values = { reinterpret_cast<const value_record*>(blob.data() + header.values_offset), header.value_count };
+	result->m_names = { reinterpret_cast<const char16_t*>(blob.data() + header.names_offset), static_cast<size_t>(header.name_units) };
+	result->m_data = { blob.data() + header.data_offset, static_cast<size_t>(header.data_size) };
+	result->m_storage = std::move(owner);
+	result->validate();
+	return result;
+}
+
+void snapshot::validate() const
+{
+	auto check_string = [this](uint32_t offset, uint32_t length)
+	{
+		if (offset > m_names.size() || length > m_names.size() - offset)
+		{
+			corrupt("Snapshot name out of bounds.");
+		}
+	};
+	for (uint32_t i = 0; i < m_keys.size(); i++)
+	{
+		const auto& key = m_keys[i];
+		check_string(key.name_offset, key.name_length);
+		check_string(key.class_offset, key.class_length);
+		if ((i == 0) != (key.parent == no_index))
+		{
+			corrupt("Snapshot key tree is malformed.");
+		}
+		// Children always come after their parent, which rules out cycles.
+		if (key.child_count > 0 && (key.first_child <= i || key.first_child > m_keys.size() || key.child_count > m_keys.size() - key.first_child))
+		{
+			corrupt("Snapshot key tree is malformed.");
+		}
+		for (uint32_t child = key.first_child; child < key.first_child + key.child_count; child++)
+		{
+			if (m_keys[child].parent != i)
+			{
+				corrupt("Snapshot key tree is malformed.");
+			}
+		}
+		if (key.first_value > m_values.size() || key.value_count > m_values.size() - key.first_value)
+		{
+			corrupt("Snapshot value range out of bounds.");
+		}
+	}
+	for (const auto& value : m_values)
+	{
+		check_string(value.name_offset, value.name_length);
+		if (value.data_offset > m_data.size() || value.data_size > m_data.size() - value.data_offset)
+		{
+			corrupt("Snapshot value data out of bounds.");
+		}
+	}
+}
+
+snapshot_key snapshot::root() const
+{
+	return snapshot_key{ this, 0 };
+}
+
+key_entry snapshot::open() const
+{
+	auto name = root().name();
+	return key_entry::from_backend(std::make_unique<snapshot_key_backend>(shared_from_this(), 0), name);
+}
+
+uint32_t snapshot::key_count() const
+{
+	return static_cast<uint32_t>(m_keys.size());
+}
+
+uint32_t snapshot::value_count() const
+{
+	return static_cast<uint32_t>(m_values.size());
+}
+
+std::u16string_view snapshot::string_at(uint32_t offset, uint32_t length) const
+{
+	return std::u16string_view{ m_names.data() + offset, length };
+}
+
+snapshot_slot::snapshot_slot(std::shared_ptr<const snapshot> initial) :
+	m_current(std::move(initial))
+{
+}
+
+std::shared_ptr<const snapshot> snapshot_slot::load() const
+{
+	return m_current.load();
+}
+
+std::shared_ptr<const snapshot> snapshot_slot::exchange(std::shared_ptr<const snapshot> next)
+{
+	return m_current.exchange(std::move(next));
+}
+
+snapshot_key_backend::snapshot_key_backend(std::shared_ptr<const snapshot> owner, uint32_t index) :
+	m_owner(std::move(owner)), m_index(index)
+{
+}
+
+std::unique_ptr<key_backend> snapshot_key_backend::open_subkey(const std::wstring& name) const
+{
+	auto found = key().find_subkey(name);
+	if (!found)
+	{
+		throw registry_error{ registry_errc::not_found, "Sub key not found." };
+	}
+	return std::make_unique<snapshot_key_backend>(m_owner, found->index());
+}
+
+key_info snapshot_key_backend::query_info() const
+{
+	auto self = key();
+	key_info info;
+	info.key_class = self.key_class();
+	info.last_written = self.last_written();
+	info.sub_keys_count = self.sub_key_count();
+	for (uint32_t i = 0; i < info.sub_keys_count; i++)
+	{
+		auto child = self.sub_key(i);
+		info.max_sub_key_name_length = (std::max)(info.max_sub_key_name_length, static_cast<uint32_t>(child.raw_name().size()));
+		info.max_class_length = (std::max)(info.max_class_length, static_cast<uint32_t>(child.key_class().size()));
+	}
+	info.values_count = self.value_count();
+	for (uint32_t i = 0; i < info.values_count; i++)
+	{
+		auto value = self.value(i);
+		info.max_value_name_length = (std::max)(info.max_value_name_length, static_cast<uint32_t>(value.raw_name().size()));
+		info.max_value_data_length = (std::max)(info.max_value_data_length, value.size());
+	}
+	return info;
+}
+
+std::wstring snapshot_key_backend::sub_key_name(uint32_t index) const
+{
+	return key().sub_key(index).name();
+}
+
+value_view snapshot_key_backend::value_at(uint32_t index, value_buffer& buffer) const
+{
+	auto value = key().value(index);
+	buffer.name = value.name();
+	return value_view{ buffer.name, value.type(), value.data(), value.size(), m_owner };
+}
+
+std::optional<value_view> snapshot_key_backend::find_value(const std::wstring& name, value_buffer& buffer) const
+{
+	auto value = key().find_value(name);
+	if (!value)
+	{
+		return std::nullopt;
+	}
+	buffer.name = value->name();
+	return value_view{ buffer.name, value->type(), value->data(), value->size(), m_owner };
+}
+
+bool snapshot_key_backend::reads_value_parts() const
+{
+	// Data is handed out in place, so the default read_value_data copies only the part asked for.
+	return true;
+}
+
+bool snapshot_key_backend::same_key(const key_backend& other) const
+{
+	auto rhs = dynamic_cast<const snapshot_key_backend*>(&other);
+	return rhs != nullptr && rhs->m_owner == m_owner && rhs->m_index == m_index;
+}
+
+snapshot_key snapshot_key_backend::key() const
+{
+	return snapshot_key{ m_owner.get(), m_index };
+}
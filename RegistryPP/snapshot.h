@@ -0,0 +1,295 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "key_backend.h"
+
+namespace win32::registry
+{
+	class snapshot;
+
+	/**
+	 * @brief A value of a snapshot.
+	 *
+	 * A plain pointer and index; copying it never touches a reference count.
+	 */
+	class DllExport snapshot_value
+	{
+	public:
+		snapshot_value(const snapshot* owner, uint32_t index);
+
+		std::wstring name() const;
+
+		std::u16string_view raw_name() const;
+
+		registry_value_type type() const;
+
+		/**
+		 * @brief Gets the raw data of the value, in place.
+		 * @return The start of the data.
+		 */
+		const uint8_t* data() const;
+
+		/**
+		 * @brief Gets the size of the data.
+		 * @return The size of the data in bytes.
+		 */
+		uint32_t size() const;
+
+	private:
+		const snapshot* m_owner;
+		uint32_t m_index;
+	};
+
+	/**
+	 * @brief A key of a snapshot.
+	 *
+	 * A plain pointer and index; copying it never touches a reference count.
+	 */
+	class DllExport snapshot_key
+	{
+	public:
+		snapshot_key(const snapshot* owner, uint32_t index);
+
+		std::wstring name() const;
+
+		std::u16string_view raw_name() const;
+
+		std::wstring key_class() const;
+
+		std::chrono::system_clock::time_point last_written() const;
+
+		bool is_root() const;
+
+		snapshot_key parent() const;
+
+		uint32_t sub_key_count() const;
+
+		/**
+		 * @brief Gets a sub key by index. Sub keys are sorted by case folded name.
+		 * @param index The index of the sub key.
+		 * @return The sub key.
+		 */
+		snapshot_key sub_key(uint32_t index) const;
+
+		/**
+		 * @brief Finds a sub key by name, ignoring case, with a binary search.
+		 * @param name The name of the sub key. May contain several backslash separated components.
+		 * @return The sub key, if found.
+		 */
+		std::optional<snapshot_key> find_subkey(std::wstring_view name) const;
+
+		uint32_t value_count() const;
+
+		/**
+		 * @brief Gets a value by index. Values are sorted by case folded name.
+		 * @param index The index of the value.
+		 * @return The value.
+		 */
+		snapshot_value value(uint32_t index) const;
+
+		/**
+		 * @brief Finds a value by name, ignoring case, with a binary search.
+		 * @param name The name of the value.
+		 * @return The value, if found.
+		 */
+		std::optional<snapshot_value> find_value(std::wstring_view name) const;
+
+		/**
+		 * @brief Gets the position of the key in the snapshot's key table.
+		 * @return The position of the key.
+		 */
+		uint32_t index() const;
+
+	private:
+		const snapshot* m_owner;
+		uint32_t m_index;
+	};
+
+	/**
+	 * @brief An immutable copy of a subtree, flattened into a few contiguous arrays.
+	 *
+	 * Keys are laid out breadth first so the children of every key form one contiguous, sorted index range. Names are
+	 * stored as UTF-16 in one pool and value data in another, and all references are indices, so the layout does not
+	 * depend on where it lives in memory. Nothing is mutated after capture, so any number of threads may read a
+	 * snapshot without locking.
+	 *
+	 * Because of that the tables can be saved as they are, and a saved snapshot is used in place from a memory mapping
+	 * of the file: loading maps the file and checks it, without parsing or copying anything.
+	 */
+	class DllExport snapshot : public std::enable_shared_from_this<snapshot>
+	{
+	public:
+		friend class snapshot_key;
+		friend class snapshot_value;
+
+		static constexpr uint32_t no_index = 0xFFFFFFFF;
+
+		struct key_record
+		{
+			uint32_t name_offset;
+			uint32_t name_length;
+			uint32_t class_offset;
+			uint32_t class_length;
+			uint32_t parent;
+			uint32_t first_child;
+			uint32_t child_count;
+			uint32_t first_value;
+			uint32_t value_count;
+			uint32_t reserved;
+			/** FILETIME ticks. */
+			uint64_t last_written;
+		};
+
+		struct value_record
+		{
+			uint32_t name_offset;
+			uint32_t name_length;
+			uint32_t type;
+			uint32_t data_offset;
+			uint32_t data_size;
+		};
+
+		/**
+		 * @brief Captures a subtree.
+		 * @param root The root of the subtree.
+		 * @return The snapshot.
+		 */
+		static std::shared_ptr<const snapshot> capture(const key_entry& root);
+
+		/**
+		 * @brief Writes the snapshot in the format load reads. The tables are streamed as they are; no blob is built.
+		 *
+		 * The file starts with a versioned header of section offsets, followed by the key table, the value table, the
+		 * name pool and the value data, each 8-byte aligned, and ends with a checksum of everything before it.
+		 * @param out The stream, opened in binary mode.
+		 */
+		void save(std::ostream& out) const;
+
+		/**
+		 * @brief Maps a file written by save and uses it in place.
+		 * @param path The path of the file.
+		 * @param verify_checksum Whether to check the checksum, which reads the whole file. The structure is checked
+		 * either way, so a damaged file is never read out of bounds.
+		 * @return The snapshot. The file stays mapped for as long as it, or any key opened from it, lives.
+		 * @exception std::system_error The file cannot be mapped.
+		 * @exception registry_error The file is not a snapshot, is of an unsupported version, or is damaged.
+		 */
+		static std::shared_ptr<const snapshot> load(const std::filesystem::path& path, bool verify_checksum = true);
+
+		/**
+		 * @brief Uses a snapshot written by save in place, wherever it is in memory.
+		 * @param blob The snapshot. Must be 8-byte aligned.
+		 * @param owner Keeps the blob alive for as long as the snapshot, or any key opened from it, lives.
+		 * @param verify_checksum Whether to check the checksum.
+		 * @return The snapshot.
+		 * @exception registry_error The blob is not a snapshot, is of an unsupported version, or is damaged.
+		 */
+		static std::shared_ptr<const snapshot> load(std::span<const uint8_t> blob, std::shared_ptr<const void> owner, bool verify_checksum = true);
+
+		/**
+		 * @brief Gets the root key.
+		 * @return The root key.
+		 */
+		snapshot_key root() const;
+
+		/**
+		 * @brief Opens the snapshot through the regular key_entry API.
+		 * @return The root key.
+		 */
+		key_entry open() const;
+
+		/**
+		 * @brief Gets the number of keys.
+		 * @return The number of keys.
+		 */
+		uint32_t key_count() const;
+
+		/**
+		 * @brief Gets the number of values.
+		 * @return The number of values.
+		 */
+		uint32_t value_count() const;
+
+	private:
+		snapshot() = default;
+
+		std::u16string_view string_at(uint32_t offset, uint32_t length) const;
+
+		/** Checks that every index and offset of the tables stays within them, and that the key tree has no cycles. */
+		void validate() const;
+
+		std::span<const key_record> m_keys;
+		std::span<const value_record> m_values;
+		std::span<const char16_t> m_names;
+		std::span<const uint8_t> m_data;
+		/** Owns the storage the tables view: the vectors of a capture, or the mapping of a loaded file. */
+		std::shared_ptr<const void> m_storage;
+	};
+
+	/**
+	 * @brief Holds the current snapshot of some configuration and lets writers replace it atomically.
+	 *
+	 * Readers load the pointer once and then read the snapshot freely; publishing a new snapshot is a single atomic
+	 * exchange and the old one is released once its last reader is done with it.
+	 */
+	class DllExport snapshot_slot
+	{
+	public:
+		snapshot_slot() = default;
+
+		explicit snapshot_slot(std::shared_ptr<const snapshot> initial);
+
+		/**
+		 * @brief Gets the current snapshot.
+		 * @return The current snapshot.
+		 */
+		std::shared_ptr<const snapshot> load() const;
+
+		/**
+		 * @brief Publishes a new snapshot.
+		 * @param next The new snapshot.
+		 * @return The snapshot that was replaced.
+		 */
+		std::shared_ptr<const snapshot> exchange(std::shared_ptr<const snapshot> next);
+
+	private:
+		std::atomic<std::shared_ptr<const snapshot>> m_current;
+	};
+
+	/**
+	 * @brief Backend serving a snapshot through the key_entry API. Value data is never copied.
+	 */
+	class DllExport snapshot_key_backend final : public key_backend
+	{
+	public:
+		explicit snapshot_key_backend(std::shared_ptr<const snapshot> owner, uint32_t index);
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override;
+		key_info query_info() const override;
+		std::wstring sub_key_name(uint32_t index) const override;
+		value_view value_at(uint32_t index, value_buffer& buffer) const override;
+		std::optional<value_view> find_value(const std::wstring& name, value_buffer& buffer) const override;
+		bool reads_value_parts() const override;
+		bool same_key(const key_backend& other) const override;
+
+		/**
+		 * @brief Gets the key.
+		 * @return The key.
+		 */
+		snapshot_key key() const;
+
+	private:
+		std::shared_ptr<const snapshot> m_owner;
+		uint32_t m_index;
+	};
+}
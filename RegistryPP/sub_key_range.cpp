@@ -0,0 +1,63 @@
+#include "sub_key_range.h"
+
+using namespace win32::registry;
+
+sub_key_iterator::sub_key_iterator(sub_key_range& range) :
+	m_range(&range)
+{
+}
+
+const key_entry& sub_key_iterator::operator*() const
+{
+	return *m_range->m_current;
+}
+
+const key_entry* sub_key_iterator::operator->() const
+{
+	return &*m_range->m_current;
+}
+
+sub_key_iterator& sub_key_iterator::operator++()
+{
+	m_range->m_index++;
+	m_range->load();
+	return *this;
+}
+
+void sub_key_iterator::operator++(int)
+{
+	++*this;
+}
+
+bool sub_key_iterator::operator==(std::default_sentinel_t) const
+{
+	return m_range == nullptr || !m_range->m_current;
+}
+
+sub_key_range::sub_key_range(const key_entry& parent) :
+	m_parent(parent), m_index(0), m_count(0), m_current()
+{
+}
+
+sub_key_iterator sub_key_range::begin()
+{
+	m_index = 0;
+	m_count = m_parent.sub_key_count();
+	load();
+	return sub_key_iterator{ *this };
+}
+
+std::default_sentinel_t sub_key_range::end() const
+{
+	return std::default_sentinel;
+}
+
+void sub_key_range::load()
+{
+	// Drop the previous sub key first so at most one is ever open.
+	m_current.reset();
+	if (m_index < m_count)
+	{
+		m_current.emplace(m_parent.open_subkey(m_parent.sub_key_name(m_index)));
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include "key_entry.h"
+
+namespace win32::registry
+{
+	class sub_key_range;
+
+	/**
+	 * @brief Single pass iterator over the sub keys of a key.
+	 *
+	 * Only the current sub key is kept open; advancing releases it before the next one is opened.
+	 */
+	class DllExport sub_key_iterator
+	{
+	public:
+		using iterator_concept = std::input_iterator_tag;
+		using value_type = key_entry;
+		using difference_type = std::ptrdiff_t;
+
+		sub_key_iterator() = default;
+		explicit sub_key_iterator(sub_key_range& range);
+
+		const key_entry& operator*() const;
+		const key_entry* operator->() const;
+		sub_key_iterator& operator++();
+		void operator++(int);
+		bool operator==(std::default_sentinel_t) const;
+
+	private:
+		sub_key_range* m_range = nullptr;
+	};
+
+	/**
+	 * @brief The sub keys of a key, opened one at a time as the range is iterated.
+	 *
+	 * Holds constant state however many sub keys there are. Unlike key_entry_iterator nothing is cached, so the range
+	 * can only be iterated once.
+	 */
+	class DllExport sub_key_range : public std::ranges::view_interface<sub_key_range>
+	{
+	public:
+		friend class sub_key_iterator;
+
+		explicit sub_key_range(const key_entry& parent);
+
+		/**
+		 * @brief Opens the first sub key.
+		 * @return An iterator to the first sub key.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		sub_key_iterator begin();
+
+		std::default_sentinel_t end() const;
+
+	private:
+		void load();
+
+		key_entry m_parent;
+		uint32_t m_index;
+		uint32_t m_count;
+		std::optional<key_entry> m_current;
+	};
+}
@@ -0,0 +1,328 @@
+#include <cstring>
+#include <unordered_map>
+#include "scan_arena.h"
+#include "tree_diff.h"
+#include "utf16.h"
+#include "value_entry.h"
+#include "value_range.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	/** The splitmix64 finalizer: spreads every input bit over the whole result. */
+	uint64_t mix(uint64_t h)
+	{
+		h ^= h >> 30;
+		h *= 0xBF58476D1CE4E5B9ULL;
+		h ^= h >> 27;
+		h *= 0x94D049BB133111EBULL;
+		h ^= h >> 31;
+		return h;
+	}
+
+	/** Hashes raw data eight bytes at a time. */
+	uint64_t hash_bytes(uint64_t seed, const uint8_t* data, size_t size)
+	{
+		uint64_t h = mix(seed ^ size);
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + i, sizeof word);
+			h = mix(h ^ word) + 0x9E3779B97F4A7C15ULL;
+		}
+		uint64_t tail = 0;
+		if (i < size)
+		{
+			std::memcpy(&tail, data + i, size - i);
+		}
+		return mix(h ^ tail);
+	}
+
+	uint64_t hash_value(const value_entry& value)
+	{
+		auto data = value.get_bytes_view();
+		uint64_t name = utf16::fold_hash(utf16::fold_hash_seed, value.name());
+		return mix(name ^ hash_bytes(static_cast<uint64_t>(value.type()), data.data(), data.size()));
+	}
+
+	uint64_t options_fingerprint(const diff_options& options)
+	{
+		return (options.compare_last_written ? 1 : 0) | (options.compare_class ? 2 : 0);
+	}
+}
+
+namespace win32::registry
+{
+	/**
+	 * Fills a hash_cache bottom up. Sub keys and values are combined by addition so their order does not matter.
+	 */
+	class tree_hasher
+	{
+	public:
+		tree_hasher(const diff_options& options, hash_cache& cache) :
+			m_options(options), m_cache(cache)
+		{
+		}
+
+		uint64_t hash_tree(const key_entry& root)
+		{
+			uint64_t fingerprint = options_fingerprint(m_options) + 1;
+			if (m_cache.m_options != fingerprint)
+			{
+				m_cache.m_entries.clear();
+				m_cache.m_options = fingerprint;
+			}
+			m_cache.m_generation++;
+			uint64_t hash = hash_key(root);
+
+			// Forget keys below the root that no longer exist.
+			const key_path& root_path = root.interned_path();
+			for (auto it = m_cache.m_entries.begin(); it != m_cache.m_entries.end();)
+			{
+				if (it->second.generation != m_cache.m_generation && is_below(it->first, root_path))
+				{
+					it = m_cache.m_entries.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			return hash;
+		}
+
+		uint64_t subtree_hash(const key_path& path) const
+		{
+			auto it = m_cache.m_entries.find(path);
+			return it != m_cache.m_entries.end() ? it->second.subtree_hash : 0;
+		}
+
+		uint64_t key_hash(const key_path& path) const
+		{
+			auto it = m_cache.m_entries.find(path);
+			return it != m_cache.m_entries.end() ? it->second.key_hash : 0;
+		}
+
+	private:
+		static bool is_below(key_path path, const key_path& root)
+		{
+			while (path.depth() > root.depth())
+			{
+				path = path.parent();
+			}
+			return path == root;
+		}
+
+		uint64_t hash_key(const key_entry& key)
+		{
+			uint32_t sub_keys_count = key.sub_key_count();
+			uint32_t values_count = key.value_count();
+			auto last_written = key.last_written();
+			// Entries are nodes, so the reference survives the inserts made by the recursion below.
+			auto it = m_cache.m_entries.find(key.interned_path());
+			if (it == m_cache.m_entries.end())
+			{
+				// The key's own path may live in a scan arena; the cache outlives it, so it keeps a copy on the heap.
+				arena_scope heap{ std::pmr::get_default_resource() };
+				it = m_cache.m_entries.try_emplace(key_path{ key.interned_path().str() }).first;
+			}
+			auto& entry = it->second;
+			if (entry.generation == 0 || entry.last_written != last_written || entry.sub_keys_count != sub_keys_count || entry.values_count != values_count)
+			{
+				entry.key_hash = read_key(key);
+				entry.last_written = last_written;
+				entry.sub_keys_count = sub_keys_count;
+				entry.values_count = values_count;
+				m_cache.m_keys_read++;
+			}
+
+			uint64_t children = 0;
+			for (uint32_t i = 0; i < sub_keys_count; i++)
+			{
+				auto name = key.sub_key_name(i);
+				uint64_t child = hash_key(key.open_subkey(name));
+				children += mix(utf16::fold_hash(utf16::fold_hash_seed, name) ^ mix(child));
+			}
+			entry.subtree_hash = mix(entry.key_hash ^ mix(children + sub_keys_count));
+			entry.generation = m_cache.m_generation;
+			return entry.subtree_hash;
+		}
+
+		uint64_t read_key(const key_entry& key) const
+		{
+			uint64_t hash = 0;
+			if (m_options.compare_class)
+			{
+				const auto& key_class = key.key_class();
+				hash ^= hash_bytes(1, reinterpret_cast<const uint8_t*>(key_class.data()), key_class.size() * sizeof(wchar_t));
+			}
+			if (m_options.compare_last_written)
+			{
+				hash ^= mix(static_cast<uint64_t>(key.last_written().time_since_epoch().count()) + 2);
+			}
+			uint64_t values = 0;
+			for (const auto& value : key.values())
+			{
+				values += hash_value(value);
+			}
+			return mix(hash ^ mix(values + key.value_count()));
+		}
+
+		const diff_options& m_options;
+		hash_cache& m_cache;
+	};
+}
+
+namespace
+{
+	class differ
+	{
+	public:
+		differ(const diff_options& options, tree_hasher& before, tree_hasher& after) :
+			m_options(options), m_before(before), m_after(after), m_changes()
+		{
+		}
+
+		void compare(const key_entry& before, const key_entry& after, const std::wstring& path)
+		{
+			const auto& before_path = before.interned_path();
+			const auto& after_path = after.interned_path();
+			if (m_before.key_hash(before_path) != m_after.key_hash(after_path))
+			{
+				compare_key(before, after, path);
+			}
+
+			std::unordered_map<std::wstring, std::wstring> after_names;
+			std::vector<std::wstring> after_order;
+			for (uint32_t i = 0; i < after.sub_key_count(); i++)
+			{
+				auto name = after.sub_key_name(i);
+				after_names.emplace(utf16::fold(name), name);
+				after_order.push_back(std::move(name));
+			}
+			for (uint32_t i = 0; i < before.sub_key_count(); i++)
+			{
+				auto name = before.sub_key_name(i);
+				auto it = after_names.find(utf16::fold(name));
+				if (it == after_names.end())
+				{
+					m_changes.push_back(tree_change{ change_kind::key_removed, join(path, name), {} });
+					continue;
+				}
+				// Identical subtrees are skipped without opening them.
+				if (m_before.subtree_hash(before_path.append(name)) != m_after.subtree_hash(after_path.append(it->second)))
+				{
+					compare(before.open_subkey(name), after.open_subkey(it->second), join(path, it->second));
+				}
+				after_names.erase(it);
+			}
+			for (const auto& name : after_order)
+			{
+				if (after_names.count(utf16::fold(name)) != 0)
+				{
+					m_changes.push_back(tree_change{ change_kind::key_added, join(path, name), {} });
+				}
+			}
+		}
+
+		std::vector<tree_change>& changes()
+		{
+			return m_changes;
+		}
+
+	private:
+		static std::wstring join(const std::wstring& path, const std::wstring& name)
+		{
+			return path.empty() ? name : path + L'\\' + name;
+		}
+
+		void compare_key(const key_entry& before, const key_entry& after, const std::wstring& path)
+		{
+			if ((m_options.compare_class && before.key_class() != after.key_class()) ||
+				(m_options.compare_last_written && before.last_written() != after.last_written()))
+			{
+				m_changes.push_back(tree_change{ change_kind::key_modified, path, {} });
+			}
+
+			std::unordered_map<std::wstring, value_entry> after_values;
+			std::vector<std::wstring> after_order;
+			for (const auto& value : after.values())
+			{
+				after_order.push_back(value.name());
+				after_values.emplace(utf16::fold(after_order.back()), value);
+			}
+			for (const auto& value : before.values())
+			{
+				auto name = value.name();
+				auto it = after_values.find(utf16::fold(name));
+				if (it == after_values.end())
+				{
+					m_changes.push_back(tree_change{ change_kind::value_removed, path, name });
+					continue;
+				}
+				auto lhs = value.get_bytes_view();
+				auto rhs = it->second.get_bytes_view();
+				if (value.type() != it->second.type() || lhs.size() != rhs.size() || (lhs.size() != 0 && std::memcmp(lhs.data(), rhs.data(), lhs.size()) != 0))
+				{
+					m_changes.push_back(tree_change{ change_kind::value_modified, path, name });
+				}
+				after_values.erase(it);
+			}
+			for (const auto& name : after_order)
+			{
+				if (after_values.count(utf16::fold(name)) != 0)
+				{
+					m_changes.push_back(tree_change{ change_kind::value_added, path, name });
+				}
+			}
+		}
+
+		const diff_options& m_options;
+		tree_hasher& m_before;
+		tree_hasher& m_after;
+		std::vector<tree_change> m_changes;
+	};
+}
+
+size_t hash_cache::size() const
+{
+	return m_entries.size();
+}
+
+uint64_t hash_cache::keys_read() const
+{
+	return m_keys_read;
+}
+
+void hash_cache::clear()
+{
+	m_entries.clear();
+	m_keys_read = 0;
+}
+
+uint64_t win32::registry::subtree_hash(const key_entry& root, const diff_options& options, hash_cache& cache)
+{
+	return tree_hasher{ options, cache }.hash_tree(root);
+}
+
+std::vector<tree_change> win32::registry::diff(const key_entry& before, const key_entry& after, const diff_options& options, hash_cache& before_cache, hash_cache& after_cache)
+{
+	tree_hasher before_hasher{ options, before_cache };
+	tree_hasher after_hasher{ options, after_cache };
+	if (before_hasher.hash_tree(before) == after_hasher.hash_tree(after))
+	{
+		return {};
+	}
+	differ comparer{ options, before_hasher, after_hasher };
+	comparer.compare(before, after, std::wstring{});
+	return std::move(comparer.changes());
+}
+
+std::vector<tree_change> win32::registry::diff(const key_entry& before, const key_entry& after, const diff_options& options)
+{
+	hash_cache before_cache;
+	hash_cache after_cache;
+	return diff(before, after, options, before_cache, after_cache);
+}
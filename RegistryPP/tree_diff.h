@@ -0,0 +1,146 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "key_entry.h"
+#include "key_path.h"
+#include "registry_value_type.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief What to take into account when hashing and comparing trees.
+	 */
+	struct DllExport diff_options
+	{
+		/** Whether keys with different last written times count as modified. */
+		bool compare_last_written = false;
+		/** Whether keys with different classes count as modified. */
+		bool compare_class = true;
+	};
+
+	/**
+	 * @brief Remembers the content hashes of the keys of one tree between diffs.
+	 *
+	 * A key whose last written time and sub key and value counts are unchanged since it was last hashed is not read
+	 * again; only its sub keys are visited. Rediffing a tree after a few changes therefore reads the values of the
+	 * changed keys only. Relies on the backend updating a key's last written time whenever its values change, as
+	 * the registry does. Not safe to use from several threads at once. Keeps its paths on the heap even when hashing
+	 * inside an arena_scope.
+	 */
+	class DllExport hash_cache
+	{
+	public:
+		/**
+		 * @brief Gets the number of keys whose hashes are remembered.
+		 * @return The number of keys.
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief Gets the number of keys whose values were read, because they were new or changed, over all diffs.
+		 * @return The number of keys read.
+		 */
+		uint64_t keys_read() const;
+
+		/**
+		 * @brief Forgets all hashes.
+		 */
+		void clear();
+
+	private:
+		friend class tree_hasher;
+
+		struct entry
+		{
+			std::chrono::system_clock::time_point last_written;
+			uint32_t sub_keys_count = 0;
+			uint32_t values_count = 0;
+			/** Hash of the key's own class and values. */
+			uint64_t key_hash = 0;
+			/** Hash of the key and everything below it; only valid while generation matches the cache's. */
+			uint64_t subtree_hash = 0;
+			uint64_t generation = 0;
+		};
+
+		std::unordered_map<key_path, entry> m_entries;
+		uint64_t m_generation = 0;
+		uint64_t m_keys_read = 0;
+		/** The options the hashes were computed with; they are discarded when the options change. */
+		uint64_t m_options = 0;
+	};
+
+	/**
+	 * @brief The kind of difference found between two trees.
+	 */
+	enum class DllExport change_kind : uint8_t
+	{
+		/** The key exists only in the second tree. Its contents are not listed separately. */
+		key_added,
+		/** The key exists only in the first tree. Its contents are not listed separately. */
+		key_removed,
+		/** The key's class or last written time differs, as selected by diff_options. */
+		key_modified,
+		value_added,
+		value_removed,
+		/** The value's type or data differs. */
+		value_modified
+	};
+
+	/**
+	 * @brief A single difference between two trees.
+	 */
+	struct DllExport tree_change
+	{
+		change_kind kind;
+		/** The path of the key, relative to the roots; empty for the roots themselves. */
+		std::wstring path;
+		/** The name of the value; empty for key changes and for the default value. */
+		std::wstring value_name;
+	};
+
+	/**
+	 * @brief Computes the content hash of a key and everything below it.
+	 *
+	 * Names are hashed ignoring case, and sub keys and values in any order, so trees served by different backends
+	 * hash the same when they hold the same data.
+	 * @param root The key.
+	 * @param options What to take into account.
+	 * @param cache Hashes from earlier calls, updated with the new ones.
+	 * @return The hash.
+	 * @exception wil::ResultException
+	 * @exception registry_error
+	 */
+	DllExport uint64_t subtree_hash(const key_entry& root, const diff_options& options, hash_cache& cache);
+
+	/**
+	 * @brief Lists the differences between two trees of keys, from any backends.
+	 *
+	 * Both trees are hashed first; then only subtrees whose hashes differ are compared, so identical subtrees cost a
+	 * single comparison however large they are.
+	 * @param before The root of the first tree.
+	 * @param after The root of the second tree.
+	 * @param options What to take into account.
+	 * @param before_cache Hashes of the first tree from earlier diffs.
+	 * @param after_cache Hashes of the second tree from earlier diffs.
+	 * @return The differences, parents before their sub keys.
+	 * @exception wil::ResultException
+	 * @exception registry_error
+	 */
+	DllExport std::vector<tree_change> diff(const key_entry& before, const key_entry& after, const diff_options& options, hash_cache& before_cache, hash_cache& after_cache);
+
+	/**
+	 * @brief Lists the differences between two trees of keys, from any backends, without keeping hashes.
+	 * @param before The root of the first tree.
+	 * @param after The root of the second tree.
+	 * @param options What to take into account.
+	 * @return The differences, parents before their sub keys.
+	 * @exception wil::ResultException
+	 * @exception registry_error
+	 */
+	DllExport std::vector<tree_change> diff(const key_entry& before, const key_entry& after, const diff_options& options = {});
+}
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include "tree_walker.h"
+
+using namespace win32::registry;
+
+namespace
+{
+	/**
+	 * A key whose children are published to the ordered emitter once it has been processed.
+	 */
+	struct walk_node
+	{
+		walk_node(key_entry entry, uint32_t depth) :
+			entry(std::move(entry)), depth(depth), children(), ready(false)
+		{
+		}
+
+		key_entry entry;
+		uint32_t depth;
+		std::vector<std::unique_ptr<walk_node>> children;
+		std::atomic<bool> ready;
+	};
+
+	struct walk_task
+	{
+		key_entry entry;
+		uint32_t depth;
+		/** Only set for ordered walks. */
+		walk_node* node;
+	};
+
+	struct alignas(64) walk_worker
+	{
+		std::mutex mutex;
+		std::deque<walk_task> tasks;
+		walk_worker_statistics statistics;
+	};
+
+	class walk_context
+	{
+	public:
+		walk_context(const walk_visitor& visitor, const walk_options& options, uint32_t threads) :
+			m_visitor(visitor), m_options(options), m_workers(threads), m_pending(0), m_failed(false)
+		{
+		}
+
+		void push(uint32_t worker, walk_task task)
+		{
+			m_pending.fetch_add(1, std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock{ m_workers[worker].mutex };
+			m_workers[worker].tasks.push_back(std::move(task));
+		}
+
+		void run(uint32_t id)
+		{
+			auto& self = m_workers[id];
+			while (!m_failed.load(std::memory_order_relaxed))
+			{
+				auto task = pop(id);
+				if (!task)
+				{
+					if (m_pending.load(std::memory_order_acquire) == 0)
+					{
+						return;
+					}
+					std::this_thread::yield();
+					continue;
+				}
+				try
+				{
+					process(id, *task);
+				}
+				catch (...)
+				{
+					fail(std::current_exception());
+				}
+				if (task->node != nullptr)
+				{
+					task->node->ready.store(true, std::memory_order_release);
+				}
+				self.statistics.keys_visited++;
+				m_pending.fetch_sub(1, std::memory_order_acq_rel);
+			}
+		}
+
+		void fail(std::exception_ptr error)
+		{
+			std::lock_guard<std::mutex> lock{ m_error_mutex };
+			if (!m_error)
+			{
+				m_error = error;
+			}
+			m_failed.store(true);
+		}
+
+		bool failed() const
+		{
+			return m_failed.load();
+		}
+
+		void rethrow()
+		{
+			if (m_error)
+			{
+				std::rethrow_exception(m_error);
+			}
+		}
+
+		walk_statistics statistics() const
+		{
+			walk_statistics result;
+			for (const auto& worker : m_workers)
+			{
+				result.workers.push_back(worker.statistics);
+			}
+			return result;
+		}
+
+	private:
+		std::optional<walk_task> pop(uint32_t id)
+		{
+			{
+				auto& self = m_workers[id];
+				std::lock_guard<std::mutex> lock{ self.mutex };
+				if (!self.tasks.empty())
+				{
+					walk_task task = std::move(self.tasks.back());
+					self.tasks.pop_back();
+					return task;
+				}
+			}
+			for (size_t i = 1; i < m_workers.size(); i++)
+			{
+				auto& victim = m_workers[(id + i) % m_workers.size()];
+				std::lock_guard<std::mutex> lock{ victim.mutex };
+				if (!victim.tasks.empty())
+				{
+					walk_task task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					m_workers[id].statistics.tasks_stolen++;
+					return task;
+				}
+			}
+			return std::nullopt;
+		}
+
+		void process(uint32_t id, walk_task& task)
+		{
+			if (!m_options.ordered)
+			{
+				m_visitor(task.entry, task.depth);
+			}
+			if (task.depth >= m_options.max_depth)
+			{
+				return;
+			}
+			auto& statistics = m_workers[id].statistics;
+			if (m_options.prune && m_options.prune(task.entry, task.depth))
+			{
+				statistics.subtrees_pruned++;
+				return;
+			}
+			std::vector<walk_task> children;
+			std::vector<std::wstring> names;
+			if (m_options.expand && m_options.expand(task.entry, task.depth, names))
+			{
+				children.reserve(names.size());
+				for (const auto& name : names)
+				{
+					open_child(id, task, name, children, true);
+				}
+			}
+			else
+			{
+				uint32_t count = task.entry.sub_key_count();
+				children.reserve(count);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					std::wstring name;
+					try
+					{
+						name = task.entry.sub_key_name(i);
+					}
+					catch (...)
+					{
+						if (!m_options.ignore_errors)
+						{
+							throw;
+						}
+						statistics.errors++;
+						continue;
+					}
+					if (m_options.filter && !m_options.filter(task.entry, name, task.depth + 1))
+					{
+						statistics.keys_filtered++;
+						continue;
+					}
+					open_child(id, task, name, children, false);
+				}
+			}
+			if (task.node != nullptr)
+			{
+				for (auto& child : children)
+				{
+					task.node->children.push_back(std::make_unique<walk_node>(child.entry, child.depth));
+					child.node = task.node->children.back().get();
+				}
+			}
+			// Pushed in reverse so this worker continues with the first child while thieves take the last ones.
+			for (auto it = children.rbegin(); it != children.rend(); ++it)
+			{
+				push(id, std::move(*it));
+			}
+		}
+
+		void open_child(uint32_t id, const walk_task& task, const std::wstring& name, std::vector<walk_task>& children, bool direct)
+		{
+			try
+			{
+				if (direct)
+				{
+					auto child = task.entry.try_open_subkey(name);
+					m_workers[id].statistics.direct_opens++;
+					if (child)
+					{
+						children.push_back(walk_task{ std::move(*child), task.depth + 1, nullptr });
+					}
+				}
+				else
+				{
+					children.push_back(walk_task{ task.entry.open_subkey(name), task.depth + 1, nullptr });
+				}
+			}
+			catch (...)
+			{
+				if (!m_options.ignore_errors)
+				{
+					throw;
+				}
+				m_workers[id].statistics.errors++;
+			}
+		}
+
+		const walk_visitor& m_visitor;
+		const walk_options& m_options;
+		std::vector<walk_worker> m_workers;
+		std::atomic<uint64_t> m_pending;
+		std::atomic<bool> m_failed;
+		std::mutex m_error_mutex;
+		std::exception_ptr m_error;
+	};
+}
+
+uint64_t walk_statistics::keys_visited() const
+{
+	uint64_t total = 0;
+	for (const auto& worker : workers)
+	{
+		total += worker.keys_visited;
+	}
+	return total;
+}
+
+walk_statistics win32::registry::walk(const key_entry& root, const walk_visitor& visitor, const walk_options& options)
+{
+	uint32_t threads = options.threads != 0 ? options.threads : (std::max)(1U, std::thread::hardware_concurrency());
+	walk_context context{ visitor, options, threads };
+
+	std::unique_ptr<walk_node> root_node;
+	if (options.ordered)
+	{
+		root_node = std::make_unique<walk_node>(root, 0);
+	}
+	context.push(0, walk_task{ root, 0, root_node.get() });
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (uint32_t i = 0; i < threads; i++)
+	{
+		workers.emplace_back([&context, i] { context.run(i); });
+	}
+
+	if (options.ordered)
+	{
+		// Emit depth first, releasing each node (and its open key) as soon as it was visited.
+		std::vector<std::unique_ptr<walk_node>> stack;
+		stack.push_back(std::move(root_node));
+		try
+		{
+			while (!stack.empty() && !context.failed())
+			{
+				auto node = std::move(stack.back());
+				stack.pop_back();
+				while (!node->ready.load(std::memory_order_acquire) && !context.failed())
+				{
+					std::this_thread::yield();
+				}
+				if (context.failed())
+				{
+					break;
+				}
+				visitor(node->entry, node->depth);
+				for (auto it = node->children.rbegin(); it != node->children.rend(); ++it)
+				{
+					stack.push_back(std::move(*it));
+				}
+			}
+		}
+		catch (...)
+		{
+			context.fail(std::current_exception());
+		}
+	}
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	context.rethrow();
+	return context.statistics();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include "key_entry.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Called for every key a walk reaches.
+	 *
+	 * Unless the walk is ordered, the visitor is called concurrently from the worker threads.
+	 */
+	using walk_visitor = std::function<void(const key_entry& key, uint32_t depth)>;
+
+	/**
+	 * @brief Decides whether a walk skips the descendants of a key. Called concurrently from the worker threads.
+	 */
+	using walk_pruner = std::function<bool(const key_entry& key, uint32_t depth)>;
+
+	/**
+	 * @brief Decides by name whether a walk opens a sub key. Called concurrently from the worker threads.
+	 */
+	using walk_filter = std::function<bool(const key_entry& parent, const std::wstring& name, uint32_t depth)>;
+
+	/**
+	 * @brief Names the sub keys of a key a walk opens, so they are opened directly instead of enumerated. Called
+	 * concurrently from the worker threads.
+	 *
+	 * Returns false to enumerate the sub keys as usual. Names of sub keys that do not exist are skipped.
+	 */
+	using walk_expander = std::function<bool(const key_entry& key, uint32_t depth, std::vector<std::wstring>& names)>;
+
+	struct DllExport walk_options
+	{
+		/** The deepest level that is visited; the root is at depth 0. */
+		uint32_t max_depth = (std::numeric_limits<uint32_t>::max)();
+		/** The number of worker threads, or 0 for one per hardware thread. */
+		uint32_t threads = 0;
+		/**
+		 * Whether the visitor is called on the calling thread, in depth first pre-order with children in enumeration
+		 * order. Keys are still opened in parallel.
+		 */
+		bool ordered = false;
+		/** Whether keys that fail to open are skipped (and counted) instead of aborting the walk. */
+		bool ignore_errors = false;
+		/** Returns true to skip the descendants of a key. The key itself is still visited. */
+		walk_pruner prune;
+		/** Returns false to skip an enumerated sub key, and its descendants, without opening it. */
+		walk_filter filter;
+		/** Names the sub keys to open instead of enumerating them. Applied before filter, which it bypasses. */
+		walk_expander expand;
+	};
+
+	/**
+	 * @brief What a single worker thread did during a walk.
+	 */
+	struct DllExport walk_worker_statistics
+	{
+		/** Keys this worker opened and processed. */
+		uint64_t keys_visited = 0;
+		/** Keys taken from another worker's queue. */
+		uint64_t tasks_stolen = 0;
+		/** Keys that failed to open and were skipped. */
+		uint64_t errors = 0;
+		/** Sub keys that were enumerated but skipped by the filter, without being opened. */
+		uint64_t keys_filtered = 0;
+		/** Keys whose descendants were skipped by the pruner. */
+		uint64_t subtrees_pruned = 0;
+		/** Sub keys opened by name, as listed by the expander, instead of enumerated. */
+		uint64_t direct_opens = 0;
+	};
+
+	struct DllExport walk_statistics
+	{
+		std::vector<walk_worker_statistics> workers;
+
+		/**
+		 * @brief Gets the number of keys visited by all workers.
+		 * @return The number of keys visited.
+		 */
+		uint64_t keys_visited() const;
+	};
+
+	/**
+	 * @brief Walks a tree of keys, fanning subtrees out over a work-stealing pool of threads.
+	 *
+	 * Each worker processes its own queue depth first and steals the oldest, and so usually largest, subtrees from
+	 * other workers once it runs dry.
+	 *
+	 * @param root The key to start from.
+	 * @param visitor Called for every key reached.
+	 * @param options How to walk.
+	 * @return Per-worker statistics.
+	 * @exception Whatever the visitor, the pruner or opening a key throws, once all workers stopped.
+	 */
+	DllExport walk_statistics walk(const key_entry& root, const walk_visitor& visitor, const walk_options& options = {});
+}
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <cwchar>
+#include <iterator>
+#include "utf16.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define REGISTRYPP_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REGISTRYPP_SSE2 1
+#endif
+
+using namespace win32::registry;
+
+namespace
+{
+	/** A run of characters whose upper case forms are delta away, every stride code points from first to last. */
+	struct upper_case_range
+	{
+		uint16_t first;
+		uint16_t last;
+		uint16_t stride;
+		int32_t delta;
+	};
+
+	/**
+	 * The simple upper case mappings of the Basic Multilingual Plane past ASCII, from the Unicode character database.
+	 * Mappings to ASCII (the dotless i and the long s) are left out, so a non-ASCII name never equals an ASCII one and
+	 * ASCII names compare without the table.
+	 */
+	constexpr upper_case_range upper_case_ranges[] = {
+		{ 0x00B5, 0x00B5, 1, 743 }, { 0x00E0, 0x00F6, 1, -32 }, { 0x00F8, 0x00FE, 1, -32 }, { 0x00FF, 0x00FF, 1, 121 },
+		{ 0x0101, 0x012F, 2, -1 }, { 0x0133, 0x0137, 2, -1 }, { 0x013A, 0x0148, 2, -1 }, { 0x014B, 0x0177, 2, -1 },
+		{ 0x017A, 0x017E, 2, -1 }, { 0x0180, 0x0180, 1, 195 }, { 0x0183, 0x0185, 2, -1 }, { 0x0188, 0x0188, 1, -1 },
+		{ 0x018C, 0x018C, 1, -1 }, { 0x0192, 0x0192, 1, -1 }, { 0x0195, 0x0195, 1, 97 }, { 0x0199, 0x0199, 1, -1 },
+		{ 0x019A, 0x019A, 1, 163 }, { 0x019E, 0x019E, 1, 130 }, { 0x01A1, 0x01A5, 2, -1 }, { 0x01A8, 0x01A8, 1, -1 },
+		{ 0x01AD, 0x01AD, 1, -1 }, { 0x01B0, 0x01B0, 1, -1 }, { 0x01B4, 0x01B6, 2, -1 }, { 0x01B9, 0x01B9, 1, -1 },
+		{ 0x01BD, 0x01BD, 1, -1 }, { 0x01BF, 0x01BF, 1, 56 }, { 0x01C5, 0x01C5, 1, -1 }, { 0x01C6, 0x01C6, 1, -2 },
+		{ 0x01C8, 0x01C8, 1, -1 }, { 0x01C9, 0x01C9, 1, -2 }, { 0x01CB, 0x01CB, 1, -1 }, { 0x01CC, 0x01CC, 1, -2 },
+		{ 0x01CE, 0x01DC, 2, -1 }, { 0x01DD, 0x01DD, 1, -79 }, { 0x01DF, 0x01EF, 2, -1 }, { 0x01F2, 0x01F2, 1, -1 },
+		{ 0x01F3, 0x01F3, 1, -2 }, { 0x01F5, 0x01F5, 1, -1 }, { 0x01F9, 0x021F, 2, -1 }, { 0x0223, 0x0233, 2, -1 },
+		{ 0x023C, 0x023C, 1, -1 }, { 0x023F, 0x0240, 1, 10815 }, { 0x0242, 0x0242, 1, -1 }, { 0x0247, 0x024F, 2, -1 },
+		{ 0x0250, 0x0250, 1, 10783 }, { 0x0251, 0x0251, 1, 10780 }, { 0x0252, 0x0252, 1, 10782 }, { 0x0253, 0x0253, 1, -210 },
+		{ 0x0254, 0x0254, 1, -206 }, { 0x0256, 0x0257, 1, -205 }, { 0x0259, 0x0259, 1, -202 }, { 0x025B, 0x025B, 1, -203 },
+		{ 0x025C, 0x025C, 1, 42319 }, { 0x0260, 0x0260, 1, -205 }, { 0x0261, 0x0261, 1, 42315 }, { 0x0263, 0x0263, 1, -207 },
+		{ 0x0265, 0x0265, 1, 42280 }, { 0x0266, 0x0266, 1, 42308 }, { 0x0268, 0x0268, 1, -209 }, { 0x0269, 0x0269, 1, -211 },
+		{ 0x026A, 0x026A, 1, 42308 }, { 0x026B, 0x026B, 1, 10743 }, { 0x026C, 0x026C, 1, 42305 }, { 0x026F, 0x026F, 1, -211 },
+		{ 0x0271, 0x0271, 1, 10749 }, { 0x0272, 0x0272, 1, -213 }, { 0x0275, 0x0275, 1, -214 }, { 0x027D, 0x027D, 1, 10727 },
+		{ 0x0280, 0x0280, 1, -218 }, { 0x0282, 0x0282, 1, 42307 }, { 0x0283, 0x0283, 1, -218 }, { 0x0287, 0x0287, 1, 42282 },
+		{ 0x0288, 0x0288, 1, -218 }, { 0x0289, 0x0289, 1, -69 }, { 0x028A, 0x028B, 1, -217 }, { 0x028C, 0x028C, 1, -71 },
+		{ 0x0292, 0x0292, 1, -219 }, { 0x029D, 0x029D, 1, 42261 }, { 0x029E, 0x029E, 1, 42258 }, { 0x0345, 0x0345, 1, 84 },
+		{ 0x0371, 0x0373, 2, -1 }, { 0x0377, 0x0377, 1, -1 }, { 0x037B, 0x037D, 1, 130 }, { 0x03AC, 0x03AC, 1, -38 },
+		{ 0x03AD, 0x03AF, 1, -37 }, { 0x03B1, 0x03C1, 1, -32 }, { 0x03C2, 0x03C2, 1, -31 }, { 0x03C3, 0x03CB, 1, -32 },
+		{ 0x03CC, 0x03CC, 1, -64 }, { 0x03CD, 0x03CE, 1, -63 }, { 0x03D0, 0x03D0, 1, -62 }, { 0x03D1, 0x03D1, 1, -57 },
+		{ 0x03D5, 0x03D5, 1, -47 }, { 0x03D6, 0x03D6, 1, -54 }, { 0x03D7, 0x03D7, 1, -8 }, { 0x03D9, 0x03EF, 2, -1 },
+		{ 0x03F0, 0x03F0, 1, -86 }, { 0x03F1, 0x03F1, 1, -80 }, { 0x03F2, 0x03F2, 1, 7 }, { 0x03F3, 0x03F3, 1, -116 },
+		{ 0x03F5, 0x03F5, 1, -96 }, { 0x03F8, 0x03F8, 1, -1 }, { 0x03FB, 0x03FB, 1, -1 }, { 0x0430, 0x044F, 1, -32 },
+		{ 0x0450, 0x045F, 1, -80 }, { 0x0461, 0x0481, 2, -1 }, { 0x048B, 0x04BF, 2, -1 }, { 0x04C2, 0x04CE, 2, -1 },
+		{ 0x04CF, 0x04CF, 1, -15 }, { 0x04D1, 0x052F, 2, -1 }, { 0x0561, 0x0586, 1, -48 }, { 0x10D0, 0x10FA, 1, 3008 },
+		{ 0x10FD, 0x10FF, 1, 3008 }, { 0x13F8, 0x13FD, 1, -8 }, { 0x1C80, 0x1C80, 1, -6254 }, { 0x1C81, 0x1C81, 1, -6253 },
+		{ 0x1C82, 0x1C82, 1, -6244 }, { 0x1C83, 0x1C84, 1, -6242 }, { 0x1C85, 0x1C85, 1, -6243 }, { 0x1C86, 0x1C86, 1, -6236 },
+		{ 0x1C87, 0x1C87, 1, -6181 }, { 0x1C88, 0x1C88, 1, 35266 }, { 0x1D79, 0x1D79, 1, 35332 }, { 0x1D7D, 0x1D7D, 1, 3814 },
+		{ 0x1D8E, 0x1D8E, 1, 35384 }, { 0x1E01, 0x1E95, 2, -1 }, { 0x1E9B, 0x1E9B, 1, -59 }, { 0x1EA1, 0x1EFF, 2, -1 },
+		{ 0x1F00, 0x1F07, 1, 8 }, { 0x1F10, 0x1F15, 1, 8 }, { 0x1F20, 0x1F27, 1, 8 }, { 0x1F30, 0x1F37, 1, 8 },
+		{ 0x1F40, 0x1F45, 1, 8 }, { 0x1F51, 0x1F57, 2, 8 }, { 0x1F60, 0x1F67, 1, 8 }, { 0x1F70, 0x1F71, 1, 74 },
+		{ 0x1F72, 0x1F75, 1, 86 }, { 0x1F76, 0x1F77, 1, 100 }, { 0x1F78, 0x1F79, 1, 128 }, { 0x1F7A, 0x1F7B, 1, 112 },
+		{ 0x1F7C, 0x1F7D, 1, 126 }, { 0x1FB0, 0x1FB1, 1, 8 }, { 0x1FBE, 0x1FBE, 1, -7205 }, { 0x1FD0, 0x1FD1, 1, 8 },
+		{ 0x1FE0, 0x1FE1, 1, 8 }, { 0x1FE5, 0x1FE5, 1, 7 }, { 0x214E, 0x214E, 1, -28 }, { 0x2170, 0x217F, 1, -16 },
+		{ 0x2184, 0x2184, 1, -1 }, { 0x24D0, 0x24E9, 1, -26 }, { 0x2C30, 0x2C5F, 1, -48 }, { 0x2C61, 0x2C61, 1, -1 },
+		{ 0x2C65, 0x2C65, 1, -10795 }, { 0x2C66, 0x2C66, 1, -10792 }, { 0x2C68, 0x2C6C, 2, -1 }, { 0x2C73, 0x2C73, 1, -1 },
+		{ 0x2C76, 0x2C76, 1, -1 }, { 0x2C81, 0x2CE3, 2, -1 }, { 0x2CEC, 0x2CEE, 2, -1 }, { 0x2CF3, 0x2CF3, 1, -1 },
+		{ 0x2D00, 0x2D25, 1, -7264 }, { 0x2D27, 0x2D27, 1, -7264 }, { 0x2D2D, 0x2D2D, 1, -7264 }, { 0xA641, 0xA66D, 2, -1 },
+		{ 0xA681, 0xA69B, 2, -1 }, { 0xA723, 0xA72F, 2, -1 }, { 0xA733, 0xA76F, 2, -1 }, { 0xA77A, 0xA77C, 2, -1 },
+		{ 0xA77F, 0xA787, 2, -1 }, { 0xA78C, 0xA78C, 1, -1 }, { 0xA791, 0xA793, 2, -1 }, { 0xA794, 0xA794, 1, 48 },
+		{ 0xA797, 0xA7A9, 2, -1 }, { 0xA7B5, 0xA7C3, 2, -1 }, { 0xA7C8, 0xA7CA, 2, -1 }, { 0xA7D1, 0xA7D1, 1, -1 },
+		{ 0xA7D7, 0xA7D9, 2, -1 }, { 0xA7F6, 0xA7F6, 1, -1 }, { 0xAB53, 0xAB53, 1, -928 }, { 0xAB70, 0xABBF, 1, -38864 },
+		{ 0xFF41, 0xFF5A, 1, -32 },
+	};
+
+	template<typename String>
+	void append_units(String& out, const uint8_t* data, size_t units)
+	{
+#if WCHAR_MAX <= 0xFFFF
+		// Little-endian UTF-16 is already the in-memory form of wchar_t.
+		size_t start = out.size();
+		out.resize(start + units);
+		if (units != 0)
+		{
+			std::memcpy(out.data() + start, data, units * 2);
+		}
+#else
+		out.reserve(out.size() + units);
+		for (size_t i = 0; i < units; i++)
+		{
+			char32_t unit = static_cast<char32_t>(data[2 * i] | (data[2 * i + 1] << 8));
+#if WCHAR_MAX > 0xFFFF
+			if (unit >= 0xD800 && unit < 0xDC00 && i + 1 < units)
+			{
+				char32_t low = static_cast<char32_t>(data[2 * i + 2] | (data[2 * i + 3] << 8));
+				if (low >= 0xDC00 && low < 0xE000)
+				{
+					unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+					i++;
+				}
+			}
+#endif
+			out.push_back(static_cast<wchar_t>(unit));
+		}
+#endif
+	}
+}
+
+void utf16::append(std::wstring& out, const uint8_t* data, size_t units)
+{
+	append_units(out, data, units);
+}
+
+void utf16::append(std::pmr::wstring& out, const uint8_t* data, size_t units)
+{
+	append_units(out, data, units);
+}
+
+size_t utf16::find_null(const utf16_unit* data, size_t units)
+{
+	size_t i = 0;
+#ifdef REGISTRYPP_AVX2
+	const __m256i zero256 = _mm256_setzero_si256();
+	for (; i + 16 <= units; i += 16)
+	{
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(chunk, zero256)));
+		if (mask != 0)
+		{
+			// Two mask bits per code unit.
+			return i + static_cast<size_t>(std::countr_zero(mask)) / 2;
+		}
+	}
+#endif
+#ifdef REGISTRYPP_SSE2
+	const __m128i zero128 = _mm_setzero_si128();
+	for (; i + 8 <= units; i += 8)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(chunk, zero128)));
+		if (mask != 0)
+		{
+			return i + static_cast<size_t>(std::countr_zero(mask)) / 2;
+		}
+	}
+#endif
+	for (; i < units; i++)
+	{
+		if (data[i] == 0)
+		{
+			return i;
+		}
+	}
+	return units;
+}
+
+utf16_string_view utf16::trim_nulls(const uint8_t* data, size_t size)
+{
+	auto units = reinterpret_cast<const utf16_unit*>(data);
+	size_t length = size / 2;
+	while (length != 0 && units[length - 1] == 0)
+	{
+		length--;
+	}
+	return utf16_string_view{ units, length };
+}
+
+std::vector<utf16_string_view> utf16::split_multi(const uint8_t* data, size_t size)
+{
+	auto units = reinterpret_cast<const utf16_unit*>(data);
+	size_t count = size / 2;
+	std::vector<utf16_string_view> strings;
+	size_t start = 0;
+	while (start < count)
+	{
+		size_t length = find_null(units + start, count - start);
+		if (length == 0)
+		{
+			break;
+		}
+		strings.emplace_back(units + start, length);
+		start += length + 1;
+	}
+	return strings;
+}
+
+void utf16::append_utf8(std::string& out, utf16_string_view text)
+{
+	out.reserve(out.size() + text.size());
+#ifdef REGISTRYPP_SSE2
+	const __m128i high = _mm_set1_epi16(static_cast<short>(0xFF80));
+#endif
+	size_t i = 0;
+	while (i < text.size())
+	{
+#ifdef REGISTRYPP_SSE2
+		// Eight ASCII code units at a time: no unit may have bits above 0x7F set.
+		while (i + 8 <= text.size())
+		{
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk, high), _mm_setzero_si128())) != 0xFFFF)
+			{
+				break;
+			}
+			char packed[16];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(packed), _mm_packus_epi16(chunk, chunk));
+			out.append(packed, 8);
+			i += 8;
+		}
+		if (i == text.size())
+		{
+			break;
+		}
+#endif
+		char32_t c = static_cast<char32_t>(text[i++]);
+		if (c >= 0xD800 && c < 0xDC00 && i < text.size() && text[i] >= 0xDC00 && text[i] < 0xE000)
+		{
+			c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<char32_t>(text[i++]) - 0xDC00);
+		}
+		else if (c >= 0xD800 && c < 0xE000)
+		{
+			c = 0xFFFD;
+		}
+		if (c < 0x80)
+		{
+			out.push_back(static_cast<char>(c));
+		}
+		else if (c < 0x800)
+		{
+			out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+			out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000)
+		{
+			out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+			out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else
+		{
+			out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+			out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+	}
+}
+
+void utf16::append_latin1(std::wstring& out, const uint8_t* data, size_t length)
+{
+	out.reserve(out.size() + length);
+	for (size_t i = 0; i < length; i++)
+	{
+		out.push_back(static_cast<wchar_t>(data[i]));
+	}
+}
+
+void utf16::append_bytes(std::vector<uint8_t>& out, std::wstring_view string)
+{
+	out.reserve(out.size() + string.size() * 2);
+	auto push = [&out](char32_t unit)
+	{
+		out.push_back(static_cast<uint8_t>(unit & 0xFF));
+		out.push_back(static_cast<uint8_t>((unit >> 8) & 0xFF));
+	};
+	for (wchar_t c : string)
+	{
+		char32_t code_point = static_cast<char32_t>(c);
+		if (code_point > 0xFFFF)
+		{
+			push(0xD800 + ((code_point - 0x10000) >> 10));
+			push(0xDC00 + ((code_point - 0x10000) & 0x3FF));
+		}
+		else
+		{
+			push(code_point);
+		}
+	}
+}
+
+wchar_t utf16::fold(wchar_t c)
+{
+	if (c < 0x80)
+	{
+		return (c >= L'a' && c <= L'z') ? static_cast<wchar_t>(c - (L'a' - L'A')) : c;
+	}
+	if (c < upper_case_ranges[0].first || c > 0xFFFF)
+	{
+		return c;
+	}
+	// Not towupper: it depends on the C locale, which usually only knows ASCII.
+	auto range = std::upper_bound(std::begin(upper_case_ranges), std::end(upper_case_ranges), c,
+		[](wchar_t value, const upper_case_range& candidate) { return value < candidate.first; }) - 1;
+	if (c > range->last || (c - range->first) % range->stride != 0)
+	{
+		return c;
+	}
+	return static_cast<wchar_t>(c + range->delta);
+}
+
+std::wstring utf16::fold(std::wstring_view name)
+{
+	std::wstring folded{ name };
+	for (wchar_t& c : folded)
+	{
+		c = fold(c);
+	}
+	return folded;
+}
+
+bool utf16::equals_ignore_case(std::wstring_view lhs, std::wstring_view rhs)
+{
+	if (lhs.size() != rhs.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < lhs.size(); i++)
+	{
+		if (lhs[i] != rhs[i] && fold(lhs[i]) != fold(rhs[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t utf16::name_hash(std::wstring_view name)
+{
+	uint32_t hash = 0;
+	for (wchar_t c : name)
+	{
+		char32_t folded = static_cast<char32_t>(fold(c));
+		if (folded > 0xFFFF)
+		{
+			hash = hash * 37 + static_cast<uint32_t>(0xD800 + ((folded - 0x10000) >> 10));
+			hash = hash * 37 + static_cast<uint32_t>(0xDC00 + ((folded - 0x10000) & 0x3FF));
+		}
+		else
+		{
+			hash = hash * 37 + static_cast<uint32_t>(folded);
+		}
+	}
+	return hash;
+}
+
+uint64_t utf16::fold_hash(uint64_t seed, std::wstring_view name)
+{
+	for (wchar_t c : name)
+	{
+		seed = (seed ^ static_cast<uint64_t>(fold(c))) * 0x100000001B3ULL;
+	}
+	return seed;
+}
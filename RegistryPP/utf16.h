@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace win32::registry
+{
+#if WCHAR_MAX <= 0xFFFF
+	/** A UTF-16 code unit; wchar_t where it is 16 bits wide, so views are plain std::wstring_view. */
+	using utf16_unit = wchar_t;
+#else
+	/** A UTF-16 code unit; wchar_t where it is 16 bits wide, so views are plain std::wstring_view. */
+	using utf16_unit = char16_t;
+#endif
+	/** A view of UTF-16 text in place, std::wstring_view on Windows. */
+	using utf16_string_view = std::basic_string_view<utf16_unit>;
+}
+
+namespace win32::registry::utf16
+{
+	/**
+	 * @brief Appends little-endian UTF-16 code units to a wide string.
+	 *
+	 * On platforms where wchar_t is 32 bits wide surrogate pairs are combined.
+	 *
+	 * @param out The string to append to.
+	 * @param data The UTF-16LE bytes. Does not need to be aligned.
+	 * @param units The number of code units to append.
+	 */
+	void append(std::wstring& out, const uint8_t* data, size_t units);
+
+	/** @copydoc append(std::wstring&, const uint8_t*, size_t) */
+	void append(std::pmr::wstring& out, const uint8_t* data, size_t units);
+
+	/**
+	 * @brief Finds the first null code unit.
+	 *
+	 * Scans 16 (AVX2) or 8 (SSE2) code units per step where the compiler targets those instruction sets.
+	 * @param data The UTF-16 code units. Must be 2-byte aligned.
+	 * @param units The number of code units.
+	 * @return The index of the first null, or units if there is none.
+	 */
+	size_t find_null(const utf16_unit* data, size_t units);
+
+	/**
+	 * @brief Views a REG_SZ or REG_EXPAND_SZ value without its trailing nulls.
+	 * @param data The value data. Must be 2-byte aligned.
+	 * @param size The size of the data in bytes. A trailing odd byte is ignored.
+	 * @return The string, in place.
+	 */
+	utf16_string_view trim_nulls(const uint8_t* data, size_t size);
+
+	/**
+	 * @brief Splits a REG_MULTI_SZ value into its strings, in place.
+	 *
+	 * The list ends at the first empty string or at the end of the data, whichever comes first, so values that lack
+	 * the final terminator still yield their last string.
+	 * @param data The value data. Must be 2-byte aligned.
+	 * @param size The size of the data in bytes. A trailing odd byte is ignored.
+	 * @return The strings, in place.
+	 */
+	std::vector<utf16_string_view> split_multi(const uint8_t* data, size_t size);
+
+	/**
+	 * @brief Appends UTF-16 text to a UTF-8 string.
+	 *
+	 * Runs of ASCII are converted 8 code units at a time where SSE2 is available. Unpaired surrogates become U+FFFD.
+	 * @param out The string to append to.
+	 * @param text The UTF-16 text.
+	 */
+	void append_utf8(std::string& out, utf16_string_view text);
+
+	/**
+	 * @brief Appends Latin-1 characters, as used by compressed hive names, to a wide string.
+	 * @param out The string to append to.
+	 * @param data The characters.
+	 * @param length The number of characters to append.
+	 */
+	void append_latin1(std::wstring& out, const uint8_t* data, size_t length);
+
+	/**
+	 * @brief Appends a wide string to a buffer as little-endian UTF-16 code units, without a terminating null.
+	 * @param out The buffer to append to.
+	 * @param string The string.
+	 */
+	void append_bytes(std::vector<uint8_t>& out, std::wstring_view string);
+
+	/**
+	 * @brief Folds a character the way the registry compares names.
+	 *
+	 * ASCII is folded directly; other characters through the Unicode simple upper case mappings, whatever the locale.
+	 * @param c The character.
+	 * @return The upper case form of the character.
+	 */
+	wchar_t fold(wchar_t c);
+
+	/**
+	 * @brief Folds a name the way the registry compares names.
+	 * @param name The name.
+	 * @return The upper case form of the name.
+	 */
+	std::wstring fold(std::wstring_view name);
+
+	/**
+	 * @brief Compares two names the way the registry does, ignoring case.
+	 * @param lhs The first name.
+	 * @param rhs The second name.
+	 * @return true if the names are equal; otherwise false.
+	 */
+	bool equals_ignore_case(std::wstring_view lhs, std::wstring_view rhs);
+
+	/**
+	 * @brief Computes the hash a hive's lh list stores for a name.
+	 * @param name The name.
+	 * @return The hash of the name.
+	 */
+	uint32_t name_hash(std::wstring_view name);
+
+	/** The starting value of fold_hash. */
+	constexpr uint64_t fold_hash_seed = 0xCBF29CE484222325ULL;
+
+	/**
+	 * @brief Continues a 64-bit FNV-1a hash over the folded form of a name.
+	 *
+	 * Hashing a path one component at a time, with the separators, gives the same result as hashing it whole.
+	 * @param seed The hash so far, or fold_hash_seed.
+	 * @param name The name.
+	 * @return The hash.
+	 */
+	uint64_t fold_hash(uint64_t seed, std::wstring_view name);
+}
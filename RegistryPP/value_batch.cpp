@@ -0,0 +1,50 @@
+#include "value_batch.h"
+#include "registry_error.h"
+
+using namespace win32::registry;
+
+value_batch::value_batch() :
+	m_keys(), m_key_of(), m_names(), m_results(), m_data(std::make_shared<std::vector<uint8_t>>())
+{
+}
+
+size_t value_batch::size() const
+{
+	return m_results.size();
+}
+
+bool value_batch::found(size_t index) const
+{
+	return m_results.at(index).found;
+}
+
+std::optional<value_entry> value_batch::get(size_t index) const
+{
+	const auto& result = m_results.at(index);
+	if (!result.found)
+	{
+		return std::nullopt;
+	}
+	std::shared_ptr<const uint8_t> data{ m_data, m_data->data() + result.offset };
+	return value_entry{ m_names[index], result.type, m_keys[m_key_of[index]], std::move(data), result.size };
+}
+
+value_entry value_batch::operator[](size_t index) const
+{
+	auto value = get(index);
+	if (!value)
+	{
+		throw registry_error{ registry_errc::not_found, "Value not found." };
+	}
+	return *value;
+}
+
+const batch_value& value_batch::result(size_t index) const
+{
+	return m_results.at(index);
+}
+
+const std::vector<uint8_t>& value_batch::data() const
+{
+	return *m_data;
+}
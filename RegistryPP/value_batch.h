@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "key_backend.h"
+#include "value_entry.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief The result of reading several values at once with key_entry::get_values.
+	 *
+	 * The data of all values lives in one shared buffer; the entries it hands out refer to that buffer instead of
+	 * copying from it. Values that do not exist are reported per entry.
+	 */
+	class DllExport value_batch
+	{
+	public:
+		friend class key_entry;
+
+		/**
+		 * @brief Gets the number of requested values.
+		 * @return The number of requested values.
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief Gets whether a requested value exists.
+		 * @param index The position of the value in the request.
+		 * @return true if the value exists; otherwise false.
+		 */
+		bool found(size_t index) const;
+
+		/**
+		 * @brief Gets a requested value.
+		 * @param index The position of the value in the request.
+		 * @return The value, or nothing if it does not exist.
+		 */
+		std::optional<value_entry> get(size_t index) const;
+
+		/**
+		 * @brief Gets a requested value.
+		 * @param index The position of the value in the request.
+		 * @return The value.
+		 * @exception registry_error The value does not exist.
+		 */
+		value_entry operator[](size_t index) const;
+
+		/**
+		 * @brief Gets the raw outcome for a requested value.
+		 * @param index The position of the value in the request.
+		 * @return Where the value's data is in data().
+		 */
+		const batch_value& result(size_t index) const;
+
+		/**
+		 * @brief Gets the buffer holding the data of all values.
+		 * @return The shared buffer.
+		 */
+		const std::vector<uint8_t>& data() const;
+
+	private:
+		value_batch();
+
+		std::vector<key_entry> m_keys;
+		/** For every requested value, the index of its key in m_keys. */
+		std::vector<uint32_t> m_key_of;
+		std::vector<std::wstring> m_names;
+		std::vector<batch_value> m_results;
+		std::shared_ptr<std::vector<uint8_t>> m_data;
+	};
+}
@@ -1,10 +1,28 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include "value_entry.h"
+#include "instrumentation.h"
+#include "key_backend.h"
+#include "registry_error.h"
+#include "scan_arena.h"
+#include "utf16.h"
 
 using namespace win32::registry;
 
+namespace
+{
+	/** Owns a copy of value data, with the control block and bytes both taken from the resource. */
+	std::shared_ptr<const uint8_t> copy_data(const uint8_t* data, uint32_t size, std::pmr::memory_resource* resource)
+	{
+		auto copy = std::allocate_shared<std::pmr::vector<uint8_t>>(std::pmr::polymorphic_allocator<uint8_t>{ resource }, data, data + size);
+		return std::shared_ptr<const uint8_t>{ copy, copy->data() };
+	}
+}
+
 std::wstring value_entry::name() const
 {
-	return m_name;
+	return std::wstring{ m_name };
 }
 
 registry_value_type value_entry::type() const
@@ -12,62 +30,160 @@ registry_value_type value_entry::type() const
 	return m_type;
 }
 
+bool value_entry::has_data() const
+{
+	return m_has_data;
+}
+
 std::vector<uint8_t> win32::registry::value_entry::get_bytes() const
 {
-	return std::get<std::vector<uint8_t>>(m_data);
+	const uint8_t* bytes = data();
+	return std::vector<uint8_t>(bytes, bytes + m_size);
+}
+
+std::span<const uint8_t> win32::registry::value_entry::get_bytes_view() const
+{
+	return std::span<const uint8_t>{ data(), m_size };
 }
 
 uint32_t win32::registry::value_entry::get_dword() const
 {
-	return std::get<uint32_t>(m_data);
+	uint32_t integer_data = 0;
+	std::memcpy(&integer_data, data_as(registry_value_type::dword), (std::min)(m_size, static_cast<uint32_t>(sizeof integer_data)));
+	REGISTRYPP_COUNT_DECODED(sizeof integer_data);
+	return integer_data;
 }
 
 uint64_t win32::registry::value_entry::get_qword() const
 {
-	return std::get<uint64_t>(m_data);
+	uint64_t integer_data = 0;
+	std::memcpy(&integer_data, data_as(registry_value_type::qword), (std::min)(m_size, static_cast<uint32_t>(sizeof integer_data)));
+	REGISTRYPP_COUNT_DECODED(sizeof integer_data);
+	return integer_data;
 }
 
 std::wstring win32::registry::value_entry::get_string() const
 {
-	return std::get<std::wstring>(m_data);
+	auto view = get_string_view();
+	std::wstring string;
+	utf16::append(string, reinterpret_cast<const uint8_t*>(view.data()), view.size());
+	return string;
 }
 
 std::vector<std::wstring> win32::registry::value_entry::get_strings() const
 {
-	return std::get<std::vector<std::wstring>>(m_data);
+	auto views = get_strings_view();
+	std::vector<std::wstring> strings(views.size());
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		utf16::append(strings[i], reinterpret_cast<const uint8_t*>(views[i].data()), views[i].size());
+	}
+	return strings;
+}
+
+std::pmr::wstring value_entry::get_string(std::pmr::memory_resource* resource) const
+{
+	auto view = get_string_view();
+	std::pmr::wstring string{ resource };
+	utf16::append(string, reinterpret_cast<const uint8_t*>(view.data()), view.size());
+	return string;
+}
+
+std::pmr::vector<std::pmr::wstring> value_entry::get_strings(std::pmr::memory_resource* resource) const
+{
+	auto views = get_strings_view();
+	// The vector hands its resource on to the strings it makes.
+	std::pmr::vector<std::pmr::wstring> strings(views.size(), resource);
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		utf16::append(strings[i], reinterpret_cast<const uint8_t*>(views[i].data()), views[i].size());
+	}
+	return strings;
+}
+
+utf16_string_view value_entry::get_string_view() const
+{
+	const uint8_t* bytes = data_as(m_type == registry_value_type::expandable_string ? registry_value_type::expandable_string : registry_value_type::string);
+	REGISTRYPP_COUNT_DECODED(m_data ? m_size : 0);
+	return utf16::trim_nulls(bytes, m_data ? m_size : 0);
+}
+
+std::vector<utf16_string_view> value_entry::get_strings_view() const
+{
+	const uint8_t* bytes = data_as(registry_value_type::multi_string);
+	REGISTRYPP_COUNT_DECODED(m_data ? m_size : 0);
+	return utf16::split_multi(bytes, m_data ? m_size : 0);
+}
+
+std::string value_entry::get_string_utf8() const
+{
+	std::string string;
+	utf16::append_utf8(string, get_string_view());
+	return string;
 }
 
-value_entry::value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, const std::vector<uint8_t>& data) :
-	m_name(name), m_type(type), m_parent(parent), m_data(data)
+std::vector<std::string> value_entry::get_strings_utf8() const
 {
+	auto views = get_strings_view();
+	std::vector<std::string> strings(views.size());
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		utf16::append_utf8(strings[i], views[i]);
+	}
+	return strings;
 }
 
-value_entry::value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, uint32_t data) :
-	m_name(name), m_type(type), m_parent(parent), m_data(data)
+value_entry::value_entry(std::wstring_view name, registry_value_type type, const key_entry& parent, std::shared_ptr<const uint8_t> data, uint32_t size, bool has_data) :
+	m_name(name, arena_scope::current()), m_type(type), m_size(size), m_parent(parent), m_data(std::move(data)), m_has_data(has_data)
 {
+	if (m_data && reinterpret_cast<uintptr_t>(m_data.get()) % alignof(utf16_unit) != 0)
+	{
+		// Borrowed data at an odd address; own an aligned copy so strings can be viewed in place.
+		m_data = copy_data(m_data.get(), m_size, m_name.get_allocator().resource());
+	}
 }
 
-value_entry::value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, uint64_t data) :
-	m_name(name), m_type(type), m_parent(parent), m_data(data)
+value_entry::value_entry(std::wstring_view name, const key_entry& parent) :
+	m_name(name, arena_scope::current()), m_type(registry_value_type::none), m_size(0), m_parent(parent), m_data(nullptr), m_has_data(true)
 {
 }
 
-value_entry::value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, const std::wstring& data) :
-	m_name(name), m_type(type), m_parent(parent), m_data(data)
+value_entry value_entry::from_view(const value_view& view, const key_entry& parent)
 {
+	std::shared_ptr<const uint8_t> data;
+	if (view.owner)
+	{
+		// The backend keeps the data alive (e.g. a mapped hive file), so the entry can refer to it in place.
+		data = std::shared_ptr<const uint8_t>{ view.owner, view.data };
+	}
+	else if (view.size != 0)
+	{
+		data = copy_data(view.data, view.size, arena_scope::current());
+	}
+	return value_entry{ view.name, view.type, parent, std::move(data), view.size };
 }
 
-value_entry::value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, const std::vector<std::wstring>& data) :
-	m_name(name), m_type(type), m_parent(parent), m_data(data)
+value_entry value_entry::from_header(const value_view& view, const key_entry& parent)
 {
+	return value_entry{ view.name, view.type, parent, nullptr, 0, false };
 }
 
-value_entry::value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent) :
-	m_name(name), m_type(type), m_parent(parent), m_data(nullptr)
+const uint8_t* value_entry::data() const
 {
+	if (!m_has_data)
+	{
+		throw registry_error{ registry_errc::not_supported, "The value was enumerated without its data." };
+	}
+	alignas(8) static const uint8_t empty[8]{};
+	return m_data ? m_data.get() : empty;
 }
 
-value_entry::value_entry(const std::wstring& name, const key_entry& parent) :
-	m_name(name), m_type(registry_value_type::none), m_parent(parent), m_data(nullptr)
+const uint8_t* value_entry::data_as(registry_value_type type) const
 {
+	if (m_type != type)
+	{
+		// Same failure as reading the wrong alternative of a variant.
+		throw std::bad_variant_access{};
+	}
+	return data();
 }
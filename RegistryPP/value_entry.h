@@ -2,15 +2,25 @@
 
 #include "key_entry.h"
 #include "registry_value_type.h"
+#include "utf16.h"
+#include <string>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <variant>
 
 namespace win32::registry
 {
+	struct value_view;
+
 	class DllExport value_entry
 	{
 	public:
 		friend class value_entry_iterator;
+		friend class value_range;
+		friend class value_batch;
+		friend class key_entry;
 
 		/**
 		 * @brief Gets the name of the value.
@@ -24,28 +34,109 @@ namespace win32::registry
 		*/
 		registry_value_type type() const;
 
+		/**
+		 * @brief Gets whether the value's data was read, which it is not when values are enumerated with
+		 * value_enumeration::names_and_types.
+		 * @return true if the data getters can be called; otherwise false.
+		*/
+		bool has_data() const;
+
+		/**
+		 * @brief Gets the raw data of the value, whatever its type.
+		 * @return The raw data of the value.
+		*/
 		std::vector<uint8_t> get_bytes() const;
 
+		/**
+		 * @brief Gets the raw data of the value, whatever its type, in place.
+		 * @return The raw data. Valid for as long as this entry, or any copy of it, lives.
+		*/
+		std::span<const uint8_t> get_bytes_view() const;
+
 		uint32_t get_dword() const;
 
 		uint64_t get_qword() const;
 
+		/**
+		 * @brief Gets a REG_SZ or REG_EXPAND_SZ value, without its trailing nulls.
+		 * @return The string.
+		*/
 		std::wstring get_string() const;
 
+		/**
+		 * @brief Gets the strings of a REG_MULTI_SZ value.
+		 * @return The strings.
+		*/
 		std::vector<std::wstring> get_strings() const;
 
+		/**
+		 * @brief Gets a REG_SZ or REG_EXPAND_SZ value, without its trailing nulls, allocating from a memory resource.
+		 * @param resource Where the string is allocated, e.g. a scan_arena.
+		 * @return The string.
+		*/
+		std::pmr::wstring get_string(std::pmr::memory_resource* resource) const;
+
+		/**
+		 * @brief Gets the strings of a REG_MULTI_SZ value, allocating from a memory resource.
+		 * @param resource Where the vector and strings are allocated, e.g. a scan_arena.
+		 * @return The strings.
+		*/
+		std::pmr::vector<std::pmr::wstring> get_strings(std::pmr::memory_resource* resource) const;
+
+		/**
+		 * @brief Gets a REG_SZ or REG_EXPAND_SZ value, without its trailing nulls, in place.
+		 * @return The string. Valid for as long as this entry, or any copy of it, lives.
+		*/
+		utf16_string_view get_string_view() const;
+
+		/**
+		 * @brief Gets the strings of a REG_MULTI_SZ value, in place.
+		 * @return The strings. Valid for as long as this entry, or any copy of it, lives.
+		*/
+		std::vector<utf16_string_view> get_strings_view() const;
+
+		/**
+		 * @brief Gets a REG_SZ or REG_EXPAND_SZ value as UTF-8, without its trailing nulls.
+		 * @return The string.
+		*/
+		std::string get_string_utf8() const;
+
+		/**
+		 * @brief Gets the strings of a REG_MULTI_SZ value as UTF-8.
+		 * @return The strings.
+		*/
+		std::vector<std::string> get_strings_utf8() const;
+
 	private:
-		explicit value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, const std::vector<uint8_t>& data);
-		explicit value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, uint32_t data);
-		explicit value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, uint64_t data);
-		explicit value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, const std::wstring& data);
-		explicit value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent, const std::vector<std::wstring>& data);
-		explicit value_entry(const std::wstring& name, registry_value_type type, const key_entry& parent);
-		explicit value_entry(const std::wstring& name, const key_entry& parent);
-		std::wstring m_name;
+		explicit value_entry(std::wstring_view name, registry_value_type type, const key_entry& parent, std::shared_ptr<const uint8_t> data, uint32_t size, bool has_data = true);
+		explicit value_entry(std::wstring_view name, const key_entry& parent);
+
+		/**
+		 * Makes an entry from a value read with key_backend::value_at, referring to the data in place when the backend
+		 * keeps it alive and copying it otherwise.
+		 */
+		static value_entry from_view(const value_view& view, const key_entry& parent);
+
+		/** Makes an entry without data from a value read with key_backend::value_header_at. */
+		static value_entry from_header(const value_view& view, const key_entry& parent);
+
+		/** Throws registry_error when the data was not read, so that a value enumerated without it never reads as empty. */
+		const uint8_t* data() const;
+
+		const uint8_t* data_as(registry_value_type type) const;
+
+		/** Allocated from the resource of the arena_scope the entry was made in. */
+		std::pmr::wstring m_name;
 		registry_value_type m_type;
-		uint8_t m_reserved[4]{};
+		uint32_t m_size;
 		key_entry m_parent;
-		std::variant<std::vector<uint8_t>, uint32_t, uint64_t, std::wstring, std::vector<std::wstring>, std::nullptr_t> m_data;
+		/**
+		 * Raw value data, either owned by this entry or borrowed from the storage behind the key (for example the
+		 * mapping of a hive file). Decoding into owned types only happens when one of the getters is called. Always
+		 * 2-byte aligned so strings can be viewed in place. Owned copies come from the entry's arena_scope too.
+		 */
+		std::shared_ptr<const uint8_t> m_data;
+		/** Whether m_data holds the value's data, or the entry was made from a header only. */
+		bool m_has_data;
 	};
 }
\ No newline at end of file
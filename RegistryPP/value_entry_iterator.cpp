@@ -1,8 +1,9 @@
 #include "value_entry_iterator.h"
+#include "key_backend.h"
 
 using namespace win32::registry;
 
-win32::registry::value_entry_iterator::value_entry_iterator(const key_entry& parent) : m_current(0U), m_reserved(), m_parent(parent), m_values()
+win32::registry::value_entry_iterator::value_entry_iterator(const key_entry& parent, value_enumeration mode) : m_current(0U), m_mode(mode), m_buffer_reserved(false), m_reserved(), m_parent(parent), m_values(), m_buffer()
 {
 }
 
@@ -57,57 +58,16 @@ value_entry_iterator::reference value_entry_iterator::get(difference_type i)
 	{
 		return it->second;
 	}
-	std::vector<WCHAR> temp_name;
-	temp_name.resize(m_parent.max_value_name_length());
-	DWORD name_length = m_parent.max_value_name_length();
-	registry_value_type type = registry_value_type::none;
-	DWORD data_size = m_parent.max_value_data_length();
-	THROW_IF_NTSTATUS_FAILED(RegEnumValue(m_parent.self(), i, temp_name.data(), &name_length, nullptr, (LPDWORD)&type, nullptr, &data_size));
-	std::vector<BYTE> data;
-	data.resize(data_size);
-	THROW_IF_NTSTATUS_FAILED(RegEnumValue(m_parent.self(), i, temp_name.data(), &name_length, nullptr, (LPDWORD)&type, data.data(), &data_size));
-	std::wstring name{ temp_name.data(), name_length };
-	value_entry ve{ name, type, m_parent };
-	switch (type)
+	auto& self = m_parent.self();
+	if (m_mode == value_enumeration::names_and_types)
 	{
-		case registry_value_type::binary:
-			ve.m_data = data;
-			break;
-		case registry_value_type::dword:
-		{
-			uint32_t integer_data;
-			std::memcpy(&integer_data, data.data(), data_size);
-			ve.m_data = integer_data;
-			break;
-		}
-		case registry_value_type::expandable_string:
-		case registry_value_type::string:
-			ve.m_data = std::wstring{ (wchar_t*)data.data(), data_size / 2 };
-			break;
-		case registry_value_type::multi_string:
-		{
-			std::vector<std::wstring> strings;
-			const BYTE* bytes = data.data();
-			for (uint32_t j = 0, l = 0; j < data_size; j += 2)
-			{
-				if (*(wchar_t*)(bytes + j) == L'\0')
-				{
-					strings.push_back(std::wstring{ (wchar_t*)(bytes + l), (j - l) / 2 });
-					l = j;
-				}
-			}
-			ve.m_data = strings;
-			break;
-		}
-		case registry_value_type::qword:
-		{
-			uint64_t integer_data;
-			std::memcpy(&integer_data, data.data(), data_size);
-			break;
-		}
-		case registry_value_type::none:
-			// Should never end up here
-			throw std::exception{ "Registry value should always have a type." };
+		return m_values.insert_or_assign(i, value_entry::from_header(self.value_header_at(i, m_buffer), m_parent)).first->second;
 	}
-	return m_values.insert_or_assign(i, ve).first->second;
+	if (!m_buffer_reserved)
+	{
+		// Sized once per iterator so every later read is a single call into the backend.
+		self.reserve(m_buffer, m_parent.max_value_name_length(), m_parent.max_value_data_length());
+		m_buffer_reserved = true;
+	}
+	return m_values.insert_or_assign(i, value_entry::from_view(self.value_at(i, m_buffer), m_parent)).first->second;
 }
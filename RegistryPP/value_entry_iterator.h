@@ -2,11 +2,27 @@
 
 #include <iterator>
 #include <map>
-#include <wil/result.h>
 #include "value_entry.h"
+#include "key_backend.h"
 
 namespace win32::registry
 {
+	/**
+	 * @brief What a value_entry_iterator reads for every value.
+	 */
+	enum class value_enumeration : uint8_t
+	{
+		/** Names, types and data. */
+		full,
+		/** Names and types only; value data is never read and the entries' data getters throw. */
+		names_and_types
+	};
+
+	/**
+	 * @brief Random access iterator that caches every value it has visited for as long as it lives.
+	 *
+	 * Prefer key_entry::values() for scans; it keeps only the current value in memory.
+	 */
 	class DllExport value_entry_iterator
 	{
 	public:
@@ -16,7 +32,7 @@ namespace win32::registry
 		using pointer = value_entry*;
 		using reference = value_entry&;
 
-		value_entry_iterator(const key_entry& parent);;
+		value_entry_iterator(const key_entry& parent, value_enumeration mode = value_enumeration::full);
 		reference operator*();
 		value_entry_iterator& operator++();
 		bool operator==(value_entry_iterator rhs) const;
@@ -34,8 +50,11 @@ namespace win32::registry
 		reference get(difference_type i);
 
 		difference_type                       m_current;
-		byte                                  m_reserved[4];
+		value_enumeration                     m_mode;
+		bool                                  m_buffer_reserved;
+		uint8_t                               m_reserved[2];
 		key_entry                             m_parent;
 		std::map<difference_type, value_type> m_values;
+		value_buffer                          m_buffer;
 	};
 }
@@ -0,0 +1,74 @@
+#include "value_range.h"
+
+using namespace win32::registry;
+
+value_iterator::value_iterator(value_range& range) :
+	m_range(&range)
+{
+}
+
+const value_entry& value_iterator::operator*() const
+{
+	return *m_range->m_current;
+}
+
+const value_entry* value_iterator::operator->() const
+{
+	return &*m_range->m_current;
+}
+
+value_iterator& value_iterator::operator++()
+{
+	m_range->m_index++;
+	m_range->load();
+	return *this;
+}
+
+void value_iterator::operator++(int)
+{
+	++*this;
+}
+
+bool value_iterator::operator==(std::default_sentinel_t) const
+{
+	return m_range == nullptr || !m_range->m_current;
+}
+
+value_range::value_range(const key_entry& parent, value_enumeration mode) :
+	m_parent(parent), m_mode(mode), m_index(0), m_count(0), m_buffer(), m_current()
+{
+}
+
+value_iterator value_range::begin()
+{
+	m_index = 0;
+	m_count = m_parent.value_count();
+	if (m_mode == value_enumeration::full)
+	{
+		m_parent.self().reserve(m_buffer, m_parent.max_value_name_length(), m_parent.max_value_data_length());
+	}
+	load();
+	return value_iterator{ *this };
+}
+
+std::default_sentinel_t value_range::end() const
+{
+	return std::default_sentinel;
+}
+
+void value_range::load()
+{
+	m_current.reset();
+	if (m_index < m_count)
+	{
+		auto& self = m_parent.self();
+		if (m_mode == value_enumeration::names_and_types)
+		{
+			m_current.emplace(value_entry::from_header(self.value_header_at(m_index, m_buffer), m_parent));
+		}
+		else
+		{
+			m_current.emplace(value_entry::from_view(self.value_at(m_index, m_buffer), m_parent));
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include "key_backend.h"
+#include "value_entry.h"
+#include "value_entry_iterator.h"
+
+namespace win32::registry
+{
+	class value_range;
+
+	/**
+	 * @brief Single pass iterator over the values of a key.
+	 *
+	 * Only the current value is kept; advancing releases it before the next one is read.
+	 */
+	class DllExport value_iterator
+	{
+	public:
+		using iterator_concept = std::input_iterator_tag;
+		using value_type = value_entry;
+		using difference_type = std::ptrdiff_t;
+
+		value_iterator() = default;
+		explicit value_iterator(value_range& range);
+
+		const value_entry& operator*() const;
+		const value_entry* operator->() const;
+		value_iterator& operator++();
+		void operator++(int);
+		bool operator==(std::default_sentinel_t) const;
+
+	private:
+		value_range* m_range = nullptr;
+	};
+
+	/**
+	 * @brief The values of a key, read one at a time as the range is iterated.
+	 *
+	 * Holds constant state, and a single scratch buffer, however many values there are. Unlike value_entry_iterator
+	 * nothing is cached, so the range can only be iterated once.
+	 */
+	class DllExport value_range : public std::ranges::view_interface<value_range>
+	{
+	public:
+		friend class value_iterator;
+
+		explicit value_range(const key_entry& parent, value_enumeration mode = value_enumeration::full);
+
+		/**
+		 * @brief Reads the first value.
+		 * @return An iterator to the first value.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		value_iterator begin();
+
+		std::default_sentinel_t end() const;
+
+	private:
+		void load();
+
+		key_entry m_parent;
+		value_enumeration m_mode;
+		uint32_t m_index;
+		uint32_t m_count;
+		value_buffer m_buffer;
+		std::optional<value_entry> m_current;
+	};
+}
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include "value_stream.h"
+#include "registry_error.h"
+
+using namespace win32::registry;
+
+value_stream::value_stream(const key_entry& key, const std::wstring& name) :
+	m_key(key), m_index(0), m_name(), m_type(registry_value_type::none), m_size(0), m_position(0), m_buffer()
+{
+	auto& self = m_key.self();
+	auto index = self.find_value_index(name, m_buffer);
+	if (!index)
+	{
+		throw registry_error{ registry_errc::not_found, "Value not found." };
+	}
+	m_index = *index;
+	auto header = self.value_header_at(m_index, m_buffer);
+	m_name = header.name;
+	m_type = header.type;
+	m_size = header.size;
+}
+
+value_stream::value_stream(const key_entry& key, uint32_t index) :
+	m_key(key), m_index(index), m_name(), m_type(registry_value_type::none), m_size(0), m_position(0), m_buffer()
+{
+	auto header = m_key.self().value_header_at(m_index, m_buffer);
+	m_name = header.name;
+	m_type = header.type;
+	m_size = header.size;
+}
+
+const std::wstring& value_stream::name() const
+{
+	return m_name;
+}
+
+registry_value_type value_stream::type() const
+{
+	return m_type;
+}
+
+uint32_t value_stream::size() const
+{
+	return m_size;
+}
+
+uint32_t value_stream::position() const
+{
+	return m_position;
+}
+
+bool value_stream::reads_in_parts() const
+{
+	return m_key.self().reads_value_parts();
+}
+
+void value_stream::seek(uint32_t position)
+{
+	m_position = position;
+}
+
+size_t value_stream::read(std::span<uint8_t> out)
+{
+	if (m_position >= m_size || out.empty())
+	{
+		return 0;
+	}
+	size_t length = m_key.self().read_value_data(m_index, m_position, out.first((std::min)(out.size(), static_cast<size_t>(m_size - m_position))), m_buffer);
+	m_position += static_cast<uint32_t>(length);
+	return length;
+}
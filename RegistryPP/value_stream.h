@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include "key_backend.h"
+#include "key_entry.h"
+#include "registry_value_type.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Reads the data of one value a chunk at a time into the caller's buffer.
+	 *
+	 * Hive files read only the big data segments a chunk covers, in place, so memory stays bounded by the chunk size
+	 * however large the value. Snapshots and memory trees copy from data they already hold. The live registry cannot
+	 * read part of a value and reads all of it for every chunk; read those with a single chunk of size() bytes.
+	 */
+	class DllExport value_stream
+	{
+	public:
+		/**
+		 * @brief Opens a value by name, ignoring case, without reading its data.
+		 * @param key The key holding the value.
+		 * @param name The name of the value.
+		 * @exception wil::ResultException
+		 * @exception registry_error registry_errc::not_found if the key has no such value.
+		 */
+		explicit value_stream(const key_entry& key, const std::wstring& name);
+
+		/**
+		 * @brief Opens a value by index, without reading its data.
+		 * @param key The key holding the value.
+		 * @param index The index of the value.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		explicit value_stream(const key_entry& key, uint32_t index);
+
+		const std::wstring& name() const;
+
+		registry_value_type type() const;
+
+		/**
+		 * @brief Gets the size of the data.
+		 * @return The size in bytes.
+		 */
+		uint32_t size() const;
+
+		/**
+		 * @brief Gets where the next read starts.
+		 * @return The offset in bytes.
+		 */
+		uint32_t position() const;
+
+		/**
+		 * @brief Gets whether reads cost only the bytes they return.
+		 *
+		 * When they do not, every read reads the whole value from the source, and reading it in one go is cheaper.
+		 * @return true if the value can be read in parts cheaply; otherwise false.
+		 */
+		bool reads_in_parts() const;
+
+		/**
+		 * @brief Moves to another offset. Reads past the end return nothing.
+		 * @param position The offset in bytes.
+		 */
+		void seek(uint32_t position);
+
+		/**
+		 * @brief Reads the next chunk.
+		 * @param out Receives up to out.size() bytes.
+		 * @return The number of bytes read; 0 once all were read.
+		 * @exception wil::ResultException
+		 * @exception registry_error
+		 */
+		size_t read(std::span<uint8_t> out);
+
+	private:
+		key_entry m_key;
+		uint32_t m_index;
+		std::wstring m_name;
+		registry_value_type m_type;
+		uint32_t m_size;
+		uint32_t m_position;
+		value_buffer m_buffer;
+	};
+}
@@ -0,0 +1,299 @@
+#ifdef _WIN32
+
+#include <algorithm>
+#include <ktmw32.h>
+#include <wil/resource.h>
+#include <wil/result.h>
+#include "instrumentation.h"
+#include "win32_backend.h"
+
+#pragma comment(lib, "ktmw32.lib")
+
+using namespace win32::registry;
+
+// Value names are limited to 16,383 characters, plus the terminating null.
+constexpr DWORD max_value_name_buffer = 16384;
+
+win32_key_backend::win32_key_backend(HKEY self, bool owned) :
+	m_self(self), m_owned(owned)
+{
+	if (m_owned)
+	{
+		REGISTRYPP_TRACK_HANDLE(1);
+	}
+}
+
+win32_key_backend::~win32_key_backend()
+{
+	if (m_owned)
+	{
+		LOG_IF_WIN32_ERROR(RegCloseKey(m_self));
+		REGISTRYPP_TRACK_HANDLE(-1);
+	}
+}
+
+std::unique_ptr<key_backend> win32_key_backend::open_subkey(const std::wstring& name) const
+{
+	HKEY self;
+	THROW_IF_WIN32_ERROR(RegOpenKeyEx(m_self, name.c_str(), 0, KEY_READ | KEY_WRITE, &self));
+	return std::make_unique<win32_key_backend>(self, true);
+}
+
+std::unique_ptr<key_backend> win32_key_backend::try_open_subkey(const std::wstring& name) const
+{
+	HKEY self;
+	LSTATUS status = RegOpenKeyEx(m_self, name.c_str(), 0, KEY_READ | KEY_WRITE, &self);
+	if (status == ERROR_FILE_NOT_FOUND)
+	{
+		return nullptr;
+	}
+	THROW_IF_WIN32_ERROR(status);
+	return std::make_unique<win32_key_backend>(self, true);
+}
+
+key_info win32_key_backend::query_info() const
+{
+	key_info info;
+	WCHAR    $class[MAX_PATH] = TEXT(""); // buffer for class name
+	DWORD    class_length = MAX_PATH;     // size of class string
+	DWORD    cb_security_descriptor;      // size of security descriptor
+	FILETIME last_written;                // last write time
+	THROW_IF_WIN32_ERROR(RegQueryInfoKey(
+		m_self,                                    // key handle
+		$class,                                    // buffer for class name
+		&class_length,                             // size of class string
+		nullptr,                                   // reserved
+		(LPDWORD)&info.sub_keys_count,             // number of subkeys
+		(LPDWORD)&info.max_sub_key_name_length,    // longest subkey size
+		(LPDWORD)&info.max_class_length,           // longest class string
+		(LPDWORD)&info.values_count,               // number of values for this key
+		(LPDWORD)&info.max_value_name_length,      // longest value name
+		(LPDWORD)&info.max_value_data_length,      // longest value data
+		&cb_security_descriptor,                   // security descriptor
+		&last_written));                           // last write time
+	ULARGE_INTEGER ull;
+	ull.LowPart = last_written.dwLowDateTime;
+	ull.HighPart = last_written.dwHighDateTime;
+	info.last_written = filetime_to_time_point(ull.QuadPart);
+	info.key_class = std::wstring{ $class, class_length };
+	return info;
+}
+
+std::wstring win32_key_backend::sub_key_name(uint32_t index) const
+{
+	WCHAR name[MAX_PATH] = TEXT("");
+	DWORD name_length = MAX_PATH;
+	THROW_IF_WIN32_ERROR(RegEnumKeyEx(m_self, index, name, &name_length, nullptr, nullptr, nullptr, nullptr));
+	return std::wstring{ name, name_length };
+}
+
+value_view win32_key_backend::value_at(uint32_t index, value_buffer& buffer) const
+{
+	// A single call when the buffers were reserved from the key's maximum lengths; grown and retried only when the
+	// value changed since, or nothing was reserved.
+	for (;;)
+	{
+		DWORD name_length = static_cast<DWORD>(buffer.name.size());
+		DWORD type = REG_NONE;
+		DWORD data_size = static_cast<DWORD>(buffer.data.size());
+		LSTATUS status = RegEnumValue(m_self, index, buffer.name.data(), &name_length, nullptr, &type, buffer.data.data(), &data_size);
+		if (status == ERROR_SUCCESS && data_size <= buffer.data.size())
+		{
+			return value_view{ std::wstring_view{ buffer.name.data(), name_length }, static_cast<registry_value_type>(type), buffer.data.data(), data_size, nullptr };
+		}
+		if (status != ERROR_SUCCESS && status != ERROR_MORE_DATA)
+		{
+			THROW_WIN32(status);
+		}
+		bool grown = false;
+		if (data_size > buffer.data.size())
+		{
+			buffer.data.resize(data_size);
+			grown = true;
+		}
+		if (buffer.name.size() < max_value_name_buffer)
+		{
+			// ERROR_MORE_DATA does not say which buffer was too small, nor how long the name is.
+			buffer.name.resize(max_value_name_buffer);
+			grown = true;
+		}
+		if (!grown)
+		{
+			THROW_WIN32(status);
+		}
+	}
+}
+
+value_view win32_key_backend::value_header_at(uint32_t index, value_buffer& buffer) const
+{
+	if (buffer.name.size() < max_value_name_buffer)
+	{
+		buffer.name.resize(max_value_name_buffer);
+	}
+	DWORD name_length = max_value_name_buffer;
+	DWORD type = REG_NONE;
+	DWORD data_size = 0;
+	THROW_IF_WIN32_ERROR(RegEnumValue(m_self, index, buffer.name.data(), &name_length, nullptr, &type, nullptr, &data_size));
+	return value_view{ std::wstring_view{ buffer.name.data(), name_length }, static_cast<registry_value_type>(type), nullptr, data_size, nullptr };
+}
+
+std::optional<value_view> win32_key_backend::find_value(const std::wstring& name, value_buffer& buffer) const
+{
+	for (;;)
+	{
+		DWORD type = REG_NONE;
+		DWORD data_size = static_cast<DWORD>(buffer.data.size());
+		LSTATUS status = RegQueryValueEx(m_self, name.c_str(), nullptr, &type, buffer.data.data(), &data_size);
+		if (status == ERROR_FILE_NOT_FOUND)
+		{
+			return std::nullopt;
+		}
+		if (status == ERROR_SUCCESS && data_size <= buffer.data.size())
+		{
+			buffer.name = name;
+			return value_view{ buffer.name, static_cast<registry_value_type>(type), buffer.data.data(), data_size, nullptr };
+		}
+		if (status != ERROR_SUCCESS && status != ERROR_MORE_DATA)
+		{
+			THROW_WIN32(status);
+		}
+		buffer.data.resize(data_size);
+	}
+}
+
+void win32_key_backend::query_values(const std::vector<std::wstring>& names, std::vector<batch_value>& results, std::vector<uint8_t>& data) const
+{
+	results.assign(names.size(), batch_value{});
+	if (names.empty())
+	{
+		return;
+	}
+	std::vector<VALENT> entries(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		entries[i].ve_valuename = const_cast<LPWSTR>(names[i].c_str());
+	}
+	// Start from a guess; a too small buffer reports the exact size needed.
+	size_t base = data.size();
+	DWORD total_size = static_cast<DWORD>(names.size() * 64);
+	LSTATUS status;
+	for (;;)
+	{
+		data.resize(base + total_size);
+		status = RegQueryMultipleValues(m_self, entries.data(), static_cast<DWORD>(entries.size()), reinterpret_cast<LPWSTR>(data.data() + base), &total_size);
+		if (status != ERROR_MORE_DATA)
+		{
+			break;
+		}
+	}
+	if (status == ERROR_FILE_NOT_FOUND)
+	{
+		// The whole call fails when any value is missing; read them one at a time to tell which.
+		data.resize(base);
+		key_backend::query_values(names, results, data);
+		return;
+	}
+	THROW_IF_WIN32_ERROR(status);
+	data.resize(base + total_size);
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		auto offset = reinterpret_cast<const uint8_t*>(entries[i].ve_valueptr) - data.data();
+		results[i] = batch_value{ true, static_cast<registry_value_type>(entries[i].ve_type), static_cast<uint32_t>(offset), entries[i].ve_valuelen };
+	}
+}
+
+void win32_key_backend::set_value(const std::wstring& name, registry_value_type type, const uint8_t* data, uint32_t size) const
+{
+	THROW_IF_WIN32_ERROR(RegSetValueEx(m_self, name.c_str(), 0, static_cast<DWORD>(type), data, size));
+}
+
+bool win32_key_backend::delete_value(const std::wstring& name) const
+{
+	LSTATUS status = RegDeleteValue(m_self, name.c_str());
+	if (status == ERROR_FILE_NOT_FOUND)
+	{
+		return false;
+	}
+	THROW_IF_WIN32_ERROR(status);
+	return true;
+}
+
+std::unique_ptr<key_backend> win32_key_backend::create_subkey(const std::wstring& name) const
+{
+	HKEY self;
+	THROW_IF_WIN32_ERROR(RegCreateKeyEx(m_self, name.c_str(), 0, nullptr, REG_OPTION_NON_VOLATILE, KEY_READ | KEY_WRITE, nullptr, &self, nullptr));
+	return std::make_unique<win32_key_backend>(self, true);
+}
+
+bool win32_key_backend::delete_subtree(const std::wstring& name) const
+{
+	LSTATUS status = RegDeleteTree(m_self, name.c_str());
+	if (status == ERROR_FILE_NOT_FOUND)
+	{
+		return false;
+	}
+	THROW_IF_WIN32_ERROR(status);
+	return true;
+}
+
+void win32_key_backend::apply(const std::vector<key_write>& writes) const
+{
+	// Every change goes through one kernel transaction; closing it without committing rolls all of them back.
+	// CreateTransaction fails with INVALID_HANDLE_VALUE, not null, so the handle needs unique_hfile.
+	wil::unique_hfile transaction{ CreateTransaction(nullptr, nullptr, 0, 0, 0, 0, nullptr) };
+	THROW_LAST_ERROR_IF(!transaction);
+	wil::unique_hkey self;
+	THROW_IF_WIN32_ERROR(RegOpenKeyTransacted(m_self, L"", 0, KEY_READ | KEY_WRITE, self.put(), transaction.get(), nullptr));
+	for (const auto& write : writes)
+	{
+		if (write.delete_subtree)
+		{
+			LSTATUS status = RegDeleteTree(self.get(), write.path.c_str());
+			if (status != ERROR_FILE_NOT_FOUND)
+			{
+				THROW_IF_WIN32_ERROR(status);
+			}
+		}
+		if (!write.create && write.values.empty())
+		{
+			continue;
+		}
+		wil::unique_hkey key;
+		THROW_IF_WIN32_ERROR(RegCreateKeyTransacted(self.get(), write.path.c_str(), 0, nullptr, REG_OPTION_NON_VOLATILE, KEY_READ | KEY_WRITE, nullptr, key.put(), nullptr, transaction.get(), nullptr));
+		for (const auto& value : write.values)
+		{
+			if (value.erase)
+			{
+				LSTATUS status = RegDeleteValue(key.get(), value.name.c_str());
+				if (status != ERROR_FILE_NOT_FOUND)
+				{
+					THROW_IF_WIN32_ERROR(status);
+				}
+			}
+			else
+			{
+				THROW_IF_WIN32_ERROR(RegSetValueEx(key.get(), value.name.c_str(), 0, static_cast<DWORD>(value.type), value.data.data(), static_cast<DWORD>(value.data.size())));
+			}
+		}
+	}
+	THROW_IF_WIN32_BOOL_FALSE(CommitTransaction(transaction.get()));
+}
+
+void win32_key_backend::reserve(value_buffer& buffer, uint32_t max_name_length, uint32_t max_data_length) const
+{
+	buffer.name.resize((std::min)(max_name_length + 1, max_value_name_buffer));
+	buffer.data.resize(max_data_length);
+}
+
+bool win32_key_backend::same_key(const key_backend& other) const
+{
+	auto rhs = dynamic_cast<const win32_key_backend*>(&other);
+	return rhs != nullptr && rhs->m_self == m_self;
+}
+
+HKEY win32_key_backend::handle() const
+{
+	return m_self;
+}
+
+#endif // _WIN32
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN 1
+
+#include <Windows.h>
+#include "key_backend.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Backend for keys of the live registry, accessed through the Win32 API.
+	 */
+	class DllExport win32_key_backend final : public key_backend
+	{
+	public:
+		/**
+		 * @brief Wraps an open key handle.
+		 * @param self The key handle.
+		 * @param owned Whether the handle is closed when the backend is destroyed. Predefined root keys are not owned.
+		 */
+		explicit win32_key_backend(HKEY self, bool owned);
+
+		~win32_key_backend() override;
+
+		win32_key_backend(const win32_key_backend&) = delete;
+		win32_key_backend& operator=(const win32_key_backend&) = delete;
+
+		std::unique_ptr<key_backend> open_subkey(const std::wstring& name) const override;
+		std::unique_ptr<key_backend> try_open_subkey(const std::wstring& name) const override;
+		key_info query_info() const override;
+		std::wstring sub_key_name(uint32_t index) const override;
+		value_view value_at(uint32_t index, value_buffer& buffer) const override;
+		value_view value_header_at(uint32_t index, value_buffer& buffer) const override;
+		std::optional<value_view> find_value(const std::wstring& name, value_buffer& buffer) const override;
+		void query_values(const std::vector<std::wstring>& names, std::vector<batch_value>& results, std::vector<uint8_t>& data) const override;
+		void set_value(const std::wstring& name, registry_value_type type, const uint8_t* data, uint32_t size) const override;
+		bool delete_value(const std::wstring& name) const override;
+		std::unique_ptr<key_backend> create_subkey(const std::wstring& name) const override;
+		bool delete_subtree(const std::wstring& name) const override;
+		void apply(const std::vector<key_write>& writes) const override;
+		void reserve(value_buffer& buffer, uint32_t max_name_length, uint32_t max_data_length) const override;
+		bool same_key(const key_backend& other) const override;
+
+		/**
+		 * @brief Gets the key handle.
+		 * @return The key handle.
+		 */
+		HKEY handle() const;
+
+	private:
+		HKEY m_self;
+		bool m_owned;
+	};
+}
+
+#endif // _WIN32
@@ -0,0 +1,157 @@
+#include <stdexcept>
+#include "write_batch.h"
+#include "scan_arena.h"
+#include "utf16.h"
+
+using namespace win32::registry;
+
+void write_batch::set_value(std::wstring_view path, const std::wstring& name, registry_value_type type, const void* data, uint32_t size)
+{
+	auto bytes = static_cast<const uint8_t*>(data);
+	write(path, value_write{ name, false, type, std::vector<uint8_t>(bytes, bytes + size) });
+}
+
+void write_batch::set_dword(std::wstring_view path, const std::wstring& name, uint32_t data)
+{
+	set_value(path, name, registry_value_type::dword, &data, sizeof data);
+}
+
+void write_batch::set_qword(std::wstring_view path, const std::wstring& name, uint64_t data)
+{
+	set_value(path, name, registry_value_type::qword, &data, sizeof data);
+}
+
+void write_batch::set_string(std::wstring_view path, const std::wstring& name, std::wstring_view data)
+{
+	std::vector<uint8_t> bytes;
+	utf16::append_bytes(bytes, data);
+	bytes.push_back(0);
+	bytes.push_back(0);
+	write(path, value_write{ name, false, registry_value_type::string, std::move(bytes) });
+}
+
+void write_batch::set_strings(std::wstring_view path, const std::wstring& name, const std::vector<std::wstring>& data)
+{
+	std::vector<uint8_t> bytes;
+	for (const auto& string : data)
+	{
+		utf16::append_bytes(bytes, string);
+		bytes.push_back(0);
+		bytes.push_back(0);
+	}
+	bytes.push_back(0);
+	bytes.push_back(0);
+	write(path, value_write{ name, false, registry_value_type::multi_string, std::move(bytes) });
+}
+
+void write_batch::delete_value(std::wstring_view path, const std::wstring& name)
+{
+	write(path, value_write{ name, true, registry_value_type::none, {} });
+}
+
+void write_batch::create_subkey(std::wstring_view path)
+{
+	m_writes[group(path)].create = true;
+}
+
+void write_batch::delete_subtree(std::wstring_view path)
+{
+	key_path target{ path };
+	if (target.empty())
+	{
+		throw std::invalid_argument{ "A batch cannot delete the key it is committed to." };
+	}
+
+	// Pending changes at or below the key would be deleted with it; drop them.
+	size_t kept = 0;
+	for (size_t i = 0; i < m_writes.size(); i++)
+	{
+		key_path ancestor = m_paths[i];
+		while (ancestor.depth() > target.depth())
+		{
+			ancestor = ancestor.parent();
+		}
+		if (ancestor == target)
+		{
+			m_group_of.erase(m_paths[i]);
+			continue;
+		}
+		if (kept != i)
+		{
+			m_writes[kept] = std::move(m_writes[i]);
+			m_paths[kept] = std::move(m_paths[i]);
+			m_value_of[kept] = std::move(m_value_of[i]);
+			m_group_of[m_paths[kept]] = kept;
+		}
+		kept++;
+	}
+	m_writes.resize(kept);
+	m_paths.resize(kept);
+	m_value_of.resize(kept);
+
+	m_writes[group(path)].delete_subtree = true;
+}
+
+size_t write_batch::size() const
+{
+	return m_writes.size();
+}
+
+bool write_batch::empty() const
+{
+	return m_writes.empty();
+}
+
+const std::vector<key_write>& write_batch::writes() const
+{
+	return m_writes;
+}
+
+void write_batch::clear()
+{
+	m_writes.clear();
+	m_paths.clear();
+	m_group_of.clear();
+	m_value_of.clear();
+}
+
+void write_batch::commit(const key_entry& root) const
+{
+	if (m_writes.empty())
+	{
+		return;
+	}
+	root.self().apply(m_writes);
+}
+
+size_t write_batch::group(std::wstring_view path)
+{
+	// Batches are often filled during a scan; the paths they keep must not come from its arena.
+	arena_scope heap{ std::pmr::get_default_resource() };
+	key_path key{ path };
+	auto [it, inserted] = m_group_of.try_emplace(key, m_writes.size());
+	if (inserted)
+	{
+		m_writes.push_back(key_write{ key.str(), false, false, {} });
+		m_paths.push_back(std::move(key));
+		m_value_of.emplace_back();
+	}
+	return it->second;
+}
+
+void write_batch::write(std::wstring_view path, value_write&& value)
+{
+	size_t index = group(path);
+	auto& key = m_writes[index];
+	auto& value_of = m_value_of[index];
+	auto [it, inserted] = value_of.try_emplace(utf16::fold(value.name), key.values.size());
+	if (inserted)
+	{
+		key.values.push_back(std::move(value));
+	}
+	else
+	{
+		// Last write wins.
+		key.values[it->second] = std::move(value);
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "key_backend.h"
+#include "key_entry.h"
+#include "key_path.h"
+
+namespace win32::registry
+{
+	/**
+	 * @brief Collects changes to keys and values and applies them all at once, all of them or none.
+	 *
+	 * Changes are combined as they are added: writes are grouped by key, so every key is opened once, and a later
+	 * write to a value replaces an earlier one instead of being sent as well. Deleting a subtree discards any pending
+	 * changes inside it. Paths are relative to the key the batch is committed to and compared ignoring case. They are
+	 * kept on the heap even when added inside an arena_scope.
+	 */
+	class DllExport write_batch
+	{
+	public:
+		/**
+		 * @brief Creates or replaces a value.
+		 * @param path The path of the key, empty for the key the batch is committed to. The key is created if missing.
+		 * @param name The name of the value.
+		 * @param type The type of the value.
+		 * @param data The raw data of the value.
+		 * @param size The size of the data in bytes.
+		 */
+		void set_value(std::wstring_view path, const std::wstring& name, registry_value_type type, const void* data, uint32_t size);
+
+		/**
+		 * @brief Creates or replaces a REG_DWORD value.
+		 * @param path The path of the key, empty for the key the batch is committed to.
+		 * @param name The name of the value.
+		 * @param data The value.
+		 */
+		void set_dword(std::wstring_view path, const std::wstring& name, uint32_t data);
+
+		/**
+		 * @brief Creates or replaces a REG_QWORD value.
+		 * @param path The path of the key, empty for the key the batch is committed to.
+		 * @param name The name of the value.
+		 * @param data The value.
+		 */
+		void set_qword(std::wstring_view path, const std::wstring& name, uint64_t data);
+
+		/**
+		 * @brief Creates or replaces a REG_SZ value.
+		 * @param path The path of the key, empty for the key the batch is committed to.
+		 * @param name The name of the value.
+		 * @param data The value.
+		 */
+		void set_string(std::wstring_view path, const std::wstring& name, std::wstring_view data);
+
+		/**
+		 * @brief Creates or replaces a REG_MULTI_SZ value.
+		 * @param path The path of the key, empty for the key the batch is committed to.
+		 * @param name The name of the value.
+		 * @param data The strings.
+		 */
+		void set_strings(std::wstring_view path, const std::wstring& name, const std::vector<std::wstring>& data);
+
+		/**
+		 * @brief Deletes a value. Values that do not exist are ignored.
+		 * @param path The path of the key, empty for the key the batch is committed to.
+		 * @param name The name of the value.
+		 */
+		void delete_value(std::wstring_view path, const std::wstring& name);
+
+		/**
+		 * @brief Creates a key and any missing parents.
+		 * @param path The path of the key.
+		 */
+		void create_subkey(std::wstring_view path);
+
+		/**
+		 * @brief Deletes a key with all of its sub keys and values. Keys that do not exist are ignored.
+		 * @param path The path of the key.
+		 * @exception std::invalid_argument The path is empty.
+		 */
+		void delete_subtree(std::wstring_view path);
+
+		/**
+		 * @brief Gets the number of keys with pending changes.
+		 * @return The number of keys.
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief Gets whether there are no pending changes.
+		 * @return true if there are no pending changes; otherwise false.
+		 */
+		bool empty() const;
+
+		/**
+		 * @brief Gets the pending changes, grouped by key in the order the keys were first written.
+		 * @return The pending changes.
+		 */
+		const std::vector<key_write>& writes() const;
+
+		/**
+		 * @brief Discards all pending changes.
+		 */
+		void clear();
+
+		/**
+		 * @brief Applies the pending changes below a key, all of them or none.
+		 *
+		 * Uses a kernel transaction for keys of the live registry. The batch is left as it is, so the same changes may
+		 * be committed again. Entries opened before the commit keep the metadata they already read.
+		 * @param root The key paths are relative to.
+		 * @exception wil::ResultException
+		 * @exception registry_error The key is read-only.
+		 */
+		void commit(const key_entry& root) const;
+
+	private:
+		size_t group(std::wstring_view path);
+
+		void write(std::wstring_view path, value_write&& value);
+
+		std::vector<key_write> m_writes;
+		std::vector<key_path> m_paths;
+		std::unordered_map<key_path, size_t> m_group_of;
+		/** Per group, the folded value name to its index in the group's values. */
+		std::vector<std::unordered_map<std::wstring, size_t>> m_value_of;
+	};
+}